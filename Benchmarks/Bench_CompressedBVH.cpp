@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark - Compressed 8-wide BVH against the binary BVH
+////////////////////////////////////////////////////////////////////////////////
+// Two stand-in scenes: a noisy displaced sphere for a dense scan (2M
+// triangles by default) and randomly sized boxes for architectural clutter
+// (480k triangles). Each is traced with incoherent rays from random points
+// inside its bounds, on one thread, through MeshBVH and CompressedMeshBVH.
+// Node memory and rays per second are reported for both, and the closest hits
+// of every ray must agree.
+//
+// Usage: Bench_CompressedBVH [ray count] [sphere resolution] [box count]
+////////////////////////////////////////////////////////////////////////////////
+
+#include "Core_Sampling.h"
+#include "Scene_CompressedBVH.h"
+#include "Scene_IMesh.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Positions and indices only; all the trees read.
+class TriangleSoup : public IMesh {
+public:
+  uint32_t getVertexCount() const override {
+    return (uint32_t)Positions.size();
+  }
+  uint32_t getIndexCount() const override { return (uint32_t)Indices.size(); }
+  void copyVertices(void *to, uint32_t stride) const override {
+    for (size_t i = 0; i < Positions.size(); ++i) {
+      memcpy((uint8_t *)to + stride * i, &Positions[i], sizeof(Vector3));
+    }
+  }
+  void copyNormals(void *to, uint32_t stride) const override {
+    Vector3 up = {0, 1, 0};
+    for (size_t i = 0; i < Positions.size(); ++i) {
+      memcpy((uint8_t *)to + stride * i, &up, sizeof(Vector3));
+    }
+  }
+  void copyTexcoords(void *to, uint32_t stride) const override {
+    Vector2 zero = {0, 0};
+    for (size_t i = 0; i < Positions.size(); ++i) {
+      memcpy((uint8_t *)to + stride * i, &zero, sizeof(Vector2));
+    }
+  }
+  void copyIndices(void *to, uint32_t stride) const override {
+    for (size_t i = 0; i < Indices.size(); ++i) {
+      memcpy((uint8_t *)to + stride * i, &Indices[i], sizeof(uint32_t));
+    }
+  }
+  std::vector<Vector3> Positions;
+  std::vector<uint32_t> Indices;
+};
+
+// A unit sphere in latitude/longitude strips with every vertex pushed in or
+// out by up to 2%; 2 * resolution^2 triangles.
+static TriangleSoup CreateScan(uint32_t resolution, uint32_t &random) {
+  TriangleSoup mesh;
+  for (uint32_t y = 0; y <= resolution; ++y) {
+    for (uint32_t x = 0; x <= resolution; ++x) {
+      float theta = Pi<float> * y / resolution;
+      float phi = 2 * Pi<float> * x / resolution;
+      float r = 1 + 0.02f * (RandomUnit(random) - 0.5f);
+      mesh.Positions.push_back({r * sinf(theta) * cosf(phi), r * cosf(theta),
+                                r * sinf(theta) * sinf(phi)});
+    }
+  }
+  for (uint32_t y = 0; y < resolution; ++y) {
+    for (uint32_t x = 0; x < resolution; ++x) {
+      uint32_t i = y * (resolution + 1) + x;
+      uint32_t j = i + resolution + 1;
+      mesh.Indices.insert(mesh.Indices.end(), {i, j, i + 1, i + 1, j, j + 1});
+    }
+  }
+  return mesh;
+}
+
+// Axis aligned boxes of widely varying size scattered through a 100 unit
+// room; 12 triangles each.
+static TriangleSoup CreateClutter(uint32_t boxCount, uint32_t &random) {
+  static const uint32_t FACES[36] = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6,
+                                     0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7,
+                                     0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+  TriangleSoup mesh;
+  for (uint32_t b = 0; b < boxCount; ++b) {
+    Vector3 center = {100 * RandomUnit(random), 100 * RandomUnit(random),
+                      100 * RandomUnit(random)};
+    float size = 0.05f + 2 * powf(RandomUnit(random), 3);
+    uint32_t base = (uint32_t)mesh.Positions.size();
+    for (uint32_t corner = 0; corner < 8; ++corner) {
+      mesh.Positions.push_back({center.X + (corner & 1 ? size : -size),
+                                center.Y + (corner & 2 ? size : -size),
+                                center.Z + (corner & 4 ? size : -size)});
+    }
+    for (uint32_t index : FACES) {
+      mesh.Indices.push_back(base + index);
+    }
+  }
+  return mesh;
+}
+
+static Vector3 RandomDirection(uint32_t &random) {
+  float z = 2 * RandomUnit(random) - 1;
+  float phi = 2 * Pi<float> * RandomUnit(random);
+  float r = sqrtf(std::max(0.0f, 1 - z * z));
+  return {r * cosf(phi), r * sinf(phi), z};
+}
+
+// Returns false if any closest hit differs between the two trees.
+static bool Compare(const char *name, const TriangleSoup &mesh,
+                    uint32_t rayCount, uint32_t &random) {
+  auto start = std::chrono::steady_clock::now();
+  MeshBVH binary(mesh);
+  double binaryBuild = Seconds(start);
+  start = std::chrono::steady_clock::now();
+  CompressedMeshBVH compressed(binary);
+  double collapse = Seconds(start);
+  size_t binaryBytes = binary.Tree.Nodes.size() * sizeof(BVHNode);
+  size_t compressedBytes =
+      compressed.Tree.Nodes.size() * sizeof(CompressedBVHNode);
+  printf("%s: %u triangles, build %.2f s + collapse %.2f s\n", name,
+         mesh.getIndexCount() / 3, binaryBuild, collapse);
+  printf("  node memory %.1f MB -> %.1f MB (%.1fx)\n", binaryBytes / 1e6,
+         compressedBytes / 1e6, (double)binaryBytes / compressedBytes);
+  const AABB &bounds = binary.GetBounds();
+  std::vector<Ray> rays(rayCount);
+  for (auto &ray : rays) {
+    ray.Origin = {
+        bounds.Min.X + (bounds.Max.X - bounds.Min.X) * RandomUnit(random),
+        bounds.Min.Y + (bounds.Max.Y - bounds.Min.Y) * RandomUnit(random),
+        bounds.Min.Z + (bounds.Max.Z - bounds.Min.Z) * RandomUnit(random)};
+    ray.Direction = RandomDirection(random);
+    ray.TMin = 0;
+    ray.TMax = INFINITY;
+  }
+  std::vector<RayHit> binaryHits(rayCount), compressedHits(rayCount);
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rayCount; ++i) {
+    binaryHits[i].T = INFINITY;
+    if (!binary.Intersect(rays[i], binaryHits[i]))
+      binaryHits[i].Primitive = ~0u;
+  }
+  double binaryTime = Seconds(start);
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rayCount; ++i) {
+    compressedHits[i].T = INFINITY;
+    if (!compressed.Intersect(rays[i], compressedHits[i]))
+      compressedHits[i].Primitive = ~0u;
+  }
+  double compressedTime = Seconds(start);
+  printf("  rays/s %.2fM -> %.2fM (%.2fx)\n", rayCount / binaryTime / 1e6,
+         rayCount / compressedTime / 1e6, binaryTime / compressedTime);
+  // Ties between coplanar triangles may resolve either way, so distances
+  // are compared rather than primitive indices.
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < rayCount; ++i) {
+    bool binaryHit = binaryHits[i].Primitive != ~0u;
+    bool compressedHit = compressedHits[i].Primitive != ~0u;
+    if (binaryHit != compressedHit ||
+        (binaryHit && fabsf(binaryHits[i].T - compressedHits[i].T) >
+                          1e-5f * std::max(binaryHits[i].T, 1.0f)))
+      ++mismatches;
+  }
+  printf("  %u of %u closest hits differ\n", mismatches, rayCount);
+  return mismatches == 0;
+}
+
+int main(int argc, char **argv) {
+  const uint32_t rayCount = argc > 1 ? (uint32_t)atoi(argv[1]) : 1000000;
+  const uint32_t resolution = argc > 2 ? (uint32_t)atoi(argv[2]) : 1000;
+  const uint32_t boxCount = argc > 3 ? (uint32_t)atoi(argv[3]) : 40000;
+  uint32_t random = HashPCG(1);
+  bool ok = Compare("Scan", CreateScan(resolution, random), rayCount, random);
+  ok = Compare("Clutter", CreateClutter(boxCount, random), rayCount, random) &&
+       ok;
+  return ok ? 0 : 1;
+}
\ No newline at end of file
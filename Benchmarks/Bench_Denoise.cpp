@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark - Edge-Avoiding A-Trous Denoiser
+////////////////////////////////////////////////////////////////////////////////
+// Path traces a floor and a few spheres under a small spherical light with the
+// CPU path tracer, once with a few samples per pixel and once with many for a
+// reference. The noisy image is denoised with the primary hit depth and
+// normal as guides, and each result is scored by its RMSE against the
+// reference. Rendering more samples for the time the denoiser took gives the
+// equal-time alternative, so the report reads as quality per millisecond.
+//
+// Usage: Bench_Denoise [width] [height] [samples] [reference samples]
+////////////////////////////////////////////////////////////////////////////////
+
+#include "Core_Parallel.h"
+#include "Core_Sampling.h"
+#include "Image_Denoise.h"
+#include "Scene_IMaterial.h"
+#include "Scene_LightBVH.h"
+#include "Scene_ParametricUVToMesh.h"
+#include "Scene_Plane.h"
+#include "Scene_Sphere.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+static Instance MakeInstance(std::shared_ptr<IMesh> mesh,
+                             std::shared_ptr<IMaterial> material,
+                             const Matrix44 &objectToWorld) {
+  Instance instance = {};
+  instance.TransformObjectToWorld.reset(new Matrix44(objectToWorld));
+  instance.Mesh = mesh;
+  instance.Material = material;
+  return instance;
+}
+
+static std::vector<Instance> CreateScene() {
+  std::shared_ptr<IParametricUV> plane(new Plane());
+  std::shared_ptr<IParametricUV> sphere(new Sphere());
+  std::shared_ptr<IMesh> planeMesh(new ParametricUVToMesh(plane, 1, 1));
+  std::shared_ptr<IMesh> sphereMesh(new ParametricUVToMesh(sphere, 48, 48));
+  // The path tracer shades everything as grey Lambertian.
+  std::shared_ptr<IMaterial> material(new RedPlastic());
+  std::shared_ptr<Emissive> light(new Emissive());
+  light->Emission = {40, 40, 40};
+  std::vector<Instance> scene;
+  scene.push_back(MakeInstance(planeMesh, material,
+                               CreateMatrixScale(Vector3{5, 1, 5})));
+  for (int i = 0; i < 3; ++i) {
+    scene.push_back(MakeInstance(
+        sphereMesh, material,
+        CreateMatrixScale(Vector3{0.6f, 0.6f, 0.6f}) *
+            CreateMatrixTranslate(Vector3{1.5f * (i - 1), 0.6f, 0.5f * i})));
+  }
+  scene.push_back(MakeInstance(
+      sphereMesh, light,
+      CreateMatrixScale(Vector3{0.25f, 0.25f, 0.25f}) *
+          CreateMatrixTranslate(Vector3{-1, 2.5f, -0.5f})));
+  return scene;
+}
+
+// Guides and an accumulated color, all R32G32B32 except depth.
+struct Frame {
+  uint32_t Width, Height;
+  std::vector<Vector3> Color;
+  std::vector<float> Depth;
+  std::vector<Vector3> Normal;
+};
+
+static Ray CameraRay(const Matrix44 &clipToWorld, const Vector3 &eye,
+                     float x, float y) {
+  Vector4 clip = {x, y, 1, 1};
+  Vector4 world = Transform(clipToWorld, clip);
+  Vector3 target = {world.X / world.W, world.Y / world.W, world.Z / world.W};
+  Ray ray = {eye, Normalize(target - eye), 0, INFINITY};
+  return ray;
+}
+
+// Average of "samples" jittered paths per pixel; seeds are offset by "pass"
+// so further passes add independent samples.
+static void Render(const SceneBVH &scene, const LightBVH &lights,
+                   const Matrix44 &clipToWorld, const Vector3 &eye,
+                   uint32_t samples, uint32_t pass, Frame &frame) {
+  ParallelFor(frame.Height, [&](uint32_t y) {
+    for (uint32_t x = 0; x < frame.Width; ++x) {
+      uint32_t pixel = y * frame.Width + x;
+      uint32_t state = HashPCG(pixel * 7919 + pass);
+      Vector3 sum = {0, 0, 0};
+      for (uint32_t s = 0; s < samples; ++s) {
+        float px = (x + RandomUnit(state)) / frame.Width * 2 - 1;
+        float py = 1 - (y + RandomUnit(state)) / frame.Height * 2;
+        sum = sum + PathTrace(scene, lights,
+                              CameraRay(clipToWorld, eye, px, py), state);
+      }
+      frame.Color[pixel] = sum * (1.0f / samples);
+    }
+  });
+}
+
+// Depth and normal of the primary hit through every pixel center; misses
+// keep a zero normal, which the denoiser treats as background.
+static void RenderGuides(const SceneBVH &scene, const Matrix44 &clipToWorld,
+                         const Vector3 &eye, Frame &frame) {
+  for (uint32_t y = 0; y < frame.Height; ++y) {
+    for (uint32_t x = 0; x < frame.Width; ++x) {
+      uint32_t pixel = y * frame.Width + x;
+      Ray ray = CameraRay(clipToWorld, eye, (x + 0.5f) / frame.Width * 2 - 1,
+                          1 - (y + 0.5f) / frame.Height * 2);
+      RayHit hit = {};
+      hit.T = ray.TMax;
+      frame.Depth[pixel] = 1000;
+      frame.Normal[pixel] = {0, 0, 0};
+      if (scene.Intersect(ray, hit)) {
+        frame.Depth[pixel] = hit.T;
+        frame.Normal[pixel] = scene.GetNormal(hit);
+      }
+    }
+  }
+}
+
+// Displayed values after a Reinhard curve, so the light and the odd
+// firefly do not swamp the error of everything else.
+static Vector3 Tonemap(const Vector3 &color) {
+  return {color.X / (1 + color.X), color.Y / (1 + color.Y),
+          color.Z / (1 + color.Z)};
+}
+
+static double RMSE(const std::vector<Vector3> &image,
+                   const std::vector<Vector3> &reference) {
+  double sum = 0;
+  for (size_t i = 0; i < image.size(); ++i) {
+    Vector3 d = Tonemap(image[i]) - Tonemap(reference[i]);
+    sum += Dot(d, d) / 3;
+  }
+  return sqrt(sum / image.size());
+}
+
+int main(int argc, char **argv) {
+  const uint32_t width = argc > 1 ? (uint32_t)atoi(argv[1]) : 320;
+  const uint32_t height = argc > 2 ? (uint32_t)atoi(argv[2]) : 240;
+  const uint32_t samples = argc > 3 ? (uint32_t)atoi(argv[3]) : 4;
+  const uint32_t referenceSamples = argc > 4 ? (uint32_t)atoi(argv[4]) : 512;
+  std::vector<Instance> instances = CreateScene();
+  SceneBVH scene(instances);
+  LightBVH lights(instances);
+  const Vector3 eye = {0, 2, -5};
+  const Matrix44 clipToWorld = Invert(
+      CreateMatrixLookAt(eye, Vector3{0, 0.5f, 0}, Vector3{0, 1, 0}) *
+      CreateProjection(0.01f, 100.0f, 60 * (Pi<float> / 180),
+                       60 * (Pi<float> / 180) * height / width));
+  Frame frame = {width, height};
+  frame.Color.resize(width * height);
+  frame.Depth.resize(width * height);
+  frame.Normal.resize(width * height);
+  RenderGuides(scene, clipToWorld, eye, frame);
+  // Reference.
+  auto start = std::chrono::steady_clock::now();
+  Render(scene, lights, clipToWorld, eye, referenceSamples, 1000, frame);
+  const std::vector<Vector3> reference = frame.Color;
+  printf("%ux%u, reference %u spp: %.0f ms\n", width, height,
+         referenceSamples, 1000 * Seconds(start));
+  // Noisy input.
+  start = std::chrono::steady_clock::now();
+  Render(scene, lights, clipToWorld, eye, samples, 0, frame);
+  double noisyTime = Seconds(start);
+  // Denoised.
+  std::unique_ptr<IImage> color = CreateImage_Unowned(
+      width, height, sizeof(Vector3) * width, DXGI_FORMAT_R32G32B32_FLOAT,
+      &frame.Color[0]);
+  std::unique_ptr<IImage> depth =
+      CreateImage_Unowned(width, height, sizeof(float) * width,
+                          DXGI_FORMAT_R32_FLOAT, &frame.Depth[0]);
+  std::unique_ptr<IImage> normal = CreateImage_Unowned(
+      width, height, sizeof(Vector3) * width, DXGI_FORMAT_R32G32B32_FLOAT,
+      &frame.Normal[0]);
+  start = std::chrono::steady_clock::now();
+  std::unique_ptr<IImage> denoised =
+      Image_Denoise(color.get(), depth.get(), normal.get(), nullptr);
+  double denoiseTime = Seconds(start);
+  std::vector<Vector3> filtered(width * height);
+  for (uint32_t y = 0; y < height; ++y) {
+    const float *row = reinterpret_cast<const float *>(
+        reinterpret_cast<const uint8_t *>(denoised->GetData()) +
+        y * denoised->GetStride());
+    for (uint32_t x = 0; x < width; ++x) {
+      filtered[y * width + x] = {row[4 * x], row[4 * x + 1], row[4 * x + 2]};
+    }
+  }
+  // Equal time: at least the time of the noisy render plus the denoiser.
+  const uint32_t equalSamples =
+      (uint32_t)ceil(samples * (noisyTime + denoiseTime) / noisyTime);
+  const std::vector<Vector3> noisy = frame.Color;
+  start = std::chrono::steady_clock::now();
+  Render(scene, lights, clipToWorld, eye, equalSamples, 0, frame);
+  double equalTime = Seconds(start);
+  printf("%-22s %9s %9s\n", "", "ms", "RMSE");
+  printf("%-22s %9.1f %9.4f\n", "noisy", 1000 * noisyTime,
+         RMSE(noisy, reference));
+  printf("%-22s %9.1f %9.4f (denoise %.1f ms)\n", "noisy + denoise",
+         1000 * (noisyTime + denoiseTime), RMSE(filtered, reference),
+         1000 * denoiseTime);
+  char label[32];
+  snprintf(label, sizeof(label), "equal time, %u spp", equalSamples);
+  printf("%-22s %9.1f %9.4f\n", label, 1000 * equalTime,
+         RMSE(frame.Color, reference));
+  // Error falls with the square root of the sample count, which estimates
+  // what matching the denoised error by sampling alone would cost.
+  double ratio = RMSE(noisy, reference) / RMSE(filtered, reference);
+  printf("Matching the denoised error needs about %.0f spp (%.0f ms)\n",
+         samples * ratio * ratio, 1000 * noisyTime * ratio * ratio);
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark - Implicit Primitive BVH
+////////////////////////////////////////////////////////////////////////////////
+// Random spheres (1M by default) in a 200^3 box with rays fired through the
+// cloud on one thread. Closest hits are checked against a brute force scalar
+// reference on a subset of the rays, and a skewed parallelogram checks that
+// the plane kernel clips to the parallelogram rather than its bounds.
+//
+// Usage: Bench_ImplicitBVH [sphere count] [ray count]
+////////////////////////////////////////////////////////////////////////////////
+
+#include "Core_Sampling.h"
+#include "Scene_ImplicitBVH.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const float BOX_SIZE = 200;
+static const uint32_t REFERENCE_RAYS = 200;
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Closest sphere by testing every one; the reference for the tree.
+static bool BruteForce(const std::vector<ImplicitSphere> &spheres,
+                       const Ray &ray, float &t, uint32_t &primitive) {
+  bool found = false;
+  t = ray.TMax;
+  for (uint32_t i = 0; i < spheres.size(); ++i) {
+    Vector3 o = ray.Origin - spheres[i].Center;
+    float b = Dot(o, ray.Direction);
+    float c = Dot(o, o) - spheres[i].Radius * spheres[i].Radius;
+    float root = b * b - c;
+    if (root < 0)
+      continue;
+    float s = sqrtf(root);
+    float hit = -b - s >= ray.TMin ? -b - s : -b + s;
+    if (hit >= ray.TMin && hit < t) {
+      t = hit;
+      primitive = i;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// A parallelogram sheared 45 degrees; points inside it but outside the
+// rectangle spanned by projecting onto U and V must still hit, and vice versa.
+static bool CheckSkewedPlane() {
+  ImplicitPlane plane = {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}};
+  ImplicitBVH bvh({}, {plane}, {}, {});
+  bool ok = true;
+  auto probe = [&](float x, float z, bool expect) {
+    Ray ray = {{x, 1, z}, {0, -1, 0}, 0, INFINITY};
+    ImplicitHit hit = {INFINITY};
+    if (bvh.Intersect(ray, hit) != expect) {
+      printf("Skewed plane: (%g, %g) should %s.\n", x, z,
+             expect ? "hit" : "miss");
+      ok = false;
+    }
+  };
+  probe(1.8f, 0.9f, true);
+  probe(-1.8f, -0.9f, true);
+  probe(1.5f, -0.8f, false);
+  probe(-1.5f, 0.8f, false);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  const uint32_t sphereCount = argc > 1 ? (uint32_t)atoi(argv[1]) : 1000000;
+  const uint32_t rayCount = argc > 2 ? (uint32_t)atoi(argv[2]) : 1000000;
+  uint32_t random = HashPCG(1);
+  std::vector<ImplicitSphere> spheres(sphereCount);
+  for (auto &sphere : spheres) {
+    sphere.Center = {RandomUnit(random) * BOX_SIZE,
+                     RandomUnit(random) * BOX_SIZE,
+                     RandomUnit(random) * BOX_SIZE};
+    sphere.Radius = 0.1f + 0.4f * RandomUnit(random);
+  }
+  auto start = std::chrono::steady_clock::now();
+  ImplicitBVH bvh(spheres, {}, {}, {});
+  printf("Build: %u spheres in %.2f s\n", sphereCount, Seconds(start));
+  // Rays start on the faces of the box and aim at a point inside it.
+  std::vector<Ray> rays(rayCount);
+  for (auto &ray : rays) {
+    Vector3 target = {RandomUnit(random) * BOX_SIZE,
+                      RandomUnit(random) * BOX_SIZE,
+                      RandomUnit(random) * BOX_SIZE};
+    ray.Origin = {RandomUnit(random) * BOX_SIZE,
+                  RandomUnit(random) * BOX_SIZE, -1};
+    ray.Direction = Normalize(target - ray.Origin);
+    ray.TMin = 0;
+    ray.TMax = INFINITY;
+  }
+  start = std::chrono::steady_clock::now();
+  uint32_t hits = 0;
+  for (const Ray &ray : rays) {
+    ImplicitHit hit = {INFINITY};
+    hits += bvh.Intersect(ray, hit) ? 1 : 0;
+  }
+  double elapsed = Seconds(start);
+  printf("Closest hit: %u rays in %.2f s (%.2f Mrays/s), %.1f%% hit\n",
+         rayCount, elapsed, rayCount / elapsed / 1e6,
+         100.0 * hits / std::max(rayCount, 1u));
+  bool ok = CheckSkewedPlane();
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < REFERENCE_RAYS && i < rayCount; ++i) {
+    ImplicitHit hit = {INFINITY};
+    bool found = bvh.Intersect(rays[i], hit);
+    float t;
+    uint32_t primitive;
+    bool expected = BruteForce(spheres, rays[i], t, primitive);
+    if (found != expected ||
+        (found && (hit.Primitive != primitive ||
+                   fabsf(hit.T - t) > 1e-3f * std::max(t, 1.0f))))
+      ++mismatches;
+  }
+  printf("Reference: %u of %u rays differ\n", mismatches,
+         std::min(REFERENCE_RAYS, rayCount));
+  return ok && mismatches == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark - Tile Based Software Rasterizer
+////////////////////////////////////////////////////////////////////////////////
+// Renders a floor and a grid of spheres, some of them squashed so normals go
+// through a non-uniform scale, with the software rasterizer and no graphics
+// device. Reports frame time and triangle throughput over a number of
+// frames, prints a hash of the final image so runs can be compared as text,
+// and optionally writes the image as a TGA for a visual regression check.
+//
+// Usage: Bench_Rasterizer [width] [height] [frames] [grid size] [output.tga]
+////////////////////////////////////////////////////////////////////////////////
+
+#include "Scene_IMesh.h"
+#include "Scene_ParametricUVToMesh.h"
+#include "Scene_Plane.h"
+#include "Scene_Rasterizer.h"
+#include "Scene_Sphere.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+static std::vector<Instance> CreateScene(uint32_t gridSize) {
+  std::shared_ptr<IParametricUV> plane(new Plane());
+  std::shared_ptr<IParametricUV> sphere(new Sphere());
+  std::shared_ptr<IMesh> planeMesh(new ParametricUVToMesh(plane, 1, 1));
+  std::shared_ptr<IMesh> sphereMesh(new ParametricUVToMesh(sphere, 64, 64));
+  std::vector<Instance> scene;
+  Instance floor = {};
+  floor.TransformObjectToWorld.reset(
+      new Matrix44(CreateMatrixScale(Vector3{10, 0.25f, 10})));
+  floor.Mesh = planeMesh;
+  scene.push_back(floor);
+  for (uint32_t z = 0; z < gridSize; ++z) {
+    for (uint32_t x = 0; x < gridSize; ++x) {
+      float spacing = 8.0f / gridSize;
+      Vector3 position = {-4 + spacing * (x + 0.5f), 0.5f * spacing,
+                          -4 + spacing * (z + 0.5f)};
+      // Every other sphere is squashed into an ellipsoid.
+      float squash = (x + z) % 2 == 0 ? 1.0f : 0.5f;
+      Instance instance = {};
+      instance.TransformObjectToWorld.reset(new Matrix44(
+          CreateMatrixScale(Vector3{0.4f * spacing, 0.4f * spacing * squash,
+                                    0.4f * spacing}) *
+          CreateMatrixTranslate(position)));
+      instance.Mesh = sphereMesh;
+      scene.push_back(instance);
+    }
+  }
+  return scene;
+}
+
+// FNV-1a over the visible pixels.
+static uint32_t HashImage(const IImage &image) {
+  uint32_t hash = 2166136261u;
+  for (uint32_t y = 0; y < image.GetHeight(); ++y) {
+    const uint8_t *row =
+        reinterpret_cast<const uint8_t *>(image.GetData()) +
+        y * image.GetStride();
+    for (uint32_t i = 0; i < 4 * image.GetWidth(); ++i) {
+      hash = (hash ^ row[i]) * 16777619u;
+    }
+  }
+  return hash;
+}
+
+// Uncompressed 32 bit TGA, which stores B8G8R8A8 as-is.
+static bool WriteTGA(const char *filename, const IImage &image) {
+  FILE *file = fopen(filename, "wb");
+  if (file == nullptr)
+    return false;
+  uint8_t header[18] = {};
+  header[2] = 2;
+  header[12] = image.GetWidth() & 0xFF;
+  header[13] = image.GetWidth() >> 8;
+  header[14] = image.GetHeight() & 0xFF;
+  header[15] = image.GetHeight() >> 8;
+  header[16] = 32;
+  // Top-left origin and 8 alpha bits.
+  header[17] = 0x28;
+  fwrite(header, sizeof(header), 1, file);
+  for (uint32_t y = 0; y < image.GetHeight(); ++y) {
+    fwrite(reinterpret_cast<const uint8_t *>(image.GetData()) +
+               y * image.GetStride(),
+           4, image.GetWidth(), file);
+  }
+  return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+  const uint32_t width = argc > 1 ? (uint32_t)atoi(argv[1]) : 1920;
+  const uint32_t height = argc > 2 ? (uint32_t)atoi(argv[2]) : 1080;
+  const uint32_t frames = argc > 3 ? (uint32_t)atoi(argv[3]) : 20;
+  const uint32_t gridSize = argc > 4 ? (uint32_t)atoi(argv[4]) : 16;
+  const char *output = argc > 5 ? argv[5] : nullptr;
+  std::vector<Instance> scene = CreateScene(gridSize);
+  Matrix44 worldToClip =
+      CreateMatrixLookAt(Vector3{0, 5, -8}, Vector3{0, 0, 0},
+                         Vector3{0, 1, 0}) *
+      CreateProjection(0.01f, 100.0f, 90 * (Pi<float> / 180),
+                       90 * (Pi<float> / 180) * height / width);
+  SoftwareRasterizer rasterizer(width, height);
+  // The first frame also reads the meshes into the rasterizer's cache.
+  rasterizer.Draw(scene, worldToClip);
+  RasterizerStats stats = {};
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t frame = 0; frame < frames; ++frame) {
+    rasterizer.Clear();
+    stats = rasterizer.Draw(scene, worldToClip);
+  }
+  double elapsed = Seconds(start);
+  printf("%ux%u, %u instances: %.2f ms/frame\n", width, height,
+         (uint32_t)scene.size(), 1000 * elapsed / std::max(frames, 1u));
+  printf("Triangles: %u submitted, %u set up, %u bin entries, %.1f M/s\n",
+         stats.TrianglesSubmitted, stats.TrianglesSetup, stats.BinEntries,
+         stats.TrianglesSubmitted * (double)frames / elapsed / 1e6);
+  std::unique_ptr<IImage> image = rasterizer.CopyColor();
+  printf("Image hash: %08x\n", HashImage(*image));
+  if (output != nullptr && !WriteTGA(output, *image)) {
+    printf("Could not write %s.\n", output);
+    return 1;
+  }
+  return 0;
+}
\ No newline at end of file
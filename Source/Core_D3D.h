@@ -26,6 +26,12 @@ struct VertexCol {
   unsigned int Color;
 };
 
+struct VertexColNorm {
+  Vector3 Position;
+  Vector3 Normal;
+  unsigned int Color;
+};
+
 struct VertexTex {
   Vector2 Position;
   Vector2 Texcoord;
@@ -37,6 +43,14 @@ struct VertexVS {
   Vector2 Texcoord;
 };
 
+// VertexVS with a tangent frame (see Scene_Tangents.h).
+struct VertexTangentVS {
+  Vector3 Position;
+  Vector3 Normal;
+  Vector2 Texcoord;
+  Vector4 Tangent;
+};
+
 extern const int kSamplerRegisterDefaultWrap;
 extern const int kSamplerRegisterDefaultBorder;
 
@@ -119,6 +119,26 @@ template <class T> TVector3<T> operator*(const TVector3<T> &lhs, const T &rhs) {
   return {lhs.X * rhs, lhs.Y * rhs, lhs.Z * rhs};
 }
 
+template <class T> TVector3<T> operator*(const T &lhs, const TVector3<T> &rhs) {
+  return {lhs * rhs.X, lhs * rhs.Y, lhs * rhs.Z};
+}
+
+template <class T> TVector3<T> operator-(const TVector3<T> &lhs) {
+  return {-lhs.X, -lhs.Y, -lhs.Z};
+}
+
+template <class T>
+TVector3<T> Min(const TVector3<T> &lhs, const TVector3<T> &rhs) {
+  return {lhs.X < rhs.X ? lhs.X : rhs.X, lhs.Y < rhs.Y ? lhs.Y : rhs.Y,
+          lhs.Z < rhs.Z ? lhs.Z : rhs.Z};
+}
+
+template <class T>
+TVector3<T> Max(const TVector3<T> &lhs, const TVector3<T> &rhs) {
+  return {lhs.X > rhs.X ? lhs.X : rhs.X, lhs.Y > rhs.Y ? lhs.Y : rhs.Y,
+          lhs.Z > rhs.Z ? lhs.Z : rhs.Z};
+}
+
 template <class T>
 TVector3<T> Cross(const TVector3<T> &lhs, const TVector3<T> &rhs) {
   return {lhs.Y * rhs.Z - lhs.Z * rhs.Y, lhs.Z * rhs.X - lhs.X * rhs.Z,
@@ -206,6 +226,30 @@ TVector4<T> Transform(const TMatrix44<T> &lhs, const TVector4<T> &rhs) {
   };
 }
 
+// Transform a position (implicit W=1) by a row-major matrix.
+template <class T>
+TVector3<T> TransformPoint(const TMatrix44<T> &lhs, const TVector3<T> &rhs) {
+  return {
+      // clang-format off
+      lhs.M11 * rhs.X + lhs.M21 * rhs.Y + lhs.M31 * rhs.Z + lhs.M41,
+      lhs.M12 * rhs.X + lhs.M22 * rhs.Y + lhs.M32 * rhs.Z + lhs.M42,
+      lhs.M13 * rhs.X + lhs.M23 * rhs.Y + lhs.M33 * rhs.Z + lhs.M43
+      // clang-format on
+  };
+}
+
+// Transform a direction (implicit W=0) by a row-major matrix.
+template <class T>
+TVector3<T> TransformVector(const TMatrix44<T> &lhs, const TVector3<T> &rhs) {
+  return {
+      // clang-format off
+      lhs.M11 * rhs.X + lhs.M21 * rhs.Y + lhs.M31 * rhs.Z,
+      lhs.M12 * rhs.X + lhs.M22 * rhs.Y + lhs.M32 * rhs.Z,
+      lhs.M13 * rhs.X + lhs.M23 * rhs.Y + lhs.M33 * rhs.Z
+      // clang-format on
+  };
+}
+
 template <class T> TMatrix44<T> Transpose(const TMatrix44<T> &lhs) {
   return {
       // clang-format off
@@ -0,0 +1,110 @@
+#include "Core_Parallel.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Set on pool workers and on a thread while it runs a ParallelFor; nested
+// calls run inline rather than waiting on a pool they are part of.
+static thread_local bool t_insideParallelFor = false;
+
+// Worker threads created on first use and kept for the life of the process,
+// so per-frame callers pay for a wake up rather than thread creation. One
+// range runs at a time; the calling thread works on it too.
+class WorkerPool {
+public:
+  WorkerPool() : m_fn(nullptr), m_count(0), m_generation(0), m_busy(0) {
+    m_nextIndex.store(0);
+    uint32_t threadCount = std::thread::hardware_concurrency();
+    for (uint32_t i = 1; i < threadCount; ++i) {
+      m_threads.emplace_back([this]() { WorkerMain(); });
+    }
+  }
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto &thread : m_threads) {
+      thread.join();
+    }
+  }
+  uint32_t GetWorkerCount() const { return (uint32_t)m_threads.size(); }
+  void Execute(uint32_t count, const std::function<void(uint32_t)> &fn) {
+    std::lock_guard<std::mutex> execute(m_execute);
+    {
+      // Workers still leaving the previous range must not see this one half
+      // written.
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_done.wait(lock, [&]() { return m_busy == 0; });
+      m_fn = &fn;
+      m_count = count;
+      m_nextIndex.store(0);
+      ++m_generation;
+    }
+    m_wake.notify_all();
+    Drain();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&]() { return m_busy == 0; });
+  }
+
+private:
+  // Pull the next index from the shared counter until the range is
+  // exhausted.
+  void Drain() {
+    while (true) {
+      uint32_t index = m_nextIndex.fetch_add(1);
+      if (index >= m_count)
+        break;
+      (*m_fn)(index);
+    }
+  }
+  void WorkerMain() {
+    t_insideParallelFor = true;
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_wake.wait(lock, [&]() { return m_quit || m_generation != seen; });
+      if (m_quit)
+        return;
+      seen = m_generation;
+      ++m_busy;
+      lock.unlock();
+      Drain();
+      lock.lock();
+      if (--m_busy == 0)
+        m_done.notify_all();
+    }
+  }
+  std::vector<std::thread> m_threads;
+  // Held by the caller for the whole of one range.
+  std::mutex m_execute;
+  // Guards everything below except the index counter.
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  const std::function<void(uint32_t)> *m_fn;
+  uint32_t m_count;
+  std::atomic<uint32_t> m_nextIndex;
+  uint64_t m_generation;
+  // Workers currently inside Drain.
+  uint32_t m_busy;
+  bool m_quit = false;
+};
+
+void ParallelFor(uint32_t count, const std::function<void(uint32_t)> &fn) {
+  if (count == 0)
+    return;
+  static WorkerPool pool;
+  if (count == 1 || t_insideParallelFor || pool.GetWorkerCount() == 0) {
+    for (uint32_t index = 0; index < count; ++index) {
+      fn(index);
+    }
+    return;
+  }
+  t_insideParallelFor = true;
+  pool.Execute(count, fn);
+  t_insideParallelFor = false;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+
+// Run a function for every index in [0, count) using all hardware threads.
+// Indices are handed out dynamically so uneven work (tiles, meshes) balances
+// itself; the call returns when every index has been processed.
+//
+// The workers are a persistent pool started on first use, so calling this
+// every frame is cheap. Calls made from inside fn run inline on the calling
+// thread.
+void ParallelFor(uint32_t count, const std::function<void(uint32_t)> &fn);
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "Core_Sampling.h"
+
+uint32_t HashPCG(uint32_t value) {
+  uint32_t state = value * 747796405u + 2891336453u;
+  uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+float RandomUnit(uint32_t &state) {
+  state = HashPCG(state);
+  // Use the top 24 bits so the result is exactly representable and < 1.
+  return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+Vector3 SampleHemisphereCosine(Vector2 uv) {
+  float radius = SquareRoot(uv.X);
+  float angle = 2 * Pi<float> * uv.Y;
+  float z = SquareRoot(1 - uv.X > 0 ? 1 - uv.X : 0);
+  return {radius * Cos(angle), radius * Sin(angle), z};
+}
+
+Vector3 SampleSphereUniform(Vector2 uv) {
+  float z = 1 - 2 * uv.X;
+  float radius = SquareRoot(1 - z * z > 0 ? 1 - z * z : 0);
+  float angle = 2 * Pi<float> * uv.Y;
+  return {radius * Cos(angle), radius * Sin(angle), z};
+}
+
+void CreateBasis(const Vector3 &normal, Vector3 &tangent, Vector3 &bitangent) {
+  // Branchless orthonormal basis (Duff et al. 2017).
+  float sign = normal.Z >= 0 ? 1.0f : -1.0f;
+  float a = -1 / (sign + normal.Z);
+  float b = normal.X * normal.Y * a;
+  tangent = {1 + sign * normal.X * normal.X * a, sign * b, -sign * normal.X};
+  bitangent = {b, sign + normal.Y * normal.Y * a, -normal.Y};
+}
+
+AliasTable::AliasTable(const float *weights, uint32_t count) {
+  m_entries.resize(count);
+  if (count == 0)
+    return;
+  double total = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    total += weights[i] > 0 ? weights[i] : 0;
+  }
+  // Scale so the average bucket holds exactly 1, then pair up small buckets
+  // with large ones (Vose's method).
+  std::vector<double> scaled(count);
+  std::vector<uint32_t> small, large;
+  for (uint32_t i = 0; i < count; ++i) {
+    double weight = weights[i] > 0 ? weights[i] : 0;
+    m_entries[i].Pdf = total > 0 ? (float)(weight / total) : 1.0f / count;
+    scaled[i] = m_entries[i].Pdf * (double)count;
+    (scaled[i] < 1 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    uint32_t less = small.back();
+    small.pop_back();
+    uint32_t more = large.back();
+    large.pop_back();
+    m_entries[less].Threshold = (float)scaled[less];
+    m_entries[less].Alias = more;
+    scaled[more] = (scaled[more] + scaled[less]) - 1;
+    (scaled[more] < 1 ? small : large).push_back(more);
+  }
+  // Whatever is left is 1 up to rounding error.
+  for (uint32_t i : large) {
+    m_entries[i].Threshold = 1;
+    m_entries[i].Alias = i;
+  }
+  for (uint32_t i : small) {
+    m_entries[i].Threshold = 1;
+    m_entries[i].Alias = i;
+  }
+}
+
+uint32_t AliasTable::Sample(float random, float &pdf) const {
+  uint32_t count = (uint32_t)m_entries.size();
+  float scaled = random * count;
+  uint32_t index = (uint32_t)scaled;
+  if (index >= count)
+    index = count - 1;
+  const Entry &entry = m_entries[index];
+  uint32_t result = (scaled - index) < entry.Threshold ? index : entry.Alias;
+  pdf = m_entries[result].Pdf;
+  return result;
+}
+
+float AliasTable::Pdf(uint32_t index) const { return m_entries[index].Pdf; }
+
+uint32_t AliasTable::GetCount() const { return (uint32_t)m_entries.size(); }
+
+const std::vector<AliasTable::Entry> &AliasTable::GetEntries() const {
+  return m_entries;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Core_Math.h"
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Random numbers and sampling helpers for the CPU ray tracing code.
+//
+// Everything here is stateless or carries its state explicitly so that work
+// can be split across threads and still reproduce the same image.
+////////////////////////////////////////////////////////////////////////////////
+
+// Hash a 32-bit value (PCG output permutation); good for seeding per-item.
+uint32_t HashPCG(uint32_t value);
+
+// Advance a random state and return a float in [0, 1).
+float RandomUnit(uint32_t &state);
+
+// Map a unit square sample onto a cosine weighted Z-up hemisphere.
+Vector3 SampleHemisphereCosine(Vector2 uv);
+
+// Map a unit square sample uniformly onto the unit sphere.
+Vector3 SampleSphereUniform(Vector2 uv);
+
+// Build two tangent vectors perpendicular to a unit normal.
+void CreateBasis(const Vector3 &normal, Vector3 &tangent, Vector3 &bitangent);
+
+////////////////////////////////////////////////////////////////////////////////
+// Walker/Vose alias table for O(1) sampling of a discrete distribution.
+//
+// Entries are laid out flat so the same table can be uploaded to the GPU as a
+// structured buffer and sampled there with identical results.
+class AliasTable {
+public:
+  struct Entry {
+    float Threshold; // Keep this entry if the remainder is below this value.
+    uint32_t Alias;  // Otherwise take this entry instead.
+    float Pdf;       // Normalized probability of this entry.
+  };
+  AliasTable() = default;
+  // Weights need not be normalized; all-zero input gives a uniform table.
+  AliasTable(const float *weights, uint32_t count);
+  // Pick an index using one uniform random number in [0, 1).
+  uint32_t Sample(float random, float &pdf) const;
+  float Pdf(uint32_t index) const;
+  uint32_t GetCount() const;
+  const std::vector<Entry> &GetEntries() const;
+
+private:
+  std::vector<Entry> m_entries;
+};
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include "Image_Denoise.h"
+#include "Core_Parallel.h"
+#include "Core_Util.h"
+#include <emmintrin.h>
+#include <exception>
+#include <utility>
+#include <vector>
+
+// The filter is run in 4-wide SSE over planar (SoA) copies of the inputs.
+// Planes carry a border wide enough for the largest filter step so that no
+// tap ever needs clamping; border normals are zero which zeroes their weight.
+static const uint32_t TILE_SIZE = 64;
+
+static uint32_t ChannelCount(DXGI_FORMAT format) {
+  switch (format) {
+  case DXGI_FORMAT_R32G32B32A32_FLOAT:
+    return 4;
+  case DXGI_FORMAT_R32G32B32_FLOAT:
+    return 3;
+  case DXGI_FORMAT_R32G32_FLOAT:
+    return 2;
+  case DXGI_FORMAT_R32_FLOAT:
+  case DXGI_FORMAT_D32_FLOAT:
+    return 1;
+  default:
+    throw std::exception("Denoiser inputs must be float images.");
+  }
+}
+
+struct Plane {
+  Plane(uint32_t width, uint32_t height, uint32_t border)
+      : Border(border), Pitch(AlignUp(width + 2 * border, 4)),
+        Data(Pitch * (height + 2 * border), 0.0f) {}
+  float *Row(uint32_t y) { return &Data[(y + Border) * Pitch + Border]; }
+  uint32_t Border;
+  uint32_t Pitch;
+  std::vector<float> Data;
+};
+
+// Scatter one channel of an image into a plane.
+static void CopyToPlane(const IImage *image, uint32_t channel, Plane &plane) {
+  uint32_t channels = ChannelCount(image->GetFormat());
+  for (uint32_t y = 0; y < image->GetHeight(); ++y) {
+    const float *src = reinterpret_cast<const float *>(
+        reinterpret_cast<const uint8_t *>(image->GetData()) +
+        image->GetStride() * y);
+    float *dst = plane.Row(y);
+    for (uint32_t x = 0; x < image->GetWidth(); ++x) {
+      dst[x] = src[x * channels + channel];
+    }
+  }
+}
+
+// e^x for x <= 0, accurate to about 1e-4 which is plenty for filter weights.
+static __m128 ExpNegative(__m128 x) {
+  x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+  __m128 t = _mm_mul_ps(x, _mm_set1_ps(1.44269504f));
+  // floor(t) without SSE4.1; truncation rounds negative values up.
+  __m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+  n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, t), _mm_set1_ps(1.0f)));
+  __m128 f = _mm_sub_ps(t, n);
+  // 2^f on [0,1) with a cubic polynomial.
+  __m128 p = _mm_set1_ps(0.0555041086648216f);
+  p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.2402264923172690f));
+  p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.6931471805599453f));
+  p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+  // Scale by 2^n through the exponent bits.
+  __m128i e = _mm_slli_epi32(
+      _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23);
+  return _mm_mul_ps(p, _mm_castsi128_ps(e));
+}
+
+static __m128 Luminance(__m128 r, __m128 g, __m128 b) {
+  return _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.2126f)),
+                 _mm_mul_ps(g, _mm_set1_ps(0.7152f))),
+      _mm_mul_ps(b, _mm_set1_ps(0.0722f)));
+}
+
+std::unique_ptr<IImage> Image_Denoise(const IImage *color, const IImage *depth,
+                                      const IImage *normal,
+                                      const IImage *albedo,
+                                      const DenoiseSettings &settings) {
+  const uint32_t width = color->GetWidth();
+  const uint32_t height = color->GetHeight();
+  if (depth->GetWidth() != width || depth->GetHeight() != height ||
+      normal->GetWidth() != width || normal->GetHeight() != height ||
+      (albedo != nullptr &&
+       (albedo->GetWidth() != width || albedo->GetHeight() != height)))
+    throw std::exception("Denoiser inputs must have matching dimensions.");
+  if (ChannelCount(color->GetFormat()) < 3 ||
+      ChannelCount(normal->GetFormat()) < 3 ||
+      (albedo != nullptr && ChannelCount(albedo->GetFormat()) < 3))
+    throw std::exception("Denoiser color inputs must be RGB.");
+  const uint32_t iterations = settings.Iterations;
+  const uint32_t maxStep = iterations > 0 ? 1 << (iterations - 1) : 1;
+  const uint32_t border = AlignUp(2 * maxStep, 4);
+  ////////////////////////////////////////////////////////////////////////////////
+  // Unpack all inputs into planar form.
+  Plane colorR(width, height, border), colorG(width, height, border),
+      colorB(width, height, border);
+  Plane albedoR(width, height, border), albedoG(width, height, border),
+      albedoB(width, height, border);
+  Plane normalX(width, height, border), normalY(width, height, border),
+      normalZ(width, height, border);
+  Plane depthZ(width, height, border);
+  CopyToPlane(color, 0, colorR);
+  CopyToPlane(color, 1, colorG);
+  CopyToPlane(color, 2, colorB);
+  CopyToPlane(normal, 0, normalX);
+  CopyToPlane(normal, 1, normalY);
+  CopyToPlane(normal, 2, normalZ);
+  CopyToPlane(depth, 0, depthZ);
+  if (albedo != nullptr) {
+    CopyToPlane(albedo, 0, albedoR);
+    CopyToPlane(albedo, 1, albedoG);
+    CopyToPlane(albedo, 2, albedoB);
+    // Demodulate; we filter irradiance so texture detail is not blurred.
+    for (uint32_t y = 0; y < height; ++y) {
+      for (uint32_t x = 0; x < width; ++x) {
+        colorR.Row(y)[x] /= albedoR.Row(y)[x] > 1e-3f ? albedoR.Row(y)[x] : 1;
+        colorG.Row(y)[x] /= albedoG.Row(y)[x] > 1e-3f ? albedoG.Row(y)[x] : 1;
+        colorB.Row(y)[x] /= albedoB.Row(y)[x] > 1e-3f ? albedoB.Row(y)[x] : 1;
+      }
+    }
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Run the a-trous passes, ping-ponging between two sets of color planes.
+  Plane tempR(width, height, border), tempG(width, height, border),
+      tempB(width, height, border);
+  Plane *srcR = &colorR, *srcG = &colorG, *srcB = &colorB;
+  Plane *dstR = &tempR, *dstG = &tempG, *dstB = &tempB;
+  const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+  const uint32_t tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+  const uint32_t tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+  const int32_t pitch = colorR.Pitch;
+  float sigmaColor = settings.SigmaColor;
+  for (uint32_t pass = 0; pass < iterations; ++pass) {
+    const int32_t step = 1 << pass;
+    const __m128 invSigmaColor = _mm_set1_ps(-1.0f / (sigmaColor + 1e-6f));
+    const __m128 invSigmaDepth =
+        _mm_set1_ps(-1.0f / (settings.SigmaDepth * step + 1e-6f));
+    ParallelFor(tilesX * tilesY, [&](uint32_t tileIndex) {
+      const uint32_t tileX = (tileIndex % tilesX) * TILE_SIZE;
+      const uint32_t tileY = (tileIndex / tilesX) * TILE_SIZE;
+      const uint32_t tileEndX =
+          tileX + TILE_SIZE < width ? tileX + TILE_SIZE : width;
+      const uint32_t tileEndY =
+          tileY + TILE_SIZE < height ? tileY + TILE_SIZE : height;
+      const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+      for (uint32_t y = tileY; y < tileEndY; ++y) {
+        // Lanes past the right edge land in the border; they have zero
+        // normals so nobody will ever read them with nonzero weight.
+        for (uint32_t x = tileX; x < tileEndX; x += 4) {
+          const int32_t center = (int32_t)x;
+          const __m128 cR = _mm_loadu_ps(srcR->Row(y) + center);
+          const __m128 cG = _mm_loadu_ps(srcG->Row(y) + center);
+          const __m128 cB = _mm_loadu_ps(srcB->Row(y) + center);
+          const __m128 cL = Luminance(cR, cG, cB);
+          const __m128 cX = _mm_loadu_ps(normalX.Row(y) + center);
+          const __m128 cY = _mm_loadu_ps(normalY.Row(y) + center);
+          const __m128 cZ = _mm_loadu_ps(normalZ.Row(y) + center);
+          const __m128 cD = _mm_loadu_ps(depthZ.Row(y) + center);
+          // The center tap is always taken so background pixels pass through.
+          const __m128 centerWeight = _mm_set1_ps(kernel[2] * kernel[2]);
+          __m128 sumW = centerWeight;
+          __m128 sumR = _mm_mul_ps(cR, centerWeight);
+          __m128 sumG = _mm_mul_ps(cG, centerWeight);
+          __m128 sumB = _mm_mul_ps(cB, centerWeight);
+          for (int32_t ky = -2; ky <= 2; ++ky) {
+            for (int32_t kx = -2; kx <= 2; ++kx) {
+              if (kx == 0 && ky == 0)
+                continue;
+              const int32_t offset = (ky * pitch + kx) * step + center;
+              const __m128 qR = _mm_loadu_ps(srcR->Row(y) + offset);
+              const __m128 qG = _mm_loadu_ps(srcG->Row(y) + offset);
+              const __m128 qB = _mm_loadu_ps(srcB->Row(y) + offset);
+              const __m128 qX = _mm_loadu_ps(normalX.Row(y) + offset);
+              const __m128 qY = _mm_loadu_ps(normalY.Row(y) + offset);
+              const __m128 qZ = _mm_loadu_ps(normalZ.Row(y) + offset);
+              const __m128 qD = _mm_loadu_ps(depthZ.Row(y) + offset);
+              // Normal weight by repeated squaring of the clamped cosine.
+              __m128 wN = _mm_add_ps(
+                  _mm_add_ps(_mm_mul_ps(cX, qX), _mm_mul_ps(cY, qY)),
+                  _mm_mul_ps(cZ, qZ));
+              wN = _mm_max_ps(wN, _mm_setzero_ps());
+              for (uint32_t p = 0; p < settings.NormalPower; ++p) {
+                wN = _mm_mul_ps(wN, wN);
+              }
+              // Depth and luminance weights share one exponential.
+              const __m128 dD = _mm_and_ps(_mm_sub_ps(cD, qD), absMask);
+              const __m128 dL =
+                  _mm_and_ps(_mm_sub_ps(cL, Luminance(qR, qG, qB)), absMask);
+              const __m128 wDL = ExpNegative(_mm_add_ps(
+                  _mm_mul_ps(dD, invSigmaDepth), _mm_mul_ps(dL, invSigmaColor)));
+              const __m128 w = _mm_mul_ps(
+                  _mm_mul_ps(wN, wDL),
+                  _mm_set1_ps(kernel[kx + 2] * kernel[ky + 2]));
+              sumW = _mm_add_ps(sumW, w);
+              sumR = _mm_add_ps(sumR, _mm_mul_ps(qR, w));
+              sumG = _mm_add_ps(sumG, _mm_mul_ps(qG, w));
+              sumB = _mm_add_ps(sumB, _mm_mul_ps(qB, w));
+            }
+          }
+          const __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), sumW);
+          _mm_storeu_ps(dstR->Row(y) + center, _mm_mul_ps(sumR, invW));
+          _mm_storeu_ps(dstG->Row(y) + center, _mm_mul_ps(sumG, invW));
+          _mm_storeu_ps(dstB->Row(y) + center, _mm_mul_ps(sumB, invW));
+        }
+      }
+    });
+    std::swap(srcR, dstR);
+    std::swap(srcG, dstG);
+    std::swap(srcB, dstB);
+    sigmaColor *= 0.5f;
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Remodulate and pack the result.
+  struct PixelR32G32B32A32F {
+    float R, G, B, A;
+  };
+  std::unique_ptr<PixelR32G32B32A32F[]> finalImage(
+      new PixelR32G32B32A32F[width * height]);
+  for (uint32_t y = 0; y < height; ++y) {
+    for (uint32_t x = 0; x < width; ++x) {
+      PixelR32G32B32A32F &out = finalImage[x + y * width];
+      out.R = srcR->Row(y)[x];
+      out.G = srcG->Row(y)[x];
+      out.B = srcB->Row(y)[x];
+      out.A = 1;
+      if (albedo != nullptr) {
+        out.R *= albedoR.Row(y)[x] > 1e-3f ? albedoR.Row(y)[x] : 1;
+        out.G *= albedoG.Row(y)[x] > 1e-3f ? albedoG.Row(y)[x] : 1;
+        out.B *= albedoB.Row(y)[x] > 1e-3f ? albedoB.Row(y)[x] : 1;
+      }
+    }
+  }
+  return CreateImage_AutoDelete(width, height,
+                                sizeof(PixelR32G32B32A32F) * width,
+                                DXGI_FORMAT_R32G32B32A32_FLOAT,
+                                finalImage.release());
+}
\ No newline at end of file
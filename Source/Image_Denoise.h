@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Core_IImage.h"
+#include <cstdint>
+#include <memory>
+
+////////////////////////////////////////////////////////////////////////////////
+// Edge-Avoiding A-Trous Denoiser
+//
+// A CPU version of the edge-avoiding a-trous wavelet filter (Dammertz et al.)
+// with the SVGF style albedo demodulation. Noisy color is divided by albedo,
+// blurred with a widening 5x5 B3-spline kernel that refuses to cross depth,
+// normal and luminance edges, then multiplied by albedo again.
+//
+// All inputs are float IImages of the same dimensions:
+//   color  - R32G32B32_FLOAT or R32G32B32A32_FLOAT radiance.
+//   depth  - R32_FLOAT or D32_FLOAT linear view distance.
+//   normal - R32G32B32_FLOAT or R32G32B32A32_FLOAT unit world normals.
+//            Zero normals mark background; those pixels are never blended.
+//   albedo - R32G32B32_FLOAT or R32G32B32A32_FLOAT (optional, may be null).
+// The result is always R32G32B32A32_FLOAT.
+////////////////////////////////////////////////////////////////////////////////
+
+struct DenoiseSettings {
+  // Number of filter passes; pass N samples with a step of 2^N pixels.
+  uint32_t Iterations = 5;
+  // Luminance tolerance of the first pass; halved on every following pass.
+  float SigmaColor = 4.0f;
+  // Depth tolerance in depth units per pixel of filter step.
+  float SigmaDepth = 1.0f;
+  // Normals are weighted by dot(n, n')^(2^NormalPower); 7 gives a power of 128.
+  uint32_t NormalPower = 7;
+};
+
+std::unique_ptr<IImage> Image_Denoise(const IImage *color, const IImage *depth,
+                                      const IImage *normal,
+                                      const IImage *albedo,
+                                      const DenoiseSettings &settings = {});
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "Image_DepthPyramid.h"
+#include "Core_Parallel.h"
+#include <algorithm>
+#include <emmintrin.h>
+#include <exception>
+#include <math.h>
+#include <utility>
+
+// Queries descend to the finest level at which the rect spans at most this
+// many texels along each axis.
+static const int32_t QUERY_TEXELS = 4;
+
+// Reduce rows 2y and 2y + 1 (or just 2y at an odd bottom edge) of a level
+// into row y of the next one. Four outputs per step with SSE2: the two rows
+// are combined vertically, then even and odd columns are split apart with
+// shuffles and combined horizontally.
+static void ReduceRow(const float *srcMin, const float *srcMax,
+                      uint32_t srcWidth, uint32_t srcHeight, float *dstMin,
+                      float *dstMax, uint32_t dstWidth, uint32_t y) {
+  const uint32_t y0 = 2 * y;
+  const uint32_t y1 = std::min(y0 + 1, srcHeight - 1);
+  const float *min0 = srcMin + y0 * srcWidth;
+  const float *min1 = srcMin + y1 * srcWidth;
+  const float *max0 = srcMax + y0 * srcWidth;
+  const float *max1 = srcMax + y1 * srcWidth;
+  float *outMin = dstMin + y * dstWidth;
+  float *outMax = dstMax + y * dstWidth;
+  uint32_t x = 0;
+  for (; 2 * x + 8 <= srcWidth; x += 4) {
+    __m128 loMin = _mm_min_ps(_mm_loadu_ps(min0 + 2 * x),
+                              _mm_loadu_ps(min1 + 2 * x));
+    __m128 hiMin = _mm_min_ps(_mm_loadu_ps(min0 + 2 * x + 4),
+                              _mm_loadu_ps(min1 + 2 * x + 4));
+    __m128 loMax = _mm_max_ps(_mm_loadu_ps(max0 + 2 * x),
+                              _mm_loadu_ps(max1 + 2 * x));
+    __m128 hiMax = _mm_max_ps(_mm_loadu_ps(max0 + 2 * x + 4),
+                              _mm_loadu_ps(max1 + 2 * x + 4));
+    _mm_storeu_ps(outMin + x,
+                  _mm_min_ps(_mm_shuffle_ps(loMin, hiMin, 0x88),
+                             _mm_shuffle_ps(loMin, hiMin, 0xDD)));
+    _mm_storeu_ps(outMax + x,
+                  _mm_max_ps(_mm_shuffle_ps(loMax, hiMax, 0x88),
+                             _mm_shuffle_ps(loMax, hiMax, 0xDD)));
+  }
+  for (; x < dstWidth; ++x) {
+    const uint32_t x0 = 2 * x;
+    const uint32_t x1 = std::min(x0 + 1, srcWidth - 1);
+    outMin[x] = std::min(std::min(min0[x0], min0[x1]),
+                         std::min(min1[x0], min1[x1]));
+    outMax[x] = std::max(std::max(max0[x0], max0[x1]),
+                         std::max(max1[x0], max1[x1]));
+  }
+}
+
+DepthPyramid::DepthPyramid(const IImage &depth) { Update(depth); }
+
+void DepthPyramid::Update(const IImage &depth) {
+  if (depth.GetFormat() != DXGI_FORMAT_R32_FLOAT &&
+      depth.GetFormat() != DXGI_FORMAT_D32_FLOAT)
+    throw std::exception("Depth pyramids need an R32_FLOAT depth image.");
+  if (depth.GetWidth() == 0 || depth.GetHeight() == 0)
+    throw std::exception("Depth pyramids need a non-empty depth image.");
+  if (m_levels.empty() || m_levels[0].Width != depth.GetWidth() ||
+      m_levels[0].Height != depth.GetHeight()) {
+    m_levels.clear();
+    uint32_t width = depth.GetWidth(), height = depth.GetHeight();
+    while (true) {
+      Level level;
+      level.Width = width;
+      level.Height = height;
+      // Level 0 is the source itself; only the reduced levels need a max.
+      level.Min.resize(width * height);
+      if (!m_levels.empty())
+        level.Max.resize(width * height);
+      m_levels.push_back(std::move(level));
+      if (width == 1 && height == 1)
+        break;
+      width = (width + 1) / 2;
+      height = (height + 1) / 2;
+    }
+  }
+  Level &top = m_levels[0];
+  for (uint32_t y = 0; y < top.Height; ++y) {
+    const float *row = reinterpret_cast<const float *>(
+        reinterpret_cast<const uint8_t *>(depth.GetData()) +
+        depth.GetStride() * y);
+    std::copy(row, row + top.Width, &top.Min[y * top.Width]);
+  }
+  for (size_t i = 1; i < m_levels.size(); ++i) {
+    const Level &src = m_levels[i - 1];
+    Level &dst = m_levels[i];
+    const float *srcMax = src.Max.empty() ? &src.Min[0] : &src.Max[0];
+    ParallelFor(dst.Height, [&](uint32_t y) {
+      ReduceRow(&src.Min[0], srcMax, src.Width, src.Height, &dst.Min[0],
+                &dst.Max[0], dst.Width, y);
+    });
+  }
+}
+
+uint32_t DepthPyramid::GetLevelCount() const {
+  return (uint32_t)m_levels.size();
+}
+
+uint32_t DepthPyramid::GetWidth(uint32_t level) const {
+  return m_levels[level].Width;
+}
+
+uint32_t DepthPyramid::GetHeight(uint32_t level) const {
+  return m_levels[level].Height;
+}
+
+const float *DepthPyramid::GetMin(uint32_t level) const {
+  return &m_levels[level].Min[0];
+}
+
+const float *DepthPyramid::GetMax(uint32_t level) const {
+  return level == 0 ? &m_levels[0].Min[0] : &m_levels[level].Max[0];
+}
+
+DepthRange DepthPyramid::GetDepthRange(int32_t x0, int32_t y0, int32_t x1,
+                                       int32_t y1) const {
+  x0 = std::max(x0, 0);
+  y0 = std::max(y0, 0);
+  x1 = std::min(x1, (int32_t)m_levels[0].Width);
+  y1 = std::min(y1, (int32_t)m_levels[0].Height);
+  if (x0 >= x1 || y0 >= y1)
+    return {1, 0};
+  // Inclusive texel bounds; each level halves them.
+  x1 -= 1;
+  y1 -= 1;
+  uint32_t level = 0;
+  while (level + 1 < m_levels.size() &&
+         (x1 - x0 >= QUERY_TEXELS || y1 - y0 >= QUERY_TEXELS)) {
+    x0 >>= 1;
+    y0 >>= 1;
+    x1 >>= 1;
+    y1 >>= 1;
+    ++level;
+  }
+  const Level &data = m_levels[level];
+  const float *minData = GetMin(level);
+  const float *maxData = GetMax(level);
+  DepthRange range = {INFINITY, -INFINITY};
+  for (int32_t y = y0; y <= y1; ++y) {
+    for (int32_t x = x0; x <= x1; ++x) {
+      range.Min = std::min(range.Min, minData[x + y * data.Width]);
+      range.Max = std::max(range.Max, maxData[x + y * data.Width]);
+    }
+  }
+  return range;
+}
+
+bool DepthPyramid::IsVisible(int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+                             float depth) const {
+  DepthRange range = GetDepthRange(x0, y0, x1, y1);
+  if (range.Min > range.Max)
+    return false;
+  return depth <= range.Max;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Core_IImage.h"
+#include "Core_Object.h"
+#include <cstdint>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Hierarchical-Z Depth Pyramid
+//
+// A CPU min/max mip chain of a depth image (a shadow map read back from the
+// GPU, SoftwareRasterizer::CopyDepth, etc). Each level halves the previous
+// one rounding up, so odd sizes are fine; a texel whose 2x2 footprint runs
+// off the edge only reduces the texels that exist. Every texel therefore
+// bounds exactly the pixels beneath it and queries are conservative.
+//
+// Levels are reduced with SSE2, four output texels at a time, in parallel
+// over rows.
+//
+// Depth follows the D3D convention of the samples: larger is farther and the
+// depth test is LESS. Testing this frame's bounds against last frame's depth
+// is cheap but only approximate while the camera moves; reproject (render the
+// previous depth from the new view) first if that matters.
+////////////////////////////////////////////////////////////////////////////////
+
+struct DepthRange {
+  float Min;
+  float Max;
+};
+
+class DepthPyramid : public Object {
+public:
+  // The image must be R32_FLOAT or D32_FLOAT.
+  DepthPyramid(const IImage &depth);
+  // Rebuild from a new depth image, keeping storage if the size is unchanged.
+  void Update(const IImage &depth);
+  uint32_t GetLevelCount() const;
+  uint32_t GetWidth(uint32_t level = 0) const;
+  uint32_t GetHeight(uint32_t level = 0) const;
+  // Tightly packed rows of a level; level 0 is the source depth for both.
+  const float *GetMin(uint32_t level) const;
+  const float *GetMax(uint32_t level) const;
+  // Bounds of the depth in the pixel rect [x0, x1) x [y0, y1) of level 0,
+  // clipped to the image. An empty rect gives {1, 0}.
+  DepthRange GetDepthRange(int32_t x0, int32_t y0, int32_t x1,
+                           int32_t y1) const;
+  // False only if every pixel of the rect is nearer than depth, i.e. something
+  // at that depth would certainly fail the depth test everywhere. Rects
+  // entirely off the image are not visible.
+  bool IsVisible(int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+                 float depth) const;
+
+private:
+  struct Level {
+    uint32_t Width;
+    uint32_t Height;
+    std::vector<float> Min;
+    std::vector<float> Max;
+  };
+  std::vector<Level> m_levels;
+};
\ No newline at end of file
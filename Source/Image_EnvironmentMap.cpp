@@ -0,0 +1,172 @@
+#include "Image_EnvironmentMap.h"
+#include <exception>
+#include <math.h>
+#include <vector>
+
+EnvironmentMapSampler::EnvironmentMapSampler(std::shared_ptr<IImage> image)
+    : m_image(image) {
+  if (m_image->GetFormat() != DXGI_FORMAT_R32G32B32_FLOAT &&
+      m_image->GetFormat() != DXGI_FORMAT_R32G32B32A32_FLOAT)
+    throw std::exception("Environment maps must be float RGB images.");
+  const uint32_t width = m_image->GetWidth();
+  const uint32_t height = m_image->GetHeight();
+  if (width * 4 == height * 3) {
+    m_isCross = true;
+    m_faceSize = height / 4;
+  } else if (width == height * 2) {
+    m_isCross = false;
+    m_faceSize = 0;
+  } else {
+    throw std::exception("Environment maps must be 3:4 cross or 2:1 latlong.");
+  }
+  // Weight = luminance * solid angle, so the table samples radiant power.
+  std::vector<float> weights(width * height);
+  for (uint32_t y = 0; y < height; ++y) {
+    for (uint32_t x = 0; x < width; ++x) {
+      Vector3 rgb = ReadPixel(x, y);
+      float luminance = 0.2126f * rgb.X + 0.7152f * rgb.Y + 0.0722f * rgb.Z;
+      weights[x + y * width] = luminance * PixelSolidAngle(x, y);
+    }
+  }
+  m_table = AliasTable(weights.data(), width * height);
+}
+
+Vector3 EnvironmentMapSampler::Sample(const Vector3 &random,
+                                      float &pdf) const {
+  const uint32_t width = m_image->GetWidth();
+  float pixelPdf;
+  uint32_t index = m_table.Sample(random.X, pixelPdf);
+  uint32_t x = index % width;
+  uint32_t y = index / width;
+  Vector3 direction;
+  if (!PixelToDirection(x + random.Y, y + random.Z, direction)) {
+    // Only reachable if the table picked a zero weight pixel.
+    pdf = 0;
+    return {0, 1, 0};
+  }
+  pdf = pixelPdf / PixelSolidAngle(x, y);
+  return direction;
+}
+
+float EnvironmentMapSampler::Pdf(const Vector3 &direction) const {
+  uint32_t x, y;
+  if (!DirectionToPixel(direction, x, y))
+    return 0;
+  return m_table.Pdf(x + y * m_image->GetWidth()) / PixelSolidAngle(x, y);
+}
+
+Vector3 EnvironmentMapSampler::Lookup(const Vector3 &direction) const {
+  uint32_t x, y;
+  if (!DirectionToPixel(direction, x, y))
+    return {0, 0, 0};
+  return ReadPixel(x, y);
+}
+
+const AliasTable &EnvironmentMapSampler::GetAliasTable() const {
+  return m_table;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Layout mapping.
+//
+// The cross layout matches Sample_D3D11LightProbeCross.cs.hlsl; each face cell
+// maps its local [-1, 1] coordinates (a, b) onto one face of the unit cube.
+
+bool EnvironmentMapSampler::PixelToDirection(float x, float y,
+                                             Vector3 &direction) const {
+  if (m_isCross) {
+    const float faceSize = (float)m_faceSize;
+    int cellX = (int)(x / faceSize);
+    int cellY = (int)(y / faceSize);
+    float a = (x - (cellX * faceSize + faceSize / 2)) / (faceSize / 2);
+    float b = (y - (cellY * faceSize + faceSize / 2)) / (faceSize / 2);
+    if (cellX == 2 && cellY == 1)
+      direction = {1, -b, a}; // Right
+    else if (cellX == 0 && cellY == 1)
+      direction = {-1, -b, -a}; // Left
+    else if (cellX == 1 && cellY == 0)
+      direction = {a, 1, -b}; // Top
+    else if (cellX == 1 && cellY == 2)
+      direction = {a, -1, b}; // Bottom
+    else if (cellX == 1 && cellY == 3)
+      direction = {a, b, 1}; // Back
+    else if (cellX == 1 && cellY == 1)
+      direction = {a, -b, -1}; // Front
+    else
+      return false;
+    direction = Normalize(direction);
+    return true;
+  }
+  float phi = 2 * Pi<float> * x / m_image->GetWidth();
+  float theta = Pi<float> * y / m_image->GetHeight();
+  direction = {Sin(phi) * Sin(theta), Cos(theta), Cos(phi) * Sin(theta)};
+  return true;
+}
+
+bool EnvironmentMapSampler::DirectionToPixel(const Vector3 &direction,
+                                             uint32_t &x, uint32_t &y) const {
+  float px, py;
+  if (m_isCross) {
+    const float face = (float)m_faceSize;
+    const float half = face / 2;
+    float ax = fabsf(direction.X), ay = fabsf(direction.Y),
+          az = fabsf(direction.Z);
+    float chebychev = ax > ay ? (ax > az ? ax : az) : (ay > az ? ay : az);
+    if (chebychev == 0)
+      return false;
+    Vector3 d = direction * (1 / chebychev);
+    if (ax >= ay && ax >= az) {
+      px = d.X > 0 ? half + face * 2 + d.Z * half : half - d.Z * half;
+      py = half + face - d.Y * half;
+    } else if (ay >= az) {
+      px = half + face + d.X * half;
+      py = d.Y > 0 ? half - d.Z * half : half + face * 2 + d.Z * half;
+    } else {
+      px = half + face + d.X * half;
+      py = d.Z > 0 ? half + face * 3 + d.Y * half : half + face - d.Y * half;
+    }
+  } else {
+    float phi = atan2f(direction.X, direction.Z);
+    if (phi < 0)
+      phi += 2 * Pi<float>;
+    float cosTheta = direction.Y;
+    cosTheta = cosTheta < -1 ? -1 : (cosTheta > 1 ? 1 : cosTheta);
+    px = phi / (2 * Pi<float>) * m_image->GetWidth();
+    py = acosf(cosTheta) / Pi<float> * m_image->GetHeight();
+  }
+  x = px < 0 ? 0 : (uint32_t)px;
+  y = py < 0 ? 0 : (uint32_t)py;
+  x = x < m_image->GetWidth() ? x : m_image->GetWidth() - 1;
+  y = y < m_image->GetHeight() ? y : m_image->GetHeight() - 1;
+  return true;
+}
+
+float EnvironmentMapSampler::PixelSolidAngle(uint32_t x, uint32_t y) const {
+  if (m_isCross) {
+    Vector3 direction;
+    if (!PixelToDirection(x + 0.5f, y + 0.5f, direction))
+      return 0;
+    // A texel of side 2/F on the unit cube at local (a, b) subtends
+    // (2/F)^2 / (1 + a^2 + b^2)^(3/2) steradians.
+    const float faceSize = (float)m_faceSize;
+    float a = (x + 0.5f - ((int)(x / m_faceSize) * faceSize + faceSize / 2)) /
+              (faceSize / 2);
+    float b = (y + 0.5f - ((int)(y / m_faceSize) * faceSize + faceSize / 2)) /
+              (faceSize / 2);
+    float texel = 2 / faceSize;
+    float r2 = 1 + a * a + b * b;
+    return texel * texel / (r2 * SquareRoot(r2));
+  }
+  float theta = Pi<float> * (y + 0.5f) / m_image->GetHeight();
+  return (2 * Pi<float> / m_image->GetWidth()) *
+         (Pi<float> / m_image->GetHeight()) * Sin(theta);
+}
+
+Vector3 EnvironmentMapSampler::ReadPixel(uint32_t x, uint32_t y) const {
+  uint32_t channels =
+      m_image->GetFormat() == DXGI_FORMAT_R32G32B32A32_FLOAT ? 4 : 3;
+  const float *row = reinterpret_cast<const float *>(
+      reinterpret_cast<const uint8_t *>(m_image->GetData()) +
+      m_image->GetStride() * y);
+  return {row[x * channels + 0], row[x * channels + 1], row[x * channels + 2]};
+}
\ No newline at end of file
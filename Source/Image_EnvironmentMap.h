@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Core_IImage.h"
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Core_Sampling.h"
+#include <memory>
+
+////////////////////////////////////////////////////////////////////////////////
+// Environment Map Importance Sampling
+//
+// Turns a float RGB environment (as returned by Load_HDR) into a piecewise
+// constant distribution over its pixels, weighted by luminance and by the
+// solid angle each pixel covers. Pixels are picked with an O(1) alias table
+// and jittered inside the pixel, so bright features like the sun are found
+// directly instead of waiting for a hemisphere sample to stumble onto them.
+//
+// Two layouts are understood, chosen from the image aspect:
+//   3:4 - Vertical cross cubemap (grace_cross.hdr), matching the face layout
+//         used by Sample_D3D11LightProbeCross.
+//   2:1 - Equirectangular latitude/longitude map, matching the orientation
+//         of Sphere.
+////////////////////////////////////////////////////////////////////////////////
+
+class EnvironmentMapSampler : public Object {
+public:
+  EnvironmentMapSampler(std::shared_ptr<IImage> image);
+  // Pick a direction from three uniform random numbers in [0, 1).
+  // The returned pdf is with respect to solid angle.
+  Vector3 Sample(const Vector3 &random, float &pdf) const;
+  // Solid angle pdf of Sample() producing this (normalized) direction.
+  float Pdf(const Vector3 &direction) const;
+  // Radiance seen along a (normalized) direction.
+  Vector3 Lookup(const Vector3 &direction) const;
+  // The pixel distribution; upload this to sample on the GPU.
+  const AliasTable &GetAliasTable() const;
+
+private:
+  bool PixelToDirection(float x, float y, Vector3 &direction) const;
+  bool DirectionToPixel(const Vector3 &direction, uint32_t &x,
+                        uint32_t &y) const;
+  float PixelSolidAngle(uint32_t x, uint32_t y) const;
+  Vector3 ReadPixel(uint32_t x, uint32_t y) const;
+  std::shared_ptr<IImage> m_image;
+  bool m_isCross;
+  uint32_t m_faceSize;
+  AliasTable m_table;
+};
\ No newline at end of file
@@ -29,6 +29,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     std::shared_ptr<Object> D3D11DXGICapture = CreateNewWindow(deviceD3D11, CreateSample_D3D11DXGICapture(deviceD3D11));
     std::shared_ptr<Object> D3D11Font = CreateNewWindow(deviceD3D11, CreateSample_D3D11Font(deviceD3D11));
     std::shared_ptr<Object> D3D11FreeType = CreateNewWindow(deviceD3D11, CreateSample_Image_FreeTypeAtlas());
+    std::shared_ptr<Object> D3D11Impostors = CreateNewWindow(deviceD3D11, CreateSample_D3D11Impostors(deviceD3D11, Scene_Default()));
     std::shared_ptr<Object> D3D11Keyboard = CreateNewWindow(deviceD3D11, CreateSample_D3D11Keyboard);
     std::shared_ptr<Object> D3D11MarchingTetrahedra = CreateNewWindow(deviceD3D11, CreateSample_D3D11MarchingTetrahedra(deviceD3D11));
     //std::shared_ptr<Object> D3D11LightProbe = CreateNewWindow(deviceD3D11, CreateSample_D3D11LightProbe(deviceD3D11));
@@ -0,0 +1,265 @@
+///////////////////////////////////////////////////////////////////////////////
+// Sample - Direct3D 11 Impostors
+///////////////////////////////////////////////////////////////////////////////
+// This sample renders a scene through an ImpostorSwapper. Instances near the
+// camera are drawn as meshes; anything further away is drawn as a single quad
+// textured with the closest baked view of its octahedral impostor. The baked
+// depth moves each impostor pixel onto the surface it stands for.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Core_D3D.h"
+#include "Core_D3D11Util.h"
+#include "Core_D3DCompiler.h"
+#include "Core_DXGI.h"
+#include "Core_Math.h"
+#include "Core_Util.h"
+#include "MutableMap.h"
+#include "SampleResources.h"
+#include "Scene_IMesh.h"
+#include "Scene_Impostor.h"
+#include "Scene_InstanceTable.h"
+#include <array>
+#include <atlbase.h>
+#include <functional>
+#include <vector>
+
+// Instances whose bounding sphere center is further than this from the
+// camera are replaced by impostors.
+static const float IMPOSTOR_DISTANCE = 6;
+
+// Where an impostor view lives in the atlas.
+__declspec(align(16)) struct ConstantsImpostor {
+  Vector2 TexcoordOffset;
+  Vector2 TexcoordScale;
+};
+
+std::function<void(const SampleResourcesD3D11 &)>
+CreateSample_D3D11Impostors(std::shared_ptr<Direct3D11Device> device,
+                            const std::vector<Instance> &scene) {
+  ////////////////////////////////////////////////////////////////////////////////
+  // Create all the shaders that we might need.
+  const char *szShaderCode = R"SHADER(
+#include "Sample_D3D11_Common.inc"
+
+cbuffer ConstantsImpostor : register(b2)
+{
+    float2 ImpostorTexcoordOffset;
+    float2 ImpostorTexcoordScale;
+};
+
+float4 mainPS(VertexPS vin) : SV_Target
+{
+    float3 p = vin.WorldPosition;
+    float3 n = vin.Normal;
+    float3 l = normalize(float3(1, 4, -1) - p);
+    float illum = dot(n, l);
+    return float4(illum, illum, illum, 1);
+}
+
+float4 mainPSImpostor(VertexPS vin, out float depth : SV_Depth) : SV_Target
+{
+    ////////////////////////////////////////////////////////////////////////////////
+    // The quad covers one view of the atlas; coverage is in albedo alpha.
+    float2 uv = ImpostorTexcoordOffset + ImpostorTexcoordScale * vin.Texcoord;
+    float4 texelAlbedo = TextureAlbedoMap.Sample(SamplerDefaultWrap, uv);
+    if (texelAlbedo.w < 0.5) discard;
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // The quad passes through the center of the bounding sphere and its z axis
+    // spans the radius toward the viewer; depth runs from the front of the
+    // sphere (0) to the back (1). Moving onto the baked surface lets impostors
+    // intersect each other and the meshes around them. The top mip is read so
+    // empty texels at the silhouette do not push the depth back.
+    float texelDepth = TextureDepthMap.SampleLevel(SamplerDefaultWrap, uv, 0).r;
+    float3 axis = mul(TransformObjectToWorld, float4(0, 0, 1, 0)).xyz;
+    float3 p = vin.WorldPosition + axis * (1 - 2 * texelDepth);
+    float4 clip = mul(TransformWorldToClip, float4(p, 1));
+    depth = clip.z / clip.w;
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Normals are baked in the space of the quad.
+    float3 texelNormal = TextureNormalMap.Sample(SamplerDefaultWrap, uv).xyz * 2 - 1;
+    float3 n = normalize(mul(TransformObjectToWorld, float4(texelNormal, 0)).xyz);
+    float3 l = normalize(float3(1, 4, -1) - p);
+    float illum = dot(n, l);
+    return float4(texelAlbedo.xyz * illum, 1);
+})SHADER";
+  CComPtr<ID3D11VertexShader> shaderVertex;
+  CComPtr<ID3DBlob> blobShaderVertex =
+      CompileShader("vs_5_0", "mainVS", szShaderCode);
+  TRYD3D(device->GetID3D11Device()->CreateVertexShader(
+      blobShaderVertex->GetBufferPointer(), blobShaderVertex->GetBufferSize(),
+      nullptr, &shaderVertex.p));
+  CComPtr<ID3D11PixelShader> shaderPixel;
+  {
+    CComPtr<ID3DBlob> blob = CompileShader("ps_5_0", "mainPS", szShaderCode);
+    TRYD3D(device->GetID3D11Device()->CreatePixelShader(
+        blob->GetBufferPointer(), blob->GetBufferSize(), nullptr,
+        &shaderPixel.p));
+  }
+  CComPtr<ID3D11PixelShader> shaderPixelImpostor;
+  {
+    CComPtr<ID3DBlob> blob =
+        CompileShader("ps_5_0", "mainPSImpostor", szShaderCode);
+    TRYD3D(device->GetID3D11Device()->CreatePixelShader(
+        blob->GetBufferPointer(), blob->GetBufferSize(), nullptr,
+        &shaderPixelImpostor.p));
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Create the input vertex layout.
+  CComPtr<ID3D11InputLayout> inputLayout;
+  {
+    std::array<D3D11_INPUT_ELEMENT_DESC, 3> desc = {};
+    desc[0].SemanticName = "SV_Position";
+    desc[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
+    desc[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+    desc[0].AlignedByteOffset = offsetof(VertexVS, Position);
+    desc[1].SemanticName = "NORMAL";
+    desc[1].Format = DXGI_FORMAT_R32G32B32_FLOAT;
+    desc[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+    desc[1].AlignedByteOffset = offsetof(VertexVS, Normal);
+    desc[2].SemanticName = "TEXCOORD";
+    desc[2].Format = DXGI_FORMAT_R32G32_FLOAT;
+    desc[2].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+    desc[2].AlignedByteOffset = offsetof(VertexVS, Texcoord);
+    TRYD3D(device->GetID3D11Device()->CreateInputLayout(
+        &desc[0], desc.size(), blobShaderVertex->GetBufferPointer(),
+        blobShaderVertex->GetBufferSize(), &inputLayout));
+  }
+  CComPtr<ID3D11Buffer> constantsWorld =
+      D3D11_Create_Buffer(device->GetID3D11Device(), D3D11_BIND_CONSTANT_BUFFER,
+                          sizeof(ConstantsWorld));
+  // The swapper rewrites impostor transforms in place every frame, so object
+  // constants are uploaded per draw rather than cached by transform.
+  CComPtr<ID3D11Buffer> constantsObject =
+      D3D11_Create_Buffer(device->GetID3D11Device(), D3D11_BIND_CONSTANT_BUFFER,
+                          sizeof(ConstantsObject));
+  CComPtr<ID3D11Buffer> constantsImpostor =
+      D3D11_Create_Buffer(device->GetID3D11Device(), D3D11_BIND_CONSTANT_BUFFER,
+                          sizeof(ConstantsImpostor));
+  CComPtr<ID3D11SamplerState> samplerDefaultWrap;
+  TRYD3D(device->GetID3D11Device()->CreateSamplerState(
+      &Make_D3D11_SAMPLER_DESC_DefaultWrap(), &samplerDefaultWrap.p));
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Geometry and impostor atlases are created on first use.
+  MutableMap<const IMesh *, CComPtr<ID3D11Buffer>> factoryIndex;
+  factoryIndex.fnGenerator = [=](const IMesh *mesh) {
+    int sizeIndices = sizeof(int32_t) * mesh->getIndexCount();
+    std::unique_ptr<int8_t[]> bytesIndex(new int8_t[sizeIndices]);
+    mesh->copyIndices(reinterpret_cast<uint32_t *>(bytesIndex.get()),
+                      sizeof(uint32_t));
+    return D3D11_Create_Buffer(device->GetID3D11Device(),
+                               D3D11_BIND_INDEX_BUFFER, sizeIndices,
+                               bytesIndex.get());
+  };
+  MutableMap<const IMesh *, CComPtr<ID3D11Buffer>> factoryVertex;
+  factoryVertex.fnGenerator = [=](const IMesh *mesh) {
+    int sizeVertex = sizeof(VertexVS) * mesh->getVertexCount();
+    std::unique_ptr<int8_t[]> bytesVertex(new int8_t[sizeVertex]);
+    mesh->copyVertices(bytesVertex.get() + offsetof(VertexVS, Position),
+                       sizeof(VertexVS));
+    mesh->copyNormals(bytesVertex.get() + offsetof(VertexVS, Normal),
+                      sizeof(VertexVS));
+    mesh->copyTexcoords(bytesVertex.get() + offsetof(VertexVS, Texcoord),
+                        sizeof(VertexVS));
+    return D3D11_Create_Buffer(device->GetID3D11Device(),
+                               D3D11_BIND_VERTEX_BUFFER, sizeVertex,
+                               bytesVertex.get());
+  };
+  MutableMap<const IImage *, CComPtr<ID3D11ShaderResourceView>> factoryTexture;
+  factoryTexture.fnGenerator = [=](const IImage *image) {
+    return D3D11_Create_SRV(device->GetID3D11DeviceContext(), image);
+  };
+  std::shared_ptr<ImpostorSwapper> swapper(new ImpostorSwapper(scene));
+
+  return [=](const SampleResourcesD3D11 &sampleResources) {
+    D3D11_TEXTURE2D_DESC descBackbuffer = {};
+    sampleResources.BackBufferTexture->GetDesc(&descBackbuffer);
+    CComPtr<ID3D11RenderTargetView> rtvBackbuffer =
+        D3D11_Create_RTV_From_Texture2D(device->GetID3D11Device(),
+                                        sampleResources.BackBufferTexture);
+    device->GetID3D11DeviceContext()->ClearState();
+    device->GetID3D11DeviceContext()->IASetPrimitiveTopology(
+        D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    device->GetID3D11DeviceContext()->IASetInputLayout(inputLayout);
+    device->GetID3D11DeviceContext()->PSSetSamplers(kSamplerRegisterDefaultWrap,
+                                                    1, &samplerDefaultWrap.p);
+    device->GetID3D11DeviceContext()->VSSetShader(shaderVertex, nullptr, 0);
+    ////////////////////////////////////////////////////////////////////////////////
+    // The camera sits at the origin of view space.
+    Matrix44 viewToWorld = Invert(sampleResources.TransformWorldToView);
+    Vector3 cameraPosition = {viewToWorld.M41, viewToWorld.M42,
+                              viewToWorld.M43};
+    {
+      ConstantsWorld data = {};
+      data.TransformWorldToClip = sampleResources.TransformWorldToClip;
+      data.TransformWorldToView = sampleResources.TransformWorldToView;
+      data.CameraPosition = cameraPosition;
+      device->GetID3D11DeviceContext()->UpdateSubresource(constantsWorld, 0,
+                                                          nullptr, &data, 0, 0);
+    }
+    ID3D11Buffer *constants[] = {constantsWorld, constantsObject,
+                                 constantsImpostor};
+    device->GetID3D11DeviceContext()->VSSetConstantBuffers(0, 3, constants);
+    device->GetID3D11DeviceContext()->PSSetConstantBuffers(0, 3, constants);
+    device->GetID3D11DeviceContext()->ClearRenderTargetView(
+        rtvBackbuffer, &std::array<FLOAT, 4>{0.1f, 0.1f, 0.1f, 1.0f}[0]);
+    device->GetID3D11DeviceContext()->ClearDepthStencilView(
+        sampleResources.DepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+    device->GetID3D11DeviceContext()->RSSetViewports(
+        1, &Make_D3D11_VIEWPORT(descBackbuffer.Width, descBackbuffer.Height));
+    device->GetID3D11DeviceContext()->OMSetRenderTargets(
+        1, &rtvBackbuffer.p, sampleResources.DepthStencilView);
+    ////////////////////////////////////////////////////////////////////////////////
+    // Draw the swapped scene.
+    for (const Instance &instance :
+         swapper->Update(cameraPosition, IMPOSTOR_DISTANCE)) {
+      {
+        ConstantsObject data = {};
+        data.TransformObjectToWorld = *instance.TransformObjectToWorld;
+        device->GetID3D11DeviceContext()->UpdateSubresource(
+            constantsObject, 0, nullptr, &data, 0, 0);
+      }
+      ImpostorMaterial *impostor =
+          dynamic_cast<ImpostorMaterial *>(instance.Material.get());
+      if (impostor != nullptr) {
+        ConstantsImpostor data = {};
+        data.TexcoordOffset = impostor->TexcoordOffset;
+        data.TexcoordScale = impostor->TexcoordScale;
+        device->GetID3D11DeviceContext()->UpdateSubresource(
+            constantsImpostor, 0, nullptr, &data, 0, 0);
+        CComPtr<ID3D11ShaderResourceView> srvAlbedoMap =
+            factoryTexture(impostor->AlbedoMap.get());
+        device->GetID3D11DeviceContext()->PSSetShaderResources(
+            kTextureRegisterAlbedoMap, 1, &srvAlbedoMap.p);
+        CComPtr<ID3D11ShaderResourceView> srvNormalMap =
+            factoryTexture(impostor->NormalMap.get());
+        device->GetID3D11DeviceContext()->PSSetShaderResources(
+            kTextureRegisterNormalMap, 1, &srvNormalMap.p);
+        CComPtr<ID3D11ShaderResourceView> srvDepthMap =
+            factoryTexture(impostor->DepthMap.get());
+        device->GetID3D11DeviceContext()->PSSetShaderResources(
+            kTextureRegisterDepthMap, 1, &srvDepthMap.p);
+        device->GetID3D11DeviceContext()->PSSetShader(shaderPixelImpostor,
+                                                      nullptr, 0);
+      } else {
+        device->GetID3D11DeviceContext()->PSSetShader(shaderPixel, nullptr, 0);
+      }
+      {
+        const UINT vertexStride[] = {sizeof(VertexVS)};
+        const UINT vertexOffset[] = {0};
+        auto vb = factoryVertex(instance.Mesh.get());
+        device->GetID3D11DeviceContext()->IASetVertexBuffers(
+            0, 1, &vb.p, vertexStride, vertexOffset);
+      }
+      auto ib = factoryIndex(instance.Mesh.get());
+      device->GetID3D11DeviceContext()->IASetIndexBuffer(
+          ib, DXGI_FORMAT_R32_UINT, 0);
+      device->GetID3D11DeviceContext()->DrawIndexed(
+          instance.Mesh->getIndexCount(), 0, 0);
+    }
+    device->GetID3D11DeviceContext()->ClearState();
+    device->GetID3D11DeviceContext()->Flush();
+  };
+}
\ No newline at end of file
@@ -15,6 +15,7 @@
 #include "Core_Util.h"
 #include "ImageUtil.h"
 #include "SampleResources.h"
+#include "Scene_Normals.h"
 #include <array>
 #include <atlbase.h>
 #include <functional>
@@ -40,12 +41,14 @@ CreateSample_D3D11MarchingTetrahedra(std::shared_ptr<Direct3D11Device> device) {
 struct VertexIn
 {
   float4 Position : SV_Position;
+  float3 Normal : NORMAL;
   float4 Color : COLOR;
 };
 
 struct VertexOut
 {
   float4 Position : SV_Position;
+  float3 Normal : NORMAL;
   float4 Color : COLOR;
 };
 
@@ -53,13 +56,15 @@ VertexOut mainVS(VertexIn vin)
 {
   VertexOut vout;
   vout.Position = mul(TransformWorldToClip, vin.Position);
+  vout.Normal = vin.Normal;
   vout.Color = vin.Color;
   return vout;
 }
 
 float4 mainPS(VertexOut vin) : SV_Target
 {
-    return float4(vin.Color.rgb, 1);
+    float light = saturate(dot(normalize(vin.Normal), LightPosition));
+    return float4(vin.Color.rgb * (0.2 + 0.8 * light), 1);
 })SHADER";
   CComPtr<ID3D11VertexShader> shaderVertex;
   CComPtr<ID3D11InputLayout> inputLayout;
@@ -69,15 +74,19 @@ float4 mainPS(VertexOut vin) : SV_Target
         blobVS->GetBufferPointer(), blobVS->GetBufferSize(), nullptr,
         &shaderVertex));
     {
-      std::array<D3D11_INPUT_ELEMENT_DESC, 2> inputdesc = {};
+      std::array<D3D11_INPUT_ELEMENT_DESC, 3> inputdesc = {};
       inputdesc[0].SemanticName = "SV_Position";
       inputdesc[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
       inputdesc[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-      inputdesc[0].AlignedByteOffset = offsetof(VertexCol, Position);
-      inputdesc[1].SemanticName = "COLOR";
-      inputdesc[1].Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+      inputdesc[0].AlignedByteOffset = offsetof(VertexColNorm, Position);
+      inputdesc[1].SemanticName = "NORMAL";
+      inputdesc[1].Format = DXGI_FORMAT_R32G32B32_FLOAT;
       inputdesc[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-      inputdesc[1].AlignedByteOffset = offsetof(VertexCol, Color);
+      inputdesc[1].AlignedByteOffset = offsetof(VertexColNorm, Normal);
+      inputdesc[2].SemanticName = "COLOR";
+      inputdesc[2].Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+      inputdesc[2].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+      inputdesc[2].AlignedByteOffset = offsetof(VertexColNorm, Color);
       TRYD3D(device->GetID3D11Device()->CreateInputLayout(
           &inputdesc[0], inputdesc.size(), blobVS->GetBufferPointer(),
           blobVS->GetBufferSize(), &inputLayout));
@@ -256,10 +265,25 @@ float4 mainPS(VertexOut vin) : SV_Target
         }
       }
     }
+    // Smooth the triangle soup; the same surface point is interpolated
+    // separately in every tetrahedron which touches it, so the normals are
+    // generated over welded positions.
     vertexCount = vertices.size();
-    bufferVertex =
-        D3D11_Create_Buffer(device->GetID3D11Device(), D3D11_BIND_VERTEX_BUFFER,
-                            sizeof(VertexCol) * vertexCount, &vertices[0]);
+    std::vector<Vector3> positions(vertexCount);
+    std::vector<uint32_t> indices(vertexCount);
+    for (int i = 0; i < vertexCount; ++i) {
+      positions[i] = vertices[i].Position;
+      indices[i] = i;
+    }
+    std::vector<Vector3> normals =
+        GenerateNormals(positions, indices, NormalWeightingAngle);
+    std::vector<VertexColNorm> verticesLit(vertexCount);
+    for (int i = 0; i < vertexCount; ++i) {
+      verticesLit[i] = {vertices[i].Position, normals[i], vertices[i].Color};
+    }
+    bufferVertex = D3D11_Create_Buffer(
+        device->GetID3D11Device(), D3D11_BIND_VERTEX_BUFFER,
+        sizeof(VertexColNorm) * vertexCount, &verticesLit[0]);
   }
   return [=](const SampleResourcesD3D11 &sampleResources) {
     D3D11_TEXTURE2D_DESC descBackbuffer = {};
@@ -304,7 +328,7 @@ float4 mainPS(VertexOut vin) : SV_Target
         D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
     device->GetID3D11DeviceContext()->IASetInputLayout(inputLayout);
     {
-      UINT uStrides[] = {sizeof(VertexCol)};
+      UINT uStrides[] = {sizeof(VertexColNorm)};
       UINT uOffsets[] = {0};
       device->GetID3D11DeviceContext()->IASetVertexBuffers(
           0, 1, &bufferVertex.p, uStrides, uOffsets);
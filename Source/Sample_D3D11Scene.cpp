@@ -1,7 +1,9 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Sample - Direct3D 11 Scene
 ///////////////////////////////////////////////////////////////////////////////
-// This sample renders the contents of a Scene object with Direct3D 11.
+// This sample renders the contents of a Scene object with Direct3D 11. If the
+// scene's transforms come from a SceneGraph, pass it in; the graph is updated
+// every frame and the constants of the nodes which moved are uploaded again.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "Core_D3D.h"
@@ -17,6 +19,9 @@
 #include "Scene_IMaterial.h"
 #include "Scene_IMesh.h"
 #include "Scene_InstanceTable.h"
+#include "Scene_OcclusionCuller.h"
+#include "Scene_SceneGraph.h"
+#include "Scene_Tangents.h"
 #include <array>
 #include <atlbase.h>
 #include <functional>
@@ -28,7 +33,8 @@
 
 std::function<void(const SampleResourcesD3D11 &)>
 CreateSample_D3D11Scene(std::shared_ptr<Direct3D11Device> device,
-                        const std::vector<Instance> &scene) {
+                        const std::vector<Instance> &scene,
+                        std::shared_ptr<SceneGraph> graph) {
   ////////////////////////////////////////////////////////////////////////////////
   // Create all the shaders that we might need.
   const char *szShaderCode = R"SHADER(
@@ -52,7 +58,7 @@ float4 mainPSOBJDepthOnly(VertexPS vin) : SV_Target
     return float4(1, 1, 1, 1);
 }
 
-float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
+float4 mainPSOBJMaterial(VertexTangentPS vin) : SV_Target
 {
     ////////////////////////////////////////////////////////////////////////////////
     // Alpha Masking (Alpha Test)
@@ -65,8 +71,8 @@ float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
 
     ////////////////////////////////////////////////////////////////////////////////
     // Normal Mapping.
-    // Calculate the normal (Pixel/Analytical Based).
-    float3x3 matTangentFrame = cotangent_frame(vin.Normal, vin.WorldPosition, vin.Texcoord);    
+    // Calculate the normal (Precomputed Vertex Tangents).
+    float3x3 matTangentFrame = tangent_frame(vin.Normal, vin.Tangent);
     float3 texelNormal = TextureNormalMap.Sample(SamplerDefaultWrap, vin.Texcoord).xyz * 2 - 1;
     float3 vectorNormal = normalize(mul(texelNormal, matTangentFrame));
 
@@ -82,7 +88,7 @@ float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
 })SHADER";
   CComPtr<ID3D11VertexShader> shaderVertex;
   CComPtr<ID3DBlob> blobShaderVertex =
-      CompileShader("vs_5_0", "mainVS", szShaderCode);
+      CompileShader("vs_5_0", "mainVSTangent", szShaderCode);
   TRYD3D(device->GetID3D11Device()->CreateVertexShader(
       blobShaderVertex->GetBufferPointer(), blobShaderVertex->GetBufferSize(),
       nullptr, &shaderVertex.p));
@@ -112,19 +118,23 @@ float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
   // Create the input vertex layout.
   CComPtr<ID3D11InputLayout> inputLayout;
   {
-    std::array<D3D11_INPUT_ELEMENT_DESC, 3> desc = {};
+    std::array<D3D11_INPUT_ELEMENT_DESC, 4> desc = {};
     desc[0].SemanticName = "SV_Position";
     desc[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
     desc[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-    desc[0].AlignedByteOffset = offsetof(VertexVS, Position);
+    desc[0].AlignedByteOffset = offsetof(VertexTangentVS, Position);
     desc[1].SemanticName = "NORMAL";
     desc[1].Format = DXGI_FORMAT_R32G32B32_FLOAT;
     desc[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-    desc[1].AlignedByteOffset = offsetof(VertexVS, Normal);
+    desc[1].AlignedByteOffset = offsetof(VertexTangentVS, Normal);
     desc[2].SemanticName = "TEXCOORD";
     desc[2].Format = DXGI_FORMAT_R32G32_FLOAT;
     desc[2].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-    desc[2].AlignedByteOffset = offsetof(VertexVS, Texcoord);
+    desc[2].AlignedByteOffset = offsetof(VertexTangentVS, Texcoord);
+    desc[3].SemanticName = "TANGENT";
+    desc[3].Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    desc[3].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+    desc[3].AlignedByteOffset = offsetof(VertexTangentVS, Tangent);
     TRYD3D(device->GetID3D11Device()->CreateInputLayout(
         &desc[0], desc.size(), blobShaderVertex->GetBufferPointer(),
         blobShaderVertex->GetBufferSize(), &inputLayout));
@@ -166,6 +176,14 @@ float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
                                sizeof(ConstantsObject), &data);
   };
 
+  // Meshes are drawn through a precomputed tangent stream, which splits the
+  // vertices on mirrored texcoord seams. Both buffers come from this mesh.
+  MutableMap<std::shared_ptr<IMesh>, std::shared_ptr<MeshWithTangents>>
+      factoryTangentMesh;
+  factoryTangentMesh.fnGenerator = [&](std::shared_ptr<IMesh> mesh) {
+    return std::shared_ptr<MeshWithTangents>(new MeshWithTangents(mesh));
+  };
+
   MutableMap<const IMesh *, CComPtr<ID3D11Buffer>> factoryIndex;
   factoryIndex.fnGenerator = [&](const IMesh *mesh) {
     int sizeIndices = sizeof(int32_t) * mesh->getIndexCount();
@@ -177,19 +195,26 @@ float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
                                bytesIndex.get());
   };
 
-  MutableMap<const IMesh *, CComPtr<ID3D11Buffer>> factoryVertex;
-  factoryVertex.fnGenerator = [&](const IMesh *mesh) {
-    int sizeVertex = sizeof(VertexVS) * mesh->getVertexCount();
+  MutableMap<const MeshWithTangents *, CComPtr<ID3D11Buffer>> factoryVertex;
+  factoryVertex.fnGenerator = [&](const MeshWithTangents *mesh) {
+    int sizeVertex = sizeof(VertexTangentVS) * mesh->getVertexCount();
     std::unique_ptr<int8_t[]> bytesVertex(new int8_t[sizeVertex]);
-    mesh->copyVertices(reinterpret_cast<Vector3 *>(
-                           bytesVertex.get() + offsetof(VertexVS, Position)),
-                       sizeof(VertexVS));
-    mesh->copyNormals(reinterpret_cast<Vector3 *>(bytesVertex.get() +
-                                                  offsetof(VertexVS, Normal)),
-                      sizeof(VertexVS));
-    mesh->copyTexcoords(reinterpret_cast<Vector2 *>(
-                            bytesVertex.get() + offsetof(VertexVS, Texcoord)),
-                        sizeof(VertexVS));
+    mesh->copyVertices(
+        reinterpret_cast<Vector3 *>(bytesVertex.get() +
+                                    offsetof(VertexTangentVS, Position)),
+        sizeof(VertexTangentVS));
+    mesh->copyNormals(
+        reinterpret_cast<Vector3 *>(bytesVertex.get() +
+                                    offsetof(VertexTangentVS, Normal)),
+        sizeof(VertexTangentVS));
+    mesh->copyTexcoords(
+        reinterpret_cast<Vector2 *>(bytesVertex.get() +
+                                    offsetof(VertexTangentVS, Texcoord)),
+        sizeof(VertexTangentVS));
+    mesh->copyTangents(
+        reinterpret_cast<Vector4 *>(bytesVertex.get() +
+                                    offsetof(VertexTangentVS, Tangent)),
+        sizeof(VertexTangentVS));
     return D3D11_Create_Buffer(device->GetID3D11Device(),
                                D3D11_BIND_VERTEX_BUFFER, sizeVertex,
                                bytesVertex.get());
@@ -299,6 +324,12 @@ float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
     }
   }
 
+  ////////////////////////////////////////////////////////////////////////////////
+  // Occlusion culling for the main pass. The largest instances are rasterized
+  // on the CPU and anything hidden behind them is never submitted.
+  std::shared_ptr<OcclusionCuller> occlusionCuller(new OcclusionCuller());
+  std::vector<Instance> occluders = SelectOccluders(scene);
+
   ////////////////////////////////////////////////////////////////////////////////
   // Capture all of the above into the rendering function for every frame.
   //
@@ -390,10 +421,30 @@ float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
           }
         };
 
+    ////////////////////////////////////////////////////////////////////////
+    // Object constants are cached by transform address, and the scene graph
+    // rewrites its transforms in place; upload the nodes which moved.
+    if (graph != nullptr) {
+      for (uint32_t node : graph->Update()) {
+        const Matrix44 *transform = graph->GetBoundTransform(node);
+        if (transform == nullptr)
+          continue;
+        ConstantsObject data = {};
+        data.TransformObjectToWorld = *transform;
+        device->GetID3D11DeviceContext()->UpdateSubresource(
+            factoryConstants(transform), 0, nullptr, &data, 0, 0);
+      }
+    }
+
+    // Instances to draw; the shadow pass draws everything.
+    std::vector<bool> visible(scene.size(), true);
+
     std::function<void(std::function<void(IMaterial *)>)> DRAWEVERYTHING =
         [&](std::function<void(IMaterial *)> fnMaterialSetup) {
           for (int instanceIndex = 0; instanceIndex < scene.size();
                ++instanceIndex) {
+            if (!visible[instanceIndex])
+              continue;
             const Instance &instance = scene[instanceIndex];
             ////////////////////////////////////////////////////////////////////////
             // Setup the material; specific shaders and shader parameters.
@@ -406,18 +457,20 @@ float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
               device->GetID3D11DeviceContext()->VSSetConstantBuffers(
                   1, 1, &constantBuffer.p);
             }
+            const MeshWithTangents *mesh =
+                factoryTangentMesh(instance.Mesh).get();
             {
-              const UINT vertexStride[] = {sizeof(VertexVS)};
+              const UINT vertexStride[] = {sizeof(VertexTangentVS)};
               const UINT vertexOffset[] = {0};
-              auto vb = factoryVertex(scene[instanceIndex].Mesh.get());
+              auto vb = factoryVertex(mesh);
               device->GetID3D11DeviceContext()->IASetVertexBuffers(
                   0, 1, &vb.p, vertexStride, vertexOffset);
             }
-            auto ib = factoryIndex(scene[instanceIndex].Mesh.get());
+            auto ib = factoryIndex(mesh);
             device->GetID3D11DeviceContext()->IASetIndexBuffer(
                 ib, DXGI_FORMAT_R32_UINT, 0);
             device->GetID3D11DeviceContext()->DrawIndexed(
-                scene[instanceIndex].Mesh->getIndexCount(), 0, 0);
+                mesh->getIndexCount(), 0, 0);
           }
         };
     ////////////////////////////////////////////////////////////////////////
@@ -481,6 +534,8 @@ float4 mainPSOBJMaterial(VertexPS vin) : SV_Target
         1, &rtvBackbuffer.p, sampleResources.DepthStencilView);
     device->GetID3D11DeviceContext()->PSSetShaderResources(
         kTextureRegisterShadowMap, 1, &srvDepthShadow.p);
+    visible = occlusionCuller->Cull(scene, occluders,
+                                    sampleResources.TransformWorldToClip);
     DRAWEVERYTHING(MATERIALSETUP_OBJMATERIAL);
 
     ////////////////////////////////////////////////////////////////////////
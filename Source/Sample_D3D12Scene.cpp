@@ -18,6 +18,7 @@
 #include "SampleResources.h"
 #include "Scene_IMesh.h"
 #include "Scene_InstanceTable.h"
+#include "Scene_OcclusionCuller.h"
 #include <atlbase.h>
 #include <functional>
 #include <memory>
@@ -100,6 +101,10 @@ float4 main() : SV_Target
                                sizeIndices, indices.get());
   };
 
+  // Instances hidden behind the largest ones in the scene are skipped.
+  std::shared_ptr<OcclusionCuller> occlusionCuller(new OcclusionCuller());
+  std::vector<Instance> occluders = SelectOccluders(scene);
+
   return [=](const SampleResourcesD3D12RTV &sampleResources) {
     D3D12_RESOURCE_DESC descBackbuffer =
         sampleResources.BackBufferResource->GetDesc();
@@ -115,6 +120,9 @@ float4 main() : SV_Target
           256, 256, &(*transform * sampleResources.TransformWorldToClip));
     };
 
+    std::vector<bool> visible = occlusionCuller->Cull(
+        scene, occluders, sampleResources.TransformWorldToClip);
+
     D3D12_Run_Synchronously(device.get(), [&](ID3D12GraphicsCommandList5
                                                   *commandList) {
       commandList->SetGraphicsRootSignature(rootSignature);
@@ -143,6 +151,8 @@ float4 main() : SV_Target
           &device->m_pDescriptorHeapRTV->GetCPUDescriptorHandleForHeapStart(),
           FALSE, nullptr);
       for (int i = 0; i < scene.size(); ++i) {
+        if (!visible[i])
+          continue;
         const Instance &instance = scene[i];
         {
           D3D12_CPU_DESCRIPTOR_HANDLE handle =
@@ -12,6 +12,7 @@ class DXGISwapChain;
 class Direct3D11Device;
 class Direct3D12Device;
 class OpenGLDevice;
+class SceneGraph;
 class VKDevice;
 
 std::function<void(const SampleResourcesD3D11 &)>
@@ -35,6 +36,10 @@ CreateSample_D3D11DXGICapture(std::shared_ptr<Direct3D11Device> device);
 std::function<void(const SampleResourcesD3D11 &)>
 CreateSample_D3D11Font(std::shared_ptr<Direct3D11Device> device);
 
+std::function<void(const SampleResourcesD3D11 &)>
+CreateSample_D3D11Impostors(std::shared_ptr<Direct3D11Device> device,
+                            const std::vector<Instance> &scene);
+
 void CreateSample_D3D11Keyboard(SampleRequestD3D11 &request);
 
 std::function<void(const SampleResourcesD3D11 &)>
@@ -60,7 +65,8 @@ CreateSample_D3D11RayMarch(std::shared_ptr<Direct3D11Device> device);
 
 std::function<void(const SampleResourcesD3D11 &)>
 CreateSample_D3D11Scene(std::shared_ptr<Direct3D11Device> device,
-                        const std::vector<Instance> &scene);
+                        const std::vector<Instance> &scene,
+                        std::shared_ptr<SceneGraph> graph = nullptr);
 
 std::function<void(const SampleResourcesD3D11 &)>
 CreateSample_D3D11ShadowMap(std::shared_ptr<Direct3D11Device> device);
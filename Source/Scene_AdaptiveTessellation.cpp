@@ -0,0 +1,233 @@
+#include "Scene_AdaptiveTessellation.h"
+#include "Core_Parallel.h"
+#include "Scene_IParametricUV.h"
+#include "Scene_MergedMesh.h"
+#include <algorithm>
+#include <exception>
+#include <math.h>
+#include <unordered_map>
+
+// Vertices evaluated per parallel task.
+static const uint32_t VERTEX_BATCH_SIZE = 16384;
+
+AdaptiveTessellator::AdaptiveTessellator(std::shared_ptr<IParametricUV> shape,
+                                         const TessellationSettings &settings)
+    : m_shape(shape), m_settings(settings) {
+  if (m_settings.PatchesU == 0 || m_settings.PatchesV == 0)
+    throw std::exception("Tessellation needs at least one patch.");
+  uint32_t maxSegments = 1;
+  while (maxSegments * 2 <= m_settings.MaxSegments)
+    maxSegments *= 2;
+  m_settings.MaxSegments = maxSegments;
+  m_settings.CacheSize = std::max(m_settings.CacheSize, 1u);
+  ////////////////////////////////////////////////////////////////////////////////
+  // Sample the patch corners, edge midpoints and centers once; only their
+  // projection changes with the camera.
+  const uint32_t samplesU = 2 * m_settings.PatchesU + 1;
+  const uint32_t samplesV = 2 * m_settings.PatchesV + 1;
+  std::vector<float> u(samplesU), v(samplesV);
+  for (uint32_t i = 0; i < samplesU; ++i)
+    u[i] = (float)i / (samplesU - 1);
+  for (uint32_t i = 0; i < samplesV; ++i)
+    v[i] = (float)i / (samplesV - 1);
+  m_samples.resize(samplesU * samplesV);
+  m_shape->evaluateGrid(&u[0], samplesU, &v[0], samplesV, &m_samples[0],
+                        nullptr);
+  ////////////////////////////////////////////////////////////////////////////////
+  // A shape closes on itself in u if its first and last columns meet (and
+  // likewise in v); patches across that seam are then neighbors.
+  float extent = 0;
+  for (const Vector3 &sample : m_samples)
+    extent = std::max(extent, Length(sample));
+  const float tolerance = 1e-4f * std::max(extent, 1.0f);
+  m_wrapU = true;
+  for (uint32_t row = 0; row < samplesV; ++row) {
+    const Vector3 *line = &m_samples[row * samplesU];
+    m_wrapU = m_wrapU && Length(line[0] - line[samplesU - 1]) <= tolerance;
+  }
+  m_wrapV = true;
+  for (uint32_t column = 0; column < samplesU; ++column) {
+    const Vector3 &first = m_samples[column];
+    const Vector3 &last = m_samples[(samplesV - 1) * samplesU + column];
+    m_wrapV = m_wrapV && Length(first - last) <= tolerance;
+  }
+  m_segments.resize(m_settings.PatchesU * m_settings.PatchesV, 1);
+}
+
+std::shared_ptr<IMesh>
+AdaptiveTessellator::Tessellate(const Matrix44 &objectToClip, uint32_t width,
+                                uint32_t height) {
+  const uint32_t samplesU = 2 * m_settings.PatchesU + 1;
+  std::vector<Vector2> screen(m_samples.size());
+  std::vector<uint8_t> inFront(m_samples.size());
+  for (size_t i = 0; i < m_samples.size(); ++i) {
+    const Vector3 &p = m_samples[i];
+    Vector4 clip = Transform(objectToClip, Vector4{p.X, p.Y, p.Z, 1});
+    inFront[i] = clip.W > 0;
+    if (inFront[i]) {
+      screen[i] = {clip.X / clip.W * 0.5f * width,
+                   clip.Y / clip.W * 0.5f * height};
+    }
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Pick the segments of each patch. Every patch has a 3x3 block of samples;
+  // the four edges and the two center lines each give a projected length
+  // and the distance of their midpoint from the chord. That distance shrinks
+  // with the square of the segment count.
+  static const uint8_t lines[6][3][2] = {
+      {{0, 0}, {1, 0}, {2, 0}}, {{0, 2}, {1, 2}, {2, 2}},
+      {{0, 0}, {0, 1}, {0, 2}}, {{2, 0}, {2, 1}, {2, 2}},
+      {{0, 1}, {1, 1}, {2, 1}}, {{1, 0}, {1, 1}, {1, 2}}};
+  std::vector<uint8_t> levels(m_segments.size());
+  for (uint32_t pv = 0; pv < m_settings.PatchesV; ++pv) {
+    for (uint32_t pu = 0; pu < m_settings.PatchesU; ++pu) {
+      auto sample = [&](const uint8_t at[2]) {
+        return (2 * pv + at[1]) * samplesU + 2 * pu + at[0];
+      };
+      uint32_t frontCount = 0;
+      for (uint32_t j = 0; j < 3; ++j) {
+        for (uint32_t i = 0; i < 3; ++i) {
+          const uint8_t at[2] = {(uint8_t)i, (uint8_t)j};
+          frontCount += inFront[sample(at)];
+        }
+      }
+      float segments = 1;
+      if (frontCount == 9) {
+        float length = 0, deviation = 0;
+        for (const auto &line : lines) {
+          const Vector2 &a = screen[sample(line[0])];
+          const Vector2 &m = screen[sample(line[1])];
+          const Vector2 &b = screen[sample(line[2])];
+          length = std::max(length, Length(m - a) + Length(b - m));
+          deviation = std::max(deviation, Length(m - (a + b) * 0.5f));
+        }
+        segments = std::max(length / m_settings.EdgePixels,
+                            sqrtf(deviation / m_settings.ErrorPixels));
+      } else if (frontCount > 0) {
+        // Crossing the eye plane; as close to the camera as it gets.
+        segments = (float)m_settings.MaxSegments;
+      }
+      uint8_t level = 0;
+      while ((1u << level) < segments &&
+             (1u << level) < m_settings.MaxSegments) {
+        ++level;
+      }
+      levels[pv * m_settings.PatchesU + pu] = level;
+      m_segments[pv * m_settings.PatchesU + pu] = 1u << level;
+    }
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Reuse the mesh of a known LOD, otherwise build and cache it.
+  auto found = m_cache.find(levels);
+  if (found != m_cache.end())
+    return found->second;
+  std::shared_ptr<IMesh> mesh = Build(levels);
+  if (m_cacheOrder.size() >= m_settings.CacheSize) {
+    m_cache.erase(m_cacheOrder.front());
+    m_cacheOrder.pop_front();
+  }
+  m_cache[levels] = mesh;
+  m_cacheOrder.push_back(levels);
+  return mesh;
+}
+
+const std::vector<uint32_t> &AdaptiveTessellator::GetPatchSegments() const {
+  return m_segments;
+}
+
+std::shared_ptr<IMesh>
+AdaptiveTessellator::Build(const std::vector<uint8_t> &levels) const {
+  const int32_t patchesU = m_settings.PatchesU;
+  const int32_t patchesV = m_settings.PatchesV;
+  const uint32_t lattice = m_settings.MaxSegments;
+  const uint32_t latticeU = patchesU * lattice;
+  const uint32_t latticeV = patchesV * lattice;
+  // Segments of a patch, wrapping across seams; 0 past an open border.
+  auto segmentsAt = [&](int32_t pu, int32_t pv) -> uint32_t {
+    if (m_wrapU)
+      pu = (pu + patchesU) % patchesU;
+    if (m_wrapV)
+      pv = (pv + patchesV) % patchesV;
+    if (pu < 0 || pu >= patchesU || pv < 0 || pv >= patchesV)
+      return 0;
+    return 1u << levels[pv * patchesU + pu];
+  };
+  std::shared_ptr<MergedMesh> mesh(new MergedMesh());
+  std::unordered_map<uint64_t, uint32_t> lookup;
+  std::vector<uint32_t> grid;
+  for (int32_t pv = 0; pv < patchesV; ++pv) {
+    for (int32_t pu = 0; pu < patchesU; ++pu) {
+      const uint32_t n = segmentsAt(pu, pv);
+      const uint32_t step = lattice / n;
+      // Fine edge vertices per coarse segment along each edge.
+      auto fold = [&](uint32_t neighbor) {
+        return neighbor == 0 ? 1 : n / std::min(n, neighbor);
+      };
+      const uint32_t foldBottom = fold(segmentsAt(pu, pv - 1));
+      const uint32_t foldTop = fold(segmentsAt(pu, pv + 1));
+      const uint32_t foldLeft = fold(segmentsAt(pu - 1, pv));
+      const uint32_t foldRight = fold(segmentsAt(pu + 1, pv));
+      ////////////////////////////////////////////////////////////////////////////
+      // Place the patch grid on the global lattice, folding edge vertices
+      // down onto the coarser side's lattice.
+      grid.resize((n + 1) * (n + 1));
+      for (uint32_t j = 0; j <= n; ++j) {
+        for (uint32_t i = 0; i <= n; ++i) {
+          uint32_t ii = i, jj = j;
+          if (i > 0 && i < n && j == 0)
+            ii = i / foldBottom * foldBottom;
+          if (i > 0 && i < n && j == n)
+            ii = i / foldTop * foldTop;
+          if (j > 0 && j < n && i == 0)
+            jj = j / foldLeft * foldLeft;
+          if (j > 0 && j < n && i == n)
+            jj = j / foldRight * foldRight;
+          const uint32_t gu = pu * lattice + ii * step;
+          const uint32_t gv = pv * lattice + jj * step;
+          const uint64_t key = (uint64_t)gv * (latticeU + 1) + gu;
+          auto inserted =
+              lookup.emplace(key, (uint32_t)mesh->Texcoords.size());
+          if (inserted.second) {
+            mesh->Texcoords.push_back(
+                {(float)gu / latticeU, (float)gv / latticeV});
+          }
+          grid[j * (n + 1) + i] = inserted.first->second;
+        }
+      }
+      ////////////////////////////////////////////////////////////////////////////
+      // Triangulate as ParametricUVToMesh does; folded cells lose a
+      // triangle.
+      auto emit = [&](uint32_t a, uint32_t b, uint32_t c) {
+        if (a == b || b == c || c == a)
+          return;
+        mesh->Indices.push_back(a);
+        mesh->Indices.push_back(b);
+        mesh->Indices.push_back(c);
+      };
+      for (uint32_t v = 0; v < n; ++v) {
+        for (uint32_t u = 0; u < n; ++u) {
+          const uint32_t a = grid[(v + 0) * (n + 1) + (u + 0)];
+          const uint32_t b = grid[(v + 1) * (n + 1) + (u + 0)];
+          const uint32_t c = grid[(v + 1) * (n + 1) + (u + 1)];
+          const uint32_t d = grid[(v + 0) * (n + 1) + (u + 1)];
+          emit(a, b, c);
+          emit(a, c, d);
+        }
+      }
+    }
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Evaluate the shared vertices in parallel batches.
+  const uint32_t vertexCount = (uint32_t)mesh->Texcoords.size();
+  mesh->Positions.resize(vertexCount);
+  mesh->Normals.resize(vertexCount);
+  const uint32_t batches =
+      (vertexCount + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE;
+  ParallelFor(batches, [&](uint32_t batch) {
+    const uint32_t first = batch * VERTEX_BATCH_SIZE;
+    const uint32_t count = std::min(VERTEX_BATCH_SIZE, vertexCount - first);
+    m_shape->evaluate(&mesh->Texcoords[first], count,
+                      &mesh->Positions[first], &mesh->Normals[first]);
+  });
+  return mesh;
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_IMesh.h"
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class IParametricUV;
+
+////////////////////////////////////////////////////////////////////////////////
+// Adaptive Tessellation
+//
+// ParametricUVToMesh uses one fixed grid whatever the size of the shape on
+// screen. This tessellator divides the uv domain into a grid of patches and
+// picks a power of two number of segments for each patch from its projected
+// edge length and from how far the surface bends away from the patch corners
+// (curvature) under the current camera.
+//
+// Two patches meeting at an edge both use the smaller of their two segment
+// counts along it; the finer patch folds its extra edge vertices onto the
+// coarser lattice. Every vertex is placed on one global lattice and shared
+// between patches, so there are no T-junctions and no cracks. A shape which
+// closes on itself in u or v (like Sphere) is detected and its seam is
+// stitched the same way.
+//
+// The per-patch segment counts are the LOD. Meshes are cached by LOD so a
+// camera which moves without changing any patch returns the same mesh
+// object, which renderers that cache by mesh pointer upload only once.
+////////////////////////////////////////////////////////////////////////////////
+
+struct TessellationSettings {
+  // Patches along u and v.
+  uint32_t PatchesU = 8;
+  uint32_t PatchesV = 8;
+  // Most segments along one side of a patch; rounded down to a power of two.
+  uint32_t MaxSegments = 32;
+  // Target projected length of a triangle edge in pixels.
+  float EdgePixels = 16;
+  // Largest projected distance allowed between the surface and its
+  // triangles in pixels.
+  float ErrorPixels = 0.5f;
+  // Meshes kept for reuse.
+  uint32_t CacheSize = 16;
+};
+
+class AdaptiveTessellator : public Object {
+public:
+  AdaptiveTessellator(std::shared_ptr<IParametricUV> shape,
+                      const TessellationSettings &settings = {});
+  // Choose the segments of every patch for a view and return the mesh for
+  // them. objectToClip takes the shape to D3D clip space and the viewport is
+  // width by height pixels.
+  std::shared_ptr<IMesh> Tessellate(const Matrix44 &objectToClip,
+                                    uint32_t width, uint32_t height);
+  // Segments per side of each patch chosen by the last call, u fastest.
+  const std::vector<uint32_t> &GetPatchSegments() const;
+
+private:
+  std::shared_ptr<IMesh> Build(const std::vector<uint8_t> &levels) const;
+  std::shared_ptr<IParametricUV> m_shape;
+  TessellationSettings m_settings;
+  bool m_wrapU;
+  bool m_wrapV;
+  // Patch corners, edge midpoints and centers; a (2 * PatchesU + 1) by
+  // (2 * PatchesV + 1) grid in object space.
+  std::vector<Vector3> m_samples;
+  std::vector<uint32_t> m_segments;
+  std::map<std::vector<uint8_t>, std::shared_ptr<IMesh>> m_cache;
+  // Cached LODs, oldest first.
+  std::deque<std::vector<uint8_t>> m_cacheOrder;
+};
\ No newline at end of file
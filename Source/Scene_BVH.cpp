@@ -0,0 +1,501 @@
+#include "Scene_BVH.h"
+#include "Core_Parallel.h"
+#include "Scene_IMesh.h"
+#include "Scene_InstanceTable.h"
+#include <float.h>
+#include <map>
+#include <utility>
+
+static const uint32_t SAH_BIN_COUNT = 16;
+
+AABB EmptyAABB() {
+  return {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+}
+
+AABB Union(const AABB &lhs, const AABB &rhs) {
+  return {Min(lhs.Min, rhs.Min), Max(lhs.Max, rhs.Max)};
+}
+
+AABB Union(const AABB &lhs, const Vector3 &rhs) {
+  return {Min(lhs.Min, rhs), Max(lhs.Max, rhs)};
+}
+
+float SurfaceArea(const AABB &box) {
+  Vector3 size = box.Max - box.Min;
+  if (size.X < 0 || size.Y < 0 || size.Z < 0)
+    return 0;
+  return 2 * (size.X * size.Y + size.Y * size.Z + size.Z * size.X);
+}
+
+AABB TransformAABB(const Matrix44 &transform, const AABB &box) {
+  AABB result = EmptyAABB();
+  for (int corner = 0; corner < 8; ++corner) {
+    Vector3 point = {(corner & 1) ? box.Max.X : box.Min.X,
+                     (corner & 2) ? box.Max.Y : box.Min.Y,
+                     (corner & 4) ? box.Max.Z : box.Min.Z};
+    result = Union(result, TransformPoint(transform, point));
+  }
+  return result;
+}
+
+AABB GetMeshBounds(const IMesh &mesh) {
+  AABB result = EmptyAABB();
+  std::vector<Vector3> positions(mesh.getVertexCount());
+  if (!positions.empty())
+    mesh.copyVertices(&positions[0], sizeof(Vector3));
+  for (const Vector3 &position : positions)
+    result = Union(result, position);
+  return result;
+}
+
+static float MinF(float lhs, float rhs) { return lhs < rhs ? lhs : rhs; }
+
+static float MaxF(float lhs, float rhs) { return lhs > rhs ? lhs : rhs; }
+
+bool IntersectAABB(const AABB &box, const Vector3 &origin,
+                   const Vector3 &invDirection, float tMin, float tMax,
+                   float &tNear) {
+  float tx1 = (box.Min.X - origin.X) * invDirection.X;
+  float tx2 = (box.Max.X - origin.X) * invDirection.X;
+  float ty1 = (box.Min.Y - origin.Y) * invDirection.Y;
+  float ty2 = (box.Max.Y - origin.Y) * invDirection.Y;
+  float tz1 = (box.Min.Z - origin.Z) * invDirection.Z;
+  float tz2 = (box.Max.Z - origin.Z) * invDirection.Z;
+  tNear = MaxF(MaxF(MinF(tx1, tx2), MinF(ty1, ty2)),
+               MaxF(MinF(tz1, tz2), tMin));
+  float tFar = MinF(MinF(MaxF(tx1, tx2), MaxF(ty1, ty2)),
+                    MinF(MaxF(tz1, tz2), tMax));
+  return tNear <= tFar;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Binned SAH builder.
+
+static float Axis(const Vector3 &v, int axis) {
+  return axis == 0 ? v.X : (axis == 1 ? v.Y : v.Z);
+}
+
+static Vector3 Centroid(const AABB &box) {
+  return (box.Min + box.Max) * 0.5f;
+}
+
+static void BuildRecursive(BVH &bvh, const AABB *bounds, uint32_t nodeIndex,
+                           uint32_t first, uint32_t count,
+                           uint32_t maxLeafSize) {
+  AABB nodeBounds = EmptyAABB();
+  AABB centroidBounds = EmptyAABB();
+  for (uint32_t i = first; i < first + count; ++i) {
+    nodeBounds = Union(nodeBounds, bounds[bvh.Primitives[i]]);
+    centroidBounds =
+        Union(centroidBounds, Centroid(bounds[bvh.Primitives[i]]));
+  }
+  bvh.Nodes[nodeIndex] = {nodeBounds, first, count};
+  if (count <= maxLeafSize)
+    return;
+  ////////////////////////////////////////////////////////////////////////////////
+  // Bin centroids along each axis and evaluate the SAH at each bin boundary.
+  float bestCost = FLT_MAX;
+  int bestAxis = -1;
+  uint32_t bestSplit = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    float axisMin = Axis(centroidBounds.Min, axis);
+    float axisMax = Axis(centroidBounds.Max, axis);
+    if (axisMax <= axisMin)
+      continue;
+    float scale = SAH_BIN_COUNT / (axisMax - axisMin);
+    AABB binBounds[SAH_BIN_COUNT];
+    uint32_t binCount[SAH_BIN_COUNT] = {};
+    for (uint32_t b = 0; b < SAH_BIN_COUNT; ++b) {
+      binBounds[b] = EmptyAABB();
+    }
+    for (uint32_t i = first; i < first + count; ++i) {
+      const AABB &box = bounds[bvh.Primitives[i]];
+      uint32_t bin = (uint32_t)((Axis(Centroid(box), axis) - axisMin) * scale);
+      if (bin >= SAH_BIN_COUNT)
+        bin = SAH_BIN_COUNT - 1;
+      binBounds[bin] = Union(binBounds[bin], box);
+      ++binCount[bin];
+    }
+    // Sweep from the right to get suffix areas, then from the left.
+    float rightArea[SAH_BIN_COUNT];
+    uint32_t rightCount[SAH_BIN_COUNT];
+    AABB accumulate = EmptyAABB();
+    uint32_t accumulateCount = 0;
+    for (uint32_t b = SAH_BIN_COUNT - 1; b > 0; --b) {
+      accumulate = Union(accumulate, binBounds[b]);
+      accumulateCount += binCount[b];
+      rightArea[b] = SurfaceArea(accumulate);
+      rightCount[b] = accumulateCount;
+    }
+    accumulate = EmptyAABB();
+    accumulateCount = 0;
+    for (uint32_t b = 0; b < SAH_BIN_COUNT - 1; ++b) {
+      accumulate = Union(accumulate, binBounds[b]);
+      accumulateCount += binCount[b];
+      float cost = SurfaceArea(accumulate) * accumulateCount +
+                   rightArea[b + 1] * rightCount[b + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestSplit = b + 1;
+      }
+    }
+  }
+  // All centroids coincide, or a split is no cheaper than a leaf.
+  if (bestAxis == -1 || bestCost >= SurfaceArea(nodeBounds) * count)
+    return;
+  ////////////////////////////////////////////////////////////////////////////////
+  // Partition the primitives in place about the chosen bin boundary.
+  float axisMin = Axis(centroidBounds.Min, bestAxis);
+  float scale = SAH_BIN_COUNT / (Axis(centroidBounds.Max, bestAxis) - axisMin);
+  uint32_t *begin = &bvh.Primitives[first];
+  uint32_t *end = begin + count;
+  uint32_t *middle = begin;
+  for (uint32_t *it = begin; it != end; ++it) {
+    uint32_t bin = (uint32_t)(
+        (Axis(Centroid(bounds[*it]), bestAxis) - axisMin) * scale);
+    if (bin >= SAH_BIN_COUNT)
+      bin = SAH_BIN_COUNT - 1;
+    if (bin < bestSplit) {
+      std::swap(*it, *middle);
+      ++middle;
+    }
+  }
+  uint32_t leftCount = (uint32_t)(middle - begin);
+  if (leftCount == 0 || leftCount == count)
+    return;
+  uint32_t childIndex = (uint32_t)bvh.Nodes.size();
+  bvh.Nodes.push_back({});
+  bvh.Nodes.push_back({});
+  bvh.Nodes[nodeIndex].Index = childIndex;
+  bvh.Nodes[nodeIndex].Count = 0;
+  BuildRecursive(bvh, bounds, childIndex, first, leftCount, maxLeafSize);
+  BuildRecursive(bvh, bounds, childIndex + 1, first + leftCount,
+                 count - leftCount, maxLeafSize);
+}
+
+BVH BuildBVH(const AABB *bounds, uint32_t count, uint32_t maxLeafSize) {
+  BVH bvh;
+  if (count == 0)
+    return bvh;
+  bvh.Primitives.resize(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    bvh.Primitives[i] = i;
+  }
+  bvh.Nodes.reserve(2 * count);
+  bvh.Nodes.push_back({});
+  BuildRecursive(bvh, bounds, 0, 0, count, maxLeafSize);
+  return bvh;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Refitting.
+
+static float NodeCost(const BVHNode &node) {
+  return SurfaceArea(node.Bounds) * (node.Count == 0 ? 1 : node.Count);
+}
+
+static bool Equal(const AABB &lhs, const AABB &rhs) {
+  return lhs.Min.X == rhs.Min.X && lhs.Min.Y == rhs.Min.Y &&
+         lhs.Min.Z == rhs.Min.Z && lhs.Max.X == rhs.Max.X &&
+         lhs.Max.Y == rhs.Max.Y && lhs.Max.Z == rhs.Max.Z;
+}
+
+static AABB ComputeNodeBounds(const BVH &bvh, const BVHNode &node,
+                              const AABB *bounds) {
+  if (node.Count == 0)
+    return Union(bvh.Nodes[node.Index].Bounds,
+                 bvh.Nodes[node.Index + 1].Bounds);
+  AABB box = EmptyAABB();
+  for (uint32_t i = 0; i < node.Count; ++i) {
+    box = Union(box, bounds[bvh.Primitives[node.Index + i]]);
+  }
+  return box;
+}
+
+float CostSAH(const BVH &bvh) {
+  if (bvh.Nodes.empty())
+    return 0;
+  float rootArea = SurfaceArea(bvh.Nodes[0].Bounds);
+  if (rootArea <= 0)
+    return 0;
+  float cost = 0;
+  for (const auto &node : bvh.Nodes) {
+    cost += NodeCost(node);
+  }
+  return cost / rootArea;
+}
+
+BVHRefitter::BVHRefitter(const BVH &bvh) {
+  m_parents.resize(bvh.Nodes.size(), UINT32_MAX);
+  m_primitiveLeaves.resize(bvh.Primitives.size(), UINT32_MAX);
+  for (uint32_t i = 0; i < bvh.Nodes.size(); ++i) {
+    const BVHNode &node = bvh.Nodes[i];
+    if (node.Count == 0) {
+      m_parents[node.Index] = i;
+      m_parents[node.Index + 1] = i;
+    } else {
+      for (uint32_t j = 0; j < node.Count; ++j) {
+        m_primitiveLeaves[bvh.Primitives[node.Index + j]] = i;
+      }
+    }
+  }
+  m_buildCost = CostSAH(bvh);
+  m_areaCost = 0;
+  for (const auto &node : bvh.Nodes) {
+    m_areaCost += NodeCost(node);
+  }
+}
+
+void BVHRefitter::RefitAll(BVH &bvh, const AABB *bounds) {
+  // Children always come after their parent, so a reverse sweep sees every
+  // child before the node that contains it.
+  m_areaCost = 0;
+  for (size_t i = bvh.Nodes.size(); i-- > 0;) {
+    BVHNode &node = bvh.Nodes[i];
+    node.Bounds = ComputeNodeBounds(bvh, node, bounds);
+    m_areaCost += NodeCost(node);
+  }
+}
+
+void BVHRefitter::Refit(BVH &bvh, const AABB *bounds, const uint32_t *changed,
+                        uint32_t changedCount) {
+  for (uint32_t i = 0; i < changedCount; ++i) {
+    // Walk up from the leaf; stop as soon as a node's bounds come out the
+    // same, since nothing above it can change either.
+    uint32_t nodeIndex = m_primitiveLeaves[changed[i]];
+    while (nodeIndex != UINT32_MAX) {
+      BVHNode &node = bvh.Nodes[nodeIndex];
+      AABB box = ComputeNodeBounds(bvh, node, bounds);
+      if (Equal(box, node.Bounds))
+        break;
+      m_areaCost -= NodeCost(node);
+      node.Bounds = box;
+      m_areaCost += NodeCost(node);
+      nodeIndex = m_parents[nodeIndex];
+    }
+  }
+}
+
+float BVHRefitter::GetDegradation(const BVH &bvh) const {
+  if (bvh.Nodes.empty() || m_buildCost <= 0)
+    return 1;
+  float rootArea = SurfaceArea(bvh.Nodes[0].Bounds);
+  if (rootArea <= 0)
+    return 1;
+  return m_areaCost / rootArea / m_buildCost;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Triangle BVH
+
+bool IntersectTriangle(const Vector3 &origin, const Vector3 &direction,
+                       const Vector3 &p0, const Vector3 &p1, const Vector3 &p2,
+                       float tMin, float &tMax, float &u, float &v) {
+  Vector3 edge1 = p1 - p0;
+  Vector3 edge2 = p2 - p0;
+  Vector3 pvec = Cross(direction, edge2);
+  float determinant = Dot(edge1, pvec);
+  if (determinant > -1e-12f && determinant < 1e-12f)
+    return false;
+  float invDeterminant = 1 / determinant;
+  Vector3 tvec = origin - p0;
+  float hitU = Dot(tvec, pvec) * invDeterminant;
+  if (hitU < 0 || hitU > 1)
+    return false;
+  Vector3 qvec = Cross(tvec, edge1);
+  float hitV = Dot(direction, qvec) * invDeterminant;
+  if (hitV < 0 || hitU + hitV > 1)
+    return false;
+  float t = Dot(edge2, qvec) * invDeterminant;
+  if (t < tMin || t >= tMax)
+    return false;
+  tMax = t;
+  u = hitU;
+  v = hitV;
+  return true;
+}
+
+static std::vector<AABB> TriangleBounds(const std::vector<Vector3> &positions,
+                                        const std::vector<uint32_t> &indices) {
+  uint32_t triangleCount = (uint32_t)indices.size() / 3;
+  std::vector<AABB> bounds(triangleCount);
+  for (uint32_t t = 0; t < triangleCount; ++t) {
+    AABB box = EmptyAABB();
+    box = Union(box, positions[indices[3 * t + 0]]);
+    box = Union(box, positions[indices[3 * t + 1]]);
+    box = Union(box, positions[indices[3 * t + 2]]);
+    bounds[t] = box;
+  }
+  return bounds;
+}
+
+MeshBVH::MeshBVH(const IMesh &mesh) {
+  Positions.resize(mesh.getVertexCount());
+  Indices.resize(mesh.getIndexCount());
+  if (!Positions.empty())
+    mesh.copyVertices(&Positions[0], sizeof(Vector3));
+  if (!Indices.empty())
+    mesh.copyIndices(&Indices[0], sizeof(uint32_t));
+  std::vector<AABB> bounds = TriangleBounds(Positions, Indices);
+  Tree = BuildBVH(bounds.data(), (uint32_t)bounds.size());
+  m_refitter = BVHRefitter(Tree);
+}
+
+bool MeshBVH::Intersect(const Ray &ray, RayHit &hit) const {
+  float tMax = hit.T < ray.TMax ? hit.T : ray.TMax;
+  return TraverseBVH(Tree, ray.Origin, ray.Direction, ray.TMin, tMax, false,
+                     [&](uint32_t triangle, float &tMax) {
+                       if (!IntersectTriangle(
+                               ray.Origin, ray.Direction,
+                               Positions[Indices[3 * triangle + 0]],
+                               Positions[Indices[3 * triangle + 1]],
+                               Positions[Indices[3 * triangle + 2]],
+                               ray.TMin, tMax, hit.U, hit.V))
+                         return false;
+                       hit.T = tMax;
+                       hit.Primitive = triangle;
+                       return true;
+                     });
+}
+
+bool MeshBVH::Occluded(const Ray &ray) const {
+  float tMax = ray.TMax;
+  float u, v;
+  return TraverseBVH(Tree, ray.Origin, ray.Direction, ray.TMin, tMax, true,
+                     [&](uint32_t triangle, float &tMax) {
+                       return IntersectTriangle(
+                           ray.Origin, ray.Direction,
+                           Positions[Indices[3 * triangle + 0]],
+                           Positions[Indices[3 * triangle + 1]],
+                           Positions[Indices[3 * triangle + 2]], ray.TMin,
+                           tMax, u, v);
+                     });
+}
+
+Vector3 MeshBVH::GetNormal(uint32_t primitive) const {
+  const Vector3 &p0 = Positions[Indices[3 * primitive + 0]];
+  const Vector3 &p1 = Positions[Indices[3 * primitive + 1]];
+  const Vector3 &p2 = Positions[Indices[3 * primitive + 2]];
+  return Cross(p1 - p0, p2 - p0);
+}
+
+const AABB &MeshBVH::GetBounds() const {
+  static const AABB empty = EmptyAABB();
+  return Tree.Nodes.empty() ? empty : Tree.Nodes[0].Bounds;
+}
+
+bool MeshBVH::Refit(float rebuildThreshold) {
+  std::vector<AABB> bounds = TriangleBounds(Positions, Indices);
+  m_refitter.RefitAll(Tree, bounds.data());
+  if (m_refitter.GetDegradation(Tree) <= rebuildThreshold)
+    return false;
+  Tree = BuildBVH(bounds.data(), (uint32_t)bounds.size());
+  m_refitter = BVHRefitter(Tree);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Instance BVH
+
+SceneBVH::SceneBVH(const std::vector<Instance> &scene) {
+  // Build one MeshBVH per unique mesh (in parallel), then place instances.
+  std::map<const IMesh *, std::shared_ptr<MeshBVH>> mapMeshToBVH;
+  std::vector<const IMesh *> uniqueMeshes;
+  for (const auto &instance : scene) {
+    if (mapMeshToBVH.find(instance.Mesh.get()) == mapMeshToBVH.end()) {
+      mapMeshToBVH[instance.Mesh.get()] = nullptr;
+      uniqueMeshes.push_back(instance.Mesh.get());
+    }
+  }
+  std::vector<std::shared_ptr<MeshBVH>> builtMeshes(uniqueMeshes.size());
+  ParallelFor((uint32_t)uniqueMeshes.size(), [&](uint32_t i) {
+    builtMeshes[i].reset(new MeshBVH(*uniqueMeshes[i]));
+  });
+  for (size_t i = 0; i < uniqueMeshes.size(); ++i) {
+    mapMeshToBVH[uniqueMeshes[i]] = builtMeshes[i];
+  }
+  for (const auto &instance : scene) {
+    Entry entry = {};
+    entry.Mesh = mapMeshToBVH[instance.Mesh.get()];
+    entry.ObjectToWorld = *instance.TransformObjectToWorld;
+    entry.WorldToObject = Invert(entry.ObjectToWorld);
+    entry.WorldBounds =
+        TransformAABB(entry.ObjectToWorld, entry.Mesh->GetBounds());
+    Instances.push_back(entry);
+    m_bounds.push_back(entry.WorldBounds);
+  }
+  m_isChanged.resize(Instances.size(), false);
+  Tree = BuildBVH(m_bounds.data(), (uint32_t)m_bounds.size(), 1);
+  m_refitter = BVHRefitter(Tree);
+}
+
+void SceneBVH::SetTransform(uint32_t instance, const Matrix44 &objectToWorld) {
+  Entry &entry = Instances[instance];
+  entry.ObjectToWorld = objectToWorld;
+  entry.WorldToObject = Invert(objectToWorld);
+  if (!m_isChanged[instance]) {
+    m_isChanged[instance] = true;
+    m_changed.push_back(instance);
+  }
+}
+
+bool SceneBVH::Update(float rebuildThreshold) {
+  if (m_changed.empty())
+    return false;
+  for (uint32_t instance : m_changed) {
+    Entry &entry = Instances[instance];
+    entry.WorldBounds =
+        TransformAABB(entry.ObjectToWorld, entry.Mesh->GetBounds());
+    m_bounds[instance] = entry.WorldBounds;
+    m_isChanged[instance] = false;
+  }
+  m_refitter.Refit(Tree, m_bounds.data(), m_changed.data(),
+                   (uint32_t)m_changed.size());
+  m_changed.clear();
+  if (m_refitter.GetDegradation(Tree) <= rebuildThreshold)
+    return false;
+  Tree = BuildBVH(m_bounds.data(), (uint32_t)m_bounds.size(), 1);
+  m_refitter = BVHRefitter(Tree);
+  return true;
+}
+
+bool SceneBVH::Intersect(const Ray &ray, RayHit &hit) const {
+  float tMax = hit.T < ray.TMax ? hit.T : ray.TMax;
+  return TraverseBVH(
+      Tree, ray.Origin, ray.Direction, ray.TMin, tMax, false,
+      [&](uint32_t instance, float &tMax) {
+        const Entry &entry = Instances[instance];
+        // Directions are not renormalized so distances agree in both spaces.
+        Ray objectRay = {TransformPoint(entry.WorldToObject, ray.Origin),
+                         TransformVector(entry.WorldToObject, ray.Direction),
+                         ray.TMin, tMax};
+        hit.T = tMax;
+        if (!entry.Mesh->Intersect(objectRay, hit))
+          return false;
+        tMax = hit.T;
+        hit.Instance = instance;
+        return true;
+      });
+}
+
+bool SceneBVH::Occluded(const Ray &ray) const {
+  float tMax = ray.TMax;
+  return TraverseBVH(
+      Tree, ray.Origin, ray.Direction, ray.TMin, tMax, true,
+      [&](uint32_t instance, float &tMax) {
+        const Entry &entry = Instances[instance];
+        Ray objectRay = {TransformPoint(entry.WorldToObject, ray.Origin),
+                         TransformVector(entry.WorldToObject, ray.Direction),
+                         ray.TMin, tMax};
+        return entry.Mesh->Occluded(objectRay);
+      });
+}
+
+Vector3 SceneBVH::GetNormal(const RayHit &hit) const {
+  const Entry &entry = Instances[hit.Instance];
+  // Normals transform by the inverse transpose; with row vectors that is a
+  // multiply by the transposed inverse.
+  return Normalize(TransformVector(Transpose(entry.WorldToObject),
+                                   entry.Mesh->GetNormal(hit.Primitive)));
+}
\ No newline at end of file
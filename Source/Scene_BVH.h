@@ -0,0 +1,250 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class IMesh;
+class Instance;
+
+////////////////////////////////////////////////////////////////////////////////
+// CPU Bounding Volume Hierarchy
+//
+// This is the CPU side equivalent of the DXR acceleration structures. A
+// MeshBVH plays the part of a BLAS (triangles in object space) and a SceneBVH
+// plays the part of a TLAS (instances of MeshBVHs placed in the world).
+////////////////////////////////////////////////////////////////////////////////
+
+struct AABB {
+  Vector3 Min, Max;
+};
+
+// An inverted box which any union will overwrite.
+AABB EmptyAABB();
+
+AABB Union(const AABB &lhs, const AABB &rhs);
+
+AABB Union(const AABB &lhs, const Vector3 &rhs);
+
+float SurfaceArea(const AABB &box);
+
+// Bounds of a box after transformation (all eight corners are considered).
+AABB TransformAABB(const Matrix44 &transform, const AABB &box);
+
+// Object space bounds of a mesh's vertices; empty for a mesh without any.
+AABB GetMeshBounds(const IMesh &mesh);
+
+struct Ray {
+  Vector3 Origin;
+  Vector3 Direction;
+  float TMin;
+  float TMax;
+};
+
+// Closest hit information; T starts as the search distance and shrinks.
+struct RayHit {
+  float T;
+  uint32_t Instance;
+  uint32_t Primitive;
+  float U, V; // Barycentrics of vertex 1 and vertex 2.
+};
+
+// A node of a binary BVH. Interior nodes (Count == 0) store the index of their
+// first child in Index with the second child immediately after it. Leaves
+// store the first entry in BVH::Primitives and the number of primitives.
+struct BVHNode {
+  AABB Bounds;
+  uint32_t Index;
+  uint32_t Count;
+};
+
+struct BVH {
+  std::vector<BVHNode> Nodes;
+  std::vector<uint32_t> Primitives;
+};
+
+// Build a BVH over a set of primitive bounds using binned SAH.
+BVH BuildBVH(const AABB *bounds, uint32_t count, uint32_t maxLeafSize = 4);
+
+// The SAH cost of a tree: the sum over nodes of surface area times the work
+// done on entry (1 for interior nodes, the primitive count for leaves),
+// divided by the root area. Refitting keeps the topology, so as primitives
+// move apart this grows and traversal slows down.
+float CostSAH(const BVH &bvh);
+
+// Keeps a BVH valid as its primitives move by recomputing node bounds from
+// the bottom up instead of rebuilding. Topology is not changed, so the tree
+// degrades as motion accumulates; compare GetDegradation() against a
+// threshold to decide when a rebuild pays for itself.
+class BVHRefitter {
+public:
+  BVHRefitter() = default;
+  BVHRefitter(const BVH &bvh);
+  // Refit every node; O(nodes).
+  void RefitAll(BVH &bvh, const AABB *bounds);
+  // Refit only the ancestors of the changed primitives; O(changed * depth).
+  void Refit(BVH &bvh, const AABB *bounds, const uint32_t *changed,
+             uint32_t changedCount);
+  // Current SAH cost over the cost when the tree was built.
+  float GetDegradation(const BVH &bvh) const;
+
+private:
+  std::vector<uint32_t> m_parents;
+  std::vector<uint32_t> m_primitiveLeaves;
+  float m_buildCost = 0;
+  // Un-normalized SAH sum, maintained incrementally by Refit().
+  float m_areaCost = 0;
+};
+
+// Test a ray against a box given a precomputed reciprocal direction. Returns
+// true if the ray overlaps the box within [tMin, tMax] and sets tNear to the
+// entry distance. Any tMax works, including FLT_MAX and INFINITY.
+bool IntersectAABB(const AABB &box, const Vector3 &origin,
+                   const Vector3 &invDirection, float tMin, float tMax,
+                   float &tNear);
+
+// Moller-Trumbore; returns true and updates tMax/u/v on a closer hit.
+bool IntersectTriangle(const Vector3 &origin, const Vector3 &direction,
+                       const Vector3 &p0, const Vector3 &p1, const Vector3 &p2,
+                       float tMin, float &tMax, float &u, float &v);
+
+////////////////////////////////////////////////////////////////////////////////
+// Walk a BVH front-to-back calling "leaf(primitive, tMax)" for each primitive
+// in the leaves the ray reaches. The leaf function returns true on a hit (and
+// is expected to shrink tMax). With anyHit set the walk stops at the first hit.
+template <class LEAF>
+bool TraverseBVH(const BVH &bvh, const Vector3 &origin,
+                 const Vector3 &direction, float tMin, float &tMax,
+                 bool anyHit, LEAF leaf) {
+  if (bvh.Nodes.empty())
+    return false;
+  const Vector3 invDirection = {1 / direction.X, 1 / direction.Y,
+                                1 / direction.Z};
+  // Nodes the ray entered and their entry distances. Only boxes which were
+  // hit are pushed; trees deeper than the fixed stack (badly clustered
+  // input) spill onto the heap.
+  struct StackEntry {
+    uint32_t Node;
+    float Distance;
+  };
+  StackEntry stack[64];
+  uint32_t stackSize = 0;
+  std::vector<StackEntry> spill;
+  auto push = [&](uint32_t node, float distance) {
+    if (stackSize < 64)
+      stack[stackSize++] = {node, distance};
+    else
+      spill.push_back({node, distance});
+  };
+  float distanceRoot;
+  if (!IntersectAABB(bvh.Nodes[0].Bounds, origin, invDirection, tMin, tMax,
+                     distanceRoot))
+    return false;
+  push(0, distanceRoot);
+  bool hitAnything = false;
+  while (stackSize > 0) {
+    StackEntry entry;
+    if (!spill.empty()) {
+      entry = spill.back();
+      spill.pop_back();
+    } else {
+      entry = stack[--stackSize];
+    }
+    // A closer hit may have been found since the node was pushed.
+    if (entry.Distance > tMax)
+      continue;
+    const BVHNode &node = bvh.Nodes[entry.Node];
+    if (node.Count > 0) {
+      for (uint32_t i = 0; i < node.Count; ++i) {
+        if (leaf(bvh.Primitives[node.Index + i], tMax)) {
+          hitAnything = true;
+          if (anyHit)
+            return true;
+        }
+      }
+      continue;
+    }
+    // Push the far child first so the near child is processed next.
+    float distanceLeft, distanceRight;
+    const bool hitLeft =
+        IntersectAABB(bvh.Nodes[node.Index].Bounds, origin, invDirection, tMin,
+                      tMax, distanceLeft);
+    const bool hitRight =
+        IntersectAABB(bvh.Nodes[node.Index + 1].Bounds, origin, invDirection,
+                      tMin, tMax, distanceRight);
+    if (hitLeft && hitRight) {
+      if (distanceLeft <= distanceRight) {
+        push(node.Index + 1, distanceRight);
+        push(node.Index, distanceLeft);
+      } else {
+        push(node.Index, distanceLeft);
+        push(node.Index + 1, distanceRight);
+      }
+    } else if (hitLeft) {
+      push(node.Index, distanceLeft);
+    } else if (hitRight) {
+      push(node.Index + 1, distanceRight);
+    }
+  }
+  return hitAnything;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Triangle BVH over a single mesh in object space.
+class MeshBVH : public Object {
+public:
+  MeshBVH(const IMesh &mesh);
+  bool Intersect(const Ray &ray, RayHit &hit) const;
+  bool Occluded(const Ray &ray) const;
+  Vector3 GetNormal(uint32_t primitive) const;
+  const AABB &GetBounds() const;
+  // Call after changing Positions (e.g. skinning). The tree is refit, or
+  // rebuilt if refitting has made it more than rebuildThreshold times as
+  // expensive as a fresh build. Returns true if it was rebuilt.
+  bool Refit(float rebuildThreshold = 1.5f);
+  std::vector<Vector3> Positions;
+  std::vector<uint32_t> Indices;
+  BVH Tree;
+
+private:
+  BVHRefitter m_refitter;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Instance BVH over a whole scene. MeshBVHs are shared between instances that
+// share the same IMesh.
+//
+// Moving instances are handled by marking them with SetTransform() and calling
+// Update() once per frame; only the changed instances and their ancestors in
+// the instance tree are touched.
+class SceneBVH : public Object {
+public:
+  struct Entry {
+    std::shared_ptr<MeshBVH> Mesh;
+    Matrix44 ObjectToWorld;
+    Matrix44 WorldToObject;
+    AABB WorldBounds;
+  };
+  SceneBVH(const std::vector<Instance> &scene);
+  bool Intersect(const Ray &ray, RayHit &hit) const;
+  bool Occluded(const Ray &ray) const;
+  // Normalized world space geometric normal of a hit.
+  Vector3 GetNormal(const RayHit &hit) const;
+  // Move an instance. This is also how to flag an instance whose MeshBVH was
+  // refit; pass its current transform.
+  void SetTransform(uint32_t instance, const Matrix44 &objectToWorld);
+  // Apply all changes since the last update. The instance tree is refit, or
+  // rebuilt if it has degraded past rebuildThreshold (see BVHRefitter).
+  // Returns true if it was rebuilt.
+  bool Update(float rebuildThreshold = 1.5f);
+  std::vector<Entry> Instances;
+  BVH Tree;
+
+private:
+  std::vector<AABB> m_bounds;
+  std::vector<uint32_t> m_changed;
+  std::vector<bool> m_isChanged;
+  BVHRefitter m_refitter;
+};
\ No newline at end of file
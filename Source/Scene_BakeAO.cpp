@@ -0,0 +1,244 @@
+#include "Scene_BakeAO.h"
+#include "Core_Parallel.h"
+#include "Core_Sampling.h"
+#include "Scene_BVH.h"
+#include <float.h>
+#include <utility>
+
+// Vertices are handed to threads in batches to keep scheduling overhead low.
+static const uint32_t VERTEX_BATCH_SIZE = 256;
+
+MeshWithOcclusion::MeshWithOcclusion(std::shared_ptr<IMesh> mesh,
+                                     std::vector<float> occlusion)
+    : m_mesh(mesh), m_occlusion(std::move(occlusion)) {}
+
+uint32_t MeshWithOcclusion::getVertexCount() const {
+  return m_mesh->getVertexCount();
+}
+
+uint32_t MeshWithOcclusion::getIndexCount() const {
+  return m_mesh->getIndexCount();
+}
+
+void MeshWithOcclusion::copyVertices(void *to, uint32_t stride) const {
+  m_mesh->copyVertices(to, stride);
+}
+
+void MeshWithOcclusion::copyNormals(void *to, uint32_t stride) const {
+  m_mesh->copyNormals(to, stride);
+}
+
+void MeshWithOcclusion::copyTexcoords(void *to, uint32_t stride) const {
+  m_mesh->copyTexcoords(to, stride);
+}
+
+void MeshWithOcclusion::copyIndices(void *to, uint32_t stride) const {
+  m_mesh->copyIndices(to, stride);
+}
+
+void MeshWithOcclusion::copyOcclusion(void *to, uint32_t stride) const {
+  for (size_t i = 0; i < m_occlusion.size(); ++i) {
+    *reinterpret_cast<float *>(to) = m_occlusion[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Trace one stratified hemisphere of rays and return the unoccluded fraction.
+static float ComputeOcclusion(const SceneBVH &bvh, const Vector3 &position,
+                              const Vector3 &normal, uint32_t seed,
+                              const BakeAOSettings &settings) {
+  uint32_t strata = (uint32_t)SquareRoot((float)settings.SampleCount);
+  if (strata < 1)
+    strata = 1;
+  Vector3 tangent, bitangent;
+  CreateBasis(normal, tangent, bitangent);
+  Vector3 origin = position + normal * settings.Bias;
+  uint32_t state = HashPCG(seed);
+  uint32_t open = 0;
+  for (uint32_t sy = 0; sy < strata; ++sy) {
+    for (uint32_t sx = 0; sx < strata; ++sx) {
+      Vector2 uv = {(sx + RandomUnit(state)) / strata,
+                    (sy + RandomUnit(state)) / strata};
+      Vector3 local = SampleHemisphereCosine(uv);
+      Vector3 direction =
+          tangent * local.X + bitangent * local.Y + normal * local.Z;
+      Ray ray = {origin, direction, 0, settings.MaxDistance};
+      if (!bvh.Occluded(ray))
+        ++open;
+    }
+  }
+  return (float)open / (strata * strata);
+}
+
+std::vector<Instance> BakeAO_PerVertex(const std::vector<Instance> &scene,
+                                       const SceneBVH &bvh,
+                                       const BakeAOSettings &settings) {
+  std::vector<Instance> result;
+  for (uint32_t instanceIndex = 0; instanceIndex < scene.size();
+       ++instanceIndex) {
+    const Instance &instance = scene[instanceIndex];
+    const Matrix44 &objectToWorld = *instance.TransformObjectToWorld;
+    const Matrix44 normalToWorld = Transpose(Invert(objectToWorld));
+    uint32_t vertexCount = instance.Mesh->getVertexCount();
+    std::vector<Vector3> positions(vertexCount);
+    std::vector<Vector3> normals(vertexCount);
+    std::vector<float> occlusion(vertexCount);
+    if (vertexCount > 0) {
+      instance.Mesh->copyVertices(&positions[0], sizeof(Vector3));
+      instance.Mesh->copyNormals(&normals[0], sizeof(Vector3));
+    }
+    uint32_t batchCount =
+        (vertexCount + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE;
+    ParallelFor(batchCount, [&](uint32_t batch) {
+      uint32_t end = (batch + 1) * VERTEX_BATCH_SIZE;
+      if (end > vertexCount)
+        end = vertexCount;
+      for (uint32_t v = batch * VERTEX_BATCH_SIZE; v < end; ++v) {
+        Vector3 position = TransformPoint(objectToWorld, positions[v]);
+        Vector3 normal =
+            Normalize(TransformVector(normalToWorld, normals[v]));
+        uint32_t seed = settings.Seed ^ HashPCG(instanceIndex) ^ HashPCG(v);
+        occlusion[v] =
+            ComputeOcclusion(bvh, position, normal, seed, settings);
+      }
+    });
+    Instance baked = instance;
+    baked.Mesh.reset(
+        new MeshWithOcclusion(instance.Mesh, std::move(occlusion)));
+    result.push_back(baked);
+  }
+  return result;
+}
+
+std::unique_ptr<IImage> BakeAO_Lightmap(const Instance &instance,
+                                        const SceneBVH &bvh, uint32_t width,
+                                        uint32_t height,
+                                        const Vector2 *texcoords,
+                                        const BakeAOSettings &settings) {
+  const Matrix44 &objectToWorld = *instance.TransformObjectToWorld;
+  const Matrix44 normalToWorld = Transpose(Invert(objectToWorld));
+  uint32_t vertexCount = instance.Mesh->getVertexCount();
+  uint32_t indexCount = instance.Mesh->getIndexCount();
+  std::vector<Vector3> positions(vertexCount);
+  std::vector<Vector3> normals(vertexCount);
+  std::vector<Vector2> uvs(vertexCount);
+  std::vector<uint32_t> indices(indexCount);
+  if (vertexCount > 0) {
+    instance.Mesh->copyVertices(&positions[0], sizeof(Vector3));
+    instance.Mesh->copyNormals(&normals[0], sizeof(Vector3));
+    if (texcoords != nullptr) {
+      uvs.assign(texcoords, texcoords + vertexCount);
+    } else {
+      instance.Mesh->copyTexcoords(&uvs[0], sizeof(Vector2));
+    }
+  }
+  if (indexCount > 0)
+    instance.Mesh->copyIndices(&indices[0], sizeof(uint32_t));
+  ////////////////////////////////////////////////////////////////////////////////
+  // Rasterize triangles in UV space to find the surface point of every texel.
+  // This is cheap and serial; the ray tracing below is the expensive part.
+  struct Texel {
+    uint32_t Triangle; // UINT32_MAX if no triangle covers this texel.
+    float U, V;
+  };
+  std::vector<Texel> texels(width * height, Texel{UINT32_MAX, 0, 0});
+  for (uint32_t t = 0; t < indexCount / 3; ++t) {
+    Vector2 p0 = uvs[indices[3 * t + 0]];
+    Vector2 p1 = uvs[indices[3 * t + 1]];
+    Vector2 p2 = uvs[indices[3 * t + 2]];
+    p0 = {p0.X * width, p0.Y * height};
+    p1 = {p1.X * width, p1.Y * height};
+    p2 = {p2.X * width, p2.Y * height};
+    float area = (p1.X - p0.X) * (p2.Y - p0.Y) - (p2.X - p0.X) * (p1.Y - p0.Y);
+    if (area == 0)
+      continue;
+    float minX = p0.X < p1.X ? (p0.X < p2.X ? p0.X : p2.X)
+                             : (p1.X < p2.X ? p1.X : p2.X);
+    float maxX = p0.X > p1.X ? (p0.X > p2.X ? p0.X : p2.X)
+                             : (p1.X > p2.X ? p1.X : p2.X);
+    float minY = p0.Y < p1.Y ? (p0.Y < p2.Y ? p0.Y : p2.Y)
+                             : (p1.Y < p2.Y ? p1.Y : p2.Y);
+    float maxY = p0.Y > p1.Y ? (p0.Y > p2.Y ? p0.Y : p2.Y)
+                             : (p1.Y > p2.Y ? p1.Y : p2.Y);
+    int32_t x0 = minX < 0 ? 0 : (int32_t)minX;
+    int32_t y0 = minY < 0 ? 0 : (int32_t)minY;
+    int32_t x1 = maxX >= width ? width - 1 : (int32_t)maxX;
+    int32_t y1 = maxY >= height ? height - 1 : (int32_t)maxY;
+    for (int32_t y = y0; y <= y1; ++y) {
+      for (int32_t x = x0; x <= x1; ++x) {
+        Vector2 p = {x + 0.5f, y + 0.5f};
+        Vector2 d = p - p0;
+        float u = (d.X * (p2.Y - p0.Y) - (p2.X - p0.X) * d.Y) / area;
+        float v = ((p1.X - p0.X) * d.Y - d.X * (p1.Y - p0.Y)) / area;
+        if (u < 0 || v < 0 || u + v > 1)
+          continue;
+        texels[x + y * width] = {t, u, v};
+      }
+    }
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Trace every covered texel; rows are distributed across threads.
+  std::unique_ptr<float[]> finalImage(new float[width * height]);
+  ParallelFor(height, [&](uint32_t y) {
+    for (uint32_t x = 0; x < width; ++x) {
+      const Texel &texel = texels[x + y * width];
+      if (texel.Triangle == UINT32_MAX) {
+        finalImage[x + y * width] = -1;
+        continue;
+      }
+      uint32_t i0 = indices[3 * texel.Triangle + 0];
+      uint32_t i1 = indices[3 * texel.Triangle + 1];
+      uint32_t i2 = indices[3 * texel.Triangle + 2];
+      float w = 1 - texel.U - texel.V;
+      Vector3 position = positions[i0] * w + positions[i1] * texel.U +
+                         positions[i2] * texel.V;
+      Vector3 normal =
+          normals[i0] * w + normals[i1] * texel.U + normals[i2] * texel.V;
+      position = TransformPoint(objectToWorld, position);
+      normal = Normalize(TransformVector(normalToWorld, normal));
+      uint32_t seed = settings.Seed ^ HashPCG(x + y * width);
+      finalImage[x + y * width] =
+          ComputeOcclusion(bvh, position, normal, seed, settings);
+    }
+  });
+  ////////////////////////////////////////////////////////////////////////////////
+  // Dilate into uncovered texels so bilinear filtering does not pull in black
+  // at chart edges; anything still uncovered after that is left open.
+  for (int pass = 0; pass < 2; ++pass) {
+    std::unique_ptr<float[]> dilated(new float[width * height]);
+    for (uint32_t y = 0; y < height; ++y) {
+      for (uint32_t x = 0; x < width; ++x) {
+        float value = finalImage[x + y * width];
+        if (value < 0) {
+          float sum = 0;
+          int count = 0;
+          for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+              int32_t nx = (int32_t)x + dx;
+              int32_t ny = (int32_t)y + dy;
+              if (nx < 0 || ny < 0 || nx >= (int32_t)width ||
+                  ny >= (int32_t)height)
+                continue;
+              float neighbor = finalImage[nx + ny * width];
+              if (neighbor >= 0) {
+                sum += neighbor;
+                ++count;
+              }
+            }
+          }
+          if (count > 0)
+            value = sum / count;
+        }
+        dilated[x + y * width] = value;
+      }
+    }
+    finalImage.swap(dilated);
+  }
+  for (uint32_t i = 0; i < width * height; ++i) {
+    if (finalImage[i] < 0)
+      finalImage[i] = 1;
+  }
+  return CreateImage_AutoDelete(width, height, sizeof(float) * width,
+                                DXGI_FORMAT_R32_FLOAT, finalImage.release());
+}
\ No newline at end of file
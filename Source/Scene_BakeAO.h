@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Core_IImage.h"
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_IMesh.h"
+#include "Scene_InstanceTable.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class SceneBVH;
+
+////////////////////////////////////////////////////////////////////////////////
+// Ambient Occlusion Baker
+//
+// Computes ambient occlusion once on the CPU for instances which never move,
+// tracing stratified cosine weighted hemisphere rays against a SceneBVH. The
+// result is 1 for fully open surfaces and 0 for fully occluded ones.
+////////////////////////////////////////////////////////////////////////////////
+
+struct BakeAOSettings {
+  // Rays per sample point; rounded down to a square for stratification.
+  uint32_t SampleCount = 64;
+  // Occluders further away than this do not count.
+  float MaxDistance = 1.0f;
+  // Ray origins are pushed this far along the normal to avoid self hits.
+  float Bias = 1e-3f;
+  uint32_t Seed = 0;
+};
+
+// A mesh decorated with a baked per-vertex occlusion stream. All of the usual
+// streams are forwarded to the original mesh.
+class MeshWithOcclusion : public Object, public IMesh {
+public:
+  MeshWithOcclusion(std::shared_ptr<IMesh> mesh, std::vector<float> occlusion);
+  uint32_t getVertexCount() const override;
+  uint32_t getIndexCount() const override;
+  void copyVertices(void *to, uint32_t stride) const override;
+  void copyNormals(void *to, uint32_t stride) const override;
+  void copyTexcoords(void *to, uint32_t stride) const override;
+  void copyIndices(void *to, uint32_t stride) const override;
+  void copyOcclusion(void *to, uint32_t stride) const;
+
+private:
+  std::shared_ptr<IMesh> m_mesh;
+  std::vector<float> m_occlusion;
+};
+
+// Bake occlusion at every vertex of every instance. The returned scene matches
+// the input except each mesh is replaced by a MeshWithOcclusion. Occlusion is
+// world dependent so instances which shared a mesh no longer do.
+std::vector<Instance> BakeAO_PerVertex(const std::vector<Instance> &scene,
+                                       const SceneBVH &bvh,
+                                       const BakeAOSettings &settings = {});
+
+// Bake occlusion for one instance into an R32_FLOAT lightmap. The texcoords
+// must not overlap; pass a per-vertex lightmap UV set or null to use the mesh
+// texcoords as-is.
+std::unique_ptr<IImage> BakeAO_Lightmap(const Instance &instance,
+                                        const SceneBVH &bvh, uint32_t width,
+                                        uint32_t height,
+                                        const Vector2 *texcoords = nullptr,
+                                        const BakeAOSettings &settings = {});
\ No newline at end of file
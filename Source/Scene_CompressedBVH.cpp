@@ -0,0 +1,307 @@
+#include "Scene_CompressedBVH.h"
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+
+// Leaf children address their primitives with 2 bits of count.
+static const uint32_t MAX_LEAF_SIZE = 4;
+
+////////////////////////////////////////////////////////////////////////////////
+// Collapse.
+//
+// Each compressed node starts from one subtree of the binary BVH and greedily
+// opens the child with the largest surface area until it has 8 children or
+// only leaves are left. Binary leaves that are too big for one compressed
+// leaf are opened by halving their primitive range.
+
+struct CollapseChild {
+  // A binary interior node, or UINT32_MAX for a range of BVH::Primitives.
+  uint32_t Node;
+  uint32_t First;
+  uint32_t Count;
+  AABB Bounds;
+};
+
+// The binary tree and the number of compressed leaves under each of its
+// nodes.
+struct CollapseSource {
+  const BVH &Tree;
+  const AABB *Bounds;
+  std::vector<uint32_t> SubtreeLeaves;
+};
+
+static uint32_t CountLeaves(const CollapseSource &source,
+                            const CollapseChild &child) {
+  if (child.Node != UINT32_MAX)
+    return source.SubtreeLeaves[child.Node];
+  return (child.Count + MAX_LEAF_SIZE - 1) / MAX_LEAF_SIZE;
+}
+
+static CollapseChild MakeChild(const CollapseSource &source,
+                               uint32_t nodeIndex) {
+  const BVHNode &node = source.Tree.Nodes[nodeIndex];
+  if (node.Count > 0)
+    return {UINT32_MAX, node.Index, node.Count, node.Bounds};
+  return {nodeIndex, 0, 0, node.Bounds};
+}
+
+static bool IsLeaf(const CollapseChild &child) {
+  return child.Node == UINT32_MAX && child.Count <= MAX_LEAF_SIZE;
+}
+
+// "child" is taken by value since it is usually overwritten by "left".
+static void Open(const CollapseSource &source, CollapseChild child,
+                 CollapseChild &left, CollapseChild &right) {
+  const BVH &bvh = source.Tree;
+  const AABB *bounds = source.Bounds;
+  if (child.Node != UINT32_MAX) {
+    left = MakeChild(source, bvh.Nodes[child.Node].Index);
+    right = MakeChild(source, bvh.Nodes[child.Node].Index + 1);
+    return;
+  }
+  uint32_t half = child.Count / 2;
+  left = {UINT32_MAX, child.First, half, EmptyAABB()};
+  right = {UINT32_MAX, child.First + half, child.Count - half, EmptyAABB()};
+  for (uint32_t i = 0; i < left.Count; ++i) {
+    left.Bounds = Union(left.Bounds, bounds[bvh.Primitives[left.First + i]]);
+  }
+  for (uint32_t i = 0; i < right.Count; ++i) {
+    right.Bounds =
+        Union(right.Bounds, bounds[bvh.Primitives[right.First + i]]);
+  }
+}
+
+// Smallest power of two grid that spans "extent" in 255 steps.
+static int8_t ChooseExponent(float extent) {
+  if (!(extent > 0))
+    return -126;
+  int exponent = (int)ceilf(log2f(extent / 255));
+  while (ldexpf(1, exponent) * 255 < extent) {
+    ++exponent;
+  }
+  if (exponent < -126)
+    exponent = -126;
+  if (exponent > 127)
+    exponent = 127;
+  return (int8_t)exponent;
+}
+
+// Quantize so the dequantized interval always contains [lo, hi].
+static void Quantize(float lo, float hi, float origin, int8_t exponent,
+                     uint8_t &qlo, uint8_t &qhi) {
+  float scale = ldexpf(1, exponent);
+  float a = floorf((lo - origin) / scale);
+  float b = ceilf((hi - origin) / scale);
+  a = a < 0 ? 0 : (a > 255 ? 255 : a);
+  b = b < 0 ? 0 : (b > 255 ? 255 : b);
+  if (origin + a * scale > lo && a > 0)
+    a -= 1;
+  if (origin + b * scale < hi && b < 255)
+    b += 1;
+  qlo = (uint8_t)a;
+  qhi = (uint8_t)b;
+}
+
+static void Collapse(CompressedBVH &out, const CollapseSource &source,
+                     const CollapseChild &root, uint32_t nodeIndex) {
+  CollapseChild children[8];
+  uint32_t childCount = 0;
+  children[childCount++] = root;
+  while (childCount < 8) {
+    // A subtree that fits in the free slots is opened first; left as an
+    // interior child it would become a node with only a few children.
+    int best = -1;
+    bool bestFits = false;
+    float bestArea = -1;
+    for (uint32_t i = 0; i < childCount; ++i) {
+      if (IsLeaf(children[i]))
+        continue;
+      bool fits = CountLeaves(source, children[i]) <= 9 - childCount;
+      float area = SurfaceArea(children[i].Bounds);
+      if ((fits && !bestFits) || (fits == bestFits && area > bestArea)) {
+        best = (int)i;
+        bestFits = fits;
+        bestArea = area;
+      }
+    }
+    if (best == -1)
+      break;
+    Open(source, children[best], children[best], children[childCount]);
+    ++childCount;
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Lay out interior children contiguously, and leaf primitives contiguously.
+  CompressedBVHNode node = {};
+  node.Origin = root.Bounds.Min;
+  node.Exponent[0] = ChooseExponent(root.Bounds.Max.X - root.Bounds.Min.X);
+  node.Exponent[1] = ChooseExponent(root.Bounds.Max.Y - root.Bounds.Min.Y);
+  node.Exponent[2] = ChooseExponent(root.Bounds.Max.Z - root.Bounds.Min.Z);
+  node.ChildBase = (uint32_t)out.Nodes.size();
+  node.PrimitiveBase = (uint32_t)out.Primitives.size();
+  uint32_t interiorCount = 0;
+  uint32_t primitiveOffset = 0;
+  for (uint32_t i = 0; i < childCount; ++i) {
+    const CollapseChild &child = children[i];
+    node.ChildMask |= 1 << i;
+    if (IsLeaf(child)) {
+      node.Meta[i] =
+          (uint8_t)(0x80 | ((child.Count - 1) << 5) | primitiveOffset);
+      for (uint32_t j = 0; j < child.Count; ++j) {
+        out.Primitives.push_back(source.Tree.Primitives[child.First + j]);
+      }
+      primitiveOffset += child.Count;
+    } else {
+      node.Meta[i] = (uint8_t)(0x40 | interiorCount++);
+    }
+    Quantize(child.Bounds.Min.X, child.Bounds.Max.X, node.Origin.X,
+             node.Exponent[0], node.MinX[i], node.MaxX[i]);
+    Quantize(child.Bounds.Min.Y, child.Bounds.Max.Y, node.Origin.Y,
+             node.Exponent[1], node.MinY[i], node.MaxY[i]);
+    Quantize(child.Bounds.Min.Z, child.Bounds.Max.Z, node.Origin.Z,
+             node.Exponent[2], node.MinZ[i], node.MaxZ[i]);
+  }
+  out.Nodes.resize(out.Nodes.size() + interiorCount);
+  out.Nodes[nodeIndex] = node;
+  uint32_t interiorIndex = 0;
+  for (uint32_t i = 0; i < childCount; ++i) {
+    if (!IsLeaf(children[i])) {
+      Collapse(out, source, children[i], node.ChildBase + interiorIndex++);
+    }
+  }
+}
+
+CompressedBVH::CompressedBVH(const BVH &bvh, const AABB *bounds) {
+  if (bvh.Nodes.empty())
+    return;
+  ////////////////////////////////////////////////////////////////////////////////
+  // Children follow their parent, so one backward pass sees both children
+  // of a node before the node itself. The counts only order the collapse,
+  // so a tree laid out otherwise still comes out correct.
+  CollapseSource source = {bvh, bounds};
+  source.SubtreeLeaves.resize(bvh.Nodes.size());
+  for (uint32_t i = (uint32_t)bvh.Nodes.size(); i-- > 0;) {
+    const BVHNode &node = bvh.Nodes[i];
+    source.SubtreeLeaves[i] =
+        node.Count > 0 ? (node.Count + MAX_LEAF_SIZE - 1) / MAX_LEAF_SIZE
+                       : source.SubtreeLeaves[node.Index] +
+                             source.SubtreeLeaves[node.Index + 1];
+  }
+  Nodes.push_back({});
+  Collapse(*this, source, MakeChild(source, 0), 0);
+}
+
+size_t CompressedBVH::GetMemoryUsage() const {
+  return Nodes.size() * sizeof(CompressedBVHNode) +
+         Primitives.size() * sizeof(uint32_t);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Child intersection; two groups of four children, one SSE register each.
+
+static __m128 LoadQuantized(const uint8_t *q) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i bytes = _mm_cvtsi32_si128(*reinterpret_cast<const int32_t *>(q));
+  __m128i words = _mm_unpacklo_epi8(bytes, zero);
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+}
+
+static float ExponentToScale(int8_t exponent) {
+  // Build 2^exponent directly in the float exponent field.
+  union {
+    uint32_t Bits;
+    float Value;
+  } scale;
+  scale.Bits = (uint32_t)(exponent + 127) << 23;
+  return scale.Value;
+}
+
+uint32_t IntersectChildren(const CompressedBVHNode &node, const Vector3 &origin,
+                           const Vector3 &invDirection, float tMin, float tMax,
+                           float distances[8]) {
+  // Fold the node origin and grid scale into the ray so each child plane is
+  // one multiply-add away: t = q * (scale / d) + (nodeOrigin - o) / d.
+  __m128 scaleX = _mm_set1_ps(ExponentToScale(node.Exponent[0]) *
+                              invDirection.X);
+  __m128 scaleY = _mm_set1_ps(ExponentToScale(node.Exponent[1]) *
+                              invDirection.Y);
+  __m128 scaleZ = _mm_set1_ps(ExponentToScale(node.Exponent[2]) *
+                              invDirection.Z);
+  __m128 offsetX = _mm_set1_ps((node.Origin.X - origin.X) * invDirection.X);
+  __m128 offsetY = _mm_set1_ps((node.Origin.Y - origin.Y) * invDirection.Y);
+  __m128 offsetZ = _mm_set1_ps((node.Origin.Z - origin.Z) * invDirection.Z);
+  __m128 rayMin = _mm_set1_ps(tMin);
+  __m128 rayMax = _mm_set1_ps(tMax);
+  uint32_t mask = 0;
+  for (uint32_t half = 0; half < 2; ++half) {
+    uint32_t base = half * 4;
+    __m128 t1x = _mm_add_ps(
+        _mm_mul_ps(LoadQuantized(node.MinX + base), scaleX), offsetX);
+    __m128 t2x = _mm_add_ps(
+        _mm_mul_ps(LoadQuantized(node.MaxX + base), scaleX), offsetX);
+    __m128 t1y = _mm_add_ps(
+        _mm_mul_ps(LoadQuantized(node.MinY + base), scaleY), offsetY);
+    __m128 t2y = _mm_add_ps(
+        _mm_mul_ps(LoadQuantized(node.MaxY + base), scaleY), offsetY);
+    __m128 t1z = _mm_add_ps(
+        _mm_mul_ps(LoadQuantized(node.MinZ + base), scaleZ), offsetZ);
+    __m128 t2z = _mm_add_ps(
+        _mm_mul_ps(LoadQuantized(node.MaxZ + base), scaleZ), offsetZ);
+    __m128 tNear = _mm_max_ps(
+        _mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)),
+        _mm_max_ps(_mm_min_ps(t1z, t2z), rayMin));
+    __m128 tFar = _mm_min_ps(
+        _mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)),
+        _mm_min_ps(_mm_max_ps(t1z, t2z), rayMax));
+    mask |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) << base;
+    _mm_storeu_ps(distances + base, tNear);
+  }
+  return mask & node.ChildMask;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Triangle mesh.
+
+CompressedMeshBVH::CompressedMeshBVH(const MeshBVH &mesh)
+    : Positions(mesh.Positions), Indices(mesh.Indices) {
+  uint32_t triangleCount = (uint32_t)Indices.size() / 3;
+  std::vector<AABB> bounds(triangleCount);
+  for (uint32_t t = 0; t < triangleCount; ++t) {
+    AABB box = EmptyAABB();
+    box = Union(box, Positions[Indices[3 * t + 0]]);
+    box = Union(box, Positions[Indices[3 * t + 1]]);
+    box = Union(box, Positions[Indices[3 * t + 2]]);
+    bounds[t] = box;
+  }
+  Tree = CompressedBVH(mesh.Tree, bounds.data());
+}
+
+bool CompressedMeshBVH::Intersect(const Ray &ray, RayHit &hit) const {
+  float tMax = hit.T < ray.TMax ? hit.T : ray.TMax;
+  return TraverseCompressedBVH(
+      Tree, ray.Origin, ray.Direction, ray.TMin, tMax, false,
+      [&](uint32_t triangle, float &tMax) {
+        if (!IntersectTriangle(ray.Origin, ray.Direction,
+                               Positions[Indices[3 * triangle + 0]],
+                               Positions[Indices[3 * triangle + 1]],
+                               Positions[Indices[3 * triangle + 2]], ray.TMin,
+                               tMax, hit.U, hit.V))
+          return false;
+        hit.T = tMax;
+        hit.Primitive = triangle;
+        return true;
+      });
+}
+
+bool CompressedMeshBVH::Occluded(const Ray &ray) const {
+  float tMax = ray.TMax;
+  return TraverseCompressedBVH(
+      Tree, ray.Origin, ray.Direction, ray.TMin, tMax, true,
+      [&](uint32_t triangle, float &tMax) {
+        float u, v;
+        return IntersectTriangle(ray.Origin, ray.Direction,
+                                 Positions[Indices[3 * triangle + 0]],
+                                 Positions[Indices[3 * triangle + 1]],
+                                 Positions[Indices[3 * triangle + 2]],
+                                 ray.TMin, tMax, u, v);
+      });
+}
\ No newline at end of file
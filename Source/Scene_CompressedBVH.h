@@ -0,0 +1,151 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_BVH.h"
+#include <stdint.h>
+#include <vector>
+
+class IMesh;
+
+////////////////////////////////////////////////////////////////////////////////
+// Compressed 8-wide BVH
+//
+// Incoherent rays spend most of their time waiting on node fetches. This
+// collapses a binary BVH into 8-wide nodes (Ylitie et al., "Efficient
+// Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs"): each node
+// stores its own bounds at full precision and the bounds of its 8 children as
+// 8-bit offsets on a power-of-two grid, so all 8 children fit in one 80 byte
+// node and are tested together with SIMD. Dequantized boxes are always at
+// least as large as the originals, so no hits are lost.
+////////////////////////////////////////////////////////////////////////////////
+
+// Child i exists if bit i of ChildMask is set. Leaf children have bit 7 of
+// Meta[i] set and hold ((Meta[i] >> 5) & 3) + 1 primitives starting at
+// PrimitiveBase + (Meta[i] & 31); interior children are node
+// ChildBase + (Meta[i] & 7).
+struct CompressedBVHNode {
+  Vector3 Origin;
+  // Per axis grid spacing is 2^Exponent.
+  int8_t Exponent[3];
+  uint8_t ChildMask;
+  uint32_t ChildBase;
+  uint32_t PrimitiveBase;
+  uint8_t Meta[8];
+  uint8_t MinX[8], MinY[8], MinZ[8];
+  uint8_t MaxX[8], MaxY[8], MaxZ[8];
+};
+
+class CompressedBVH {
+public:
+  CompressedBVH() = default;
+  // Collapse a binary BVH built over "bounds". Binary leaves with more than
+  // four primitives are split into several compressed leaves.
+  CompressedBVH(const BVH &bvh, const AABB *bounds);
+  size_t GetMemoryUsage() const;
+  std::vector<CompressedBVHNode> Nodes;
+  std::vector<uint32_t> Primitives;
+};
+
+// Test a ray against all 8 children of a node. Returns a bit mask of the
+// children hit and writes their entry distances.
+uint32_t IntersectChildren(const CompressedBVHNode &node, const Vector3 &origin,
+                           const Vector3 &invDirection, float tMin, float tMax,
+                           float distances[8]);
+
+////////////////////////////////////////////////////////////////////////////////
+// Same contract as TraverseBVH: "leaf(primitive, tMax)" returns true on a hit
+// and shrinks tMax. Children are visited nearest first.
+template <class LEAF>
+bool TraverseCompressedBVH(const CompressedBVH &bvh, const Vector3 &origin,
+                           const Vector3 &direction, float tMin, float &tMax,
+                           bool anyHit, LEAF leaf) {
+  if (bvh.Nodes.empty())
+    return false;
+  const Vector3 invDirection = {1 / direction.X, 1 / direction.Y,
+                                1 / direction.Z};
+  // Entries are node indices, or (leaf bit | first primitive << 2 | count-1).
+  struct StackEntry {
+    uint32_t Item;
+    float Distance;
+  };
+  const uint32_t LEAF_BIT = 0x80000000;
+  // As in TraverseBVH, trees deeper than the fixed stack spill onto the heap.
+  StackEntry stack[512];
+  uint32_t stackSize = 0;
+  std::vector<StackEntry> spill;
+  auto push = [&](const StackEntry &entry) {
+    if (stackSize < 512)
+      stack[stackSize++] = entry;
+    else
+      spill.push_back(entry);
+  };
+  push({0, tMin});
+  bool hitAnything = false;
+  while (stackSize > 0) {
+    StackEntry entry;
+    if (!spill.empty()) {
+      entry = spill.back();
+      spill.pop_back();
+    } else {
+      entry = stack[--stackSize];
+    }
+    if (entry.Distance > tMax)
+      continue;
+    if (entry.Item & LEAF_BIT) {
+      uint32_t first = (entry.Item & ~LEAF_BIT) >> 2;
+      uint32_t count = (entry.Item & 3) + 1;
+      for (uint32_t i = 0; i < count; ++i) {
+        if (leaf(bvh.Primitives[first + i], tMax)) {
+          hitAnything = true;
+          if (anyHit)
+            return true;
+        }
+      }
+      continue;
+    }
+    const CompressedBVHNode &node = bvh.Nodes[entry.Item];
+    float distances[8];
+    uint32_t mask =
+        IntersectChildren(node, origin, invDirection, tMin, tMax, distances);
+    // Sort the hit children far to near so the nearest is popped first.
+    StackEntry children[8];
+    uint32_t childCount = 0;
+    for (uint32_t i = 0; i < 8; ++i) {
+      if (!(mask & (1 << i)))
+        continue;
+      uint32_t meta = node.Meta[i];
+      StackEntry child;
+      child.Distance = distances[i];
+      if (meta & 0x80) {
+        child.Item = LEAF_BIT | ((node.PrimitiveBase + (meta & 31)) << 2) |
+                     ((meta >> 5) & 3);
+      } else {
+        child.Item = node.ChildBase + (meta & 7);
+      }
+      uint32_t j = childCount++;
+      while (j > 0 && children[j - 1].Distance < child.Distance) {
+        children[j] = children[j - 1];
+        --j;
+      }
+      children[j] = child;
+    }
+    for (uint32_t i = 0; i < childCount; ++i) {
+      push(children[i]);
+    }
+  }
+  return hitAnything;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Triangle mesh over a compressed tree; a drop-in for MeshBVH queries when
+// the mesh is static and memory bound.
+class CompressedMeshBVH : public Object {
+public:
+  CompressedMeshBVH(const MeshBVH &mesh);
+  bool Intersect(const Ray &ray, RayHit &hit) const;
+  bool Occluded(const Ray &ray) const;
+  std::vector<Vector3> Positions;
+  std::vector<uint32_t> Indices;
+  CompressedBVH Tree;
+};
\ No newline at end of file
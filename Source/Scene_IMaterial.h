@@ -1,6 +1,8 @@
 #pragma once
 
+#include "Core_Math.h"
 #include "Core_Object.h"
+#include <memory>
 #include <string>
 
 class IMaterial {
@@ -12,6 +14,12 @@ class Checkerboard : public Object, public IMaterial {};
 
 class RedPlastic : public Object, public IMaterial {};
 
+// A one-sided area light; triangles emit on the side of Cross(p1-p0, p2-p0).
+class Emissive : public Object, public IMaterial {
+public:
+  Vector3 Emission;
+};
+
 class TextureImage : public Object {
 public:
   std::string Filename;
@@ -1,10 +1,40 @@
 #pragma once
 
 #include "Core_Math.h"
+#include <stdint.h>
+#include <vector>
 
 class IParametricUV {
 public:
   virtual ~IParametricUV() = default;
   virtual Vector3 getVertexPosition(Vector2 uv) = 0;
   virtual Vector3 getVertexNormal(Vector2 uv) = 0;
+  // Evaluate a span of points in one call. Either output may be null. Shapes
+  // override this to share work between the position and normal or to use
+  // SIMD; it may be called from several threads at once.
+  virtual void evaluate(const Vector2 *uv, uint32_t count, Vector3 *positions,
+                        Vector3 *normals) {
+    for (uint32_t i = 0; i < count; ++i) {
+      if (positions != nullptr)
+        positions[i] = getVertexPosition(uv[i]);
+      if (normals != nullptr)
+        normals[i] = getVertexNormal(uv[i]);
+    }
+  }
+  // Evaluate every combination of the given u and v, u varying fastest, so
+  // that countU * countV points are written to each non-null output. Shapes
+  // which are separable in u and v override this to compute each row and
+  // column term only once.
+  virtual void evaluateGrid(const float *u, uint32_t countU, const float *v,
+                            uint32_t countV, Vector3 *positions,
+                            Vector3 *normals) {
+    std::vector<Vector2> uv(countU);
+    for (uint32_t row = 0; row < countV; ++row) {
+      for (uint32_t column = 0; column < countU; ++column)
+        uv[column] = {u[column], v[row]};
+      const uint32_t offset = row * countU;
+      evaluate(&uv[0], countU, positions ? positions + offset : nullptr,
+               normals ? normals + offset : nullptr);
+    }
+  }
 };
\ No newline at end of file
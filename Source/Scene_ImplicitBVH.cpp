@@ -0,0 +1,502 @@
+#include "Scene_ImplicitBVH.h"
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+
+// Primitives per leaf block; two SSE registers wide.
+static const uint32_t BLOCK_WIDTH = 8;
+
+// Floats per primitive in each block layout.
+static const uint32_t SPHERE_FIELDS = 4;   // Center, Radius^2
+static const uint32_t PLANE_FIELDS = 12;   // Center, Normal, dual U, dual V
+static const uint32_t BOX_FIELDS = 6;      // Min, Max
+static const uint32_t QUADRIC_FIELDS = 16; // A-J, Min, Max
+
+static const uint32_t FIELD_COUNT[ShapeCount] = {SPHERE_FIELDS, PLANE_FIELDS,
+                                                 BOX_FIELDS, QUADRIC_FIELDS};
+
+////////////////////////////////////////////////////////////////////////////////
+// Block construction.
+//
+// A BVH is built over the primitive bounds with up to 8 primitives per leaf,
+// then every leaf is rewritten to point at the blocks holding its primitives.
+// Unused lanes are filled with NaN, which fails every comparison in the
+// kernels and so can never report a hit.
+template <class WRITE>
+static void BuildBlocks(const std::vector<AABB> &bounds, uint32_t fieldCount,
+                        BVH &tree, std::vector<float> &blocks,
+                        std::vector<uint32_t> &lanes, WRITE write) {
+  tree = BuildBVH(bounds.data(), (uint32_t)bounds.size(), BLOCK_WIDTH);
+  uint32_t blockCount = 0;
+  for (auto &node : tree.Nodes) {
+    if (node.Count == 0)
+      continue;
+    uint32_t first = node.Index;
+    uint32_t count = node.Count;
+    node.Index = blockCount;
+    node.Count = (count + BLOCK_WIDTH - 1) / BLOCK_WIDTH;
+    blocks.resize((blockCount + node.Count) * fieldCount * BLOCK_WIDTH, NAN);
+    lanes.resize((blockCount + node.Count) * BLOCK_WIDTH, UINT32_MAX);
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t block = blockCount + i / BLOCK_WIDTH;
+      uint32_t lane = i % BLOCK_WIDTH;
+      uint32_t primitive = tree.Primitives[first + i];
+      write(&blocks[block * fieldCount * BLOCK_WIDTH + lane], primitive);
+      lanes[block * BLOCK_WIDTH + lane] = primitive;
+    }
+    blockCount += node.Count;
+  }
+  // Leaves now index blocks directly.
+  tree.Primitives.resize(blockCount);
+  for (uint32_t i = 0; i < blockCount; ++i) {
+    tree.Primitives[i] = i;
+  }
+}
+
+ImplicitBVH::ImplicitBVH(const std::vector<ImplicitSphere> &spheres,
+                         const std::vector<ImplicitPlane> &planes,
+                         const std::vector<AABB> &boxes,
+                         const std::vector<ImplicitQuadric> &quadrics)
+    : m_spheres(spheres), m_planes(planes), m_boxes(boxes),
+      m_quadrics(quadrics) {
+  // Field f of a lane lives at lane[f * BLOCK_WIDTH].
+  std::vector<AABB> bounds;
+  for (uint32_t i = 0; i < m_spheres.size(); ++i) {
+    bounds.push_back(GetPrimitiveBounds(ShapeSphere, i));
+  }
+  BuildBlocks(bounds, SPHERE_FIELDS, m_groups[ShapeSphere].Tree,
+              m_groups[ShapeSphere].Blocks, m_groups[ShapeSphere].Lanes,
+              [&](float *lane, uint32_t i) {
+                const ImplicitSphere &sphere = m_spheres[i];
+                lane[0 * BLOCK_WIDTH] = sphere.Center.X;
+                lane[1 * BLOCK_WIDTH] = sphere.Center.Y;
+                lane[2 * BLOCK_WIDTH] = sphere.Center.Z;
+                lane[3 * BLOCK_WIDTH] = sphere.Radius * sphere.Radius;
+              });
+  bounds.clear();
+  for (uint32_t i = 0; i < m_planes.size(); ++i) {
+    bounds.push_back(GetPrimitiveBounds(ShapePlane, i));
+  }
+  BuildBlocks(bounds, PLANE_FIELDS, m_groups[ShapePlane].Tree,
+              m_groups[ShapePlane].Blocks, m_groups[ShapePlane].Lanes,
+              [&](float *lane, uint32_t i) {
+                const ImplicitPlane &plane = m_planes[i];
+                Vector3 normal = Normalize(Cross(plane.V, plane.U));
+                // The dual basis of U and V in the plane, so that a point
+                // Center + a U + b V projects to exactly (a, b) even when U
+                // and V are not orthogonal.
+                Vector3 n = Cross(plane.U, plane.V);
+                float invArea = 1 / Dot(n, n);
+                Vector3 u = Cross(plane.V, n) * invArea;
+                Vector3 v = Cross(n, plane.U) * invArea;
+                const float fields[PLANE_FIELDS] = {
+                    plane.Center.X, plane.Center.Y, plane.Center.Z,
+                    normal.X,       normal.Y,       normal.Z,
+                    u.X,            u.Y,            u.Z,
+                    v.X,            v.Y,            v.Z};
+                for (uint32_t f = 0; f < PLANE_FIELDS; ++f) {
+                  lane[f * BLOCK_WIDTH] = fields[f];
+                }
+              });
+  BuildBlocks(m_boxes, BOX_FIELDS, m_groups[ShapeBox].Tree,
+              m_groups[ShapeBox].Blocks, m_groups[ShapeBox].Lanes,
+              [&](float *lane, uint32_t i) {
+                const AABB &box = m_boxes[i];
+                lane[0 * BLOCK_WIDTH] = box.Min.X;
+                lane[1 * BLOCK_WIDTH] = box.Min.Y;
+                lane[2 * BLOCK_WIDTH] = box.Min.Z;
+                lane[3 * BLOCK_WIDTH] = box.Max.X;
+                lane[4 * BLOCK_WIDTH] = box.Max.Y;
+                lane[5 * BLOCK_WIDTH] = box.Max.Z;
+              });
+  bounds.clear();
+  for (uint32_t i = 0; i < m_quadrics.size(); ++i) {
+    bounds.push_back(GetPrimitiveBounds(ShapeQuadric, i));
+  }
+  BuildBlocks(bounds, QUADRIC_FIELDS, m_groups[ShapeQuadric].Tree,
+              m_groups[ShapeQuadric].Blocks, m_groups[ShapeQuadric].Lanes,
+              [&](float *lane, uint32_t i) {
+                const ImplicitQuadric &q = m_quadrics[i];
+                const float fields[QUADRIC_FIELDS] = {
+                    q.A, q.B, q.C, q.D, q.E, q.F, q.G, q.H, q.I, q.J,
+                    q.Bounds.Min.X, q.Bounds.Min.Y, q.Bounds.Min.Z,
+                    q.Bounds.Max.X, q.Bounds.Max.Y, q.Bounds.Max.Z};
+                for (uint32_t f = 0; f < QUADRIC_FIELDS; ++f) {
+                  lane[f * BLOCK_WIDTH] = fields[f];
+                }
+              });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 8-wide kernels.
+//
+// Each kernel walks the block as two groups of four lanes, computes a hit
+// distance per lane (+inf for a miss) and keeps the nearest one under tMax.
+// The return value is the winning lane or -1.
+
+struct RaySSE {
+  __m128 OriginX, OriginY, OriginZ;
+  __m128 DirectionX, DirectionY, DirectionZ;
+  __m128 InvDirectionX, InvDirectionY, InvDirectionZ;
+  __m128 TMin;
+};
+
+static __m128 Select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static __m128 Field(const float *block, uint32_t field, uint32_t half) {
+  return _mm_loadu_ps(block + field * BLOCK_WIDTH + half * 4);
+}
+
+// Reduce four candidate distances to the nearest one below tMax.
+static int NearestLane(__m128 t, uint32_t half, float &tMax, int best) {
+  int mask = _mm_movemask_ps(_mm_cmplt_ps(t, _mm_set1_ps(tMax)));
+  if (mask == 0)
+    return best;
+  float lanes[4];
+  _mm_storeu_ps(lanes, t);
+  for (int i = 0; i < 4; ++i) {
+    if ((mask & (1 << i)) && lanes[i] < tMax) {
+      tMax = lanes[i];
+      best = (int)(half * 4 + i);
+    }
+  }
+  return best;
+}
+
+// Slab test of a ray against four boxes; returns entry and exit distances.
+static void SlabTest(const RaySSE &ray, __m128 minX, __m128 minY, __m128 minZ,
+                     __m128 maxX, __m128 maxY, __m128 maxZ, __m128 &tNear,
+                     __m128 &tFar) {
+  __m128 t1x = _mm_mul_ps(_mm_sub_ps(minX, ray.OriginX), ray.InvDirectionX);
+  __m128 t2x = _mm_mul_ps(_mm_sub_ps(maxX, ray.OriginX), ray.InvDirectionX);
+  __m128 t1y = _mm_mul_ps(_mm_sub_ps(minY, ray.OriginY), ray.InvDirectionY);
+  __m128 t2y = _mm_mul_ps(_mm_sub_ps(maxY, ray.OriginY), ray.InvDirectionY);
+  __m128 t1z = _mm_mul_ps(_mm_sub_ps(minZ, ray.OriginZ), ray.InvDirectionZ);
+  __m128 t2z = _mm_mul_ps(_mm_sub_ps(maxZ, ray.OriginZ), ray.InvDirectionZ);
+  tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)),
+                     _mm_min_ps(t1z, t2z));
+  tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)),
+                    _mm_max_ps(t1z, t2z));
+}
+
+// IntersectSphere: the front hit if it is in range, otherwise the back hit.
+static int IntersectSphereBlock(const float *block, const RaySSE &ray,
+                                float &tMax) {
+  const __m128 infinity = _mm_set1_ps(INFINITY);
+  int best = -1;
+  for (uint32_t half = 0; half < 2; ++half) {
+    __m128 ox = _mm_sub_ps(ray.OriginX, Field(block, 0, half));
+    __m128 oy = _mm_sub_ps(ray.OriginY, Field(block, 1, half));
+    __m128 oz = _mm_sub_ps(ray.OriginZ, Field(block, 2, half));
+    __m128 radiusSquared = Field(block, 3, half);
+    __m128 a = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(ray.DirectionX, ray.DirectionX),
+                   _mm_mul_ps(ray.DirectionY, ray.DirectionY)),
+        _mm_mul_ps(ray.DirectionZ, ray.DirectionZ));
+    __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ray.DirectionX),
+                                     _mm_mul_ps(oy, ray.DirectionY)),
+                          _mm_mul_ps(oz, ray.DirectionZ));
+    b = _mm_add_ps(b, b);
+    __m128 c = _mm_sub_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)),
+                   _mm_mul_ps(oz, oz)),
+        radiusSquared);
+    __m128 root = _mm_sub_ps(_mm_mul_ps(b, b),
+                             _mm_mul_ps(_mm_set1_ps(4), _mm_mul_ps(a, c)));
+    __m128 solution = _mm_sqrt_ps(_mm_max_ps(root, _mm_setzero_ps()));
+    __m128 invTwoA = _mm_div_ps(_mm_set1_ps(0.5f), a);
+    __m128 hitFront = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), b),
+                                            solution),
+                                 invTwoA);
+    __m128 hitBack = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), b),
+                                           solution),
+                                invTwoA);
+    __m128 t = Select(_mm_cmpge_ps(hitFront, ray.TMin), hitFront, hitBack);
+    __m128 valid = _mm_and_ps(_mm_cmpge_ps(root, _mm_setzero_ps()),
+                              _mm_cmpge_ps(t, ray.TMin));
+    best = NearestLane(Select(valid, t, infinity), half, tMax, best);
+  }
+  return best;
+}
+
+// IntersectPlane generalized to any parallelogram.
+static int IntersectPlaneBlock(const float *block, const RaySSE &ray,
+                               float &tMax) {
+  const __m128 infinity = _mm_set1_ps(INFINITY);
+  const __m128 one = _mm_set1_ps(1);
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  int best = -1;
+  for (uint32_t half = 0; half < 2; ++half) {
+    __m128 ox = _mm_sub_ps(ray.OriginX, Field(block, 0, half));
+    __m128 oy = _mm_sub_ps(ray.OriginY, Field(block, 1, half));
+    __m128 oz = _mm_sub_ps(ray.OriginZ, Field(block, 2, half));
+    __m128 nx = Field(block, 3, half);
+    __m128 ny = Field(block, 4, half);
+    __m128 nz = Field(block, 5, half);
+    __m128 divisor = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ray.DirectionX),
+                                           _mm_mul_ps(ny, ray.DirectionY)),
+                                _mm_mul_ps(nz, ray.DirectionZ));
+    __m128 distance = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(nx, ox), _mm_mul_ps(ny, oy)), _mm_mul_ps(nz, oz));
+    __m128 lambda =
+        _mm_div_ps(_mm_sub_ps(_mm_setzero_ps(), distance), divisor);
+    __m128 px = _mm_add_ps(ox, _mm_mul_ps(ray.DirectionX, lambda));
+    __m128 py = _mm_add_ps(oy, _mm_mul_ps(ray.DirectionY, lambda));
+    __m128 pz = _mm_add_ps(oz, _mm_mul_ps(ray.DirectionZ, lambda));
+    __m128 u = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(px, Field(block, 6, half)),
+                   _mm_mul_ps(py, Field(block, 7, half))),
+        _mm_mul_ps(pz, Field(block, 8, half)));
+    __m128 v = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(px, Field(block, 9, half)),
+                   _mm_mul_ps(py, Field(block, 10, half))),
+        _mm_mul_ps(pz, Field(block, 11, half)));
+    __m128 valid = _mm_and_ps(
+        _mm_cmpge_ps(lambda, ray.TMin),
+        _mm_and_ps(_mm_cmple_ps(_mm_and_ps(u, absMask), one),
+                   _mm_cmple_ps(_mm_and_ps(v, absMask), one)));
+    best = NearestLane(Select(valid, lambda, infinity), half, tMax, best);
+  }
+  return best;
+}
+
+// Boxes report their entry point, or the exit point from inside.
+static int IntersectBoxBlock(const float *block, const RaySSE &ray,
+                             float &tMax) {
+  const __m128 infinity = _mm_set1_ps(INFINITY);
+  int best = -1;
+  for (uint32_t half = 0; half < 2; ++half) {
+    __m128 tNear, tFar;
+    SlabTest(ray, Field(block, 0, half), Field(block, 1, half),
+             Field(block, 2, half), Field(block, 3, half),
+             Field(block, 4, half), Field(block, 5, half), tNear, tFar);
+    __m128 t = Select(_mm_cmpge_ps(tNear, ray.TMin), tNear, tFar);
+    __m128 valid =
+        _mm_and_ps(_mm_cmple_ps(tNear, tFar), _mm_cmpge_ps(t, ray.TMin));
+    best = NearestLane(Select(valid, t, infinity), half, tMax, best);
+  }
+  return best;
+}
+
+// Quadrics: solve the quadratic in t, then keep the nearest root inside both
+// the ray interval and the clipping box. Near-zero leading terms (planes,
+// and rays parallel to a cylinder wall) fall back to the linear solution.
+static int IntersectQuadricBlock(const float *block, const RaySSE &ray,
+                                 float &tMax) {
+  const __m128 infinity = _mm_set1_ps(INFINITY);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  const __m128 &ox = ray.OriginX, &oy = ray.OriginY, &oz = ray.OriginZ;
+  const __m128 &dx = ray.DirectionX, &dy = ray.DirectionY,
+               &dz = ray.DirectionZ;
+  int best = -1;
+  for (uint32_t half = 0; half < 2; ++half) {
+    __m128 A = Field(block, 0, half), B = Field(block, 1, half),
+           C = Field(block, 2, half), D = Field(block, 3, half),
+           E = Field(block, 4, half), F = Field(block, 5, half),
+           G = Field(block, 6, half), H = Field(block, 7, half),
+           I = Field(block, 8, half), J = Field(block, 9, half);
+    // qa t^2 + qb t + qc = 0
+    __m128 qa = _mm_add_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(A, _mm_mul_ps(dx, dx)),
+                              _mm_mul_ps(B, _mm_mul_ps(dy, dy))),
+                   _mm_add_ps(_mm_mul_ps(C, _mm_mul_ps(dz, dz)),
+                              _mm_mul_ps(D, _mm_mul_ps(dx, dy)))),
+        _mm_add_ps(_mm_mul_ps(E, _mm_mul_ps(dx, dz)),
+                   _mm_mul_ps(F, _mm_mul_ps(dy, dz))));
+    __m128 qb = _mm_add_ps(
+        _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_add_ps(A, A), _mm_mul_ps(ox, dx)),
+                       _mm_mul_ps(_mm_add_ps(B, B), _mm_mul_ps(oy, dy))),
+            _mm_add_ps(
+                _mm_mul_ps(_mm_add_ps(C, C), _mm_mul_ps(oz, dz)),
+                _mm_mul_ps(D, _mm_add_ps(_mm_mul_ps(ox, dy),
+                                         _mm_mul_ps(oy, dx))))),
+        _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(E, _mm_add_ps(_mm_mul_ps(ox, dz),
+                                                _mm_mul_ps(oz, dx))),
+                       _mm_mul_ps(F, _mm_add_ps(_mm_mul_ps(oy, dz),
+                                                _mm_mul_ps(oz, dy)))),
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(G, dx), _mm_mul_ps(H, dy)),
+                       _mm_mul_ps(I, dz))));
+    __m128 qc = _mm_add_ps(
+        _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(A, _mm_mul_ps(ox, ox)),
+                       _mm_mul_ps(B, _mm_mul_ps(oy, oy))),
+            _mm_add_ps(_mm_mul_ps(C, _mm_mul_ps(oz, oz)),
+                       _mm_mul_ps(D, _mm_mul_ps(ox, oy)))),
+        _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(E, _mm_mul_ps(ox, oz)),
+                       _mm_mul_ps(F, _mm_mul_ps(oy, oz))),
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(G, ox), _mm_mul_ps(H, oy)),
+                       _mm_add_ps(_mm_mul_ps(I, oz), J))));
+    __m128 root = _mm_sub_ps(_mm_mul_ps(qb, qb),
+                             _mm_mul_ps(_mm_set1_ps(4), _mm_mul_ps(qa, qc)));
+    __m128 solution = _mm_sqrt_ps(_mm_max_ps(root, zero));
+    __m128 invTwoA = _mm_div_ps(_mm_set1_ps(0.5f), qa);
+    __m128 r0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(zero, qb), solution), invTwoA);
+    __m128 r1 = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(zero, qb), solution), invTwoA);
+    __m128 linear = _mm_cmplt_ps(_mm_and_ps(qa, absMask), _mm_set1_ps(1e-7f));
+    __m128 tLinear = _mm_div_ps(_mm_sub_ps(zero, qc), qb);
+    __m128 t0 = Select(linear, tLinear, _mm_min_ps(r0, r1));
+    __m128 t1 = Select(linear, tLinear, _mm_max_ps(r0, r1));
+    __m128 solvable = _mm_or_ps(linear, _mm_cmpge_ps(root, zero));
+    __m128 tNear, tFar;
+    SlabTest(ray, Field(block, 10, half), Field(block, 11, half),
+             Field(block, 12, half), Field(block, 13, half),
+             Field(block, 14, half), Field(block, 15, half), tNear, tFar);
+    __m128 lo = _mm_max_ps(tNear, ray.TMin);
+    __m128 inside0 = _mm_and_ps(_mm_cmpge_ps(t0, lo), _mm_cmple_ps(t0, tFar));
+    __m128 inside1 = _mm_and_ps(_mm_cmpge_ps(t1, lo), _mm_cmple_ps(t1, tFar));
+    __m128 t = Select(inside0, t0, Select(inside1, t1, infinity));
+    best = NearestLane(Select(solvable, t, infinity), half, tMax, best);
+  }
+  return best;
+}
+
+typedef int (*BlockKernel)(const float *block, const RaySSE &ray,
+                           float &tMax);
+
+static const BlockKernel KERNELS[ShapeCount] = {
+    IntersectSphereBlock, IntersectPlaneBlock, IntersectBoxBlock,
+    IntersectQuadricBlock};
+
+static RaySSE BroadcastRay(const Ray &ray) {
+  RaySSE result;
+  result.OriginX = _mm_set1_ps(ray.Origin.X);
+  result.OriginY = _mm_set1_ps(ray.Origin.Y);
+  result.OriginZ = _mm_set1_ps(ray.Origin.Z);
+  result.DirectionX = _mm_set1_ps(ray.Direction.X);
+  result.DirectionY = _mm_set1_ps(ray.Direction.Y);
+  result.DirectionZ = _mm_set1_ps(ray.Direction.Z);
+  result.InvDirectionX = _mm_set1_ps(1 / ray.Direction.X);
+  result.InvDirectionY = _mm_set1_ps(1 / ray.Direction.Y);
+  result.InvDirectionZ = _mm_set1_ps(1 / ray.Direction.Z);
+  result.TMin = _mm_set1_ps(ray.TMin);
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries walk each shape's tree in turn, sharing the shrinking tMax so later
+// trees are culled by hits found in earlier ones.
+
+bool ImplicitBVH::Intersect(const Ray &ray, ImplicitHit &hit) const {
+  const RaySSE raySSE = BroadcastRay(ray);
+  float tMax = hit.T < ray.TMax ? hit.T : ray.TMax;
+  bool hitAnything = false;
+  for (int shape = 0; shape < ShapeCount; ++shape) {
+    const Group &group = m_groups[shape];
+    const uint32_t stride = FIELD_COUNT[shape] * BLOCK_WIDTH;
+    const BlockKernel kernel = KERNELS[shape];
+    hitAnything |= TraverseBVH(
+        group.Tree, ray.Origin, ray.Direction, ray.TMin, tMax, false,
+        [&](uint32_t block, float &tMax) {
+          int lane = kernel(&group.Blocks[block * stride], raySSE, tMax);
+          if (lane < 0)
+            return false;
+          hit.T = tMax;
+          hit.Shape = (ImplicitShape)shape;
+          hit.Primitive = group.Lanes[block * BLOCK_WIDTH + lane];
+          return true;
+        });
+  }
+  return hitAnything;
+}
+
+bool ImplicitBVH::Occluded(const Ray &ray) const {
+  const RaySSE raySSE = BroadcastRay(ray);
+  for (int shape = 0; shape < ShapeCount; ++shape) {
+    const Group &group = m_groups[shape];
+    const uint32_t stride = FIELD_COUNT[shape] * BLOCK_WIDTH;
+    const BlockKernel kernel = KERNELS[shape];
+    float tMax = ray.TMax;
+    if (TraverseBVH(group.Tree, ray.Origin, ray.Direction, ray.TMin, tMax,
+                    true, [&](uint32_t block, float &tMax) {
+                      return kernel(&group.Blocks[block * stride], raySSE,
+                                    tMax) >= 0;
+                    }))
+      return true;
+  }
+  return false;
+}
+
+Vector3 ImplicitBVH::GetNormal(const Ray &ray, const ImplicitHit &hit) const {
+  Vector3 p = ray.Origin + ray.Direction * hit.T;
+  switch (hit.Shape) {
+  case ShapeSphere: {
+    const ImplicitSphere &sphere = m_spheres[hit.Primitive];
+    return Normalize(p - sphere.Center);
+  }
+  case ShapePlane: {
+    const ImplicitPlane &plane = m_planes[hit.Primitive];
+    return Normalize(Cross(plane.V, plane.U));
+  }
+  case ShapeBox: {
+    // The face whose plane the hit point lies closest to.
+    const AABB &box = m_boxes[hit.Primitive];
+    const float distances[6] = {fabsf(p.X - box.Min.X), fabsf(p.Y - box.Min.Y),
+                                fabsf(p.Z - box.Min.Z), fabsf(p.X - box.Max.X),
+                                fabsf(p.Y - box.Max.Y), fabsf(p.Z - box.Max.Z)};
+    const Vector3 normals[6] = {{-1, 0, 0}, {0, -1, 0}, {0, 0, -1},
+                                {1, 0, 0},  {0, 1, 0},  {0, 0, 1}};
+    int face = 0;
+    for (int i = 1; i < 6; ++i) {
+      if (distances[i] < distances[face])
+        face = i;
+    }
+    return normals[face];
+  }
+  case ShapeQuadric: {
+    // The gradient of the implicit function.
+    const ImplicitQuadric &q = m_quadrics[hit.Primitive];
+    return Normalize(Vector3{2 * q.A * p.X + q.D * p.Y + q.E * p.Z + q.G,
+                             2 * q.B * p.Y + q.D * p.X + q.F * p.Z + q.H,
+                             2 * q.C * p.Z + q.E * p.X + q.F * p.Y + q.I});
+  }
+  default:
+    return {0, 1, 0};
+  }
+}
+
+uint32_t ImplicitBVH::GetPrimitiveCount(ImplicitShape shape) const {
+  switch (shape) {
+  case ShapeSphere:
+    return (uint32_t)m_spheres.size();
+  case ShapePlane:
+    return (uint32_t)m_planes.size();
+  case ShapeBox:
+    return (uint32_t)m_boxes.size();
+  case ShapeQuadric:
+    return (uint32_t)m_quadrics.size();
+  default:
+    return 0;
+  }
+}
+
+AABB ImplicitBVH::GetPrimitiveBounds(ImplicitShape shape,
+                                     uint32_t primitive) const {
+  switch (shape) {
+  case ShapeSphere: {
+    const ImplicitSphere &sphere = m_spheres[primitive];
+    Vector3 extent = {sphere.Radius, sphere.Radius, sphere.Radius};
+    return {sphere.Center - extent, sphere.Center + extent};
+  }
+  case ShapePlane: {
+    const ImplicitPlane &plane = m_planes[primitive];
+    AABB box = EmptyAABB();
+    box = Union(box, plane.Center - plane.U - plane.V);
+    box = Union(box, plane.Center - plane.U + plane.V);
+    box = Union(box, plane.Center + plane.U - plane.V);
+    box = Union(box, plane.Center + plane.U + plane.V);
+    return box;
+  }
+  case ShapeBox:
+    return m_boxes[primitive];
+  case ShapeQuadric:
+    return m_quadrics[primitive].Bounds;
+  default:
+    return EmptyAABB();
+  }
+}
\ No newline at end of file
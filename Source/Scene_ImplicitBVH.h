@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_BVH.h"
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Implicit Primitive BVH
+//
+// The DXR samples give every analytic primitive its own AABB BLAS and rely on
+// intersection shaders (Sample_DXR_Implicit.inc) to find the surface. That is
+// fine for a handful of objects; this is the CPU counterpart for millions.
+//
+// Each primitive kind gets its own BVH whose leaves point at blocks of 8
+// primitives stored structure-of-arrays, so a leaf is tested with one 8-wide
+// kernel (two SSE registers) instead of eight scalar calls. The sphere and
+// plane kernels use the same math as IntersectSphere and IntersectPlane.
+////////////////////////////////////////////////////////////////////////////////
+
+enum ImplicitShape {
+  ShapeSphere,
+  ShapePlane,
+  ShapeBox,
+  ShapeQuadric,
+  ShapeCount
+};
+
+struct ImplicitSphere {
+  Vector3 Center;
+  float Radius;
+};
+
+// A bounded plane; the parallelogram Center +/- U +/- V. The HLSL unit plane
+// is Center = (0, 0, 0), U = (1, 0, 0), V = (0, 0, 1).
+struct ImplicitPlane {
+  Vector3 Center;
+  Vector3 U;
+  Vector3 V;
+};
+
+// The quadric surface
+//   Ax^2 + By^2 + Cz^2 + Dxy + Exz + Fyz + Gx + Hy + Iz + J = 0
+// clipped to a box; this covers cylinders, cones, paraboloids and hyperboloids.
+struct ImplicitQuadric {
+  float A, B, C, D, E, F, G, H, I, J;
+  AABB Bounds;
+};
+
+struct ImplicitHit {
+  float T;
+  ImplicitShape Shape;
+  // Index into the input array for this shape.
+  uint32_t Primitive;
+};
+
+class ImplicitBVH : public Object {
+public:
+  ImplicitBVH(const std::vector<ImplicitSphere> &spheres,
+              const std::vector<ImplicitPlane> &planes,
+              const std::vector<AABB> &boxes,
+              const std::vector<ImplicitQuadric> &quadrics);
+  // As with RayHit, hit.T must be initialized to the search distance.
+  bool Intersect(const Ray &ray, ImplicitHit &hit) const;
+  bool Occluded(const Ray &ray) const;
+  // Normalized surface normal at a hit (not flipped toward the ray).
+  Vector3 GetNormal(const Ray &ray, const ImplicitHit &hit) const;
+  uint32_t GetPrimitiveCount(ImplicitShape shape) const;
+  AABB GetPrimitiveBounds(ImplicitShape shape, uint32_t primitive) const;
+
+private:
+  struct Group {
+    // Leaves reference blocks rather than primitives.
+    BVH Tree;
+    // Fields-by-8 floats per block; see the kernels for the layout.
+    std::vector<float> Blocks;
+    // The input index of each lane, or UINT32_MAX for padding.
+    std::vector<uint32_t> Lanes;
+  };
+  std::vector<ImplicitSphere> m_spheres;
+  std::vector<ImplicitPlane> m_planes;
+  std::vector<AABB> m_boxes;
+  std::vector<ImplicitQuadric> m_quadrics;
+  Group m_groups[ShapeCount];
+};
\ No newline at end of file
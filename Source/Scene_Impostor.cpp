@@ -0,0 +1,335 @@
+#include "Scene_Impostor.h"
+#include "Core_Parallel.h"
+#include "Core_Sampling.h"
+#include "Image_TGA.h"
+#include "Scene_BVH.h"
+#include <math.h>
+#include <string.h>
+#include <utility>
+
+// Rays which land on alpha masked texels continue through at most this many
+// layers before the texel is left empty.
+static const uint32_t MAX_MASKED_LAYERS = 16;
+
+static float SignNotZero(float value) { return value >= 0 ? 1.0f : -1.0f; }
+
+Vector2 EncodeOctahedral(const Vector3 &direction) {
+  float length =
+      fabsf(direction.X) + fabsf(direction.Y) + fabsf(direction.Z);
+  float x = direction.X / length;
+  float y = direction.Y / length;
+  if (direction.Z < 0) {
+    float foldX = (1 - fabsf(y)) * SignNotZero(x);
+    float foldY = (1 - fabsf(x)) * SignNotZero(y);
+    x = foldX;
+    y = foldY;
+  }
+  return {x * 0.5f + 0.5f, y * 0.5f + 0.5f};
+}
+
+Vector3 DecodeOctahedral(const Vector2 &uv) {
+  float x = uv.X * 2 - 1;
+  float y = uv.Y * 2 - 1;
+  float z = 1 - fabsf(x) - fabsf(y);
+  if (z < 0) {
+    float foldX = (1 - fabsf(y)) * SignNotZero(x);
+    float foldY = (1 - fabsf(x)) * SignNotZero(y);
+    x = foldX;
+    y = foldY;
+  }
+  return Normalize(Vector3{x, y, z});
+}
+
+uint32_t Impostor::GetView(const Vector3 &directionToViewer) const {
+  Vector2 uv = EncodeOctahedral(directionToViewer);
+  uint32_t x = (uint32_t)(uv.X * ViewCount);
+  uint32_t y = (uint32_t)(uv.Y * ViewCount);
+  x = x < ViewCount ? x : ViewCount - 1;
+  y = y < ViewCount ? y : ViewCount - 1;
+  return x + y * ViewCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Impostor quad.
+
+uint32_t ImpostorQuad::getVertexCount() const { return 4; }
+
+uint32_t ImpostorQuad::getIndexCount() const { return 6; }
+
+void ImpostorQuad::copyVertices(void *to, uint32_t stride) const {
+  static const Vector3 positions[] = {
+      {-1, 1, 0}, {1, 1, 0}, {1, -1, 0}, {-1, -1, 0}};
+  for (int i = 0; i < 4; ++i) {
+    *reinterpret_cast<Vector3 *>(to) = positions[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+void ImpostorQuad::copyNormals(void *to, uint32_t stride) const {
+  for (int i = 0; i < 4; ++i) {
+    *reinterpret_cast<Vector3 *>(to) = {0, 0, 1};
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+void ImpostorQuad::copyTexcoords(void *to, uint32_t stride) const {
+  static const Vector2 texcoords[] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+  for (int i = 0; i < 4; ++i) {
+    *reinterpret_cast<Vector2 *>(to) = texcoords[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+void ImpostorQuad::copyIndices(void *to, uint32_t stride) const {
+  static const uint32_t indices[] = {0, 3, 2, 0, 2, 1};
+  for (int i = 0; i < 6; ++i) {
+    *reinterpret_cast<uint32_t *>(to) = indices[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Material evaluation; a CPU stand-in for the sample pixel shaders.
+
+// Nearest texel of a B8G8R8A8 image with wrapping; null reads as white.
+static Vector4 SampleBGRA(const IImage *image, const Vector2 &uv) {
+  if (image == nullptr)
+    return {1, 1, 1, 1};
+  float u = uv.X - floorf(uv.X);
+  float v = uv.Y - floorf(uv.Y);
+  uint32_t x = (uint32_t)(u * image->GetWidth());
+  uint32_t y = (uint32_t)(v * image->GetHeight());
+  x = x < image->GetWidth() ? x : image->GetWidth() - 1;
+  y = y < image->GetHeight() ? y : image->GetHeight() - 1;
+  const uint8_t *texel = reinterpret_cast<const uint8_t *>(image->GetData()) +
+                         y * image->GetStride() + 4 * x;
+  return {texel[2] / 255.0f, texel[1] / 255.0f, texel[0] / 255.0f,
+          texel[3] / 255.0f};
+}
+
+struct ImpostorAlbedo {
+  const IMaterial *Material;
+  std::shared_ptr<IImage> AlbedoMap;
+  std::shared_ptr<IImage> MaskMap;
+  // Returns false if the surface is alpha masked out at this point.
+  bool Evaluate(const Vector3 &position, const Vector2 &texcoord,
+                Vector3 &albedo) const {
+    if (dynamic_cast<const OBJMaterial *>(Material) != nullptr) {
+      if (MaskMap != nullptr && SampleBGRA(MaskMap.get(), texcoord).X < 0.5f)
+        return false;
+      Vector4 texel = SampleBGRA(AlbedoMap.get(), texcoord);
+      albedo = {texel.X, texel.Y, texel.Z};
+    } else if (dynamic_cast<const Checkerboard *>(Material) != nullptr) {
+      float check =
+          (float)(((int32_t)floorf(position.X * 2) +
+                   (int32_t)floorf(position.Z * 2)) &
+                  1);
+      albedo = {check, check, check};
+    } else if (dynamic_cast<const RedPlastic *>(Material) != nullptr) {
+      albedo = {1, 0, 0};
+    } else {
+      albedo = {1, 1, 1};
+    }
+    return true;
+  }
+};
+
+static uint32_t PackBGRA(float r, float g, float b, float a) {
+  auto channel = [](float value) {
+    value = value < 0 ? 0 : (value > 1 ? 1 : value);
+    return (uint32_t)(value * 255 + 0.5f);
+  };
+  return channel(b) | channel(g) << 8 | channel(r) << 16 | channel(a) << 24;
+}
+
+std::shared_ptr<Impostor> BakeImpostor(const IMesh &mesh,
+                                       const IMaterial *material,
+                                       const ImpostorSettings &settings) {
+  MeshBVH bvh(mesh);
+  if (bvh.Indices.size() < 3 || settings.ViewCount == 0 ||
+      settings.ViewResolution == 0)
+    return nullptr;
+  uint32_t vertexCount = mesh.getVertexCount();
+  std::vector<Vector3> normals(vertexCount);
+  std::vector<Vector2> texcoords(vertexCount);
+  mesh.copyNormals(&normals[0], sizeof(Vector3));
+  mesh.copyTexcoords(&texcoords[0], sizeof(Vector2));
+  ImpostorAlbedo albedo = {material};
+  if (const OBJMaterial *obj = dynamic_cast<const OBJMaterial *>(material)) {
+    if (obj->DiffuseMap != nullptr)
+      albedo.AlbedoMap = Load_TGA(obj->DiffuseMap->Filename.c_str());
+    if (obj->DissolveMap != nullptr)
+      albedo.MaskMap = Load_TGA(obj->DissolveMap->Filename.c_str());
+  }
+  std::shared_ptr<Impostor> impostor(new Impostor());
+  impostor->ViewCount = settings.ViewCount;
+  impostor->ViewResolution = settings.ViewResolution;
+  const AABB &bounds = bvh.GetBounds();
+  impostor->Center = (bounds.Min + bounds.Max) * 0.5f;
+  float radiusSquared = 0;
+  for (const Vector3 &position : bvh.Positions) {
+    Vector3 d = position - impostor->Center;
+    radiusSquared = radiusSquared > Dot(d, d) ? radiusSquared : Dot(d, d);
+  }
+  impostor->Radius = SquareRoot(radiusSquared);
+  const Vector3 center = impostor->Center;
+  const float radius = impostor->Radius > 0 ? impostor->Radius : 1;
+  const uint32_t resolution = settings.ViewResolution;
+  const uint32_t size = settings.ViewCount * resolution;
+  const uint32_t viewCount = settings.ViewCount * settings.ViewCount;
+  std::unique_ptr<uint32_t[]> albedoPixels(new uint32_t[size * size]);
+  std::unique_ptr<uint32_t[]> normalPixels(new uint32_t[size * size]);
+  std::unique_ptr<float[]> depthPixels(new float[size * size]);
+  impostor->QuadToObject.resize(viewCount);
+  ////////////////////////////////////////////////////////////////////////////////
+  // Each view is an orthographic projection of the bounding sphere along the
+  // direction of its cell center.
+  ParallelFor(viewCount, [&](uint32_t view) {
+    uint32_t viewX = view % settings.ViewCount;
+    uint32_t viewY = view / settings.ViewCount;
+    Vector3 direction =
+        DecodeOctahedral({(viewX + 0.5f) / settings.ViewCount,
+                          (viewY + 0.5f) / settings.ViewCount});
+    Vector3 right, up;
+    CreateBasis(direction, right, up);
+    impostor->QuadToObject[view] = {
+        right.X * radius,     right.Y * radius,     right.Z * radius,     0,
+        up.X * radius,        up.Y * radius,        up.Z * radius,        0,
+        direction.X * radius, direction.Y * radius, direction.Z * radius, 0,
+        center.X,             center.Y,             center.Z,             1};
+    for (uint32_t py = 0; py < resolution; ++py) {
+      for (uint32_t px = 0; px < resolution; ++px) {
+        float x = -1 + 2 * (px + 0.5f) / resolution;
+        float y = 1 - 2 * (py + 0.5f) / resolution;
+        Ray ray = {center + (right * x + up * y + direction) * radius,
+                   -direction, 0, 2 * radius};
+        uint32_t albedoTexel = 0;
+        uint32_t normalTexel = PackBGRA(0.5f, 0.5f, 1, 0);
+        float depth = 1;
+        for (uint32_t layer = 0; layer < MAX_MASKED_LAYERS; ++layer) {
+          RayHit hit = {};
+          hit.T = ray.TMax;
+          if (!bvh.Intersect(ray, hit))
+            break;
+          uint32_t i0 = bvh.Indices[3 * hit.Primitive + 0];
+          uint32_t i1 = bvh.Indices[3 * hit.Primitive + 1];
+          uint32_t i2 = bvh.Indices[3 * hit.Primitive + 2];
+          float w = 1 - hit.U - hit.V;
+          Vector3 position = ray.Origin + ray.Direction * hit.T;
+          Vector2 texcoord = texcoords[i0] * w + texcoords[i1] * hit.U +
+                             texcoords[i2] * hit.V;
+          Vector3 color;
+          if (!albedo.Evaluate(position, texcoord, color)) {
+            ray.TMin = hit.T * 1.0001f;
+            continue;
+          }
+          Vector3 normal =
+              normals[i0] * w + normals[i1] * hit.U + normals[i2] * hit.V;
+          if (Dot(normal, normal) == 0)
+            normal = bvh.GetNormal(hit.Primitive);
+          normal = Normalize(normal);
+          // Two-sided surfaces (foliage) are seen from behind in some views.
+          if (Dot(normal, direction) < 0)
+            normal = -normal;
+          // Stored in the space of the view's quad so a renderer can take it
+          // to world space with the quad transform alone.
+          Vector3 local = {Dot(normal, right), Dot(normal, up),
+                           Dot(normal, direction)};
+          albedoTexel = PackBGRA(color.X, color.Y, color.Z, 1);
+          normalTexel = PackBGRA(0.5f + 0.5f * local.X, 0.5f + 0.5f * local.Y,
+                                 0.5f + 0.5f * local.Z, 1);
+          depth = hit.T / (2 * radius);
+          break;
+        }
+        uint32_t texel = (viewX * resolution + px) +
+                         (viewY * resolution + py) * size;
+        albedoPixels[texel] = albedoTexel;
+        normalPixels[texel] = normalTexel;
+        depthPixels[texel] = depth;
+      }
+    }
+  });
+  impostor->AlbedoMap.reset(
+      CreateImage_AutoDelete(size, size, 4 * size, DXGI_FORMAT_B8G8R8A8_UNORM,
+                             albedoPixels.release())
+          .release());
+  impostor->NormalMap.reset(
+      CreateImage_AutoDelete(size, size, 4 * size, DXGI_FORMAT_B8G8R8A8_UNORM,
+                             normalPixels.release())
+          .release());
+  impostor->DepthMap.reset(
+      CreateImage_AutoDelete(size, size, sizeof(float) * size,
+                             DXGI_FORMAT_R32_FLOAT, depthPixels.release())
+          .release());
+  for (uint32_t view = 0; view < viewCount; ++view) {
+    std::shared_ptr<ImpostorMaterial> viewMaterial(new ImpostorMaterial());
+    viewMaterial->AlbedoMap = impostor->AlbedoMap;
+    viewMaterial->NormalMap = impostor->NormalMap;
+    viewMaterial->DepthMap = impostor->DepthMap;
+    viewMaterial->TexcoordOffset = {
+        (float)(view % settings.ViewCount) / settings.ViewCount,
+        (float)(view / settings.ViewCount) / settings.ViewCount};
+    viewMaterial->TexcoordScale = {1.0f / settings.ViewCount,
+                                   1.0f / settings.ViewCount};
+    impostor->Materials.push_back(viewMaterial);
+  }
+  return impostor;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Level of detail switching.
+
+ImpostorSwapper::ImpostorSwapper(const std::vector<Instance> &scene,
+                                 const ImpostorSettings &settings)
+    : m_scene(scene), m_quad(new ImpostorQuad()) {
+  // Instances sharing a mesh and material share an impostor.
+  std::map<std::pair<const IMesh *, const IMaterial *>,
+           std::shared_ptr<Impostor>>
+      baked;
+  for (const Instance &instance : m_scene) {
+    auto key = std::make_pair(instance.Mesh.get(), instance.Material.get());
+    auto findIt = baked.find(key);
+    if (findIt == baked.end()) {
+      findIt = baked
+                   .insert({key, BakeImpostor(*instance.Mesh,
+                                              instance.Material.get(),
+                                              settings)})
+                   .first;
+    }
+    m_impostors.push_back(findIt->second);
+    m_quadTransforms.emplace_back(new Matrix44());
+    m_objectToWorld.push_back(*instance.TransformObjectToWorld);
+    m_worldToObject.push_back(Invert(*instance.TransformObjectToWorld));
+  }
+}
+
+const std::vector<Instance> &
+ImpostorSwapper::Update(const Vector3 &cameraPosition, float distance) {
+  m_result.clear();
+  for (size_t i = 0; i < m_scene.size(); ++i) {
+    const Instance &instance = m_scene[i];
+    const Impostor *impostor = m_impostors[i].get();
+    if (impostor == nullptr) {
+      m_result.push_back(instance);
+      continue;
+    }
+    const Matrix44 &objectToWorld = *instance.TransformObjectToWorld;
+    Vector3 toCamera =
+        cameraPosition - TransformPoint(objectToWorld, impostor->Center);
+    if (Length(toCamera) <= distance) {
+      m_result.push_back(instance);
+      continue;
+    }
+    // Most instances never move; only invert transforms which changed.
+    if (memcmp(&m_objectToWorld[i], &objectToWorld, sizeof(Matrix44)) != 0) {
+      m_objectToWorld[i] = objectToWorld;
+      m_worldToObject[i] = Invert(objectToWorld);
+    }
+    uint32_t view = impostor->GetView(
+        Normalize(TransformVector(m_worldToObject[i], toCamera)));
+    *m_quadTransforms[i] = impostor->QuadToObject[view] * objectToWorld;
+    m_result.push_back(
+        Instance{m_quadTransforms[i], m_quad, impostor->Materials[view]});
+  }
+  return m_result;
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "Core_IImage.h"
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_IMaterial.h"
+#include "Scene_IMesh.h"
+#include "Scene_InstanceTable.h"
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Octahedral Impostors
+//
+// A mesh is rendered orthographically from a grid of directions spread over
+// the sphere with an octahedral mapping, and every view is written into one
+// cell of an albedo, normal and depth atlas. Far from the camera the mesh can
+// then be drawn as a single camera facing quad textured with the view cell
+// closest to the current direction.
+//
+// Views are baked with the CPU ray tracer (one MeshBVH per mesh) in parallel.
+////////////////////////////////////////////////////////////////////////////////
+
+// Map a unit direction onto [0, 1]^2 and back. The +Z hemisphere fills the
+// inner diamond and the -Z hemisphere is folded into the corners.
+Vector2 EncodeOctahedral(const Vector3 &direction);
+Vector3 DecodeOctahedral(const Vector2 &uv);
+
+struct ImpostorSettings {
+  // Views along each side of the octahedral grid (ViewCount^2 views).
+  uint32_t ViewCount = 8;
+  // Texels along each side of a single view.
+  uint32_t ViewResolution = 64;
+};
+
+// One baked view; the material to draw the quad with when this view is the
+// closest to the camera.
+class ImpostorMaterial : public Object, public IMaterial {
+public:
+  std::shared_ptr<IImage> AlbedoMap;
+  std::shared_ptr<IImage> NormalMap;
+  std::shared_ptr<IImage> DepthMap;
+  // Quad texcoords in [0, 1] are mapped to Offset + Scale * uv in the atlas.
+  Vector2 TexcoordOffset;
+  Vector2 TexcoordScale;
+};
+
+class Impostor : public Object {
+public:
+  uint32_t ViewCount;
+  uint32_t ViewResolution;
+  // Bounding sphere of the mesh in object space.
+  Vector3 Center;
+  float Radius;
+  // B8G8R8A8_UNORM; alpha is coverage.
+  std::shared_ptr<IImage> AlbedoMap;
+  // B8G8R8A8_UNORM; normal encoded as 0.5 + 0.5 * n in the space of the
+  // view's quad (x right, y up, z toward the viewer), so transforming it by
+  // the quad's world transform gives the world space normal.
+  std::shared_ptr<IImage> NormalMap;
+  // R32_FLOAT; distance from the front of the bounding sphere over its
+  // diameter, 1 where nothing was hit. The quad sits at the sphere center
+  // with its z axis spanning the radius, so a quad point moved by
+  // (1 - 2 * depth) along that axis lands on the baked surface.
+  std::shared_ptr<IImage> DepthMap;
+  // Per view (x + y * ViewCount): the transform which places ImpostorQuad in
+  // object space facing the view direction, and the material for that view.
+  std::vector<Matrix44> QuadToObject;
+  std::vector<std::shared_ptr<ImpostorMaterial>> Materials;
+  // The view whose direction is closest to an object space direction.
+  uint32_t GetView(const Vector3 &directionToViewer) const;
+};
+
+// The two triangle quad spanning [-1, 1] in XY, facing +Z.
+class ImpostorQuad : public Object, public IMesh {
+public:
+  uint32_t getVertexCount() const override;
+  uint32_t getIndexCount() const override;
+  void copyVertices(void *to, uint32_t stride) const override;
+  void copyNormals(void *to, uint32_t stride) const override;
+  void copyTexcoords(void *to, uint32_t stride) const override;
+  void copyIndices(void *to, uint32_t stride) const override;
+};
+
+// Bake a mesh. Albedo comes from the material: OBJMaterial diffuse maps
+// (alpha masked by the dissolve map), the Checkerboard and RedPlastic
+// patterns used by the samples, and white for anything else.
+std::shared_ptr<Impostor> BakeImpostor(const IMesh &mesh,
+                                       const IMaterial *material,
+                                       const ImpostorSettings &settings = {});
+
+// Holds the impostors for a scene and produces, once per frame, the list of
+// instances to draw with every instance past the switch distance replaced by
+// its impostor quad. The swapped transforms are owned here and rewritten in
+// place every frame, so renderers must not cache their contents.
+class ImpostorSwapper : public Object {
+public:
+  ImpostorSwapper(const std::vector<Instance> &scene,
+                  const ImpostorSettings &settings = {});
+  // Instances whose bounding sphere center is further than distance from the
+  // camera are swapped. The result is valid until the next call.
+  const std::vector<Instance> &Update(const Vector3 &cameraPosition,
+                                      float distance);
+
+private:
+  std::vector<Instance> m_scene;
+  // Indexed by instance; null where the mesh had no geometry.
+  std::vector<std::shared_ptr<Impostor>> m_impostors;
+  std::vector<std::shared_ptr<Matrix44>> m_quadTransforms;
+  // The last transform seen for every instance and its inverse.
+  std::vector<Matrix44> m_objectToWorld;
+  std::vector<Matrix44> m_worldToObject;
+  std::shared_ptr<IMesh> m_quad;
+  std::vector<Instance> m_result;
+};
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "Scene_InstanceBatching.h"
+#include <exception>
+#include <map>
+#include <utility>
+
+InstanceBatches BuildInstanceBatches(const std::vector<Instance> &scene,
+                                     const std::vector<bool> *visible) {
+  if (visible != nullptr && visible->size() != scene.size())
+    throw std::exception("Visibility must have one flag per instance.");
+  InstanceBatches batches;
+  ////////////////////////////////////////////////////////////////////////////////
+  // Assign every instance to a packet and count the packet sizes.
+  std::map<std::pair<const IMesh *, const IMaterial *>, uint32_t> packetIndex;
+  std::vector<uint32_t> instancePacket(scene.size());
+  for (size_t i = 0; i < scene.size(); ++i) {
+    if (visible != nullptr && !(*visible)[i])
+      continue;
+    const Instance &instance = scene[i];
+    auto key = std::make_pair(instance.Mesh.get(), instance.Material.get());
+    auto findIt = packetIndex.find(key);
+    if (findIt == packetIndex.end()) {
+      uint32_t index = (uint32_t)batches.Packets.size();
+      findIt = packetIndex.insert({key, index}).first;
+      InstanceDrawPacket packet = {};
+      packet.Mesh = instance.Mesh;
+      packet.Material = instance.Material;
+      batches.Packets.push_back(packet);
+    }
+    instancePacket[i] = findIt->second;
+    ++batches.Packets[findIt->second].InstanceCount;
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Lay the packets out back to back and scatter the transforms into them.
+  uint32_t total = 0;
+  for (InstanceDrawPacket &packet : batches.Packets) {
+    packet.FirstInstance = total;
+    total += packet.InstanceCount;
+  }
+  batches.Transforms.resize(total);
+  batches.SourceIndex.resize(total);
+  std::vector<uint32_t> cursor(batches.Packets.size());
+  for (size_t p = 0; p < batches.Packets.size(); ++p)
+    cursor[p] = batches.Packets[p].FirstInstance;
+  for (size_t i = 0; i < scene.size(); ++i) {
+    if (visible != nullptr && !(*visible)[i])
+      continue;
+    uint32_t slot = cursor[instancePacket[i]]++;
+    batches.Transforms[slot] = *scene[i].TransformObjectToWorld;
+    batches.SourceIndex[slot] = (uint32_t)i;
+  }
+  return batches;
+}
+
+void UpdateInstanceTransforms(InstanceBatches &batches,
+                              const std::vector<Instance> &scene) {
+  for (size_t slot = 0; slot < batches.SourceIndex.size(); ++slot) {
+    batches.Transforms[slot] =
+        *scene[batches.SourceIndex[slot]].TransformObjectToWorld;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Scene_InstanceTable.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Automatic Instancing
+//
+// Instances which share both mesh and material can be drawn with a single
+// instanced draw. This pass groups a scene into such draw packets and packs
+// the world matrices of every packet next to each other, so one buffer holds
+// the per-instance data of the whole scene and each packet is a range of it
+// (the StartInstanceLocation and InstanceCount of DrawIndexedInstanced).
+//
+// Packets are ordered by first use in the scene and instances keep their
+// scene order inside a packet, so the result is deterministic.
+////////////////////////////////////////////////////////////////////////////////
+
+struct InstanceDrawPacket {
+  std::shared_ptr<IMesh> Mesh;
+  std::shared_ptr<IMaterial> Material;
+  // The range of this packet in InstanceBatches::Transforms.
+  uint32_t FirstInstance;
+  uint32_t InstanceCount;
+};
+
+struct InstanceBatches {
+  std::vector<InstanceDrawPacket> Packets;
+  // Object to world matrices, packet after packet; laid out exactly like
+  // ConstantsObject::TransformObjectToWorld.
+  std::vector<Matrix44> Transforms;
+  // The scene index of each entry of Transforms.
+  std::vector<uint32_t> SourceIndex;
+};
+
+// Group a scene into instanced draw packets. If visible is given only the
+// instances flagged true are included (e.g. OcclusionCuller::Cull).
+InstanceBatches
+BuildInstanceBatches(const std::vector<Instance> &scene,
+                     const std::vector<bool> *visible = nullptr);
+
+// Copy the current transforms of the scene into the packed array without
+// grouping again; for scenes whose transforms move but whose meshes and
+// materials do not.
+void UpdateInstanceTransforms(InstanceBatches &batches,
+                              const std::vector<Instance> &scene);
\ No newline at end of file
@@ -0,0 +1,382 @@
+#include "Scene_LightBVH.h"
+#include "Core_Sampling.h"
+#include "Scene_IMaterial.h"
+#include "Scene_IMesh.h"
+#include <math.h>
+
+static float Luminance(const Vector3 &rgb) {
+  return 0.2126f * rgb.X + 0.7152f * rgb.Y + 0.0722f * rgb.Z;
+}
+
+static float Clamp(float value, float lo, float hi) {
+  return value < lo ? lo : (value > hi ? hi : value);
+}
+
+static float LengthSquared(const Vector3 &v) { return Dot(v, v); }
+
+////////////////////////////////////////////////////////////////////////////////
+// Normal cones are stored as an axis and the cosine of the half angle; a
+// cosine of -1 covers the whole sphere.
+static void UnionCone(const Vector3 &axisA, float cosA, const Vector3 &axisB,
+                      float cosB, Vector3 &axis, float &cosTheta) {
+  float thetaA = acosf(Clamp(cosA, -1, 1));
+  float thetaB = acosf(Clamp(cosB, -1, 1));
+  float thetaD = acosf(Clamp(Dot(axisA, axisB), -1, 1));
+  // One cone already contains the other.
+  if (fminf(thetaD + thetaB, Pi<float>) <= thetaA) {
+    axis = axisA;
+    cosTheta = cosA;
+    return;
+  }
+  if (fminf(thetaD + thetaA, Pi<float>) <= thetaB) {
+    axis = axisB;
+    cosTheta = cosB;
+    return;
+  }
+  float thetaO = (thetaA + thetaD + thetaB) / 2;
+  Vector3 rotationAxis = Cross(axisA, axisB);
+  if (thetaO >= Pi<float> || LengthSquared(rotationAxis) == 0) {
+    axis = axisA;
+    cosTheta = -1;
+    return;
+  }
+  // Rotate axisA towards axisB so the new cone just touches both edges.
+  float thetaR = thetaO - thetaA;
+  rotationAxis = Normalize(rotationAxis);
+  axis = Normalize(axisA * Cos(thetaR) +
+                   Cross(rotationAxis, axisA) * Sin(thetaR));
+  cosTheta = Cos(thetaO);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Conservative estimate of the light a node can deliver to a shading point,
+// following the bound used by PBRT-v4's BVHLightSampler. Emitters are one
+// sided, so no light leaves more than 90 degrees from the cone.
+static float Importance(const LightBVHNode &node, const Vector3 &position,
+                        const Vector3 &normal) {
+  if (node.Power <= 0)
+    return 0;
+  Vector3 center = (node.Bounds.Min + node.Bounds.Max) * 0.5f;
+  Vector3 toPoint = position - center;
+  float distanceSquared = LengthSquared(toPoint);
+  // Clamp the distance for points near or inside the bounds so the estimate
+  // does not go to infinity.
+  float radius = Length(node.Bounds.Max - node.Bounds.Min) / 2;
+  distanceSquared = fmaxf(distanceSquared, radius * radius);
+  Vector3 direction = Normalize(toPoint);
+  // Angle subtended by the bounds, from its bounding sphere.
+  float thetaB = Pi<float>;
+  if (LengthSquared(toPoint) > radius * radius) {
+    thetaB = asinf(Clamp(radius / SquareRoot(LengthSquared(toPoint)), 0, 1));
+  }
+  // Minimum angle between the emission cone and the shading point.
+  float thetaW = acosf(Clamp(Dot(node.Axis, direction), -1, 1));
+  float thetaO = acosf(Clamp(node.CosTheta, -1, 1));
+  float thetaX = fmaxf(0, thetaW - thetaO - thetaB);
+  if (thetaX >= Pi<float> / 2)
+    return 0;
+  // Minimum angle between the receiver normal and any point of the bounds.
+  float thetaI = acosf(Clamp(-Dot(normal, direction), -1, 1));
+  float thetaP = fmaxf(0, thetaI - thetaB);
+  if (thetaP >= Pi<float> / 2)
+    return 0;
+  return node.Power * Cos(thetaX) * Cos(thetaP) / distanceSquared;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Build a node for a single triangle; leaves holding several triangles pick
+// among them with the same estimate.
+static LightBVHNode TriangleNode(const LightBVH::Triangle &triangle) {
+  LightBVHNode node = {};
+  node.Bounds = Union(Union(Union(EmptyAABB(), triangle.P0), triangle.P1),
+                      triangle.P2);
+  node.Axis = triangle.Normal;
+  node.CosTheta = 1;
+  node.Power = Luminance(triangle.Emission) * triangle.Area * Pi<float>;
+  return node;
+}
+
+LightBVH::LightBVH(const std::vector<Instance> &scene) {
+  m_instanceFirstTriangle.resize(scene.size(), UINT32_MAX);
+  m_instanceEmission.resize(scene.size(), Vector3{0, 0, 0});
+  for (size_t instanceIndex = 0; instanceIndex < scene.size();
+       ++instanceIndex) {
+    const Instance &instance = scene[instanceIndex];
+    const Emissive *emissive =
+        dynamic_cast<const Emissive *>(instance.Material.get());
+    if (emissive == nullptr || Luminance(emissive->Emission) <= 0)
+      continue;
+    m_instanceFirstTriangle[instanceIndex] = (uint32_t)m_triangles.size();
+    m_instanceEmission[instanceIndex] = emissive->Emission;
+    uint32_t vertexCount = instance.Mesh->getVertexCount();
+    uint32_t indexCount = instance.Mesh->getIndexCount();
+    std::vector<Vector3> positions(vertexCount);
+    std::vector<uint32_t> indices(indexCount);
+    if (vertexCount > 0)
+      instance.Mesh->copyVertices(&positions[0], sizeof(Vector3));
+    if (indexCount > 0)
+      instance.Mesh->copyIndices(&indices[0], sizeof(uint32_t));
+    const Matrix44 &objectToWorld = *instance.TransformObjectToWorld;
+    for (uint32_t t = 0; t < indexCount / 3; ++t) {
+      // Degenerate triangles are kept (with zero power) so that primitive
+      // indices still line up with the SceneBVH.
+      Triangle triangle = {};
+      const uint32_t *corner = &indices[3 * t];
+      triangle.P0 = TransformPoint(objectToWorld, positions[corner[0]]);
+      triangle.P1 = TransformPoint(objectToWorld, positions[corner[1]]);
+      triangle.P2 = TransformPoint(objectToWorld, positions[corner[2]]);
+      Vector3 cross =
+          Cross(triangle.P1 - triangle.P0, triangle.P2 - triangle.P0);
+      float length = Length(cross);
+      triangle.Area = length / 2;
+      triangle.Normal =
+          length > 0 ? cross * (1 / length) : Vector3{0, 0, 1};
+      triangle.Emission = length > 0 ? emissive->Emission : Vector3{0, 0, 0};
+      m_triangles.push_back(triangle);
+    }
+  }
+  //////////////////////////////////////////////////////////////////////////////
+  // Take the topology from a spatial BVH, then fill in cones and power from
+  // the leaves up. Children always follow their parent in the node array, so
+  // a reverse sweep visits children first.
+  std::vector<AABB> bounds;
+  for (const auto &triangle : m_triangles) {
+    bounds.push_back(TriangleNode(triangle).Bounds);
+  }
+  BVH bvh = BuildBVH(bounds.data(), (uint32_t)bounds.size(), 1);
+  m_primitives = bvh.Primitives;
+  m_nodes.resize(bvh.Nodes.size());
+  m_nodeParent.resize(bvh.Nodes.size(), UINT32_MAX);
+  m_triangleLeaf.resize(m_triangles.size(), UINT32_MAX);
+  for (size_t i = bvh.Nodes.size(); i-- > 0;) {
+    const BVHNode &source = bvh.Nodes[i];
+    LightBVHNode &node = m_nodes[i];
+    node.Bounds = source.Bounds;
+    node.Index = source.Index;
+    node.Count = source.Count;
+    node.Power = 0;
+    node.CosTheta = 1;
+    if (source.Count > 0) {
+      for (uint32_t j = 0; j < source.Count; ++j) {
+        m_triangleLeaf[m_primitives[source.Index + j]] = (uint32_t)i;
+      }
+    } else {
+      m_nodeParent[source.Index] = (uint32_t)i;
+      m_nodeParent[source.Index + 1] = (uint32_t)i;
+    }
+    // Merge the cones of everything directly beneath this node.
+    bool empty = true;
+    uint32_t mergeCount = source.Count > 0 ? source.Count : 2;
+    for (uint32_t j = 0; j < mergeCount; ++j) {
+      LightBVHNode child =
+          source.Count > 0
+              ? TriangleNode(m_triangles[m_primitives[source.Index + j]])
+              : m_nodes[source.Index + j];
+      if (child.Power <= 0)
+        continue;
+      if (empty) {
+        node.Axis = child.Axis;
+        node.CosTheta = child.CosTheta;
+        empty = false;
+      } else {
+        UnionCone(node.Axis, node.CosTheta, child.Axis, child.CosTheta,
+                  node.Axis, node.CosTheta);
+      }
+      node.Power += child.Power;
+    }
+    if (empty)
+      node.Axis = {0, 0, 1};
+  }
+}
+
+bool LightBVH::Sample(const Vector3 &position, const Vector3 &normal,
+                      const Vector3 &random, LightSample &sample) const {
+  if (m_nodes.empty())
+    return false;
+  // Descend choosing a child by importance. The random number is rescaled at
+  // each step so one number serves the whole walk.
+  float u = random.X;
+  float pmf = 1;
+  uint32_t nodeIndex = 0;
+  while (m_nodes[nodeIndex].Count == 0) {
+    const LightBVHNode &node = m_nodes[nodeIndex];
+    float left = Importance(m_nodes[node.Index], position, normal);
+    float right = Importance(m_nodes[node.Index + 1], position, normal);
+    if (left + right <= 0)
+      return false;
+    float probabilityLeft = left / (left + right);
+    if (u < probabilityLeft) {
+      u = fminf(u / probabilityLeft, 0.99999994f);
+      pmf *= probabilityLeft;
+      nodeIndex = node.Index;
+    } else {
+      u = fminf((u - probabilityLeft) / (1 - probabilityLeft), 0.99999994f);
+      pmf *= 1 - probabilityLeft;
+      nodeIndex = node.Index + 1;
+    }
+  }
+  // Pick a triangle within the leaf.
+  const LightBVHNode &leaf = m_nodes[nodeIndex];
+  float total = 0;
+  for (uint32_t i = 0; i < leaf.Count; ++i) {
+    total += Importance(TriangleNode(m_triangles[m_primitives[leaf.Index + i]]),
+                        position, normal);
+  }
+  if (total <= 0)
+    return false;
+  uint32_t chosen = m_primitives[leaf.Index + leaf.Count - 1];
+  float chosenImportance = 0;
+  float target = u * total;
+  for (uint32_t i = 0; i < leaf.Count; ++i) {
+    uint32_t triangleIndex = m_primitives[leaf.Index + i];
+    float importance =
+        Importance(TriangleNode(m_triangles[triangleIndex]), position, normal);
+    if (importance <= 0)
+      continue;
+    chosen = triangleIndex;
+    chosenImportance = importance;
+    if (target < importance)
+      break;
+    target -= importance;
+  }
+  pmf *= chosenImportance / total;
+  //////////////////////////////////////////////////////////////////////////////
+  // Uniform point on the triangle, converted to a solid angle pdf.
+  const Triangle &triangle = m_triangles[chosen];
+  float su = SquareRoot(random.Y);
+  float b0 = 1 - su;
+  float b1 = random.Z * su;
+  sample.Position = triangle.P0 * b0 + triangle.P1 * b1 +
+                    triangle.P2 * (1 - b0 - b1);
+  sample.Normal = triangle.Normal;
+  sample.Emission = triangle.Emission;
+  Vector3 toLight = sample.Position - position;
+  float distanceSquared = LengthSquared(toLight);
+  float cosLight = -Dot(triangle.Normal, toLight) / SquareRoot(distanceSquared);
+  if (cosLight <= 0 || distanceSquared == 0)
+    return false;
+  sample.Pdf = pmf * distanceSquared / (triangle.Area * cosLight);
+  return true;
+}
+
+float LightBVH::Pdf(const Vector3 &position, const Vector3 &normal,
+                    uint32_t instance, uint32_t primitive,
+                    const Vector3 &lightPosition) const {
+  if (instance >= m_instanceFirstTriangle.size() ||
+      m_instanceFirstTriangle[instance] == UINT32_MAX)
+    return 0;
+  uint32_t triangleIndex = m_instanceFirstTriangle[instance] + primitive;
+  const Triangle &triangle = m_triangles[triangleIndex];
+  // Probability within the leaf.
+  uint32_t nodeIndex = m_triangleLeaf[triangleIndex];
+  const LightBVHNode &leaf = m_nodes[nodeIndex];
+  float total = 0;
+  for (uint32_t i = 0; i < leaf.Count; ++i) {
+    total += Importance(TriangleNode(m_triangles[m_primitives[leaf.Index + i]]),
+                        position, normal);
+  }
+  if (total <= 0)
+    return 0;
+  float pmf = Importance(TriangleNode(triangle), position, normal) / total;
+  // Probability of each choice on the way back up to the root.
+  while (nodeIndex != 0 && pmf > 0) {
+    uint32_t parentIndex = m_nodeParent[nodeIndex];
+    const LightBVHNode &parent = m_nodes[parentIndex];
+    float left = Importance(m_nodes[parent.Index], position, normal);
+    float right = Importance(m_nodes[parent.Index + 1], position, normal);
+    if (left + right <= 0)
+      return 0;
+    pmf *= (nodeIndex == parent.Index ? left : right) / (left + right);
+    nodeIndex = parentIndex;
+  }
+  Vector3 toLight = lightPosition - position;
+  float distanceSquared = LengthSquared(toLight);
+  float cosLight = -Dot(triangle.Normal, toLight) / SquareRoot(distanceSquared);
+  if (cosLight <= 0 || distanceSquared == 0)
+    return 0;
+  return pmf * distanceSquared / (triangle.Area * cosLight);
+}
+
+Vector3 LightBVH::GetEmission(uint32_t instance) const {
+  return m_instanceEmission[instance];
+}
+
+uint32_t LightBVH::GetLightCount() const {
+  return (uint32_t)m_triangles.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Path tracing.
+
+static float PowerHeuristic(float pdfA, float pdfB) {
+  return pdfA * pdfA / (pdfA * pdfA + pdfB * pdfB);
+}
+
+Vector3 PathTrace(const SceneBVH &scene, const LightBVH &lights, const Ray &ray,
+                  uint32_t &state, const PathTraceSettings &settings) {
+  const float brdf = settings.Albedo / Pi<float>;
+  Vector3 radiance = {0, 0, 0};
+  float throughput = 1;
+  Ray currentRay = ray;
+  Vector3 previousPosition = {0, 0, 0};
+  Vector3 previousNormal = {0, 0, 0};
+  float previousPdf = 0;
+  for (uint32_t bounce = 0; bounce <= settings.MaxBounces; ++bounce) {
+    RayHit hit = {};
+    hit.T = currentRay.TMax;
+    if (!scene.Intersect(currentRay, hit))
+      break;
+    Vector3 position = currentRay.Origin + currentRay.Direction * hit.T;
+    Vector3 normal = scene.GetNormal(hit);
+    // Emission found by BSDF sampling; MIS weighted against light sampling
+    // except on the camera ray, which light sampling could not have made.
+    Vector3 emission = lights.GetEmission(hit.Instance);
+    if (Dot(normal, currentRay.Direction) < 0 && Luminance(emission) > 0) {
+      float weight = 1;
+      if (bounce > 0) {
+        float lightPdf = lights.Pdf(previousPosition, previousNormal,
+                                    hit.Instance, hit.Primitive, position);
+        weight = PowerHeuristic(previousPdf, lightPdf);
+      }
+      radiance = radiance + emission * (throughput * weight);
+    }
+    if (bounce == settings.MaxBounces)
+      break;
+    if (Dot(normal, currentRay.Direction) > 0)
+      normal = -normal;
+    Vector3 origin = position + normal * settings.Bias;
+    ////////////////////////////////////////////////////////////////////////////
+    // Next event estimation.
+    LightSample light;
+    Vector3 random = {RandomUnit(state), RandomUnit(state), RandomUnit(state)};
+    if (lights.Sample(position, normal, random, light)) {
+      Vector3 toLight = light.Position - origin;
+      float distance = Length(toLight);
+      Vector3 direction = toLight * (1 / distance);
+      float cosSurface = Dot(normal, direction);
+      if (cosSurface > 0) {
+        Ray shadow = {origin, direction, 0, distance - settings.Bias};
+        if (!scene.Occluded(shadow)) {
+          float weight = PowerHeuristic(light.Pdf, cosSurface / Pi<float>);
+          radiance = radiance + light.Emission * (throughput * brdf *
+                                                  cosSurface * weight /
+                                                  light.Pdf);
+        }
+      }
+    }
+    ////////////////////////////////////////////////////////////////////////////
+    // Cosine weighted bounce; cos/pdf cancels so throughput scales by albedo.
+    Vector3 tangent, bitangent;
+    CreateBasis(normal, tangent, bitangent);
+    Vector3 local =
+        SampleHemisphereCosine({RandomUnit(state), RandomUnit(state)});
+    Vector3 direction =
+        tangent * local.X + bitangent * local.Y + normal * local.Z;
+    throughput *= settings.Albedo;
+    previousPosition = position;
+    previousNormal = normal;
+    previousPdf = local.Z / Pi<float>;
+    currentRay = {origin, direction, 0, 1e30f};
+  }
+  return radiance;
+}
\ No newline at end of file
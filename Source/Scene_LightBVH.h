@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_BVH.h"
+#include "Scene_InstanceTable.h"
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Light BVH
+//
+// A hierarchy over every emissive triangle in a scene for many-light sampling
+// (Estevez & Kulla, "Importance Sampling of Many Lights with Adaptive Tree
+// Splitting"). Each node bounds the positions, emitted power and emission
+// directions (as a normal cone) of the lights beneath it, which gives a cheap
+// conservative estimate of how much that node can contribute to a shading
+// point. Sampling walks from the root choosing a child in proportion to that
+// estimate, so the cost is logarithmic in the number of emitters and distant
+// or back facing lights are rarely picked.
+//
+// Emitters are the instances whose material is Emissive.
+////////////////////////////////////////////////////////////////////////////////
+
+struct LightSample {
+  Vector3 Position;
+  Vector3 Normal;
+  Vector3 Emission;
+  // Probability density with respect to solid angle at the shading point.
+  float Pdf;
+};
+
+// A node of the light hierarchy. The topology (Index/Count) mirrors the BVH
+// it was built from; Axis/CosTheta bound the emitter normals beneath it.
+struct LightBVHNode {
+  AABB Bounds;
+  Vector3 Axis;
+  float CosTheta;
+  float Power;
+  uint32_t Index;
+  uint32_t Count;
+};
+
+class LightBVH : public Object {
+public:
+  struct Triangle {
+    Vector3 P0, P1, P2;
+    Vector3 Normal;
+    Vector3 Emission;
+    float Area;
+  };
+  LightBVH(const std::vector<Instance> &scene);
+  // Pick a point on a light as seen from a shading point with normal "normal",
+  // using three uniform random numbers. Returns false if no light can reach.
+  bool Sample(const Vector3 &position, const Vector3 &normal,
+              const Vector3 &random, LightSample &sample) const;
+  // Solid angle pdf of Sample() choosing "lightPosition" on the given
+  // primitive of an instance; used to weight hits found by BSDF sampling.
+  float Pdf(const Vector3 &position, const Vector3 &normal, uint32_t instance,
+            uint32_t primitive, const Vector3 &lightPosition) const;
+  // Emission of an instance in the source scene (zero if not emissive).
+  Vector3 GetEmission(uint32_t instance) const;
+  uint32_t GetLightCount() const;
+
+private:
+  std::vector<Triangle> m_triangles;
+  std::vector<LightBVHNode> m_nodes;
+  std::vector<uint32_t> m_primitives;
+  std::vector<uint32_t> m_nodeParent;
+  std::vector<uint32_t> m_triangleLeaf;
+  std::vector<uint32_t> m_instanceFirstTriangle;
+  std::vector<Vector3> m_instanceEmission;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// CPU path tracer with next event estimation.
+//
+// Every surface is treated as grey Lambertian. At each bounce a light is
+// chosen through the LightBVH and tested with a shadow ray; emitters hit by
+// cosine sampled bounce rays are also counted, and the two strategies are
+// combined with the power heuristic so neither small nor large lights blow up.
+struct PathTraceSettings {
+  uint32_t MaxBounces = 4;
+  float Albedo = 0.5f;
+  // Ray origins are pushed this far along the normal to avoid self hits.
+  float Bias = 1e-3f;
+};
+
+// Radiance arriving along a ray. "state" is an RNG state owned by the caller.
+Vector3 PathTrace(const SceneBVH &scene, const LightBVH &lights, const Ray &ray,
+                  uint32_t &state, const PathTraceSettings &settings = {});
\ No newline at end of file
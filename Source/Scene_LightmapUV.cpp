@@ -0,0 +1,369 @@
+#include "Scene_LightmapUV.h"
+#include "Core_Parallel.h"
+#include "Core_Sampling.h"
+#include "Scene_BVH.h"
+#include "Scene_MeshRemap.h"
+#include <algorithm>
+#include <float.h>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+MeshWithLightmapUV::MeshWithLightmapUV(std::shared_ptr<IMesh> mesh,
+                                       std::vector<uint32_t> remap,
+                                       std::vector<uint32_t> indices,
+                                       std::vector<Vector2> lightmapTexcoords)
+    : m_mesh(mesh), m_remap(std::move(remap)), m_indices(std::move(indices)),
+      m_lightmapTexcoords(std::move(lightmapTexcoords)) {}
+
+uint32_t MeshWithLightmapUV::getVertexCount() const {
+  return (uint32_t)m_remap.size();
+}
+
+uint32_t MeshWithLightmapUV::getIndexCount() const {
+  return (uint32_t)m_indices.size();
+}
+
+void MeshWithLightmapUV::copyVertices(void *to, uint32_t stride) const {
+  CopyRemapped<Vector3>(m_remap, m_mesh->getVertexCount(), to, stride,
+                        [&](void *to, uint32_t stride) {
+                          m_mesh->copyVertices(to, stride);
+                        });
+}
+
+void MeshWithLightmapUV::copyNormals(void *to, uint32_t stride) const {
+  CopyRemapped<Vector3>(m_remap, m_mesh->getVertexCount(), to, stride,
+                        [&](void *to, uint32_t stride) {
+                          m_mesh->copyNormals(to, stride);
+                        });
+}
+
+void MeshWithLightmapUV::copyTexcoords(void *to, uint32_t stride) const {
+  CopyRemapped<Vector2>(m_remap, m_mesh->getVertexCount(), to, stride,
+                        [&](void *to, uint32_t stride) {
+                          m_mesh->copyTexcoords(to, stride);
+                        });
+}
+
+void MeshWithLightmapUV::copyIndices(void *to, uint32_t stride) const {
+  for (size_t i = 0; i < m_indices.size(); ++i) {
+    *reinterpret_cast<uint32_t *>(to) = m_indices[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+void MeshWithLightmapUV::copyLightmapTexcoords(void *to,
+                                               uint32_t stride) const {
+  for (size_t i = 0; i < m_lightmapTexcoords.size(); ++i) {
+    *reinterpret_cast<Vector2 *>(to) = m_lightmapTexcoords[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Chart segmentation and parameterization (per instance).
+
+struct Chart {
+  uint32_t Instance;
+  std::vector<uint32_t> Triangles;
+  // Three corners per triangle, in texels relative to the chart origin.
+  std::vector<Vector2> Corners;
+  float Width, Height;
+  // Texel position of the chart origin in the atlas (set by the packer).
+  uint32_t X, Y;
+};
+
+struct InstanceCharts {
+  std::vector<uint32_t> Indices;
+  std::vector<uint32_t> TriangleChart;
+  std::vector<Chart> Charts;
+};
+
+// Weld positions so that fractured meshes (like OBJ) still have adjacency.
+static std::vector<uint32_t>
+WeldPositions(const std::vector<Vector3> &positions, float epsilon) {
+  using Key = std::tuple<int64_t, int64_t, int64_t>;
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      return (size_t)(std::get<0>(key) * 73856093 ^
+                      std::get<1>(key) * 19349663 ^
+                      std::get<2>(key) * 83492791);
+    }
+  };
+  std::unordered_map<Key, uint32_t, KeyHash> mapPositionToID;
+  std::vector<uint32_t> welded(positions.size());
+  float scale = 1 / epsilon;
+  for (size_t i = 0; i < positions.size(); ++i) {
+    auto key = std::make_tuple((int64_t)(positions[i].X * scale + 0.5f),
+                               (int64_t)(positions[i].Y * scale + 0.5f),
+                               (int64_t)(positions[i].Z * scale + 0.5f));
+    auto result = mapPositionToID.insert({key, (uint32_t)i});
+    welded[i] = result.first->second;
+  }
+  return welded;
+}
+
+static InstanceCharts BuildCharts(uint32_t instanceIndex,
+                                  const Instance &instance,
+                                  const LightmapUVSettings &settings) {
+  InstanceCharts result;
+  const IMesh &mesh = *instance.Mesh;
+  std::vector<Vector3> positions(mesh.getVertexCount());
+  result.Indices.resize(mesh.getIndexCount());
+  if (!positions.empty())
+    mesh.copyVertices(&positions[0], sizeof(Vector3));
+  if (!result.Indices.empty())
+    mesh.copyIndices(&result.Indices[0], sizeof(uint32_t));
+  // Work in world space so texel density is consistent across instances.
+  AABB bounds = EmptyAABB();
+  for (auto &position : positions) {
+    position = TransformPoint(*instance.TransformObjectToWorld, position);
+    bounds = Union(bounds, position);
+  }
+  const std::vector<uint32_t> &indices = result.Indices;
+  const uint32_t triangleCount = (uint32_t)indices.size() / 3;
+  float diagonal = Length(bounds.Max - bounds.Min);
+  std::vector<uint32_t> welded =
+      WeldPositions(positions, diagonal > 0 ? diagonal * 1e-5f : 1e-5f);
+  ////////////////////////////////////////////////////////////////////////////////
+  // Face normals (area weighted) and edge adjacency through welded vertices.
+  std::vector<Vector3> faceNormals(triangleCount);
+  std::vector<uint32_t> adjacency(3 * triangleCount, UINT32_MAX);
+  std::unordered_map<uint64_t, uint32_t> mapEdgeToTriangleEdge;
+  for (uint32_t t = 0; t < triangleCount; ++t) {
+    const Vector3 &p0 = positions[indices[3 * t + 0]];
+    const Vector3 &p1 = positions[indices[3 * t + 1]];
+    const Vector3 &p2 = positions[indices[3 * t + 2]];
+    faceNormals[t] = Cross(p1 - p0, p2 - p0);
+    for (uint32_t e = 0; e < 3; ++e) {
+      uint32_t a = welded[indices[3 * t + e]];
+      uint32_t b = welded[indices[3 * t + (e + 1) % 3]];
+      uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+      auto findIt = mapEdgeToTriangleEdge.find(key);
+      if (findIt == mapEdgeToTriangleEdge.end()) {
+        mapEdgeToTriangleEdge[key] = 3 * t + e;
+      } else if (findIt->second != UINT32_MAX) {
+        // Only manifold edges link charts; extra faces start new charts.
+        adjacency[3 * t + e] = findIt->second / 3;
+        adjacency[findIt->second] = t;
+        findIt->second = UINT32_MAX;
+      }
+    }
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Grow charts by flood fill while normals stay inside the cone around the
+  // seed triangle's normal. The cone is fixed rather than following the
+  // chart's average, which would let it drift until triangles accepted early
+  // face away from the projection plane and fold over in UV. Capped below
+  // 90 degrees, every triangle projects onto the seed plane with the same
+  // winding.
+  const float cosAngle = std::max(Cos(settings.ChartAngle), 1e-3f);
+  result.TriangleChart.assign(triangleCount, UINT32_MAX);
+  std::vector<uint32_t> queue;
+  for (uint32_t seed = 0; seed < triangleCount; ++seed) {
+    if (result.TriangleChart[seed] != UINT32_MAX)
+      continue;
+    uint32_t chartIndex = (uint32_t)result.Charts.size();
+    result.Charts.push_back({});
+    Chart &chart = result.Charts.back();
+    chart.Instance = instanceIndex;
+    const Vector3 normal = Length(faceNormals[seed]) > 0
+                               ? Normalize(faceNormals[seed])
+                               : Vector3{0, 1, 0};
+    result.TriangleChart[seed] = chartIndex;
+    queue.assign(1, seed);
+    while (!queue.empty()) {
+      uint32_t t = queue.back();
+      queue.pop_back();
+      chart.Triangles.push_back(t);
+      // Degenerate seeds stay charts of their own.
+      if (Length(faceNormals[seed]) == 0)
+        break;
+      for (uint32_t e = 0; e < 3; ++e) {
+        uint32_t neighbor = adjacency[3 * t + e];
+        if (neighbor == UINT32_MAX ||
+            result.TriangleChart[neighbor] != UINT32_MAX)
+          continue;
+        float area = Length(faceNormals[neighbor]);
+        if (area == 0 || Dot(faceNormals[neighbor], normal) < cosAngle * area)
+          continue;
+        result.TriangleChart[neighbor] = chartIndex;
+        queue.push_back(neighbor);
+      }
+    }
+    // Planar projection onto the seed plane, in texels.
+    Vector3 tangent, bitangent;
+    CreateBasis(normal, tangent, bitangent);
+    float minU = FLT_MAX, minV = FLT_MAX, maxU = -FLT_MAX, maxV = -FLT_MAX;
+    for (uint32_t t : chart.Triangles) {
+      for (uint32_t c = 0; c < 3; ++c) {
+        const Vector3 &p = positions[indices[3 * t + c]];
+        Vector2 uv = {Dot(p, tangent) * settings.TexelsPerUnit,
+                      Dot(p, bitangent) * settings.TexelsPerUnit};
+        minU = uv.X < minU ? uv.X : minU;
+        minV = uv.Y < minV ? uv.Y : minV;
+        maxU = uv.X > maxU ? uv.X : maxU;
+        maxV = uv.Y > maxV ? uv.Y : maxV;
+        chart.Corners.push_back(uv);
+      }
+    }
+    chart.Width = maxU - minU;
+    chart.Height = maxV - minV;
+    // Lay charts down on their long side; the skyline packs those best.
+    bool rotate = chart.Height > chart.Width;
+    for (auto &corner : chart.Corners) {
+      corner = {corner.X - minU, corner.Y - minV};
+      if (rotate)
+        corner = {corner.Y, chart.Width - corner.X};
+    }
+    if (rotate)
+      std::swap(chart.Width, chart.Height);
+  }
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Skyline bottom-left packer.
+
+class SkylinePacker {
+public:
+  SkylinePacker(uint32_t width) : m_width(width) {
+    m_skyline.push_back({0, 0, width});
+  }
+  // Place a rectangle at the lowest available position.
+  void Insert(uint32_t width, uint32_t height, uint32_t &x, uint32_t &y) {
+    uint32_t bestY = UINT32_MAX, bestIndex = 0;
+    for (uint32_t i = 0; i < m_skyline.size(); ++i) {
+      uint32_t top;
+      if (Fits(i, width, top) && top < bestY) {
+        bestY = top;
+        bestIndex = i;
+      }
+    }
+    x = m_skyline[bestIndex].X;
+    y = bestY;
+    // Raise the skyline under the new rectangle.
+    Segment added = {x, y + height, width};
+    m_skyline.insert(m_skyline.begin() + bestIndex, added);
+    for (uint32_t i = bestIndex + 1; i < m_skyline.size();) {
+      Segment &segment = m_skyline[i];
+      uint32_t coveredEnd = added.X + added.Width;
+      if (segment.X >= coveredEnd)
+        break;
+      uint32_t shrink = coveredEnd - segment.X;
+      if (shrink >= segment.Width) {
+        m_skyline.erase(m_skyline.begin() + i);
+        continue;
+      }
+      segment.X += shrink;
+      segment.Width -= shrink;
+      break;
+    }
+    // Merge neighbouring segments of equal height.
+    for (uint32_t i = 0; i + 1 < m_skyline.size();) {
+      if (m_skyline[i].Y == m_skyline[i + 1].Y) {
+        m_skyline[i].Width += m_skyline[i + 1].Width;
+        m_skyline.erase(m_skyline.begin() + i + 1);
+      } else {
+        ++i;
+      }
+    }
+    if (y + height > m_height)
+      m_height = y + height;
+  }
+  uint32_t GetHeight() const { return m_height; }
+
+private:
+  struct Segment {
+    uint32_t X, Y, Width;
+  };
+  bool Fits(uint32_t index, uint32_t width, uint32_t &top) const {
+    if (m_skyline[index].X + width > m_width)
+      return false;
+    top = 0;
+    uint32_t remaining = width;
+    for (uint32_t i = index; remaining > 0; ++i) {
+      top = m_skyline[i].Y > top ? m_skyline[i].Y : top;
+      remaining -= remaining < m_skyline[i].Width ? remaining
+                                                  : m_skyline[i].Width;
+    }
+    return true;
+  }
+  uint32_t m_width;
+  uint32_t m_height = 0;
+  std::vector<Segment> m_skyline;
+};
+
+LightmapAtlas GenerateLightmapUVs(const std::vector<Instance> &scene,
+                                  const LightmapUVSettings &settings) {
+  ////////////////////////////////////////////////////////////////////////////////
+  // Segment and parameterize all instances in parallel.
+  std::vector<InstanceCharts> instanceCharts(scene.size());
+  ParallelFor((uint32_t)scene.size(), [&](uint32_t i) {
+    instanceCharts[i] = BuildCharts(i, scene[i], settings);
+  });
+  ////////////////////////////////////////////////////////////////////////////////
+  // Pack every chart into one atlas, tallest first. The atlas is made roughly
+  // square from the total chart area but never narrower than the widest chart.
+  std::vector<Chart *> charts;
+  double totalArea = 0;
+  uint32_t widest = 0;
+  const uint32_t padding = settings.Padding;
+  for (auto &instance : instanceCharts) {
+    for (auto &chart : instance.Charts) {
+      charts.push_back(&chart);
+      uint32_t w = (uint32_t)chart.Width + 1 + padding;
+      uint32_t h = (uint32_t)chart.Height + 1 + padding;
+      totalArea += (double)w * h;
+      widest = w > widest ? w : widest;
+    }
+  }
+  std::sort(charts.begin(), charts.end(), [](const Chart *a, const Chart *b) {
+    return a->Height > b->Height;
+  });
+  uint32_t atlasWidth = (uint32_t)SquareRoot(totalArea * 1.15) + padding;
+  atlasWidth = atlasWidth > widest + padding ? atlasWidth : widest + padding;
+  SkylinePacker packer(atlasWidth);
+  for (Chart *chart : charts) {
+    packer.Insert((uint32_t)chart->Width + 1 + padding,
+                  (uint32_t)chart->Height + 1 + padding, chart->X, chart->Y);
+  }
+  LightmapAtlas atlas;
+  atlas.Width = atlasWidth;
+  atlas.Height = packer.GetHeight() + padding;
+  ////////////////////////////////////////////////////////////////////////////////
+  // Split vertices at chart seams and emit the final meshes.
+  atlas.Scene.resize(scene.size());
+  ParallelFor((uint32_t)scene.size(), [&](uint32_t i) {
+    const InstanceCharts &source = instanceCharts[i];
+    std::vector<uint32_t> remap;
+    std::vector<uint32_t> indices(source.Indices.size());
+    std::vector<Vector2> lightmapTexcoords;
+    std::unordered_map<uint64_t, uint32_t> mapVertexChartToIndex;
+    for (const Chart &chart : source.Charts) {
+      uint32_t chartIndex = source.TriangleChart[chart.Triangles[0]];
+      for (uint32_t t = 0; t < chart.Triangles.size(); ++t) {
+        uint32_t triangle = chart.Triangles[t];
+        for (uint32_t c = 0; c < 3; ++c) {
+          uint32_t original = source.Indices[3 * triangle + c];
+          uint64_t key = ((uint64_t)chartIndex << 32) | original;
+          auto result =
+              mapVertexChartToIndex.insert({key, (uint32_t)remap.size()});
+          if (result.second) {
+            const Vector2 &corner = chart.Corners[3 * t + c];
+            remap.push_back(original);
+            lightmapTexcoords.push_back(
+                {(chart.X + padding + 0.5f + corner.X) / atlas.Width,
+                 (chart.Y + padding + 0.5f + corner.Y) / atlas.Height});
+          }
+          indices[3 * triangle + c] = result.first->second;
+        }
+      }
+    }
+    atlas.Scene[i] = scene[i];
+    atlas.Scene[i].Mesh.reset(new MeshWithLightmapUV(
+        scene[i].Mesh, std::move(remap), std::move(indices),
+        std::move(lightmapTexcoords)));
+  });
+  return atlas;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_IMesh.h"
+#include "Scene_InstanceTable.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Lightmap UV Generation
+//
+// OBJ texcoords tile and overlap so they can't hold baked lighting. This
+// generates a second, non-overlapping UV set for every instance in a scene:
+//
+// 1. Segment each mesh into charts by growing across shared edges while the
+//    triangle normals stay within a cone around the normal of the chart's
+//    seed triangle.
+// 2. Parameterize each chart by projecting onto the seed triangle's plane,
+//    scaled to the requested texel density in world units. Every triangle
+//    in the cone projects with the same winding, so charts do not fold.
+// 3. Pack every chart of every instance into one atlas with a skyline packer.
+//
+// Vertices that sit on chart boundaries are duplicated, so each instance gets
+// a new mesh which re-exposes the original streams through a vertex remap.
+////////////////////////////////////////////////////////////////////////////////
+
+struct LightmapUVSettings {
+  // Lightmap texels per world unit.
+  float TexelsPerUnit = 16.0f;
+  // Maximum angle (radians) between a triangle and its chart's seed
+  // triangle; kept below 90 degrees.
+  float ChartAngle = 60.0f * Pi<float> / 180.0f;
+  // Empty texels left around every chart to stop bilinear bleeding.
+  uint32_t Padding = 2;
+};
+
+// A mesh with an added lightmap texcoord stream. Vertex streams are gathered
+// from the original mesh through a remap table that splits chart seams.
+class MeshWithLightmapUV : public Object, public IMesh {
+public:
+  MeshWithLightmapUV(std::shared_ptr<IMesh> mesh, std::vector<uint32_t> remap,
+                     std::vector<uint32_t> indices,
+                     std::vector<Vector2> lightmapTexcoords);
+  uint32_t getVertexCount() const override;
+  uint32_t getIndexCount() const override;
+  void copyVertices(void *to, uint32_t stride) const override;
+  void copyNormals(void *to, uint32_t stride) const override;
+  void copyTexcoords(void *to, uint32_t stride) const override;
+  void copyIndices(void *to, uint32_t stride) const override;
+  void copyLightmapTexcoords(void *to, uint32_t stride) const;
+
+private:
+  std::shared_ptr<IMesh> m_mesh;
+  std::vector<uint32_t> m_remap;
+  std::vector<uint32_t> m_indices;
+  std::vector<Vector2> m_lightmapTexcoords;
+};
+
+struct LightmapAtlas {
+  uint32_t Width;
+  uint32_t Height;
+  // The input scene with each mesh replaced by a MeshWithLightmapUV.
+  std::vector<Instance> Scene;
+};
+
+LightmapAtlas GenerateLightmapUVs(const std::vector<Instance> &scene,
+                                  const LightmapUVSettings &settings = {});
\ No newline at end of file
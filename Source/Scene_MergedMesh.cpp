@@ -0,0 +1,31 @@
+#include "Scene_MergedMesh.h"
+
+template <class T>
+static void CopyStream(const std::vector<T> &from, void *to, uint32_t stride) {
+  for (const T &value : from) {
+    *reinterpret_cast<T *>(to) = value;
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+uint32_t MergedMesh::getVertexCount() const {
+  return (uint32_t)Positions.size();
+}
+
+uint32_t MergedMesh::getIndexCount() const { return (uint32_t)Indices.size(); }
+
+void MergedMesh::copyVertices(void *to, uint32_t stride) const {
+  CopyStream(Positions, to, stride);
+}
+
+void MergedMesh::copyNormals(void *to, uint32_t stride) const {
+  CopyStream(Normals, to, stride);
+}
+
+void MergedMesh::copyTexcoords(void *to, uint32_t stride) const {
+  CopyStream(Texcoords, to, stride);
+}
+
+void MergedMesh::copyIndices(void *to, uint32_t stride) const {
+  CopyStream(Indices, to, stride);
+}
\ No newline at end of file
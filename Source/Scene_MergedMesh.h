@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_IMesh.h"
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// A mesh held as plain vertex and index streams, for code which builds its
+// own geometry: static batches, subdivision and tessellation results.
+////////////////////////////////////////////////////////////////////////////////
+
+class MergedMesh : public Object, public IMesh {
+public:
+  uint32_t getVertexCount() const override;
+  uint32_t getIndexCount() const override;
+  void copyVertices(void *to, uint32_t stride) const override;
+  void copyNormals(void *to, uint32_t stride) const override;
+  void copyTexcoords(void *to, uint32_t stride) const override;
+  void copyIndices(void *to, uint32_t stride) const override;
+  std::vector<Vector3> Positions;
+  std::vector<Vector3> Normals;
+  std::vector<Vector2> Texcoords;
+  std::vector<uint32_t> Indices;
+};
\ No newline at end of file
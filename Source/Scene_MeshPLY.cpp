@@ -1,4 +1,5 @@
 #include "Scene_MeshPLY.h"
+#include "Scene_Normals.h"
 #include <fstream>
 #include <string>
 
@@ -90,6 +91,7 @@ ANOTHERPROPERTY:
     int c = std::stoi(line);
     m_faces[i] = {a, b, c};
   }
+  m_normals = GenerateNormals(*this, NormalWeightingAngle);
 }
 
 uint32_t MeshPLY::getVertexCount() const { return m_vertexCount; }
@@ -105,6 +107,20 @@ void MeshPLY::copyVertices(void *to, uint32_t stride) const {
   int test = 0;
 }
 
+void MeshPLY::copyNormals(void *to, uint32_t stride) const {
+  for (const Vector3 &normal : m_normals) {
+    *reinterpret_cast<Vector3 *>(to) = normal;
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+void MeshPLY::copyTexcoords(void *to, uint32_t stride) const {
+  for (int i = 0; i < m_vertexCount; ++i) {
+    *reinterpret_cast<Vector2 *>(to) = {0, 0};
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
 void MeshPLY::copyIndices(void *to, uint32_t stride) const {
   uint32_t *from = reinterpret_cast<uint32_t *>(&m_faces[0]);
   for (int i = 0; i < m_faceCount * 3; ++i) {
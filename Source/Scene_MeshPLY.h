@@ -4,6 +4,7 @@
 #include "Core_Object.h"
 #include "Scene_IMesh.h"
 #include <memory>
+#include <vector>
 
 ////////////////////////////////////////////////////////////////////////////////
 // NOTE: This is an INCREDIBLY limited PLY loader.
@@ -15,6 +16,11 @@ public:
   uint32_t getVertexCount() const override;
   uint32_t getIndexCount() const override;
   void copyVertices(void *to, uint32_t stride) const override;
+  // PLY files carry no normals; these are generated once on load (see
+  // Scene_Normals.h).
+  void copyNormals(void *to, uint32_t stride) const override;
+  // No texcoords either; all zero.
+  void copyTexcoords(void *to, uint32_t stride) const override;
   void copyIndices(void *to, uint32_t stride) const override;
 
 private:
@@ -22,4 +28,5 @@ private:
   int m_faceCount;
   std::unique_ptr<TVector3<float>[]> m_vertices;
   std::unique_ptr<TVector3<int>[]> m_faces;
+  std::vector<Vector3> m_normals;
 };
\ No newline at end of file
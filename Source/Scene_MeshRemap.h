@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Remapped Mesh Streams
+//
+// Meshes that split vertices (MeshWithNormals, MeshWithTangents,
+// MeshWithLightmapUV) keep the original mesh and, for every output vertex,
+// the original vertex it came from. Their streams are read from the original
+// and scattered through that remap.
+////////////////////////////////////////////////////////////////////////////////
+
+// Pull a stream of sourceCount values of T with copy(to, stride) and write
+// the value of remap[i] to the i-th output element.
+template <class T, class COPY>
+void CopyRemapped(const std::vector<uint32_t> &remap, uint32_t sourceCount,
+                  void *to, uint32_t stride, COPY copy) {
+  std::vector<T> source(sourceCount);
+  if (sourceCount > 0)
+    copy(&source[0], sizeof(T));
+  for (uint32_t i = 0; i < remap.size(); ++i) {
+    *reinterpret_cast<T *>(to) = source[remap[i]];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,426 @@
+#include "Scene_Normals.h"
+#include "Core_Parallel.h"
+#include "Scene_MeshRemap.h"
+#include <algorithm>
+#include <exception>
+#include <math.h>
+
+// Items handed to each parallel task.
+static const uint32_t BATCH_SIZE = 4096;
+// Runs sorted independently before they are merged.
+static const size_t SORT_RUN_SIZE = 1 << 16;
+// Weld cells along the longest side of the bounds, and the fraction of a
+// cell within which positions are welded. The tolerance is kept small next
+// to the cells so most vertices only need to search their own.
+static const uint32_t WELD_CELLS = 1 << 16;
+static const float WELD_TOLERANCE = 1.0f / 64;
+
+// Call fn(begin, end) for batches of [0, count) in parallel.
+template <class FN> static void ParallelBatches(uint32_t count, FN fn) {
+  const uint32_t batches = (count + BATCH_SIZE - 1) / BATCH_SIZE;
+  ParallelFor(batches, [&](uint32_t batch) {
+    fn(batch * BATCH_SIZE, std::min((batch + 1) * BATCH_SIZE, count));
+  });
+}
+
+// Sort runs in parallel, then merge pairs of runs in parallel until one is
+// left.
+template <class T> static void ParallelSort(std::vector<T> &items) {
+  const size_t count = items.size();
+  const uint32_t runs =
+      (uint32_t)((count + SORT_RUN_SIZE - 1) / SORT_RUN_SIZE);
+  ParallelFor(runs, [&](uint32_t run) {
+    std::sort(items.begin() + run * SORT_RUN_SIZE,
+              items.begin() + std::min((run + 1) * SORT_RUN_SIZE, count));
+  });
+  std::vector<T> merged(count);
+  for (size_t width = SORT_RUN_SIZE; width < count; width *= 2) {
+    const uint32_t pairs = (uint32_t)((count + 2 * width - 1) / (2 * width));
+    ParallelFor(pairs, [&](uint32_t pair) {
+      const size_t begin = pair * 2 * width;
+      const size_t middle = std::min(begin + width, count);
+      const size_t end = std::min(begin + 2 * width, count);
+      std::merge(items.begin() + begin, items.begin() + middle,
+                 items.begin() + middle, items.begin() + end,
+                 merged.begin() + begin);
+    });
+    items.swap(merged);
+  }
+}
+
+// A vertex and the weld cell it falls in, ordered by cell then vertex.
+struct WeldKey {
+  uint64_t Cell;
+  uint32_t Vertex;
+  bool operator<(const WeldKey &rhs) const {
+    return Cell != rhs.Cell ? Cell < rhs.Cell : Vertex < rhs.Vertex;
+  }
+};
+
+static uint64_t PackCell(int64_t x, int64_t y, int64_t z) {
+  return (uint64_t)x << 42 | (uint64_t)y << 21 | (uint64_t)z;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Map every vertex to a welded vertex; welded vertices are numbered in order
+// of their first vertex. Returns the welded vertex count.
+static uint32_t WeldPositions(const std::vector<Vector3> &positions,
+                              std::vector<uint32_t> &weld) {
+  const uint32_t vertexCount = (uint32_t)positions.size();
+  weld.resize(vertexCount);
+  if (vertexCount == 0)
+    return 0;
+  Vector3 boundsMin = positions[0], boundsMax = positions[0];
+  for (const Vector3 &p : positions) {
+    boundsMin = {std::min(boundsMin.X, p.X), std::min(boundsMin.Y, p.Y),
+                 std::min(boundsMin.Z, p.Z)};
+    boundsMax = {std::max(boundsMax.X, p.X), std::max(boundsMax.Y, p.Y),
+                 std::max(boundsMax.Z, p.Z)};
+  }
+  const Vector3 size = boundsMax - boundsMin;
+  const float extent = std::max(std::max(size.X, size.Y), size.Z);
+  const float cellSize = extent > 0 ? extent / WELD_CELLS : 1;
+  const float tolerance = cellSize * WELD_TOLERANCE;
+  // Cells are offset by one so the neighbors of every cell are in range.
+  auto cellOf = [&](const Vector3 &p, int64_t cell[3], float fraction[3]) {
+    const Vector3 q = (p - boundsMin) * (1 / cellSize);
+    const float axes[3] = {q.X, q.Y, q.Z};
+    for (int axis = 0; axis < 3; ++axis) {
+      const float whole = floorf(axes[axis]);
+      cell[axis] = std::min((int64_t)whole, (int64_t)WELD_CELLS) + 1;
+      fraction[axis] = (axes[axis] - whole) * cellSize;
+    }
+  };
+  std::vector<WeldKey> keys(vertexCount);
+  ParallelBatches(vertexCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t vertex = begin; vertex < end; ++vertex) {
+      int64_t cell[3];
+      float fraction[3];
+      cellOf(positions[vertex], cell, fraction);
+      keys[vertex] = {PackCell(cell[0], cell[1], cell[2]), vertex};
+    }
+  });
+  ParallelSort(keys);
+  // Every vertex finds the lowest numbered vertex within the tolerance. The
+  // neighboring cells only need searching when it is close to their side;
+  // its own cell starts at the last change of cell.
+  ParallelBatches(vertexCount, [&](uint32_t begin, uint32_t end) {
+    uint32_t cellStart =
+        (uint32_t)(std::lower_bound(keys.begin(), keys.begin() + begin,
+                                    WeldKey{keys[begin].Cell, 0}) -
+                   keys.begin());
+    for (uint32_t rank = begin; rank < end; ++rank) {
+      if (keys[rank].Cell != keys[cellStart].Cell)
+        cellStart = rank;
+      const uint32_t vertex = keys[rank].Vertex;
+      const Vector3 &p = positions[vertex];
+      int64_t cell[3], low[3], high[3];
+      float fraction[3];
+      cellOf(p, cell, fraction);
+      for (int axis = 0; axis < 3; ++axis) {
+        low[axis] = cell[axis] - (fraction[axis] < tolerance ? 1 : 0);
+        high[axis] =
+            cell[axis] + (fraction[axis] > cellSize - tolerance ? 1 : 0);
+      }
+      uint32_t best = vertex;
+      for (int64_t x = low[0]; x <= high[0]; ++x) {
+        for (int64_t y = low[1]; y <= high[1]; ++y) {
+          for (int64_t z = low[2]; z <= high[2]; ++z) {
+            const uint64_t search = PackCell(x, y, z);
+            auto it = search == keys[rank].Cell
+                          ? keys.begin() + cellStart
+                          : std::lower_bound(keys.begin(), keys.end(),
+                                             WeldKey{search, 0});
+            for (; it != keys.end() && it->Cell == search && it->Vertex < best;
+                 ++it) {
+              if (Length(positions[it->Vertex] - p) <= tolerance) {
+                best = it->Vertex;
+                break;
+              }
+            }
+          }
+        }
+      }
+      weld[vertex] = best;
+    }
+  });
+  // Follow chains of matches to their first vertex and number the welded
+  // vertices. Matches always point backwards so one pass suffices.
+  uint32_t weldedCount = 0;
+  for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+    weld[vertex] = weld[vertex] == vertex ? weldedCount++ : weld[weld[vertex]];
+  return weldedCount;
+}
+
+// The corners around every welded vertex in index order, as a compressed
+// sparse row list: the corners of vertex w are Corners[Offsets[w]] up to
+// Corners[Offsets[w + 1]].
+struct CornerAdjacency {
+  std::vector<uint32_t> Offsets;
+  std::vector<uint32_t> Corners;
+};
+
+static CornerAdjacency BuildAdjacency(const std::vector<uint32_t> &indices,
+                                      const std::vector<uint32_t> &weld,
+                                      uint32_t weldedCount) {
+  const uint32_t cornerCount = (uint32_t)indices.size();
+  std::vector<uint64_t> keys(cornerCount);
+  ParallelBatches(cornerCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t corner = begin; corner < end; ++corner)
+      keys[corner] = (uint64_t)weld[indices[corner]] << 32 | corner;
+  });
+  ParallelSort(keys);
+  // The first corner of each vertex writes the offsets of every vertex since
+  // the previous one, so vertices without corners get empty ranges.
+  CornerAdjacency adjacency;
+  adjacency.Offsets.resize(weldedCount + 1);
+  adjacency.Corners.resize(cornerCount);
+  ParallelBatches(cornerCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t rank = begin; rank < end; ++rank) {
+      const uint32_t welded = (uint32_t)(keys[rank] >> 32);
+      const uint32_t first =
+          rank == 0 ? 0 : (uint32_t)(keys[rank - 1] >> 32) + 1;
+      for (uint32_t w = first; w <= welded; ++w)
+        adjacency.Offsets[w] = rank;
+      adjacency.Corners[rank] = (uint32_t)keys[rank];
+    }
+  });
+  const uint32_t last =
+      cornerCount == 0 ? 0 : (uint32_t)(keys[cornerCount - 1] >> 32) + 1;
+  for (uint32_t w = last; w <= weldedCount; ++w)
+    adjacency.Offsets[w] = cornerCount;
+  return adjacency;
+}
+
+// Unit face normals and the weight every corner gives its face normal.
+// Degenerate triangles, including those with two corners welded together,
+// have a zero normal and weight.
+static void ComputeFaces(const std::vector<Vector3> &positions,
+                         const std::vector<uint32_t> &indices,
+                         const std::vector<uint32_t> &weld,
+                         NormalWeighting weighting,
+                         std::vector<Vector3> &faceNormals,
+                         std::vector<float> &cornerWeights) {
+  const uint32_t triangleCount = (uint32_t)indices.size() / 3;
+  faceNormals.resize(triangleCount);
+  cornerWeights.resize(indices.size());
+  ParallelBatches(triangleCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t triangle = begin; triangle < end; ++triangle) {
+      const uint32_t *corner = &indices[3 * triangle];
+      const Vector3 &p0 = positions[corner[0]];
+      const Vector3 normal =
+          Cross(positions[corner[1]] - p0, positions[corner[2]] - p0);
+      // Twice the area, which is as good as the area once normalized.
+      const float length = Length(normal);
+      const uint32_t w0 = weld[corner[0]], w1 = weld[corner[1]],
+                     w2 = weld[corner[2]];
+      const bool degenerate =
+          !(length > 0) || w0 == w1 || w1 == w2 || w2 == w0;
+      faceNormals[triangle] =
+          degenerate ? Vector3{0, 0, 0} : normal * (1 / length);
+      for (uint32_t i = 0; i < 3; ++i) {
+        float weight = degenerate ? 0 : length;
+        if (weighting == NormalWeightingAngle && !degenerate) {
+          const Vector3 &p = positions[corner[i]];
+          const Vector3 e1 = Normalize(positions[corner[(i + 1) % 3]] - p);
+          const Vector3 e2 = Normalize(positions[corner[(i + 2) % 3]] - p);
+          weight = acosf(std::min(std::max(Dot(e1, e2), -1.0f), 1.0f));
+        }
+        cornerWeights[3 * triangle + i] = weight;
+      }
+    }
+  });
+}
+
+// Everything normal generation needs to know about a mesh.
+struct NormalInput {
+  std::vector<Vector3> Positions;
+  std::vector<uint32_t> Indices;
+  std::vector<uint32_t> Weld;
+  CornerAdjacency Adjacency;
+  std::vector<Vector3> FaceNormals;
+  std::vector<float> CornerWeights;
+};
+
+static void PrepareNormalInput(NormalInput &input, NormalWeighting weighting) {
+  const uint32_t weldedCount = WeldPositions(input.Positions, input.Weld);
+  input.Adjacency = BuildAdjacency(input.Indices, input.Weld, weldedCount);
+  ComputeFaces(input.Positions, input.Indices, input.Weld, weighting,
+               input.FaceNormals, input.CornerWeights);
+}
+
+static void ReadNormalInput(const IMesh &mesh, NormalInput &input) {
+  const uint32_t vertexCount = mesh.getVertexCount();
+  input.Positions.resize(vertexCount);
+  input.Indices.resize(mesh.getIndexCount());
+  if (vertexCount > 0)
+    mesh.copyVertices(&input.Positions[0], sizeof(Vector3));
+  if (!input.Indices.empty())
+    mesh.copyIndices(&input.Indices[0], sizeof(uint32_t));
+  input.Indices.resize(input.Indices.size() / 3 * 3);
+}
+
+// The smooth normal of every welded vertex, gathered over its corners.
+static std::vector<Vector3> GatherWeldedNormals(const NormalInput &input) {
+  const CornerAdjacency &adjacency = input.Adjacency;
+  const uint32_t weldedCount = (uint32_t)adjacency.Offsets.size() - 1;
+  std::vector<Vector3> normals(weldedCount);
+  ParallelBatches(weldedCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t welded = begin; welded < end; ++welded) {
+      Vector3 sum = {0, 0, 0};
+      for (uint32_t i = adjacency.Offsets[welded];
+           i < adjacency.Offsets[welded + 1]; ++i) {
+        const uint32_t corner = adjacency.Corners[i];
+        sum = sum + input.FaceNormals[corner / 3] * input.CornerWeights[corner];
+      }
+      const float length = Length(sum);
+      normals[welded] = length > 0 ? sum * (1 / length) : Vector3{0, 0, 0};
+    }
+  });
+  return normals;
+}
+
+// The normal of every corner, gathered over the corners of its welded vertex
+// whose faces are within the crease angle of its own.
+static std::vector<Vector3> GatherCornerNormals(const NormalInput &input,
+                                                float creaseAngle) {
+  const CornerAdjacency &adjacency = input.Adjacency;
+  const uint32_t cornerCount = (uint32_t)input.Indices.size();
+  std::vector<Vector3> normals(cornerCount);
+  if (creaseAngle >= Pi<float>) {
+    const std::vector<Vector3> welded = GatherWeldedNormals(input);
+    ParallelBatches(cornerCount, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t corner = begin; corner < end; ++corner)
+        normals[corner] = welded[input.Weld[input.Indices[corner]]];
+    });
+    return normals;
+  }
+  const float threshold = cosf(creaseAngle);
+  ParallelBatches(cornerCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t corner = begin; corner < end; ++corner) {
+      const Vector3 &face = input.FaceNormals[corner / 3];
+      const uint32_t welded = input.Weld[input.Indices[corner]];
+      Vector3 sum = {0, 0, 0};
+      for (uint32_t i = adjacency.Offsets[welded];
+           i < adjacency.Offsets[welded + 1]; ++i) {
+        const uint32_t other = adjacency.Corners[i];
+        const Vector3 &otherFace = input.FaceNormals[other / 3];
+        if (Dot(face, otherFace) >= threshold)
+          sum = sum + otherFace * input.CornerWeights[other];
+      }
+      const float length = Length(sum);
+      normals[corner] = length > 0 ? sum * (1 / length) : Vector3{0, 0, 0};
+    }
+  });
+  return normals;
+}
+
+static std::vector<Vector3> GenerateNormals(NormalInput &input,
+                                            NormalWeighting weighting) {
+  PrepareNormalInput(input, weighting);
+  const std::vector<Vector3> welded = GatherWeldedNormals(input);
+  std::vector<Vector3> normals(input.Positions.size());
+  ParallelBatches((uint32_t)normals.size(), [&](uint32_t begin, uint32_t end) {
+    for (uint32_t vertex = begin; vertex < end; ++vertex)
+      normals[vertex] = welded[input.Weld[vertex]];
+  });
+  return normals;
+}
+
+std::vector<Vector3> GenerateNormals(const std::vector<Vector3> &positions,
+                                     const std::vector<uint32_t> &indices,
+                                     NormalWeighting weighting) {
+  if (indices.size() % 3 != 0)
+    throw std::exception("Triangle lists need three indices per triangle.");
+  NormalInput input;
+  input.Positions = positions;
+  input.Indices = indices;
+  return GenerateNormals(input, weighting);
+}
+
+std::vector<Vector3> GenerateNormals(const IMesh &mesh,
+                                     NormalWeighting weighting) {
+  NormalInput input;
+  ReadNormalInput(mesh, input);
+  return GenerateNormals(input, weighting);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MeshWithNormals.
+
+MeshWithNormals::MeshWithNormals(std::shared_ptr<IMesh> mesh,
+                                 const NormalSettings &settings)
+    : m_mesh(mesh) {
+  NormalInput input;
+  ReadNormalInput(*mesh, input);
+  PrepareNormalInput(input, settings.Weighting);
+  const std::vector<Vector3> cornerNormals =
+      GatherCornerNormals(input, settings.CreaseAngle);
+  // Every vertex keeps its index for the normal of its first corner; each
+  // other normal its corners need gets a copy, chained through next.
+  const uint32_t vertexCount = (uint32_t)input.Positions.size();
+  const uint32_t none = 0xFFFFFFFF;
+  std::vector<uint32_t> next(vertexCount, none);
+  std::vector<uint8_t> used(vertexCount, 0);
+  m_remap.resize(vertexCount);
+  for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+    m_remap[vertex] = vertex;
+  m_normals.assign(vertexCount, {0, 0, 0});
+  m_indices.resize(input.Indices.size());
+  for (size_t corner = 0; corner < input.Indices.size(); ++corner) {
+    const uint32_t vertex = input.Indices[corner];
+    const Vector3 &normal = cornerNormals[corner];
+    if (!used[vertex]) {
+      used[vertex] = 1;
+      m_normals[vertex] = normal;
+    }
+    uint32_t output = vertex;
+    while (m_normals[output].X != normal.X || m_normals[output].Y != normal.Y ||
+           m_normals[output].Z != normal.Z) {
+      if (next[output] == none) {
+        next[output] = (uint32_t)m_remap.size();
+        m_remap.push_back(vertex);
+        m_normals.push_back(normal);
+        next.push_back(none);
+      }
+      output = next[output];
+    }
+    m_indices[corner] = output;
+  }
+}
+
+uint32_t MeshWithNormals::getVertexCount() const {
+  return (uint32_t)m_remap.size();
+}
+
+uint32_t MeshWithNormals::getIndexCount() const {
+  return (uint32_t)m_indices.size();
+}
+
+void MeshWithNormals::copyVertices(void *to, uint32_t stride) const {
+  CopyRemapped<Vector3>(m_remap, m_mesh->getVertexCount(), to, stride,
+                        [&](void *to, uint32_t stride) {
+                          m_mesh->copyVertices(to, stride);
+                        });
+}
+
+void MeshWithNormals::copyNormals(void *to, uint32_t stride) const {
+  for (size_t i = 0; i < m_normals.size(); ++i) {
+    *reinterpret_cast<Vector3 *>(to) = m_normals[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+void MeshWithNormals::copyTexcoords(void *to, uint32_t stride) const {
+  CopyRemapped<Vector2>(m_remap, m_mesh->getVertexCount(), to, stride,
+                        [&](void *to, uint32_t stride) {
+                          m_mesh->copyTexcoords(to, stride);
+                        });
+}
+
+void MeshWithNormals::copyIndices(void *to, uint32_t stride) const {
+  for (size_t i = 0; i < m_indices.size(); ++i) {
+    *reinterpret_cast<uint32_t *>(to) = m_indices[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_IMesh.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Smooth Normals
+//
+// Vertex normals for meshes which come without them (scans, isosurfaces).
+// Vertices are first welded by position, so triangles which only touch
+// through duplicated vertices (texcoord seams, triangle soups) still shade
+// as one surface. Every corner then contributes its face normal weighted by
+// the triangle area or by the corner angle; angle weights do not depend on
+// how a surface happens to be triangulated.
+//
+// Nothing is accumulated by scattering into vertices. Corners are sorted by
+// welded vertex into an adjacency list and every vertex gathers its own
+// sum, so the work splits over threads without atomics and the result is
+// the same on any number of them.
+//
+// A crease angle keeps faces meeting at a sharper angle from smoothing into
+// each other; a vertex on a crease needs one normal per side, which only
+// MeshWithNormals can provide.
+////////////////////////////////////////////////////////////////////////////////
+
+enum NormalWeighting {
+  NormalWeightingArea,
+  NormalWeightingAngle,
+};
+
+struct NormalSettings {
+  NormalWeighting Weighting = NormalWeightingAngle;
+  // Faces whose normals differ by more than this (radians) do not share a
+  // normal; pi or more smooths every edge.
+  float CreaseAngle = Pi<float>;
+};
+
+// Smooth normals for positions and a triangle list, one per vertex. Vertices
+// used only by degenerate triangles get a zero normal.
+std::vector<Vector3> GenerateNormals(const std::vector<Vector3> &positions,
+                                     const std::vector<uint32_t> &indices,
+                                     NormalWeighting weighting);
+
+// Smooth normals from the position and index streams of any mesh.
+std::vector<Vector3> GenerateNormals(const IMesh &mesh,
+                                     NormalWeighting weighting);
+
+// A mesh with a generated normal stream. Vertices on a crease are duplicated
+// once for every distinct normal their corners need; the other streams are
+// copied from the original mesh through the remap.
+class MeshWithNormals : public Object, public IMesh {
+public:
+  MeshWithNormals(std::shared_ptr<IMesh> mesh,
+                  const NormalSettings &settings);
+  uint32_t getVertexCount() const override;
+  uint32_t getIndexCount() const override;
+  void copyVertices(void *to, uint32_t stride) const override;
+  void copyNormals(void *to, uint32_t stride) const override;
+  void copyTexcoords(void *to, uint32_t stride) const override;
+  void copyIndices(void *to, uint32_t stride) const override;
+
+private:
+  std::shared_ptr<IMesh> m_mesh;
+  // Original vertex of every output vertex.
+  std::vector<uint32_t> m_remap;
+  std::vector<uint32_t> m_indices;
+  std::vector<Vector3> m_normals;
+};
\ No newline at end of file
@@ -0,0 +1,364 @@
+#include "Scene_OcclusionCuller.h"
+#include "Core_Parallel.h"
+#include "Scene_IMaterial.h"
+#include "Scene_IMesh.h"
+#include <algorithm>
+#include <emmintrin.h>
+#include <math.h>
+
+// Pixels covered by one subtile; a coverage mask holds one bit per pixel with
+// row r in bits [8r, 8r + 8).
+static const uint32_t SUBTILE_WIDTH = 8;
+static const uint32_t SUBTILE_HEIGHT = 4;
+
+// Subtile rows rasterized per parallel task.
+static const uint32_t BAND_HEIGHT = 4;
+
+// Occluders are clipped to a guard band this many viewports wide so edge
+// functions stay accurate in single precision.
+static const float GUARD_BAND = 16;
+
+struct OccluderTriangle {
+  // Edge k is A[k] * x + B[k] * y + C[k] with pixel corner coordinates. C has
+  // been biased so the edge is positive only if the whole pixel is inside.
+  float A[3], B[3], C[3];
+  // Depth plane z = Z0 + DZDX * x + DZDY * y and its largest vertex value.
+  float Z0, DZDX, DZDY, ZMax;
+  // Subtile bounds, inclusive.
+  int32_t MinX, MinY, MaxX, MaxY;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Setup.
+
+static float PlaneDistance(const Vector4 &plane, const Vector4 &clip) {
+  return plane.X * clip.X + plane.Y * clip.Y + plane.Z * clip.Z +
+         plane.W * clip.W;
+}
+
+// Sutherland-Hodgman against the near plane and guard band. Returns the vertex
+// count of the convex polygon left in out.
+static uint32_t ClipPolygon(const Vector4 *in, Vector4 *out) {
+  static const Vector4 planes[] = {{0, 0, 1, 0},
+                                   {-1, 0, 0, GUARD_BAND},
+                                   {1, 0, 0, GUARD_BAND},
+                                   {0, -1, 0, GUARD_BAND},
+                                   {0, 1, 0, GUARD_BAND}};
+  Vector4 buffer[2][16];
+  uint32_t count = 3;
+  std::copy(in, in + 3, buffer[0]);
+  for (uint32_t p = 0; p < 5 && count > 0; ++p) {
+    const Vector4 *src = buffer[p & 1];
+    Vector4 *dst = buffer[(p + 1) & 1];
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      const Vector4 &a = src[i];
+      const Vector4 &b = src[(i + 1) % count];
+      float da = PlaneDistance(planes[p], a);
+      float db = PlaneDistance(planes[p], b);
+      if (da >= 0)
+        dst[written++] = a;
+      if ((da >= 0) != (db >= 0)) {
+        float t = da / (da - db);
+        dst[written++] = {a.X + (b.X - a.X) * t, a.Y + (b.Y - a.Y) * t,
+                          a.Z + (b.Z - a.Z) * t, a.W + (b.W - a.W) * t};
+      }
+    }
+    count = written;
+  }
+  std::copy(buffer[1], buffer[1] + count, out);
+  return count;
+}
+
+// Set up a screen space triangle (x, y in pixels, z in [0, 1]). Returns false
+// if it is degenerate or outside the buffer.
+static bool SetupTriangle(const Vector3 *v, uint32_t width, uint32_t height,
+                          OccluderTriangle &tri) {
+  Vector3 p0 = v[0], p1 = v[1], p2 = v[2];
+  float area = (p1.X - p0.X) * (p2.Y - p0.Y) - (p2.X - p0.X) * (p1.Y - p0.Y);
+  // Any triangle occludes what is behind it regardless of facing; give every
+  // triangle the same winding.
+  if (area < 0) {
+    std::swap(p1, p2);
+    area = -area;
+  }
+  if (!(area > 1e-6f))
+    return false;
+  float minX = std::min(std::min(p0.X, p1.X), p2.X);
+  float maxX = std::max(std::max(p0.X, p1.X), p2.X);
+  float minY = std::min(std::min(p0.Y, p1.Y), p2.Y);
+  float maxY = std::max(std::max(p0.Y, p1.Y), p2.Y);
+  if (maxX <= 0 || maxY <= 0 || minX >= width || minY >= height)
+    return false;
+  tri.MinX = std::max((int32_t)floorf(minX), 0) / SUBTILE_WIDTH;
+  tri.MinY = std::max((int32_t)floorf(minY), 0) / SUBTILE_HEIGHT;
+  tri.MaxX = std::min((int32_t)ceilf(maxX), (int32_t)width - 1) / SUBTILE_WIDTH;
+  tri.MaxY =
+      std::min((int32_t)ceilf(maxY), (int32_t)height - 1) / SUBTILE_HEIGHT;
+  const Vector3 *p[3] = {&p0, &p1, &p2};
+  for (int k = 0; k < 3; ++k) {
+    const Vector3 &a = *p[(k + 1) % 3];
+    const Vector3 &b = *p[(k + 2) % 3];
+    tri.A[k] = a.Y - b.Y;
+    tri.B[k] = b.X - a.X;
+    // The edge is evaluated at the top left corner of a pixel; move it to the
+    // corner of the pixel square which is furthest outside.
+    tri.C[k] = -(tri.A[k] * a.X + tri.B[k] * a.Y) + std::min(tri.A[k], 0.0f) +
+               std::min(tri.B[k], 0.0f);
+  }
+  float dz1 = p1.Z - p0.Z, dz2 = p2.Z - p0.Z;
+  tri.DZDX = (dz1 * (p2.Y - p0.Y) - dz2 * (p1.Y - p0.Y)) / area;
+  tri.DZDY = (dz2 * (p1.X - p0.X) - dz1 * (p2.X - p0.X)) / area;
+  tri.Z0 = p0.Z - tri.DZDX * p0.X - tri.DZDY * p0.Y;
+  tri.ZMax = std::max(std::max(p0.Z, p1.Z), p2.Z);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Rasterization.
+
+// The pixels of a subtile fully inside a triangle, from the SSE2 edge tests
+// of eight pixels per row.
+static uint32_t ComputeCoverage(const OccluderTriangle &tri, float x,
+                                float y) {
+  const __m128 columns0 = _mm_setr_ps(0, 1, 2, 3);
+  const __m128 columns1 = _mm_setr_ps(4, 5, 6, 7);
+  __m128 edgeX0[3], edgeX1[3];
+  for (int k = 0; k < 3; ++k) {
+    __m128 a = _mm_set1_ps(tri.A[k]);
+    __m128 base = _mm_set1_ps(tri.A[k] * x + tri.B[k] * y + tri.C[k]);
+    edgeX0[k] = _mm_add_ps(base, _mm_mul_ps(a, columns0));
+    edgeX1[k] = _mm_add_ps(base, _mm_mul_ps(a, columns1));
+  }
+  uint32_t mask = 0;
+  for (uint32_t row = 0; row < SUBTILE_HEIGHT; ++row) {
+    __m128 inside0 = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128 inside1 = inside0;
+    for (int k = 0; k < 3; ++k) {
+      __m128 rowOffset = _mm_set1_ps(tri.B[k] * row);
+      __m128 e0 = _mm_add_ps(edgeX0[k], rowOffset);
+      __m128 e1 = _mm_add_ps(edgeX1[k], rowOffset);
+      inside0 = _mm_and_ps(inside0, _mm_cmpgt_ps(e0, _mm_setzero_ps()));
+      inside1 = _mm_and_ps(inside1, _mm_cmpgt_ps(e1, _mm_setzero_ps()));
+    }
+    uint32_t bits = _mm_movemask_ps(inside0) | (_mm_movemask_ps(inside1) << 4);
+    mask |= bits << (row * SUBTILE_WIDTH);
+  }
+  return mask;
+}
+
+// Merge a triangle into a subtile. The mask layer is thrown away when the new
+// triangle is much closer than it, and becomes the full layer once complete.
+static void UpdateSubtile(float &zMax0, float &zMax1, uint32_t &mask,
+                          uint32_t coverage, float zTriangle) {
+  if (zTriangle >= zMax0)
+    return;
+  if (mask != 0 && zMax1 - zTriangle > zMax0 - zMax1) {
+    mask = 0;
+    zMax1 = 0;
+  }
+  mask |= coverage;
+  zMax1 = std::max(zMax1, zTriangle);
+  if (mask == 0xFFFFFFFF) {
+    zMax0 = std::min(zMax0, zMax1);
+    mask = 0;
+    zMax1 = 0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// OcclusionCuller.
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height) {
+  if (width == 0 || height == 0)
+    throw std::exception("Occlusion buffer must not be empty.");
+  m_subtilesX = (width + SUBTILE_WIDTH - 1) / SUBTILE_WIDTH;
+  m_subtilesY = (height + SUBTILE_HEIGHT - 1) / SUBTILE_HEIGHT;
+  m_width = m_subtilesX * SUBTILE_WIDTH;
+  m_height = m_subtilesY * SUBTILE_HEIGHT;
+  m_worldToClip = Identity<float>;
+  m_zMax0.resize(m_subtilesX * m_subtilesY);
+  m_zMax1.resize(m_subtilesX * m_subtilesY);
+  m_mask.resize(m_subtilesX * m_subtilesY);
+  Clear();
+}
+
+void OcclusionCuller::Clear() {
+  std::fill(m_zMax0.begin(), m_zMax0.end(), 1.0f);
+  std::fill(m_zMax1.begin(), m_zMax1.end(), 0.0f);
+  std::fill(m_mask.begin(), m_mask.end(), 0);
+}
+
+const OcclusionCuller::MeshData &
+OcclusionCuller::GetMeshData(const std::shared_ptr<IMesh> &mesh) {
+  auto findIt = m_meshes.find(mesh.get());
+  if (findIt != m_meshes.end())
+    return findIt->second;
+  MeshData &data = m_meshes[mesh.get()];
+  data.Mesh = mesh;
+  data.Positions.resize(mesh->getVertexCount());
+  data.Indices.resize(mesh->getIndexCount());
+  data.Bounds = EmptyAABB();
+  if (!data.Positions.empty())
+    mesh->copyVertices(&data.Positions[0], sizeof(Vector3));
+  if (!data.Indices.empty())
+    mesh->copyIndices(&data.Indices[0], sizeof(uint32_t));
+  for (const Vector3 &position : data.Positions)
+    data.Bounds = Union(data.Bounds, position);
+  return data;
+}
+
+AABB OcclusionCuller::GetWorldBounds(const Instance &instance) {
+  return TransformAABB(*instance.TransformObjectToWorld,
+                       GetMeshData(instance.Mesh).Bounds);
+}
+
+void OcclusionCuller::RenderOccluders(const std::vector<Instance> &occluders,
+                                      const Matrix44 &worldToClip) {
+  m_worldToClip = worldToClip;
+  std::vector<OccluderTriangle> triangles;
+  std::vector<Vector4> clip;
+  for (const Instance &instance : occluders) {
+    const MeshData &data = GetMeshData(instance.Mesh);
+    Matrix44 objectToClip = *instance.TransformObjectToWorld * worldToClip;
+    clip.resize(data.Positions.size());
+    for (size_t i = 0; i < data.Positions.size(); ++i) {
+      const Vector3 &p = data.Positions[i];
+      clip[i] = Transform(objectToClip, Vector4{p.X, p.Y, p.Z, 1});
+    }
+    for (size_t i = 0; i + 2 < data.Indices.size(); i += 3) {
+      const Vector4 in[3] = {clip[data.Indices[i + 0]],
+                             clip[data.Indices[i + 1]],
+                             clip[data.Indices[i + 2]]};
+      Vector4 polygon[16];
+      uint32_t count = ClipPolygon(in, polygon);
+      if (count < 3)
+        continue;
+      Vector3 screen[16];
+      for (uint32_t j = 0; j < count; ++j) {
+        float invW = 1 / polygon[j].W;
+        screen[j] = {(polygon[j].X * invW * 0.5f + 0.5f) * m_width,
+                     (0.5f - polygon[j].Y * invW * 0.5f) * m_height,
+                     polygon[j].Z * invW};
+      }
+      for (uint32_t j = 2; j < count; ++j) {
+        const Vector3 fan[3] = {screen[0], screen[j - 1], screen[j]};
+        OccluderTriangle tri;
+        if (SetupTriangle(fan, m_width, m_height, tri))
+          triangles.push_back(tri);
+      }
+    }
+  }
+  //////////////////////////////////////////////////////////////////////////////
+  // Every band owns its subtiles and walks the triangles in order.
+  const uint32_t bandCount = (m_subtilesY + BAND_HEIGHT - 1) / BAND_HEIGHT;
+  ParallelFor(bandCount, [&](uint32_t band) {
+    const int32_t bandMinY = band * BAND_HEIGHT;
+    const int32_t bandMaxY =
+        std::min(bandMinY + (int32_t)BAND_HEIGHT, (int32_t)m_subtilesY) - 1;
+    for (const OccluderTriangle &tri : triangles) {
+      const int32_t minY = std::max(tri.MinY, bandMinY);
+      const int32_t maxY = std::min(tri.MaxY, bandMaxY);
+      for (int32_t sy = minY; sy <= maxY; ++sy) {
+        const float y = (float)(sy * SUBTILE_HEIGHT);
+        for (int32_t sx = tri.MinX; sx <= tri.MaxX; ++sx) {
+          const float x = (float)(sx * SUBTILE_WIDTH);
+          uint32_t coverage = ComputeCoverage(tri, x, y);
+          if (coverage == 0)
+            continue;
+          // The farthest point of the plane over the subtile, which bounds
+          // every covered pixel.
+          float zTriangle =
+              tri.Z0 + tri.DZDX * (tri.DZDX > 0 ? x + SUBTILE_WIDTH : x) +
+              tri.DZDY * (tri.DZDY > 0 ? y + SUBTILE_HEIGHT : y);
+          zTriangle = std::min(zTriangle, tri.ZMax);
+          uint32_t index = sx + sy * m_subtilesX;
+          UpdateSubtile(m_zMax0[index], m_zMax1[index], m_mask[index],
+                        coverage, zTriangle);
+        }
+      }
+    }
+  });
+}
+
+OcclusionResult OcclusionCuller::TestAABB(const AABB &worldBounds) const {
+  float minX = INFINITY, minY = INFINITY, minZ = INFINITY;
+  float maxX = -INFINITY, maxY = -INFINITY;
+  for (int corner = 0; corner < 8; ++corner) {
+    Vector4 p = {corner & 1 ? worldBounds.Max.X : worldBounds.Min.X,
+                 corner & 2 ? worldBounds.Max.Y : worldBounds.Min.Y,
+                 corner & 4 ? worldBounds.Max.Z : worldBounds.Min.Z, 1};
+    Vector4 clip = Transform(m_worldToClip, p);
+    // A box reaching past the near plane surrounds the camera or is about to;
+    // leave it alone.
+    if (clip.Z < 0 || clip.W <= 0)
+      return OcclusionVisible;
+    float invW = 1 / clip.W;
+    float x = (clip.X * invW * 0.5f + 0.5f) * m_width;
+    float y = (0.5f - clip.Y * invW * 0.5f) * m_height;
+    minX = std::min(minX, x);
+    maxX = std::max(maxX, x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+    minZ = std::min(minZ, clip.Z * invW);
+  }
+  if (maxX < 0 || maxY < 0 || minX > m_width || minY > m_height || minZ > 1)
+    return OcclusionViewCulled;
+  const int32_t sx0 = std::max((int32_t)floorf(minX), 0) / SUBTILE_WIDTH;
+  const int32_t sy0 = std::max((int32_t)floorf(minY), 0) / SUBTILE_HEIGHT;
+  const int32_t sx1 =
+      std::min((int32_t)floorf(maxX), (int32_t)m_width - 1) / SUBTILE_WIDTH;
+  const int32_t sy1 =
+      std::min((int32_t)floorf(maxY), (int32_t)m_height - 1) / SUBTILE_HEIGHT;
+  for (int32_t sy = sy0; sy <= sy1; ++sy) {
+    const float *row = &m_zMax0[sy * m_subtilesX];
+    for (int32_t sx = sx0; sx <= sx1; ++sx) {
+      if (row[sx] >= minZ)
+        return OcclusionVisible;
+    }
+  }
+  return OcclusionOccluded;
+}
+
+std::vector<bool> OcclusionCuller::Cull(const std::vector<Instance> &scene,
+                                        const std::vector<Instance> &occluders,
+                                        const Matrix44 &worldToClip) {
+  Clear();
+  RenderOccluders(occluders, worldToClip);
+  std::vector<bool> visible(scene.size());
+  for (size_t i = 0; i < scene.size(); ++i) {
+    visible[i] = TestAABB(GetWorldBounds(scene[i])) == OcclusionVisible;
+  }
+  return visible;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Occluder selection.
+
+std::vector<Instance> SelectOccluders(const std::vector<Instance> &scene,
+                                      float minimumFraction) {
+  std::vector<AABB> bounds;
+  AABB sceneBounds = EmptyAABB();
+  for (const Instance &instance : scene) {
+    AABB box = GetMeshBounds(*instance.Mesh);
+    if (instance.Mesh->getVertexCount() > 0) {
+      box = TransformAABB(*instance.TransformObjectToWorld, box);
+      sceneBounds = Union(sceneBounds, box);
+    }
+    bounds.push_back(box);
+  }
+  const float minimumSize =
+      Length(sceneBounds.Max - sceneBounds.Min) * minimumFraction;
+  std::vector<Instance> occluders;
+  for (size_t i = 0; i < scene.size(); ++i) {
+    if (bounds[i].Min.X > bounds[i].Max.X)
+      continue;
+    const OBJMaterial *obj =
+        dynamic_cast<const OBJMaterial *>(scene[i].Material.get());
+    if (obj != nullptr && obj->DissolveMap != nullptr)
+      continue;
+    if (Length(bounds[i].Max - bounds[i].Min) >= minimumSize)
+      occluders.push_back(scene[i]);
+  }
+  return occluders;
+}
\ No newline at end of file
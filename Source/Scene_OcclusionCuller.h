@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_BVH.h"
+#include "Scene_InstanceTable.h"
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Masked Software Occlusion Culling
+//
+// A small depth buffer of the largest occluders is rasterized on the CPU and
+// instance bounds are tested against it before anything is submitted to the
+// GPU (Hasselgren et al., "Masked Software Occlusion Culling").
+//
+// Depth is not stored per pixel. Each 8x4 pixel subtile keeps a 32-bit
+// coverage mask and two depths: ZMax0 bounds every pixel of the subtile and
+// ZMax1 bounds the pixels set in the mask. Triangles are merged into the mask
+// layer until it covers the whole subtile, at which point it replaces ZMax0.
+// Every stored depth is an upper bound of the true occluder depth, so a box
+// is only culled if it really is hidden.
+//
+// Coverage masks are computed with SSE2, eight pixels of a row at a time, and
+// occluders are rasterized in parallel over horizontal bands of subtiles.
+////////////////////////////////////////////////////////////////////////////////
+
+enum OcclusionResult {
+  OcclusionVisible,
+  OcclusionOccluded,
+  OcclusionViewCulled
+};
+
+class OcclusionCuller : public Object {
+public:
+  // The buffer is rounded up to a whole number of subtiles.
+  OcclusionCuller(uint32_t width = 512, uint32_t height = 256);
+  void Clear();
+  // Rasterize occluders with a world to clip transform (D3D clip space, as
+  // in SampleResources::TransformWorldToClip). Triangles crossing the near
+  // plane or the guard band are clipped to them before rasterization.
+  void RenderOccluders(const std::vector<Instance> &occluders,
+                       const Matrix44 &worldToClip);
+  // Test a world space box with the transform of the last RenderOccluders.
+  OcclusionResult TestAABB(const AABB &worldBounds) const;
+  // World space bounds of an instance.
+  AABB GetWorldBounds(const Instance &instance);
+  // Clear, render the occluders and test every instance of a scene. Returns
+  // true for each instance which may be visible.
+  std::vector<bool> Cull(const std::vector<Instance> &scene,
+                         const std::vector<Instance> &occluders,
+                         const Matrix44 &worldToClip);
+
+private:
+  struct MeshData {
+    std::shared_ptr<IMesh> Mesh;
+    std::vector<Vector3> Positions;
+    std::vector<uint32_t> Indices;
+    AABB Bounds;
+  };
+  const MeshData &GetMeshData(const std::shared_ptr<IMesh> &mesh);
+  uint32_t m_width;
+  uint32_t m_height;
+  uint32_t m_subtilesX;
+  uint32_t m_subtilesY;
+  Matrix44 m_worldToClip;
+  std::vector<float> m_zMax0;
+  std::vector<float> m_zMax1;
+  std::vector<uint32_t> m_mask;
+  std::map<const IMesh *, MeshData> m_meshes;
+};
+
+// Choose occluders: instances whose world bounds have a diagonal of at least
+// minimumFraction of the whole scene's diagonal. Alpha masked OBJ materials
+// are never chosen since their triangles are not solid.
+std::vector<Instance> SelectOccluders(const std::vector<Instance> &scene,
+                                      float minimumFraction = 0.1f);
\ No newline at end of file
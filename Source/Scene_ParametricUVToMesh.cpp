@@ -1,6 +1,13 @@
 #include "Scene_ParametricUVToMesh.h"
 #include "Core_Math.h"
+#include "Core_Parallel.h"
 #include "Scene_IParametricUV.h"
+#include <algorithm>
+#include <vector>
+
+// Vertices evaluated per parallel task. Small meshes fit in one band and
+// never leave the calling thread.
+static const uint32_t BAND_VERTEX_COUNT = 16384;
 
 ParametricUVToMesh::ParametricUVToMesh(std::shared_ptr<IParametricUV> shape,
                                        uint32_t stepsInU, uint32_t stepsInV)
@@ -15,25 +22,11 @@ uint32_t ParametricUVToMesh::getIndexCount() const {
 }
 
 void ParametricUVToMesh::copyVertices(void *to, uint32_t stride) const {
-  for (int32_t v = 0; v <= m_stepsInV; ++v) {
-    for (int32_t u = 0; u <= m_stepsInU; ++u) {
-      *(reinterpret_cast<Vector3 *>(to)) = m_shape->getVertexPosition(
-          {(float)u / m_stepsInU, (float)v / m_stepsInV});
-      to =
-          reinterpret_cast<Vector3 *>(reinterpret_cast<uint8_t *>(to) + stride);
-    }
-  }
+  copyEvaluated(to, stride, false);
 }
 
 void ParametricUVToMesh::copyNormals(void *to, uint32_t stride) const {
-  for (int32_t v = 0; v <= m_stepsInV; ++v) {
-    for (int32_t u = 0; u <= m_stepsInU; ++u) {
-      *(reinterpret_cast<Vector3 *>(to)) = m_shape->getVertexNormal(
-          {(float)u / m_stepsInU, (float)v / m_stepsInV});
-      to =
-          reinterpret_cast<Vector3 *>(reinterpret_cast<uint8_t *>(to) + stride);
-    }
-  }
+  copyEvaluated(to, stride, true);
 }
 
 void ParametricUVToMesh::copyTexcoords(void *to, uint32_t stride) const {
@@ -76,4 +69,40 @@ void ParametricUVToMesh::copyIndices(void *to, uint32_t stride) const {
                                         stride);
     }
   }
+}
+
+void ParametricUVToMesh::copyEvaluated(void *to, uint32_t stride,
+                                       bool normals) const {
+  const uint32_t columns = m_stepsInU + 1;
+  const uint32_t rows = m_stepsInV + 1;
+  std::vector<float> u(columns), v(rows);
+  for (uint32_t column = 0; column < columns; ++column)
+    u[column] = (float)column / m_stepsInU;
+  for (uint32_t row = 0; row < rows; ++row)
+    v[row] = (float)row / m_stepsInV;
+  const uint32_t bandRows = std::max(1u, BAND_VERTEX_COUNT / columns);
+  const uint32_t bands = (rows + bandRows - 1) / bandRows;
+  ParallelFor(bands, [&](uint32_t band) {
+    const uint32_t firstRow = band * bandRows;
+    const uint32_t rowCount = std::min(bandRows, rows - firstRow);
+    uint8_t *out =
+        reinterpret_cast<uint8_t *>(to) + (size_t)firstRow * columns * stride;
+    // Packed outputs are written in place; anything else goes through a
+    // scratch band.
+    std::vector<Vector3> scratch;
+    Vector3 *evaluated = reinterpret_cast<Vector3 *>(out);
+    if (stride != sizeof(Vector3)) {
+      scratch.resize(rowCount * columns);
+      evaluated = &scratch[0];
+    }
+    m_shape->evaluateGrid(&u[0], columns, &v[firstRow], rowCount,
+                          normals ? nullptr : evaluated,
+                          normals ? evaluated : nullptr);
+    if (stride != sizeof(Vector3)) {
+      for (const Vector3 &value : scratch) {
+        *(reinterpret_cast<Vector3 *>(out)) = value;
+        out += stride;
+      }
+    }
+  });
 }
\ No newline at end of file
@@ -19,6 +19,8 @@ public:
   void copyIndices(void *to, uint32_t stride) const override;
 
 private:
+  // Evaluate the grid in parallel row bands and write positions or normals.
+  void copyEvaluated(void *to, uint32_t stride, bool normals) const;
   std::shared_ptr<IParametricUV> m_shape;
   uint32_t m_stepsInU;
   uint32_t m_stepsInV;
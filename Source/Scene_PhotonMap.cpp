@@ -0,0 +1,517 @@
+#include "Scene_PhotonMap.h"
+#include "Core_Parallel.h"
+#include "Core_Sampling.h"
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <utility>
+
+// Photons are emitted, hashed and scattered in batches of this size.
+static const uint32_t PHOTON_BATCH_SIZE = 4096;
+
+// FindNearest keeps its candidates on the stack.
+static const uint32_t MAX_NEAREST = 256;
+
+////////////////////////////////////////////////////////////////////////////////
+// Hashed grid.
+
+static int32_t CellCoordinate(float value, float cellSize) {
+  return (int32_t)floorf(value / cellSize);
+}
+
+uint32_t PhotonMap::Hash(int32_t x, int32_t y, int32_t z) const {
+  return ((uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^
+          (uint32_t)z * 83492791u) &
+         m_tableMask;
+}
+
+PhotonMap::PhotonMap(std::vector<Photon> photons, float cellSize)
+    : m_cellSize(cellSize) {
+  const uint32_t count = (uint32_t)photons.size();
+  uint32_t tableSize = 1;
+  while (tableSize < count * 2) {
+    tableSize <<= 1;
+  }
+  m_tableMask = tableSize - 1;
+  const uint32_t batchCount =
+      (count + PHOTON_BATCH_SIZE - 1) / PHOTON_BATCH_SIZE;
+  ////////////////////////////////////////////////////////////////////////////////
+  // Counting sort by bucket. Histogram and scatter both run in parallel with
+  // atomics; order within a bucket is arbitrary, which queries don't care
+  // about.
+  std::vector<uint32_t> buckets(count);
+  std::unique_ptr<std::atomic<uint32_t>[]> cursor(
+      new std::atomic<uint32_t>[tableSize]);
+  for (uint32_t i = 0; i < tableSize; ++i) {
+    cursor[i] = 0;
+  }
+  ParallelFor(batchCount, [&](uint32_t batch) {
+    uint32_t end = std::min(count, (batch + 1) * PHOTON_BATCH_SIZE);
+    for (uint32_t i = batch * PHOTON_BATCH_SIZE; i < end; ++i) {
+      const Vector3 &p = photons[i].Position;
+      buckets[i] = Hash(CellCoordinate(p.X, m_cellSize),
+                        CellCoordinate(p.Y, m_cellSize),
+                        CellCoordinate(p.Z, m_cellSize));
+      cursor[buckets[i]].fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  m_cellStart.resize(tableSize + 1);
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < tableSize; ++i) {
+    m_cellStart[i] = sum;
+    sum += cursor[i].load(std::memory_order_relaxed);
+    cursor[i].store(m_cellStart[i], std::memory_order_relaxed);
+  }
+  m_cellStart[tableSize] = sum;
+  m_photons.resize(count);
+  ParallelFor(batchCount, [&](uint32_t batch) {
+    uint32_t end = std::min(count, (batch + 1) * PHOTON_BATCH_SIZE);
+    for (uint32_t i = batch * PHOTON_BATCH_SIZE; i < end; ++i) {
+      uint32_t slot =
+          cursor[buckets[i]].fetch_add(1, std::memory_order_relaxed);
+      m_photons[slot] = photons[i];
+    }
+  });
+}
+
+// Visit every distinct bucket overlapping a sphere. Several cells can hash to
+// the same bucket, so the buckets are sorted and each is visited once. Usual
+// queries touch 2x2x2 cells and stay on the stack.
+template <class VISIT>
+static void ForEachBucket(const Vector3 &position, float radius,
+                          float cellSize, VISIT visit) {
+  int32_t x0 = CellCoordinate(position.X - radius, cellSize);
+  int32_t y0 = CellCoordinate(position.Y - radius, cellSize);
+  int32_t z0 = CellCoordinate(position.Z - radius, cellSize);
+  int32_t x1 = CellCoordinate(position.X + radius, cellSize);
+  int32_t y1 = CellCoordinate(position.Y + radius, cellSize);
+  int32_t z1 = CellCoordinate(position.Z + radius, cellSize);
+  size_t cellCount =
+      (size_t)(x1 - x0 + 1) * (size_t)(y1 - y0 + 1) * (size_t)(z1 - z0 + 1);
+  uint32_t local[64];
+  std::vector<uint32_t> spill;
+  uint32_t *buckets = local;
+  if (cellCount > 64) {
+    spill.resize(cellCount);
+    buckets = spill.data();
+  }
+  uint32_t bucketCount = 0;
+  for (int32_t z = z0; z <= z1; ++z) {
+    for (int32_t y = y0; y <= y1; ++y) {
+      for (int32_t x = x0; x <= x1; ++x) {
+        buckets[bucketCount++] = visit.Hash(x, y, z);
+      }
+    }
+  }
+  std::sort(buckets, buckets + bucketCount);
+  uint32_t *end = std::unique(buckets, buckets + bucketCount);
+  for (uint32_t *bucket = buckets; bucket != end; ++bucket) {
+    visit(*bucket);
+  }
+}
+
+void PhotonMap::Gather(
+    const Vector3 &position, float radius,
+    const std::function<void(const Photon &, float)> &visit) const {
+  struct Visitor {
+    const PhotonMap *Map;
+    const Vector3 &Position;
+    float RadiusSquared;
+    const std::function<void(const Photon &, float)> &Visit;
+    uint32_t Hash(int32_t x, int32_t y, int32_t z) const {
+      return Map->Hash(x, y, z);
+    }
+    void operator()(uint32_t bucket) const {
+      for (uint32_t i = Map->m_cellStart[bucket];
+           i < Map->m_cellStart[bucket + 1]; ++i) {
+        Vector3 d = Map->m_photons[i].Position - Position;
+        float distanceSquared = Dot(d, d);
+        if (distanceSquared <= RadiusSquared)
+          Visit(Map->m_photons[i], distanceSquared);
+      }
+    }
+  };
+  ForEachBucket(position, radius, m_cellSize,
+                Visitor{this, position, radius * radius, visit});
+}
+
+uint32_t PhotonMap::FindNearest(const Vector3 &position, uint32_t count,
+                                float maxRadius, uint32_t *indices,
+                                float &radiusSquared) const {
+  // A max-heap on distance holds the best candidates so far; once full, its
+  // top is the current search radius.
+  struct Candidate {
+    float DistanceSquared;
+    uint32_t Index;
+    bool operator<(const Candidate &rhs) const {
+      return DistanceSquared < rhs.DistanceSquared;
+    }
+  };
+  struct Visitor {
+    const PhotonMap *Map;
+    const Vector3 &Position;
+    uint32_t Count;
+    Candidate *Heap;
+    uint32_t &HeapSize;
+    float &Limit;
+    uint32_t Hash(int32_t x, int32_t y, int32_t z) const {
+      return Map->Hash(x, y, z);
+    }
+    void operator()(uint32_t bucket) const {
+      for (uint32_t i = Map->m_cellStart[bucket];
+           i < Map->m_cellStart[bucket + 1]; ++i) {
+        Vector3 d = Map->m_photons[i].Position - Position;
+        float distanceSquared = Dot(d, d);
+        if (distanceSquared >= Limit)
+          continue;
+        if (HeapSize == Count) {
+          std::pop_heap(Heap, Heap + HeapSize);
+          --HeapSize;
+        }
+        Heap[HeapSize++] = {distanceSquared, i};
+        std::push_heap(Heap, Heap + HeapSize);
+        if (HeapSize == Count)
+          Limit = Heap[0].DistanceSquared;
+      }
+    }
+  };
+  if (count > MAX_NEAREST)
+    count = MAX_NEAREST;
+  Candidate heap[MAX_NEAREST];
+  uint32_t heapSize = 0;
+  float limit = maxRadius * maxRadius;
+  if (count == 0)
+    return 0;
+  ForEachBucket(position, maxRadius, m_cellSize,
+                Visitor{this, position, count, heap, heapSize, limit});
+  for (uint32_t i = 0; i < heapSize; ++i) {
+    indices[i] = heap[i].Index;
+  }
+  radiusSquared = heapSize == count ? heap[0].DistanceSquared
+                                    : maxRadius * maxRadius;
+  return heapSize;
+}
+
+const std::vector<Photon> &PhotonMap::GetPhotons() const { return m_photons; }
+
+////////////////////////////////////////////////////////////////////////////////
+// Specular scattering; CPU versions of reflect, refract2 and schlick from
+// Sample_HLSL_Common.inc. The normal is first turned to face the incoming
+// ray so the Fresnel term is also valid when leaving the glass.
+
+static Vector3 Reflect(const Vector3 &incident, const Vector3 &normal) {
+  return incident - normal * (2 * Dot(incident, normal));
+}
+
+static bool Refract2(const Vector3 &incident, const Vector3 &normal, float ior,
+                     Vector3 &refracted) {
+  float cosi = Dot(incident, normal);
+  cosi = cosi < -1 ? -1 : (cosi > 1 ? 1 : cosi);
+  float etai = 1, etat = ior;
+  Vector3 n = normal;
+  if (cosi < 0) {
+    cosi = -cosi;
+  } else {
+    std::swap(etai, etat);
+    n = -normal;
+  }
+  float eta = etai / etat;
+  float k = 1 - eta * eta * (1 - cosi * cosi);
+  if (k < 0)
+    return false;
+  refracted = Normalize(incident * eta + n * (eta * cosi - SquareRoot(k)));
+  return true;
+}
+
+static float Schlick(const Vector3 &incident, const Vector3 &normal,
+                     float ior1, float ior2) {
+  Vector3 n = Dot(incident, normal) < 0 ? normal : -normal;
+  float coeff = (ior1 - ior2) / (ior1 + ior2);
+  coeff = coeff * coeff;
+  float c = 1 - Dot(-incident, n);
+  return coeff + (1 - coeff) * c * c * c * c * c;
+}
+
+// Move a ray to continue from a surface, on the side it is travelling to.
+// Surfaces lie inside the scene bounds, so nothing can be hit further away
+// than their diagonal.
+static Ray ContinueRay(const Vector3 &position, const Vector3 &normal,
+                       const Vector3 &direction, float bias, float diagonal) {
+  Vector3 offset = Dot(direction, normal) > 0 ? normal : -normal;
+  return {position + offset * bias, direction, 0, diagonal + bias};
+}
+
+static AABB GetSceneBounds(const ImplicitBVH &geometry) {
+  AABB bounds = EmptyAABB();
+  for (int shape = 0; shape < ShapeCount; ++shape) {
+    uint32_t count = geometry.GetPrimitiveCount((ImplicitShape)shape);
+    for (uint32_t i = 0; i < count; ++i) {
+      bounds =
+          Union(bounds, geometry.GetPrimitiveBounds((ImplicitShape)shape, i));
+    }
+  }
+  return bounds;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Photon tracing.
+
+struct CausticTarget {
+  Vector3 Center;
+  float Radius;
+};
+
+// The target disks as seen from the light, binned into a 2D grid on the
+// plane spanned by "tangent" and "bitangent" so a point only tests the disks
+// overlapping its cell.
+class CausticCoverage {
+public:
+  CausticCoverage(const std::vector<CausticTarget> &targets,
+                  const Vector3 &tangent, const Vector3 &bitangent)
+      : m_targets(targets), m_tangent(tangent), m_bitangent(bitangent) {
+    m_min = {INFINITY, INFINITY};
+    Vector2 max = {-INFINITY, -INFINITY};
+    for (const auto &target : targets) {
+      Vector2 center = Project(target.Center);
+      m_min = {std::min(m_min.X, center.X - target.Radius),
+               std::min(m_min.Y, center.Y - target.Radius)};
+      max = {std::max(max.X, center.X + target.Radius),
+             std::max(max.Y, center.Y + target.Radius)};
+    }
+    // About one cell per target.
+    m_resolution = std::min(
+        std::max((uint32_t)ceilf(sqrtf((float)targets.size())), 1u), 1024u);
+    m_cellSize = std::max(std::max(max.X - m_min.X, max.Y - m_min.Y) /
+                              m_resolution,
+                          1e-20f);
+    ////////////////////////////////////////////////////////////////////////////
+    // Count the disks over each cell, then scatter them (compressed rows).
+    m_cellStart.assign(m_resolution * m_resolution + 1, 0);
+    for (int pass = 0; pass < 2; ++pass) {
+      std::vector<uint32_t> cursor(m_cellStart.begin(), m_cellStart.end() - 1);
+      for (uint32_t t = 0; t < targets.size(); ++t) {
+        Vector2 center = Project(targets[t].Center);
+        uint32_t x0 = Cell(center.X - targets[t].Radius - m_min.X);
+        uint32_t x1 = Cell(center.X + targets[t].Radius - m_min.X);
+        uint32_t y0 = Cell(center.Y - targets[t].Radius - m_min.Y);
+        uint32_t y1 = Cell(center.Y + targets[t].Radius - m_min.Y);
+        for (uint32_t y = y0; y <= y1; ++y) {
+          for (uint32_t x = x0; x <= x1; ++x) {
+            uint32_t cell = y * m_resolution + x;
+            if (pass == 0)
+              ++m_cellStart[cell + 1];
+            else
+              m_cellTargets[cursor[cell]++] = t;
+          }
+        }
+      }
+      if (pass == 0) {
+        for (uint32_t i = 0; i < m_resolution * m_resolution; ++i) {
+          m_cellStart[i + 1] += m_cellStart[i];
+        }
+        m_cellTargets.resize(m_cellStart.back());
+      }
+    }
+  }
+  // Number of target disks containing a point on any of them.
+  uint32_t Count(const Vector3 &point) const {
+    Vector2 p = Project(point);
+    uint32_t cell = Cell(p.Y - m_min.Y) * m_resolution + Cell(p.X - m_min.X);
+    uint32_t count = 0;
+    for (uint32_t i = m_cellStart[cell]; i < m_cellStart[cell + 1]; ++i) {
+      const CausticTarget &target = m_targets[m_cellTargets[i]];
+      Vector2 d = p - Project(target.Center);
+      count += Dot(d, d) <= target.Radius * target.Radius ? 1 : 0;
+    }
+    return count;
+  }
+
+private:
+  Vector2 Project(const Vector3 &point) const {
+    return {Dot(point, m_tangent), Dot(point, m_bitangent)};
+  }
+  uint32_t Cell(float offset) const {
+    float cell = floorf(offset / m_cellSize);
+    return cell < 0 ? 0 : std::min((uint32_t)cell, m_resolution - 1);
+  }
+  const std::vector<CausticTarget> &m_targets;
+  Vector3 m_tangent, m_bitangent;
+  Vector2 m_min;
+  float m_cellSize;
+  uint32_t m_resolution;
+  std::vector<uint32_t> m_cellStart;
+  std::vector<uint32_t> m_cellTargets;
+};
+
+std::vector<Photon> TraceCausticPhotons(const CausticScene &scene,
+                                        const CausticSettings &settings) {
+  // Aim at the bounding sphere of every specular primitive, in proportion to
+  // the area each one presents to the light.
+  std::vector<CausticTarget> targets;
+  std::vector<float> weights;
+  for (int shape = 0; shape < ShapeCount; ++shape) {
+    uint32_t count = scene.Geometry->GetPrimitiveCount((ImplicitShape)shape);
+    for (uint32_t i = 0; i < count; ++i) {
+      AABB box = scene.Geometry->GetPrimitiveBounds((ImplicitShape)shape, i);
+      if (scene.GetSurface((ImplicitShape)shape, i) == SurfaceDiffuse)
+        continue;
+      CausticTarget target = {(box.Min + box.Max) * 0.5f,
+                              Length(box.Max - box.Min) * 0.5f};
+      targets.push_back(target);
+      weights.push_back(Pi<float> * target.Radius * target.Radius);
+    }
+  }
+  if (targets.empty() || settings.PhotonCount == 0)
+    return {};
+  AliasTable table(weights.data(), (uint32_t)weights.size());
+  float totalArea = 0;
+  for (float weight : weights) {
+    totalArea += weight;
+  }
+  const Vector3 toLight = Normalize(scene.LightDirection);
+  Vector3 tangent, bitangent;
+  CreateBasis(toLight, tangent, bitangent);
+  const CausticCoverage coverageGrid(targets, tangent, bitangent);
+  const AABB sceneBounds = GetSceneBounds(*scene.Geometry);
+  const float startDistance = Length(sceneBounds.Max - sceneBounds.Min);
+  const Vector3 photonPower =
+      scene.LightIrradiance * (totalArea / settings.PhotonCount);
+  const uint32_t batchCount =
+      (settings.PhotonCount + PHOTON_BATCH_SIZE - 1) / PHOTON_BATCH_SIZE;
+  std::vector<std::vector<Photon>> batches(batchCount);
+  ParallelFor(batchCount, [&](uint32_t batch) {
+    uint32_t state = HashPCG(settings.Seed ^ HashPCG(batch));
+    uint32_t end =
+        std::min(settings.PhotonCount, (batch + 1) * PHOTON_BATCH_SIZE);
+    for (uint32_t i = batch * PHOTON_BATCH_SIZE; i < end; ++i) {
+      float pdf;
+      const CausticTarget &target =
+          targets[table.Sample(RandomUnit(state), pdf)];
+      float r = target.Radius * SquareRoot(RandomUnit(state));
+      float phi = 2 * Pi<float> * RandomUnit(state);
+      Vector3 onDisk = target.Center + tangent * (r * Cos(phi)) +
+                       bitangent * (r * Sin(phi));
+      // Where target disks overlap, each could have produced this photon;
+      // split its power so the overlap isn't counted twice.
+      uint32_t coverage = coverageGrid.Count(onDisk);
+      Vector3 power = photonPower * (1.0f / (coverage > 0 ? coverage : 1));
+      // The ray starts one diagonal behind the disk, which itself reaches at
+      // most half a diagonal outside the bounds.
+      Ray ray = {onDisk + toLight * startDistance, -toLight, 0,
+                 3 * startDistance};
+      for (uint32_t depth = 0; depth < settings.MaxDepth; ++depth) {
+        ImplicitHit hit = {};
+        hit.T = INFINITY;
+        if (!scene.Geometry->Intersect(ray, hit))
+          break;
+        Vector3 position = ray.Origin + ray.Direction * hit.T;
+        Vector3 normal = scene.Geometry->GetNormal(ray, hit);
+        PhotonSurface surface = scene.GetSurface(hit.Shape, hit.Primitive);
+        if (surface == SurfaceDiffuse) {
+          if (depth > 0)
+            batches[batch].push_back({position, ray.Direction, power});
+          break;
+        }
+        Vector3 direction = Reflect(ray.Direction, normal);
+        if (surface == SurfaceGlass) {
+          // Choose reflection or refraction by the Fresnel weight, so the
+          // photon keeps its full power either way.
+          float fresnel =
+              Schlick(ray.Direction, normal, 1.0f, settings.GlassIOR);
+          Vector3 refracted;
+          if (RandomUnit(state) >= fresnel &&
+              Refract2(ray.Direction, normal, settings.GlassIOR, refracted))
+            direction = refracted;
+        }
+        ray = ContinueRay(position, normal, direction, settings.Bias,
+                          startDistance);
+      }
+    }
+  });
+  std::vector<Photon> photons;
+  for (const auto &batch : batches) {
+    photons.insert(photons.end(), batch.begin(), batch.end());
+  }
+  return photons;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Final gather.
+
+static Vector3 EstimateCaustic(const PhotonMap &photons,
+                               const Vector3 &position, const Vector3 &normal,
+                               const CausticSettings &settings) {
+  uint32_t indices[MAX_NEAREST];
+  float radiusSquared;
+  uint32_t found = photons.FindNearest(position, settings.NearestCount,
+                                       settings.MaxRadius, indices,
+                                       radiusSquared);
+  Vector3 flux = {0, 0, 0};
+  for (uint32_t i = 0; i < found; ++i) {
+    const Photon &photon = photons.GetPhotons()[indices[i]];
+    if (Dot(photon.Direction, normal) < 0)
+      flux = flux + photon.Power;
+  }
+  if (radiusSquared <= 0)
+    return {0, 0, 0};
+  // Irradiance is flux over the gather disk; a white Lambertian surface
+  // reflects 1/pi of it per steradian.
+  return flux * (1 / (Pi<float> * Pi<float> * radiusSquared));
+}
+
+std::unique_ptr<IImage> RenderCaustics(const CausticScene &scene,
+                                       const PhotonMap &photons,
+                                       const Matrix44 &clipToWorld,
+                                       uint32_t width, uint32_t height,
+                                       const CausticSettings &settings) {
+  std::unique_ptr<float[]> pixels(new float[4 * width * height]);
+  const AABB sceneBounds = GetSceneBounds(*scene.Geometry);
+  const Vector3 sceneCenter = (sceneBounds.Min + sceneBounds.Max) * 0.5f;
+  const float diagonal = Length(sceneBounds.Max - sceneBounds.Min);
+  ParallelFor(height, [&](uint32_t y) {
+    for (uint32_t x = 0; x < width; ++x) {
+      // Same unprojection as _RayGenerationMVPClipBase.
+      float normalizedX = -1 + 2 * (float)x / width;
+      float normalizedY = 1 - 2 * (float)y / height;
+      Vector4 front =
+          Transform(clipToWorld, Vector4{normalizedX, normalizedY, 0, 1});
+      Vector4 back =
+          Transform(clipToWorld, Vector4{normalizedX, normalizedY, 1, 1});
+      Vector3 origin = {front.X / front.W, front.Y / front.W,
+                        front.Z / front.W};
+      Vector3 target = {back.X / back.W, back.Y / back.W, back.Z / back.W};
+      Ray ray = {origin, Normalize(target - origin), 0,
+                 Length(origin - sceneCenter) + diagonal};
+      Vector3 radiance = {0, 0, 0};
+      for (uint32_t depth = 0; depth < settings.MaxDepth; ++depth) {
+        ImplicitHit hit = {};
+        hit.T = INFINITY;
+        if (!scene.Geometry->Intersect(ray, hit))
+          break;
+        Vector3 position = ray.Origin + ray.Direction * hit.T;
+        Vector3 normal = scene.Geometry->GetNormal(ray, hit);
+        PhotonSurface surface = scene.GetSurface(hit.Shape, hit.Primitive);
+        if (surface == SurfaceDiffuse) {
+          Vector3 facing = Dot(normal, ray.Direction) < 0 ? normal : -normal;
+          radiance = EstimateCaustic(photons, position, facing, settings);
+          break;
+        }
+        Vector3 direction = Reflect(ray.Direction, normal);
+        Vector3 refracted;
+        if (surface == SurfaceGlass &&
+            Refract2(ray.Direction, normal, settings.GlassIOR, refracted))
+          direction = refracted;
+        ray = ContinueRay(position, normal, direction, settings.Bias,
+                          diagonal);
+      }
+      float *pixel = &pixels[4 * (x + y * width)];
+      pixel[0] = radiance.X;
+      pixel[1] = radiance.Y;
+      pixel[2] = radiance.Z;
+      pixel[3] = 1;
+    }
+  });
+  return CreateImage_AutoDelete(width, height, sizeof(float) * 4 * width,
+                                DXGI_FORMAT_R32G32B32A32_FLOAT,
+                                pixels.release());
+}
\ No newline at end of file
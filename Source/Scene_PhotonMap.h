@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Core_IImage.h"
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_ImplicitBVH.h"
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Caustic Photon Mapping
+//
+// Whitted style ray tracing follows light from the eye, so it can never find
+// light that a glass sphere focuses onto the floor. This traces photons the
+// other way: from a directional light, through mirror and glass surfaces,
+// storing them where they first land on a diffuse surface (L S+ D paths
+// only). A density estimate over the nearest photons at each visible diffuse
+// point then gives a caustics buffer to add onto the Whitted image.
+//
+// Photons are emitted only toward specular primitives, traced in parallel,
+// and stored in a hashed uniform grid sorted by cell so every cell is one
+// contiguous run of memory.
+////////////////////////////////////////////////////////////////////////////////
+
+enum PhotonSurface { SurfaceDiffuse, SurfaceMirror, SurfaceGlass };
+
+struct Photon {
+  Vector3 Position;
+  // Direction of travel when the photon landed.
+  Vector3 Direction;
+  Vector3 Power;
+};
+
+struct CausticScene {
+  const ImplicitBVH *Geometry;
+  // How each primitive scatters light.
+  std::function<PhotonSurface(ImplicitShape shape, uint32_t primitive)>
+      GetSurface;
+  // Unit vector pointing toward the light; the Whitted sample uses
+  // normalize(1, 1, -1).
+  Vector3 LightDirection;
+  // Irradiance on a surface facing the light.
+  Vector3 LightIrradiance;
+};
+
+struct CausticSettings {
+  uint32_t PhotonCount = 1 << 20;
+  uint32_t MaxDepth = 8;
+  // IOR_GLASS from Sample_HLSL_Common.inc.
+  float GlassIOR = 1.52f;
+  // Photons used in each density estimate and the search radius cap.
+  uint32_t NearestCount = 64;
+  float MaxRadius = 0.1f;
+  // Ray origins are pushed this far off surfaces to avoid self hits.
+  float Bias = 1e-4f;
+  uint32_t Seed = 0;
+};
+
+class PhotonMap : public Object {
+public:
+  // Builds the grid in parallel; cellSize should be about twice the usual
+  // query radius so a query touches at most 2x2x2 cells.
+  PhotonMap(std::vector<Photon> photons, float cellSize);
+  // Call visit(photon, distanceSquared) for every photon within radius.
+  void Gather(const Vector3 &position, float radius,
+              const std::function<void(const Photon &, float)> &visit) const;
+  // Find up to "count" nearest photons within maxRadius. Writes their indices
+  // into GetPhotons() and returns how many were found; radiusSquared is set
+  // to the squared distance of the furthest one (or maxRadius^2 if fewer
+  // were found).
+  uint32_t FindNearest(const Vector3 &position, uint32_t count,
+                       float maxRadius, uint32_t *indices,
+                       float &radiusSquared) const;
+  const std::vector<Photon> &GetPhotons() const;
+
+private:
+  uint32_t Hash(int32_t x, int32_t y, int32_t z) const;
+  float m_cellSize;
+  uint32_t m_tableMask;
+  std::vector<uint32_t> m_cellStart;
+  std::vector<Photon> m_photons;
+};
+
+// Trace settings.PhotonCount photons from the light; only photons which reach
+// a diffuse surface after at least one specular bounce are returned.
+std::vector<Photon> TraceCausticPhotons(const CausticScene &scene,
+                                        const CausticSettings &settings = {});
+
+// Caustic radiance as seen through each pixel of a camera, for a white
+// diffuse surface; multiply by albedo when compositing. Primary rays that hit
+// mirrors or glass are followed to the first diffuse surface. The result is
+// R32G32B32A32_FLOAT.
+std::unique_ptr<IImage> RenderCaustics(const CausticScene &scene,
+                                       const PhotonMap &photons,
+                                       const Matrix44 &clipToWorld,
+                                       uint32_t width, uint32_t height,
+                                       const CausticSettings &settings = {});
\ No newline at end of file
@@ -0,0 +1,536 @@
+#include "Scene_Rasterizer.h"
+#include "Core_Parallel.h"
+#include "Scene_IMesh.h"
+#include <algorithm>
+#include <emmintrin.h>
+#include <math.h>
+
+// Triangles are clipped to a guard band this far past the viewport so snapped
+// coordinates stay small enough for exact edge functions; anything inside it
+// is left to the scissor of the tile loops.
+static const double GUARD_BAND_PIXELS = 8192;
+
+// Screen coordinates are snapped to 1/SUBPIXEL_STEPS of a pixel.
+static const double SUBPIXEL_STEPS = 256;
+
+// Triangles are clipped against the first CLIP_PLANES planes (near and guard
+// band); the rest (viewport and far) are only used to reject triangles.
+static const uint32_t CLIP_PLANES = 5;
+static const uint32_t PLANE_COUNT = 10;
+
+struct RasterVertex {
+  Vector4 Clip;
+  Vector3 Position;
+  Vector3 Normal;
+  // Snapped screen position; only valid inside the clip planes.
+  double X, Y;
+  // Bit p is set if the vertex is outside plane p.
+  uint32_t Outcode;
+};
+
+// Everything the tile loops need to walk one triangle. Edge k is opposite
+// vertex k, so E_k / area is the barycentric weight of vertex k.
+struct RasterTriangle {
+  double A[3], B[3], C[3];
+  int32_t MinX, MinY, MaxX, MaxY;
+  // Bit k is set if edge k is a top or left edge.
+  uint32_t TopLeft;
+  float InvArea;
+  float Z[3];
+  float InvW[3];
+  // World position and normal, each divided by w, per vertex.
+  float Attributes[6][3];
+};
+
+// The triangles and bins of one parallel setup task. Bins are stored sorted
+// by tile; the entries for tile t are [TileStart[t], TileStart[t + 1]).
+struct RasterBatch {
+  std::vector<RasterTriangle> Triangles;
+  std::vector<uint32_t> TileStart;
+  std::vector<uint32_t> Entries;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Clipping and setup.
+
+static RasterVertex Lerp(const RasterVertex &a, const RasterVertex &b,
+                         float t) {
+  RasterVertex o;
+  o.Clip = {a.Clip.X + (b.Clip.X - a.Clip.X) * t,
+            a.Clip.Y + (b.Clip.Y - a.Clip.Y) * t,
+            a.Clip.Z + (b.Clip.Z - a.Clip.Z) * t,
+            a.Clip.W + (b.Clip.W - a.Clip.W) * t};
+  o.Position = a.Position + (b.Position - a.Position) * t;
+  o.Normal = a.Normal + (b.Normal - a.Normal) * t;
+  return o;
+}
+
+static float PlaneDistance(const Vector4 &plane, const Vector4 &clip) {
+  return plane.X * clip.X + plane.Y * clip.Y + plane.Z * clip.Z +
+         plane.W * clip.W;
+}
+
+// Sutherland-Hodgman against every plane (kept where the distance is not
+// negative). Returns the vertex count of the convex polygon left in out.
+static uint32_t ClipPolygon(const RasterVertex *in, const Vector4 *planes,
+                            uint32_t planeCount, RasterVertex *out) {
+  RasterVertex buffer[2][16];
+  uint32_t count = 3;
+  std::copy(in, in + 3, buffer[0]);
+  for (uint32_t p = 0; p < planeCount && count > 0; ++p) {
+    const RasterVertex *source = buffer[p & 1];
+    RasterVertex *target = buffer[(p + 1) & 1];
+    uint32_t clipped = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      const RasterVertex &a = source[i];
+      const RasterVertex &b = source[(i + 1) % count];
+      float da = PlaneDistance(planes[p], a.Clip);
+      float db = PlaneDistance(planes[p], b.Clip);
+      if (da >= 0)
+        target[clipped++] = a;
+      if ((da >= 0) != (db >= 0))
+        target[clipped++] = Lerp(a, b, da / (da - db));
+    }
+    count = clipped;
+  }
+  std::copy(buffer[planeCount & 1], buffer[planeCount & 1] + count, out);
+  return count;
+}
+
+static uint32_t ComputeOutcode(const Vector4 *planes, const Vector4 &clip) {
+  uint32_t outcode = 0;
+  for (uint32_t p = 0; p < PLANE_COUNT; ++p) {
+    outcode |= (PlaneDistance(planes[p], clip) < 0 ? 1 : 0) << p;
+  }
+  return outcode;
+}
+
+static void ProjectVertex(RasterVertex &v, uint32_t width, uint32_t height) {
+  double sx = (v.Clip.X / v.Clip.W * 0.5 + 0.5) * width;
+  double sy = (0.5 - v.Clip.Y / v.Clip.W * 0.5) * height;
+  v.X = floor(sx * SUBPIXEL_STEPS + 0.5) / SUBPIXEL_STEPS;
+  v.Y = floor(sy * SUBPIXEL_STEPS + 0.5) / SUBPIXEL_STEPS;
+}
+
+static bool SetupTriangle(const RasterVertex &v0, const RasterVertex &v1,
+                          const RasterVertex &v2, uint32_t width,
+                          uint32_t height, bool cullBackFaces,
+                          RasterTriangle &triangle) {
+  const RasterVertex *vertices[3] = {&v0, &v1, &v2};
+  double x[3] = {v0.X, v1.X, v2.X};
+  double y[3] = {v0.Y, v1.Y, v2.Y};
+  // With y pointing down, clockwise (front facing) triangles have a positive
+  // area.
+  double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (area == 0 || (area < 0 && cullBackFaces))
+    return false;
+  if (area < 0) {
+    std::swap(vertices[1], vertices[2]);
+    std::swap(x[1], x[2]);
+    std::swap(y[1], y[2]);
+    area = -area;
+  }
+  double minX = std::min(x[0], std::min(x[1], x[2]));
+  double maxX = std::max(x[0], std::max(x[1], x[2]));
+  double minY = std::min(y[0], std::min(y[1], y[2]));
+  double maxY = std::max(y[0], std::max(y[1], y[2]));
+  triangle.MinX = std::max(0, (int32_t)floor(minX));
+  triangle.MinY = std::max(0, (int32_t)floor(minY));
+  triangle.MaxX = std::min((int32_t)width - 1, (int32_t)ceil(maxX));
+  triangle.MaxY = std::min((int32_t)height - 1, (int32_t)ceil(maxY));
+  if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY)
+    return false;
+  triangle.TopLeft = 0;
+  for (int k = 0; k < 3; ++k) {
+    int i = (k + 1) % 3;
+    int j = (k + 2) % 3;
+    triangle.A[k] = y[i] - y[j];
+    triangle.B[k] = x[j] - x[i];
+    triangle.C[k] = -(triangle.A[k] * x[i] + triangle.B[k] * y[i]);
+    if (triangle.A[k] > 0 || (triangle.A[k] == 0 && triangle.B[k] > 0))
+      triangle.TopLeft |= 1 << k;
+  }
+  triangle.InvArea = (float)(1 / area);
+  for (int k = 0; k < 3; ++k) {
+    const RasterVertex &v = *vertices[k];
+    float invW = 1 / v.Clip.W;
+    triangle.Z[k] = v.Clip.Z * invW;
+    triangle.InvW[k] = invW;
+    triangle.Attributes[0][k] = v.Position.X * invW;
+    triangle.Attributes[1][k] = v.Position.Y * invW;
+    triangle.Attributes[2][k] = v.Position.Z * invW;
+    triangle.Attributes[3][k] = v.Normal.X * invW;
+    triangle.Attributes[4][k] = v.Normal.Y * invW;
+    triangle.Attributes[5][k] = v.Normal.Z * invW;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Rasterization of one tile; four pixels of a row at a time.
+
+static __m128 Interpolate(const float *values, __m128 b0, __m128 b1,
+                          __m128 b2) {
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, _mm_set1_ps(values[0])),
+                               _mm_mul_ps(b1, _mm_set1_ps(values[1]))),
+                    _mm_mul_ps(b2, _mm_set1_ps(values[2])));
+}
+
+static __m128 ReciprocalLength(__m128 x, __m128 y, __m128 z) {
+  __m128 lengthSquared = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+  return _mm_div_ps(_mm_set1_ps(1), _mm_sqrt_ps(lengthSquared));
+}
+
+// The conversion the output merger applies when writing to a UNORM target:
+// saturate, then round to the nearest of 255 steps.
+static __m128i ConvertToUNORM8(__m128 value) {
+  value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1));
+  return _mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(255)));
+}
+
+static void RasterizeTriangle(const RasterTriangle &triangle, int32_t tileX0,
+                              int32_t tileY0, int32_t tileX1, int32_t tileY1,
+                              uint32_t width, uint32_t stride,
+                              const Vector3 &light, uint32_t *color,
+                              float *depth) {
+  int32_t x0 = std::max(triangle.MinX, tileX0) & ~3;
+  int32_t x1 = std::min(triangle.MaxX, tileX1 - 1);
+  int32_t y0 = std::max(triangle.MinY, tileY0);
+  int32_t y1 = std::min(triangle.MaxY, tileY1 - 1);
+  const __m128d zero = _mm_setzero_pd();
+  __m128d topLeft[3];
+  for (int k = 0; k < 3; ++k) {
+    topLeft[k] =
+        (triangle.TopLeft >> k) & 1 ? _mm_cmpeq_pd(zero, zero) : zero;
+  }
+  const __m128 invArea = _mm_set1_ps(triangle.InvArea);
+  for (int32_t y = y0; y <= y1; ++y) {
+    double rowE[3];
+    for (int k = 0; k < 3; ++k) {
+      rowE[k] = triangle.B[k] * (y + 0.5) + triangle.C[k];
+    }
+    for (int32_t x = x0; x <= x1; x += 4) {
+      //////////////////////////////////////////////////////////////////////////
+      // Coverage. Pixel centers are exact in double, so shared edges produce
+      // exactly negated values and the top-left rule settles the ties.
+      const __m128d centerLo = _mm_set_pd(x + 1.5, x + 0.5);
+      const __m128d centerHi = _mm_set_pd(x + 3.5, x + 2.5);
+      __m128 e[3];
+      __m128 coverage = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (int k = 0; k < 3; ++k) {
+        __m128d a = _mm_set1_pd(triangle.A[k]);
+        __m128d r = _mm_set1_pd(rowE[k]);
+        __m128d lo = _mm_add_pd(_mm_mul_pd(a, centerLo), r);
+        __m128d hi = _mm_add_pd(_mm_mul_pd(a, centerHi), r);
+        __m128d insideLo =
+            _mm_or_pd(_mm_cmpgt_pd(lo, zero),
+                      _mm_and_pd(_mm_cmpeq_pd(lo, zero), topLeft[k]));
+        __m128d insideHi =
+            _mm_or_pd(_mm_cmpgt_pd(hi, zero),
+                      _mm_and_pd(_mm_cmpeq_pd(hi, zero), topLeft[k]));
+        coverage = _mm_and_ps(
+            coverage, _mm_shuffle_ps(_mm_castpd_ps(insideLo),
+                                     _mm_castpd_ps(insideHi),
+                                     _MM_SHUFFLE(2, 0, 2, 0)));
+        e[k] = _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+      }
+      if (x + 4 > (int32_t)width) {
+        __m128i lane =
+            _mm_add_epi32(_mm_set1_epi32(x), _mm_set_epi32(3, 2, 1, 0));
+        coverage = _mm_and_ps(
+            coverage,
+            _mm_castsi128_ps(_mm_cmplt_epi32(lane, _mm_set1_epi32(width))));
+      }
+      if (_mm_movemask_ps(coverage) == 0)
+        continue;
+      //////////////////////////////////////////////////////////////////////////
+      // Depth test; z/w is linear in screen space.
+      __m128 b0 = _mm_mul_ps(e[0], invArea);
+      __m128 b1 = _mm_mul_ps(e[1], invArea);
+      __m128 b2 = _mm_mul_ps(e[2], invArea);
+      __m128 z = Interpolate(triangle.Z, b0, b1, b2);
+      float *depthRow = depth + y * stride + x;
+      __m128 depthOld = _mm_loadu_ps(depthRow);
+      __m128 pass = _mm_and_ps(
+          coverage, _mm_and_ps(_mm_cmplt_ps(z, depthOld),
+                               _mm_cmple_ps(z, _mm_set1_ps(1))));
+      if (_mm_movemask_ps(pass) == 0)
+        continue;
+      _mm_storeu_ps(depthRow, _mm_or_ps(_mm_and_ps(pass, z),
+                                        _mm_andnot_ps(pass, depthOld)));
+      //////////////////////////////////////////////////////////////////////////
+      // Perspective correct attributes and the Sample_D3D11Scene mainPS,
+      // which uses the interpolated normal as-is and does not clamp.
+      __m128 w = _mm_div_ps(_mm_set1_ps(1),
+                            Interpolate(triangle.InvW, b0, b1, b2));
+      __m128 attributes[6];
+      for (int i = 0; i < 6; ++i) {
+        attributes[i] =
+            _mm_mul_ps(Interpolate(triangle.Attributes[i], b0, b1, b2), w);
+      }
+      __m128 px = attributes[0], py = attributes[1], pz = attributes[2];
+      __m128 nx = attributes[3], ny = attributes[4], nz = attributes[5];
+      __m128 lx = _mm_sub_ps(_mm_set1_ps(light.X), px);
+      __m128 ly = _mm_sub_ps(_mm_set1_ps(light.Y), py);
+      __m128 lz = _mm_sub_ps(_mm_set1_ps(light.Z), pz);
+      __m128 illumination = _mm_mul_ps(
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, lx), _mm_mul_ps(ny, ly)),
+                     _mm_mul_ps(nz, lz)),
+          ReciprocalLength(lx, ly, lz));
+      __m128i gray = ConvertToUNORM8(illumination);
+      __m128i bgra = _mm_or_si128(
+          _mm_or_si128(gray, _mm_slli_epi32(gray, 8)),
+          _mm_or_si128(_mm_slli_epi32(gray, 16), _mm_set1_epi32(0xFF000000)));
+      __m128i *colorRow =
+          reinterpret_cast<__m128i *>(color + y * stride + x);
+      __m128i mask = _mm_castps_si128(pass);
+      _mm_storeu_si128(colorRow,
+                       _mm_or_si128(_mm_and_si128(mask, bgra),
+                                    _mm_andnot_si128(
+                                        mask, _mm_loadu_si128(colorRow))));
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SoftwareRasterizer.
+
+SoftwareRasterizer::SoftwareRasterizer(uint32_t width, uint32_t height,
+                                       const RasterizerSettings &settings)
+    : m_width(width), m_height(height), m_stride((width + 3) & ~3),
+      m_settings(settings) {
+  if (m_settings.TileSize < 4 || m_settings.TileSize % 4 != 0)
+    throw std::exception("Rasterizer tile size must be a multiple of 4.");
+  if (m_settings.TriangleBatchSize == 0)
+    m_settings.TriangleBatchSize = 1;
+  m_tilesX = (width + m_settings.TileSize - 1) / m_settings.TileSize;
+  m_tilesY = (height + m_settings.TileSize - 1) / m_settings.TileSize;
+  m_color.resize(m_stride * height);
+  m_depth.resize(m_stride * height);
+  Clear();
+}
+
+void SoftwareRasterizer::Clear() {
+  std::fill(m_color.begin(), m_color.end(), m_settings.ClearColor);
+  std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+}
+
+const SoftwareRasterizer::MeshData &
+SoftwareRasterizer::GetMeshData(const std::shared_ptr<IMesh> &mesh) {
+  auto findIt = m_meshes.find(mesh.get());
+  if (findIt != m_meshes.end())
+    return findIt->second;
+  MeshData &data = m_meshes[mesh.get()];
+  data.Mesh = mesh;
+  data.Positions.resize(mesh->getVertexCount());
+  data.Normals.resize(mesh->getVertexCount());
+  data.Indices.resize(mesh->getIndexCount());
+  if (!data.Positions.empty()) {
+    mesh->copyVertices(&data.Positions[0], sizeof(Vector3));
+    mesh->copyNormals(&data.Normals[0], sizeof(Vector3));
+  }
+  if (!data.Indices.empty())
+    mesh->copyIndices(&data.Indices[0], sizeof(uint32_t));
+  return data;
+}
+
+RasterizerStats SoftwareRasterizer::Draw(const std::vector<Instance> &scene,
+                                         const Matrix44 &worldToClip) {
+  RasterizerStats stats = {};
+  ////////////////////////////////////////////////////////////////////////////////
+  // Vertex processing, in parallel over instances.
+  std::vector<const MeshData *> meshes;
+  std::vector<uint32_t> vertexBase = {0};
+  std::vector<uint32_t> triangleBase = {0};
+  for (const Instance &instance : scene) {
+    const MeshData &data = GetMeshData(instance.Mesh);
+    meshes.push_back(&data);
+    vertexBase.push_back(vertexBase.back() + (uint32_t)data.Positions.size());
+    triangleBase.push_back(triangleBase.back() +
+                           (uint32_t)data.Indices.size() / 3);
+  }
+  const float guardX = (float)(1 + 2 * GUARD_BAND_PIXELS / m_width);
+  const float guardY = (float)(1 + 2 * GUARD_BAND_PIXELS / m_height);
+  const Vector4 planes[PLANE_COUNT] = {
+      {0, 0, 1, 0},       {-1, 0, 0, guardX}, {1, 0, 0, guardX},
+      {0, -1, 0, guardY}, {0, 1, 0, guardY},  {-1, 0, 0, 1},
+      {1, 0, 0, 1},       {0, -1, 0, 1},      {0, 1, 0, 1},
+      {0, 0, -1, 1}};
+  const uint32_t clipMask = (1 << CLIP_PLANES) - 1;
+  std::vector<RasterVertex> vertices(vertexBase.back());
+  ParallelFor((uint32_t)scene.size(), [&](uint32_t instanceIndex) {
+    const Matrix44 &objectToWorld =
+        *scene[instanceIndex].TransformObjectToWorld;
+    // Normals take the inverse transpose so they stay perpendicular to the
+    // surface under non-uniform scale.
+    const Matrix44 normalToWorld = Transpose(Invert(objectToWorld));
+    const MeshData &data = *meshes[instanceIndex];
+    RasterVertex *out = &vertices[0] + vertexBase[instanceIndex];
+    for (size_t i = 0; i < data.Positions.size(); ++i) {
+      Vector3 world = TransformPoint(objectToWorld, data.Positions[i]);
+      Vector3 normal = TransformVector(normalToWorld, data.Normals[i]);
+      float length = Length(normal);
+      out[i].Clip =
+          Transform(worldToClip, Vector4{world.X, world.Y, world.Z, 1});
+      out[i].Position = world;
+      out[i].Normal = length > 0 ? normal * (1 / length) : normal;
+      out[i].Outcode = ComputeOutcode(planes, out[i].Clip);
+      if ((out[i].Outcode & clipMask) == 0)
+        ProjectVertex(out[i], m_width, m_height);
+    }
+  });
+  ////////////////////////////////////////////////////////////////////////////////
+  // Clip, set up and bin triangles in batches.
+  const uint32_t triangleCount = triangleBase.back();
+  const uint32_t batchSize = m_settings.TriangleBatchSize;
+  const uint32_t batchCount = (triangleCount + batchSize - 1) / batchSize;
+  const uint32_t tileSize = m_settings.TileSize;
+  const uint32_t tileCount = m_tilesX * m_tilesY;
+  std::vector<RasterBatch> batches(batchCount);
+  ParallelFor(batchCount, [&](uint32_t batchIndex) {
+    RasterBatch &batch = batches[batchIndex];
+    std::vector<std::pair<uint32_t, uint32_t>> binned;
+    uint32_t begin = batchIndex * batchSize;
+    uint32_t end = std::min(triangleCount, begin + batchSize);
+    batch.Triangles.reserve(end - begin);
+    binned.reserve(end - begin);
+    uint32_t instanceIndex = (uint32_t)(std::upper_bound(triangleBase.begin(),
+                                                         triangleBase.end(),
+                                                         begin) -
+                                        triangleBase.begin()) -
+                             1;
+    for (uint32_t t = begin; t < end; ++t) {
+      while (t >= triangleBase[instanceIndex + 1]) {
+        ++instanceIndex;
+      }
+      const std::vector<uint32_t> &indices = meshes[instanceIndex]->Indices;
+      const RasterVertex *base = &vertices[0] + vertexBase[instanceIndex];
+      uint32_t local = t - triangleBase[instanceIndex];
+      const RasterVertex *corners[3] = {&base[indices[3 * local + 0]],
+                                        &base[indices[3 * local + 1]],
+                                        &base[indices[3 * local + 2]]};
+      if (corners[0]->Outcode & corners[1]->Outcode & corners[2]->Outcode)
+        continue;
+      // Most triangles need no clipping and use the shared vertices as-is.
+      const RasterVertex *fan[16] = {corners[0], corners[1], corners[2]};
+      uint32_t fanCount = 3;
+      RasterVertex polygon[16];
+      if (((corners[0]->Outcode | corners[1]->Outcode |
+            corners[2]->Outcode) &
+           clipMask) != 0) {
+        RasterVertex triangle[3] = {*corners[0], *corners[1], *corners[2]};
+        fanCount = ClipPolygon(triangle, planes, CLIP_PLANES, polygon);
+        for (uint32_t i = 0; i < fanCount; ++i) {
+          ProjectVertex(polygon[i], m_width, m_height);
+          fan[i] = &polygon[i];
+        }
+      }
+      for (uint32_t i = 2; i < fanCount; ++i) {
+        RasterTriangle triangle;
+        if (!SetupTriangle(*fan[0], *fan[i - 1], *fan[i], m_width, m_height,
+                           m_settings.CullBackFaces, triangle))
+          continue;
+        uint32_t index = (uint32_t)batch.Triangles.size();
+        // Skip tiles entirely outside one of the edges; large thin triangles
+        // would otherwise be binned into many tiles they never touch.
+        for (int32_t ty = triangle.MinY / tileSize;
+             ty <= triangle.MaxY / (int32_t)tileSize; ++ty) {
+          for (int32_t tx = triangle.MinX / tileSize;
+               tx <= triangle.MaxX / (int32_t)tileSize; ++tx) {
+            double cx0 = tx * tileSize + 0.5, cx1 = cx0 + tileSize - 1;
+            double cy0 = ty * tileSize + 0.5, cy1 = cy0 + tileSize - 1;
+            bool reject = false;
+            for (int k = 0; k < 3; ++k) {
+              double cx = triangle.A[k] > 0 ? cx1 : cx0;
+              double cy = triangle.B[k] > 0 ? cy1 : cy0;
+              reject |=
+                  triangle.A[k] * cx + triangle.B[k] * cy + triangle.C[k] < 0;
+            }
+            if (!reject)
+              binned.push_back({tx + ty * m_tilesX, index});
+          }
+        }
+        batch.Triangles.push_back(triangle);
+      }
+    }
+    // Counting sort by tile; the order of triangles within a tile is kept.
+    batch.TileStart.assign(tileCount + 1, 0);
+    for (const auto &entry : binned) {
+      ++batch.TileStart[entry.first + 1];
+    }
+    for (uint32_t i = 0; i < tileCount; ++i) {
+      batch.TileStart[i + 1] += batch.TileStart[i];
+    }
+    batch.Entries.resize(binned.size());
+    std::vector<uint32_t> cursor(batch.TileStart.begin(),
+                                 batch.TileStart.end() - 1);
+    for (const auto &entry : binned) {
+      batch.Entries[cursor[entry.first]++] = entry.second;
+    }
+  });
+  ////////////////////////////////////////////////////////////////////////////////
+  // Rasterize tiles, the most heavily loaded first so that the long tiles do
+  // not end up running alone at the end.
+  std::vector<uint32_t> tileLoad(tileCount, 0);
+  for (const RasterBatch &batch : batches) {
+    for (uint32_t i = 0; i < tileCount; ++i) {
+      tileLoad[i] += batch.TileStart[i + 1] - batch.TileStart[i];
+    }
+    stats.TrianglesSetup += (uint32_t)batch.Triangles.size();
+    stats.BinEntries += (uint32_t)batch.Entries.size();
+  }
+  stats.TrianglesSubmitted = triangleCount;
+  std::vector<uint32_t> tileOrder(tileCount);
+  for (uint32_t i = 0; i < tileCount; ++i) {
+    tileOrder[i] = i;
+  }
+  std::stable_sort(tileOrder.begin(), tileOrder.end(),
+                   [&](uint32_t lhs, uint32_t rhs) {
+                     return tileLoad[lhs] > tileLoad[rhs];
+                   });
+  ParallelFor(tileCount, [&](uint32_t order) {
+    uint32_t tile = tileOrder[order];
+    if (tileLoad[tile] == 0)
+      return;
+    int32_t tileX0 = (tile % m_tilesX) * tileSize;
+    int32_t tileY0 = (tile / m_tilesX) * tileSize;
+    int32_t tileX1 = std::min(tileX0 + (int32_t)tileSize, (int32_t)m_width);
+    int32_t tileY1 = std::min(tileY0 + (int32_t)tileSize, (int32_t)m_height);
+    for (const RasterBatch &batch : batches) {
+      for (uint32_t i = batch.TileStart[tile]; i < batch.TileStart[tile + 1];
+           ++i) {
+        RasterizeTriangle(batch.Triangles[batch.Entries[i]], tileX0, tileY0,
+                          tileX1, tileY1, m_width, m_stride,
+                          m_settings.LightPosition, &m_color[0], &m_depth[0]);
+      }
+    }
+  });
+  return stats;
+}
+
+uint32_t SoftwareRasterizer::GetWidth() const { return m_width; }
+
+uint32_t SoftwareRasterizer::GetHeight() const { return m_height; }
+
+uint32_t SoftwareRasterizer::GetStride() const { return m_stride; }
+
+const float *SoftwareRasterizer::GetDepth() const { return &m_depth[0]; }
+
+std::unique_ptr<IImage> SoftwareRasterizer::CopyColor() const {
+  return CreateImage_CopyPixels(m_width, m_height, 4 * m_stride,
+                                DXGI_FORMAT_B8G8R8A8_UNORM, &m_color[0]);
+}
+
+std::unique_ptr<IImage> SoftwareRasterizer::CopyDepth() const {
+  return CreateImage_CopyPixels(m_width, m_height, sizeof(float) * m_stride,
+                                DXGI_FORMAT_R32_FLOAT, &m_depth[0]);
+}
+
+std::unique_ptr<IImage> RenderScene_Software(
+    const std::vector<Instance> &scene, const Matrix44 &worldToClip,
+    uint32_t width, uint32_t height, const RasterizerSettings &settings) {
+  SoftwareRasterizer rasterizer(width, height, settings);
+  rasterizer.Draw(scene, worldToClip);
+  return rasterizer.CopyColor();
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "Scene_SceneGraph.h"
+#include "Core_Parallel.h"
+#include <algorithm>
+#include <exception>
+
+// Nodes of one depth recomputed per parallel task.
+static const uint32_t NODE_BATCH_SIZE = 1024;
+
+const uint32_t SceneGraph::NoParent;
+
+uint32_t SceneGraph::AddNode(uint32_t parent, const Matrix44 &local) {
+  const uint32_t node = (uint32_t)m_parent.size();
+  if (parent != NoParent && parent >= node)
+    throw std::exception("Scene graph parents must be added first.");
+  m_parent.push_back(parent);
+  m_depth.push_back(parent == NoParent ? 0 : m_depth[parent] + 1);
+  m_firstChild.push_back(NoParent);
+  m_nextSibling.push_back(NoParent);
+  if (parent != NoParent) {
+    m_nextSibling[node] = m_firstChild[parent];
+    m_firstChild[parent] = node;
+  }
+  m_local.push_back(local);
+  m_world.push_back(local);
+  m_dirty.push_back(1);
+  m_bound.push_back(nullptr);
+  m_dirtyNodes.push_back(node);
+  return node;
+}
+
+uint32_t SceneGraph::GetNodeCount() const { return (uint32_t)m_parent.size(); }
+
+uint32_t SceneGraph::GetParent(uint32_t node) const { return m_parent[node]; }
+
+const Matrix44 &SceneGraph::GetLocal(uint32_t node) const {
+  return m_local[node];
+}
+
+void SceneGraph::SetLocal(uint32_t node, const Matrix44 &local) {
+  m_local[node] = local;
+  if (!m_dirty[node]) {
+    m_dirty[node] = 1;
+    m_dirtyNodes.push_back(node);
+  }
+}
+
+const Matrix44 &SceneGraph::GetWorld(uint32_t node) const {
+  return m_world[node];
+}
+
+std::shared_ptr<Matrix44> SceneGraph::GetWorldTransform(uint32_t node) {
+  if (m_bound[node] == nullptr)
+    m_bound[node].reset(new Matrix44(m_world[node]));
+  return m_bound[node];
+}
+
+const Matrix44 *SceneGraph::GetBoundTransform(uint32_t node) const {
+  return m_bound[node].get();
+}
+
+const std::vector<uint32_t> &SceneGraph::Update() {
+  m_changed.clear();
+  ////////////////////////////////////////////////////////////////////////////////
+  // Collect the subtree of every dirty node which has no dirty ancestor; the
+  // others are inside one of those subtrees already.
+  std::vector<uint32_t> stack;
+  for (uint32_t node : m_dirtyNodes) {
+    bool covered = false;
+    for (uint32_t p = m_parent[node]; p != NoParent && !covered;
+         p = m_parent[p]) {
+      covered = m_dirty[p] != 0;
+    }
+    if (covered)
+      continue;
+    stack.push_back(node);
+    while (!stack.empty()) {
+      uint32_t visit = stack.back();
+      stack.pop_back();
+      m_changed.push_back(visit);
+      for (uint32_t child = m_firstChild[visit]; child != NoParent;
+           child = m_nextSibling[child]) {
+        stack.push_back(child);
+      }
+    }
+  }
+  m_dirtyNodes.clear();
+  if (m_changed.empty())
+    return m_changed;
+  ////////////////////////////////////////////////////////////////////////////////
+  // Counting sort by depth so every level only reads the one above it.
+  uint32_t depthCount = 0;
+  for (uint32_t node : m_changed)
+    depthCount = std::max(depthCount, m_depth[node] + 1);
+  std::vector<uint32_t> levelStart(depthCount + 1, 0);
+  for (uint32_t node : m_changed)
+    ++levelStart[m_depth[node] + 1];
+  for (uint32_t depth = 0; depth < depthCount; ++depth)
+    levelStart[depth + 1] += levelStart[depth];
+  std::vector<uint32_t> sorted(m_changed.size());
+  {
+    std::vector<uint32_t> cursor(levelStart.begin(), levelStart.end() - 1);
+    for (uint32_t node : m_changed)
+      sorted[cursor[m_depth[node]]++] = node;
+  }
+  m_changed.swap(sorted);
+  ////////////////////////////////////////////////////////////////////////////////
+  // Recompute each level in parallel batches.
+  for (uint32_t depth = 0; depth < depthCount; ++depth) {
+    const uint32_t begin = levelStart[depth];
+    const uint32_t count = levelStart[depth + 1] - begin;
+    const uint32_t batches = (count + NODE_BATCH_SIZE - 1) / NODE_BATCH_SIZE;
+    ParallelFor(batches, [&](uint32_t batch) {
+      const uint32_t end =
+          std::min(begin + (batch + 1) * NODE_BATCH_SIZE, begin + count);
+      for (uint32_t i = begin + batch * NODE_BATCH_SIZE; i < end; ++i) {
+        const uint32_t node = m_changed[i];
+        const uint32_t parent = m_parent[node];
+        m_world[node] = parent == NoParent
+                            ? m_local[node]
+                            : m_local[node] * m_world[parent];
+        m_dirty[node] = 0;
+        if (m_bound[node] != nullptr)
+          *m_bound[node] = m_world[node];
+      }
+    });
+  }
+  return m_changed;
+}
\ No newline at end of file
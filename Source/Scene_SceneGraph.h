@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Scene Graph
+//
+// A transform hierarchy stored as flat arrays (SoA) indexed by node: parent,
+// depth, local matrix, world matrix and a dirty flag. A node can only be
+// added under an existing node so parents always come before their children.
+//
+// SetLocal only marks a node dirty. Update finds the dirty subtrees through
+// the child lists, groups the affected nodes by depth and recomputes each
+// depth in parallel, so moving one node costs only its own subtree. The
+// nodes whose world transform changed are returned, which is exactly the set
+// of constant buffers a renderer needs to upload again.
+//
+// Instances refer to transforms by shared_ptr<Matrix44>. GetWorldTransform
+// hands out one such matrix per node which Update rewrites in place. Its
+// address never changes, so a renderer which caches constants by address
+// must upload them again for the nodes Update returns (Sample_D3D11Scene
+// does this when given the graph).
+////////////////////////////////////////////////////////////////////////////////
+
+class SceneGraph : public Object {
+public:
+  // Parent of a node at the top of the hierarchy.
+  static const uint32_t NoParent = 0xFFFFFFFF;
+  // Add a node and return its index. The parent must already exist.
+  uint32_t AddNode(uint32_t parent, const Matrix44 &local);
+  uint32_t GetNodeCount() const;
+  uint32_t GetParent(uint32_t node) const;
+  const Matrix44 &GetLocal(uint32_t node) const;
+  void SetLocal(uint32_t node, const Matrix44 &local);
+  // Valid for clean nodes; call Update after SetLocal.
+  const Matrix44 &GetWorld(uint32_t node) const;
+  // The world transform of a node for use in an Instance.
+  std::shared_ptr<Matrix44> GetWorldTransform(uint32_t node);
+  // The matrix GetWorldTransform handed out for a node, or null if it has
+  // not been asked for.
+  const Matrix44 *GetBoundTransform(uint32_t node) const;
+  // Recompute the world transforms under every dirty node. Returns the nodes
+  // which changed, each parent before its children; valid until the next
+  // call.
+  const std::vector<uint32_t> &Update();
+
+private:
+  std::vector<uint32_t> m_parent;
+  std::vector<uint32_t> m_depth;
+  std::vector<uint32_t> m_firstChild;
+  std::vector<uint32_t> m_nextSibling;
+  std::vector<Matrix44> m_local;
+  std::vector<Matrix44> m_world;
+  std::vector<uint8_t> m_dirty;
+  std::vector<std::shared_ptr<Matrix44>> m_bound;
+  // Nodes marked dirty since the last update.
+  std::vector<uint32_t> m_dirtyNodes;
+  std::vector<uint32_t> m_changed;
+};
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "Scene_ShadowCascades.h"
+#include "Scene_IMesh.h"
+#include <algorithm>
+#include <exception>
+#include <math.h>
+
+std::vector<float> ComputeCascadeSplits(float nearPlane, float farPlane,
+                                        uint32_t count, float lambda) {
+  if (count == 0)
+    throw std::exception("At least one shadow cascade is required.");
+  if (!(nearPlane > 0) || !(farPlane > nearPlane))
+    throw std::exception("Cascade splits need 0 < near < far.");
+  std::vector<float> splits(count + 1);
+  for (uint32_t i = 0; i <= count; ++i) {
+    float t = (float)i / count;
+    float logarithmic = nearPlane * powf(farPlane / nearPlane, t);
+    float uniform = nearPlane + (farPlane - nearPlane) * t;
+    splits[i] = lambda * logarithmic + (1 - lambda) * uniform;
+  }
+  splits[0] = nearPlane;
+  splits[count] = farPlane;
+  return splits;
+}
+
+ShadowCascadeFitter::ShadowCascadeFitter(const std::vector<Instance> &scene,
+                                         const CascadeSettings &settings)
+    : m_scene(scene), m_settings(settings) {
+  if (m_settings.CascadeCount == 0)
+    throw std::exception("At least one shadow cascade is required.");
+  if (m_settings.Resolution == 0)
+    throw std::exception("Shadow cascades need a non-zero resolution.");
+  for (const Instance &instance : m_scene) {
+    m_bounds.push_back(GetMeshBounds(*instance.Mesh));
+  }
+  m_cascades.resize(m_settings.CascadeCount);
+}
+
+const std::vector<ShadowCascade> &
+ShadowCascadeFitter::Update(const Matrix44 &cameraWorldToClip,
+                            const Vector3 &lightDirection) {
+  ////////////////////////////////////////////////////////////////////////////////
+  // Rays through the four corners of the camera frustum.
+  const Matrix44 clipToWorld = Invert(cameraWorldToClip);
+  Vector3 cornerNear[4], cornerFar[4];
+  for (int i = 0; i < 4; ++i) {
+    float x = i & 1 ? 1.0f : -1.0f;
+    float y = i & 2 ? 1.0f : -1.0f;
+    Vector4 n = Transform(clipToWorld, Vector4{x, y, 0, 1});
+    Vector4 f = Transform(clipToWorld, Vector4{x, y, 1, 1});
+    cornerNear[i] = Vector3{n.X, n.Y, n.Z} * (1 / n.W);
+    cornerFar[i] = Vector3{f.X, f.Y, f.Z} * (1 / f.W);
+  }
+  // Clip space w is the view distance, which is linear along each ray.
+  const Vector3 &p = cornerNear[0];
+  const Vector3 &q = cornerFar[0];
+  const float nearPlane =
+      Transform(cameraWorldToClip, Vector4{p.X, p.Y, p.Z, 1}).W;
+  const float farPlane =
+      Transform(cameraWorldToClip, Vector4{q.X, q.Y, q.Z, 1}).W;
+  const std::vector<float> splits = ComputeCascadeSplits(
+      nearPlane, std::min(farPlane, m_settings.ShadowDistance),
+      m_settings.CascadeCount, m_settings.SplitLambda);
+  ////////////////////////////////////////////////////////////////////////////////
+  // Light space bounds of every instance. The light view only depends on the
+  // light so that snapped cascades stay put while the camera moves.
+  const Vector3 up = fabsf(Normalize(lightDirection).Y) > 0.99f
+                         ? Vector3{1, 0, 0}
+                         : Vector3{0, 1, 0};
+  const Matrix44 worldToLight =
+      CreateMatrixLookAt(Vector3{0, 0, 0}, lightDirection, up);
+  std::vector<AABB> lightBounds(m_scene.size());
+  float sceneNearZ = INFINITY;
+  for (size_t i = 0; i < m_scene.size(); ++i) {
+    lightBounds[i] = m_bounds[i];
+    if (m_bounds[i].Min.X > m_bounds[i].Max.X)
+      continue;
+    lightBounds[i] = TransformAABB(
+        *m_scene[i].TransformObjectToWorld * worldToLight, m_bounds[i]);
+    sceneNearZ = std::min(sceneNearZ, lightBounds[i].Min.Z);
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Fit each cascade around its slice of the camera frustum.
+  for (uint32_t c = 0; c < m_settings.CascadeCount; ++c) {
+    ShadowCascade &cascade = m_cascades[c];
+    cascade.SplitNear = splits[c];
+    cascade.SplitFar = splits[c + 1];
+    Vector3 corners[8];
+    Vector3 center = {0, 0, 0};
+    for (int i = 0; i < 4; ++i) {
+      Vector3 ray = cornerFar[i] - cornerNear[i];
+      float t0 = (cascade.SplitNear - nearPlane) / (farPlane - nearPlane);
+      float t1 = (cascade.SplitFar - nearPlane) / (farPlane - nearPlane);
+      corners[i] = cornerNear[i] + ray * t0;
+      corners[i + 4] = cornerNear[i] + ray * t1;
+      center = center + corners[i] + corners[i + 4];
+    }
+    center = center * (1.0f / 8);
+    float radius = 0;
+    for (const Vector3 &corner : corners)
+      radius = std::max(radius, Length(corner - center));
+    // Round up so that float noise in the corners never changes the size.
+    radius = ceilf(radius * 16) / 16;
+    const float texel = 2 * radius / m_settings.Resolution;
+    Vector3 lightCenter = TransformPoint(worldToLight, center);
+    lightCenter.X = floorf(lightCenter.X / texel) * texel;
+    lightCenter.Y = floorf(lightCenter.Y / texel) * texel;
+    const float minX = lightCenter.X - radius, maxX = lightCenter.X + radius;
+    const float minY = lightCenter.Y - radius, maxY = lightCenter.Y + radius;
+    const float farZ = lightCenter.Z + radius;
+    const float nearZ = std::min(sceneNearZ, lightCenter.Z - radius);
+    const float depthScale = 1 / (farZ - nearZ);
+    const Matrix44 lightToClip = {
+        // clang-format off
+        1 / radius, 0, 0, 0,
+        0, 1 / radius, 0, 0,
+        0, 0, depthScale, 0,
+        -lightCenter.X / radius, -lightCenter.Y / radius, -nearZ * depthScale, 1
+        // clang-format on
+    };
+    cascade.TransformWorldToClip = worldToLight * lightToClip;
+    // Anything overlapping the cascade in light space X and Y and starting
+    // before its far end can throw a shadow into it.
+    cascade.Casters.clear();
+    for (size_t i = 0; i < m_scene.size(); ++i) {
+      const AABB &box = lightBounds[i];
+      if (box.Min.X > box.Max.X)
+        continue;
+      if (box.Max.X < minX || box.Min.X > maxX || box.Max.Y < minY ||
+          box.Min.Y > maxY || box.Min.Z > farZ)
+        continue;
+      cascade.Casters.push_back(m_scene[i]);
+    }
+  }
+  return m_cascades;
+}
\ No newline at end of file
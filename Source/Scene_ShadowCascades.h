@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_BVH.h"
+#include "Scene_InstanceTable.h"
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Cascaded Shadow Maps
+//
+// The CPU side of cascaded shadows for a directional light. The camera depth
+// range is divided into cascades, each cascade slice of the view frustum is
+// enclosed in an orthographic light frustum, and every cascade gets the list
+// of instances which can cast a shadow into it.
+//
+// Light frusta are fitted to the bounding sphere of the slice, so their size
+// does not change as the camera turns, and their centers are snapped to whole
+// shadow map texels, so shadow edges do not crawl as the camera moves. Each
+// frustum is extruded toward the light to the edge of the scene so casters
+// outside the view still land in the map.
+////////////////////////////////////////////////////////////////////////////////
+
+struct CascadeSettings {
+  uint32_t CascadeCount = 4;
+  // Blend between uniform (0) and logarithmic (1) split distances.
+  float SplitLambda = 0.75f;
+  // Shadows end at this view distance, or the camera far plane if nearer.
+  float ShadowDistance = 50;
+  // Shadow map texels along each side of one cascade.
+  uint32_t Resolution = 2048;
+};
+
+struct ShadowCascade {
+  // View distance range of the camera covered by this cascade.
+  float SplitNear;
+  float SplitFar;
+  // Orthographic light transform in D3D clip space; z is 0 at the edge of the
+  // scene nearest the light.
+  Matrix44 TransformWorldToClip;
+  // Instances which may cast a shadow into this cascade.
+  std::vector<Instance> Casters;
+};
+
+// Split distances for count cascades over [nearPlane, farPlane]; the result
+// has count + 1 entries from nearPlane to farPlane.
+std::vector<float> ComputeCascadeSplits(float nearPlane, float farPlane,
+                                        uint32_t count, float lambda);
+
+class ShadowCascadeFitter : public Object {
+public:
+  ShadowCascadeFitter(const std::vector<Instance> &scene,
+                      const CascadeSettings &settings = {});
+  // Fit the cascades for a perspective camera (as made by CreateProjection)
+  // and a light shining along lightDirection. Instance transforms are read
+  // every call so moving instances are fine. The result is valid until the
+  // next call.
+  const std::vector<ShadowCascade> &Update(const Matrix44 &cameraWorldToClip,
+                                           const Vector3 &lightDirection);
+
+private:
+  std::vector<Instance> m_scene;
+  CascadeSettings m_settings;
+  // Object space bounds per instance; empty boxes for empty meshes.
+  std::vector<AABB> m_bounds;
+  std::vector<ShadowCascade> m_cascades;
+};
\ No newline at end of file
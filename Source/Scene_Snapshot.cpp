@@ -0,0 +1,147 @@
+#include "Scene_Snapshot.h"
+#include <algorithm>
+#include <exception>
+
+// Instances per copy-on-write chunk.
+static const uint32_t CHUNK_SIZE = 256;
+
+const uint32_t SceneStore::MaxReaders;
+
+////////////////////////////////////////////////////////////////////////////////
+// SceneSnapshot.
+
+uint64_t SceneSnapshot::GetVersion() const { return m_version; }
+
+uint32_t SceneSnapshot::GetInstanceCount() const { return m_count; }
+
+const Instance &SceneSnapshot::GetInstance(uint32_t index) const {
+  return (*m_chunks[index / CHUNK_SIZE])[index % CHUNK_SIZE];
+}
+
+std::vector<Instance> SceneSnapshot::CopyInstances() const {
+  std::vector<Instance> instances;
+  instances.reserve(m_count);
+  for (const std::shared_ptr<Chunk> &chunk : m_chunks)
+    instances.insert(instances.end(), chunk->begin(), chunk->end());
+  return instances;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SceneStore writer.
+
+SceneStore::SceneStore(const std::vector<Instance> &scene)
+    : m_epoch(1), m_version(0), m_draftCount(0) {
+  for (std::atomic<uint64_t> &reader : m_readers)
+    reader.store(0);
+  for (const Instance &instance : scene)
+    AddInstance(instance);
+  SceneSnapshot *snapshot = new SceneSnapshot();
+  snapshot->m_version = m_version;
+  snapshot->m_count = m_draftCount;
+  snapshot->m_chunks = m_draftChunks;
+  std::fill(m_draftOwned.begin(), m_draftOwned.end(), false);
+  m_current.store(snapshot);
+}
+
+SceneStore::~SceneStore() {
+  for (const Retired &retired : m_retired)
+    delete retired.Snapshot;
+  delete m_current.load();
+}
+
+std::vector<Instance> &SceneStore::GetDraftChunk(uint32_t chunk) {
+  if (!m_draftOwned[chunk]) {
+    m_draftChunks[chunk].reset(
+        new SceneSnapshot::Chunk(*m_draftChunks[chunk]));
+    m_draftOwned[chunk] = true;
+  }
+  return *m_draftChunks[chunk];
+}
+
+uint32_t SceneStore::GetInstanceCount() const { return m_draftCount; }
+
+const Instance &SceneStore::GetInstance(uint32_t index) const {
+  return (*m_draftChunks[index / CHUNK_SIZE])[index % CHUNK_SIZE];
+}
+
+void SceneStore::SetInstance(uint32_t index, const Instance &instance) {
+  if (index >= m_draftCount)
+    throw std::exception("Scene instance index out of range.");
+  GetDraftChunk(index / CHUNK_SIZE)[index % CHUNK_SIZE] = instance;
+}
+
+void SceneStore::SetTransform(uint32_t index, const Matrix44 &objectToWorld) {
+  if (index >= m_draftCount)
+    throw std::exception("Scene instance index out of range.");
+  GetDraftChunk(index / CHUNK_SIZE)[index % CHUNK_SIZE]
+      .TransformObjectToWorld.reset(new Matrix44(objectToWorld));
+}
+
+uint32_t SceneStore::AddInstance(const Instance &instance) {
+  const uint32_t index = m_draftCount++;
+  if (index % CHUNK_SIZE == 0) {
+    m_draftChunks.emplace_back(new SceneSnapshot::Chunk());
+    m_draftChunks.back()->reserve(CHUNK_SIZE);
+    m_draftOwned.push_back(true);
+  }
+  GetDraftChunk(index / CHUNK_SIZE).push_back(instance);
+  return index;
+}
+
+uint64_t SceneStore::Publish() {
+  SceneSnapshot *snapshot = new SceneSnapshot();
+  snapshot->m_version = ++m_version;
+  snapshot->m_count = m_draftCount;
+  snapshot->m_chunks = m_draftChunks;
+  std::fill(m_draftOwned.begin(), m_draftOwned.end(), false);
+  // Readers which pinned at or before this epoch may have seen the old
+  // snapshot; anyone pinning after the increment sees the new one.
+  const SceneSnapshot *old = m_current.exchange(snapshot);
+  m_retired.push_back({old, m_epoch.fetch_add(1)});
+  Reclaim();
+  return m_version;
+}
+
+void SceneStore::Reclaim() {
+  uint64_t oldestPin = UINT64_MAX;
+  for (const std::atomic<uint64_t> &reader : m_readers) {
+    uint64_t epoch = reader.load();
+    if (epoch != 0)
+      oldestPin = std::min(oldestPin, epoch);
+  }
+  auto keep = std::partition(
+      m_retired.begin(), m_retired.end(),
+      [&](const Retired &retired) { return retired.Epoch >= oldestPin; });
+  for (auto it = keep; it != m_retired.end(); ++it)
+    delete it->Snapshot;
+  m_retired.erase(keep, m_retired.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SceneStore readers.
+
+const SceneSnapshot *SceneStore::Pin(uint32_t &slot) {
+  // Claim a free slot with the current epoch. An epoch read a moment ago is
+  // only ever older than the real one, which is safe.
+  const uint64_t epoch = m_epoch.load();
+  for (slot = 0; slot < MaxReaders; ++slot) {
+    uint64_t expected = 0;
+    if (m_readers[slot].compare_exchange_strong(expected, epoch))
+      return m_current.load();
+  }
+  throw std::exception("Too many scene readers.");
+}
+
+void SceneStore::Unpin(uint32_t slot) { m_readers[slot].store(0); }
+
+////////////////////////////////////////////////////////////////////////////////
+// SceneReadLock.
+
+SceneReadLock::SceneReadLock(SceneStore &store)
+    : m_store(store), m_snapshot(store.Pin(m_slot)) {}
+
+SceneReadLock::~SceneReadLock() { m_store.Unpin(m_slot); }
+
+const SceneSnapshot &SceneReadLock::operator*() const { return *m_snapshot; }
+
+const SceneSnapshot *SceneReadLock::operator->() const { return m_snapshot; }
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_InstanceTable.h"
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Copy-On-Write Scene Snapshots
+//
+// Lets one thread edit a scene while others build frames from it. The writer
+// edits a draft and publishes it as a new immutable SceneSnapshot; readers pin
+// whichever snapshot is current and keep it, unchanged, for as long as they
+// need it.
+//
+// Instances are stored in fixed size chunks. A draft starts out sharing every
+// chunk of the last snapshot and only copies a chunk the first time one of
+// its instances changes, so publishing a small edit costs a few chunks rather
+// than the whole scene.
+//
+// Readers never lock and never touch a reference count. Pinning writes the
+// global epoch into a reader slot; publishing retires the old snapshot with
+// the epoch at which it stopped being current, and a retired snapshot is
+// freed once every pinned reader has an epoch past that (epoch based
+// reclamation).
+//
+// Snapshots are immutable, and that includes the matrices their instances
+// point to: use SetTransform, which allocates a new matrix, rather than
+// writing through Instance::TransformObjectToWorld.
+////////////////////////////////////////////////////////////////////////////////
+
+class SceneSnapshot : public Object {
+public:
+  // Increases by one with every publish; the initial scene is version 0.
+  uint64_t GetVersion() const;
+  uint32_t GetInstanceCount() const;
+  const Instance &GetInstance(uint32_t index) const;
+  // A flat copy for code which takes a std::vector<Instance>.
+  std::vector<Instance> CopyInstances() const;
+
+private:
+  friend class SceneStore;
+  typedef std::vector<Instance> Chunk;
+  uint64_t m_version;
+  uint32_t m_count;
+  std::vector<std::shared_ptr<Chunk>> m_chunks;
+};
+
+class SceneStore : public Object {
+public:
+  // Readers which can hold a pin at the same time.
+  static const uint32_t MaxReaders = 64;
+  SceneStore(const std::vector<Instance> &scene);
+  // No reader may still hold a pin.
+  ~SceneStore();
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Writer; one thread at a time.
+  uint32_t GetInstanceCount() const;
+  const Instance &GetInstance(uint32_t index) const;
+  void SetInstance(uint32_t index, const Instance &instance);
+  void SetTransform(uint32_t index, const Matrix44 &objectToWorld);
+  uint32_t AddInstance(const Instance &instance);
+  // Make the draft the current snapshot and return its version. Snapshots no
+  // reader can see any more are freed.
+  uint64_t Publish();
+  // Free unreachable snapshots without publishing.
+  void Reclaim();
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Readers; any thread. Every Pin must be matched by an Unpin with the
+  // returned slot. Prefer SceneReadLock.
+  const SceneSnapshot *Pin(uint32_t &slot);
+  void Unpin(uint32_t slot);
+
+private:
+  struct Retired {
+    const SceneSnapshot *Snapshot;
+    uint64_t Epoch;
+  };
+  std::vector<Instance> &GetDraftChunk(uint32_t chunk);
+  std::atomic<const SceneSnapshot *> m_current;
+  std::atomic<uint64_t> m_epoch;
+  // Epoch each reader pinned at; zero for a free slot.
+  std::atomic<uint64_t> m_readers[MaxReaders];
+  // Writer state.
+  uint64_t m_version;
+  uint32_t m_draftCount;
+  std::vector<std::shared_ptr<SceneSnapshot::Chunk>> m_draftChunks;
+  // Chunks already copied by the current draft.
+  std::vector<bool> m_draftOwned;
+  std::vector<Retired> m_retired;
+};
+
+// Pins the current snapshot of a store for the lifetime of the lock.
+class SceneReadLock {
+public:
+  SceneReadLock(SceneStore &store);
+  ~SceneReadLock();
+  SceneReadLock(const SceneReadLock &) = delete;
+  SceneReadLock &operator=(const SceneReadLock &) = delete;
+  const SceneSnapshot &operator*() const;
+  const SceneSnapshot *operator->() const;
+
+private:
+  SceneStore &m_store;
+  uint32_t m_slot;
+  const SceneSnapshot *m_snapshot;
+};
\ No newline at end of file
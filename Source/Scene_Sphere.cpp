@@ -1,5 +1,6 @@
 #include "Scene_Sphere.h"
 #include "Core_Math.h"
+#include <vector>
 
 Vector3 Sphere::getVertexPosition(Vector2 uv) {
   float angleU = uv.X * (2 * Pi<float>);
@@ -8,4 +9,42 @@ Vector3 Sphere::getVertexPosition(Vector2 uv) {
           Cos(angleU) * Sin(angleV)};
 }
 
-Vector3 Sphere::getVertexNormal(Vector2 uv) { return getVertexPosition(uv); }
\ No newline at end of file
+Vector3 Sphere::getVertexNormal(Vector2 uv) { return getVertexPosition(uv); }
+
+void Sphere::evaluate(const Vector2 *uv, uint32_t count, Vector3 *positions,
+                      Vector3 *normals) {
+  // The unit sphere is its own normal; evaluate once for both.
+  for (uint32_t i = 0; i < count; ++i) {
+    Vector3 position = getVertexPosition(uv[i]);
+    if (positions != nullptr)
+      positions[i] = position;
+    if (normals != nullptr)
+      normals[i] = position;
+  }
+}
+
+void Sphere::evaluateGrid(const float *u, uint32_t countU, const float *v,
+                          uint32_t countV, Vector3 *positions,
+                          Vector3 *normals) {
+  // Both angles are separable so a grid needs one sin/cos per column and row
+  // instead of four per point; what's left is two multiplies per point.
+  std::vector<float> sinU(countU), cosU(countU);
+  for (uint32_t column = 0; column < countU; ++column) {
+    float angleU = u[column] * (2 * Pi<float>);
+    sinU[column] = Sin(angleU);
+    cosU[column] = Cos(angleU);
+  }
+  for (uint32_t row = 0; row < countV; ++row) {
+    float angleV = v[row] * (1 * Pi<float>);
+    const float sinV = Sin(angleV);
+    const float cosV = Cos(angleV);
+    const uint32_t offset = row * countU;
+    for (uint32_t column = 0; column < countU; ++column) {
+      Vector3 position = {sinU[column] * sinV, cosV, cosU[column] * sinV};
+      if (positions != nullptr)
+        positions[offset + column] = position;
+      if (normals != nullptr)
+        normals[offset + column] = position;
+    }
+  }
+}
\ No newline at end of file
@@ -7,4 +7,9 @@ class Sphere : public Object, public IParametricUV {
 public:
   Vector3 getVertexPosition(Vector2 uv) override;
   Vector3 getVertexNormal(Vector2 uv) override;
+  void evaluate(const Vector2 *uv, uint32_t count, Vector3 *positions,
+                Vector3 *normals) override;
+  void evaluateGrid(const float *u, uint32_t countU, const float *v,
+                    uint32_t countV, Vector3 *positions,
+                    Vector3 *normals) override;
 };
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "Scene_SplinePatch.h"
+#include "Core_Math.h"
+#include <algorithm>
+#include <emmintrin.h>
+#include <exception>
+#include <math.h>
+
+const uint32_t NURBSPatch::MaxDegree;
+
+NURBSPatch::NURBSPatch(uint32_t degreeU, uint32_t degreeV, uint32_t countU,
+                       uint32_t countV, const std::vector<Vector3> &points,
+                       const std::vector<float> &weights,
+                       const std::vector<float> &knotsU,
+                       const std::vector<float> &knotsV)
+    : m_degreeU(degreeU), m_degreeV(degreeV), m_countU(countU),
+      m_countV(countV), m_knotsU(knotsU), m_knotsV(knotsV) {
+  if (degreeU < 1 || degreeU > MaxDegree || degreeV < 1 ||
+      degreeV > MaxDegree)
+    throw std::exception("Spline patch degree out of range.");
+  if (countU <= degreeU || countV <= degreeV)
+    throw std::exception("Spline patch needs more than degree points.");
+  if (points.size() != countU * countV || weights.size() != points.size())
+    throw std::exception("Spline patch point or weight count mismatch.");
+  if (knotsU.size() != countU + degreeU + 1 ||
+      knotsV.size() != countV + degreeV + 1)
+    throw std::exception("Spline patch knot count mismatch.");
+  if (!std::is_sorted(knotsU.begin(), knotsU.end()) ||
+      !std::is_sorted(knotsV.begin(), knotsV.end()))
+    throw std::exception("Spline patch knots must not decrease.");
+  if (!(knotsU[degreeU] < knotsU[countU]) ||
+      !(knotsV[degreeV] < knotsV[countV]))
+    throw std::exception("Spline patch has an empty knot range.");
+  m_points.resize(points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (!(weights[i] > 0))
+      throw std::exception("Spline patch weights must be positive.");
+    const Vector3 &p = points[i];
+    const float w = weights[i];
+    m_points[i] = {p.X * w, p.Y * w, p.Z * w, w};
+  }
+}
+
+Vector3 NURBSPatch::getVertexPosition(Vector2 uv) {
+  Vector3 position;
+  evaluate(&uv, 1, &position, nullptr);
+  return position;
+}
+
+Vector3 NURBSPatch::getVertexNormal(Vector2 uv) {
+  Vector3 normal;
+  evaluate(&uv, 1, nullptr, &normal);
+  return normal;
+}
+
+void NURBSPatch::evaluate(const Vector2 *uv, uint32_t count,
+                          Vector3 *positions, Vector3 *normals) {
+  for (uint32_t i = 0; i < count; ++i) {
+    const Basis basisU = EvaluateBasis(m_degreeU, m_countU, m_knotsU, uv[i].X);
+    const Basis basisV = EvaluateBasis(m_degreeV, m_countV, m_knotsV, uv[i].Y);
+    EvaluatePoint(basisU, basisV, positions ? positions + i : nullptr,
+                  normals ? normals + i : nullptr);
+  }
+}
+
+void NURBSPatch::evaluateGrid(const float *u, uint32_t countU, const float *v,
+                              uint32_t countV, Vector3 *positions,
+                              Vector3 *normals) {
+  std::vector<Basis> basisU(countU);
+  for (uint32_t column = 0; column < countU; ++column)
+    basisU[column] = EvaluateBasis(m_degreeU, m_countU, m_knotsU, u[column]);
+  for (uint32_t row = 0; row < countV; ++row) {
+    const Basis basisV = EvaluateBasis(m_degreeV, m_countV, m_knotsV, v[row]);
+    const uint32_t offset = row * countU;
+    for (uint32_t column = 0; column < countU; ++column) {
+      EvaluatePoint(basisU[column], basisV,
+                    positions ? positions + offset + column : nullptr,
+                    normals ? normals + offset + column : nullptr);
+    }
+  }
+}
+
+NURBSPatch::Basis NURBSPatch::EvaluateBasis(uint32_t degree, uint32_t count,
+                                            const std::vector<float> &knots,
+                                            float t) {
+  ////////////////////////////////////////////////////////////////////////////////
+  // Map [0, 1] onto the valid knot range and find the span holding t; the
+  // end of the range belongs to the last non-empty span.
+  const uint32_t p = degree;
+  t = knots[p] + std::min(std::max(t, 0.0f), 1.0f) * (knots[count] - knots[p]);
+  uint32_t span = (uint32_t)(std::upper_bound(knots.begin() + p,
+                                              knots.begin() + count, t) -
+                             knots.begin()) -
+                  1;
+  while (span > p && knots[span] == knots[span + 1])
+    --span;
+  ////////////////////////////////////////////////////////////////////////////////
+  // Cox-de Boor triangle of basis values, keeping the knot differences in
+  // the lower half for the derivatives (The NURBS Book, A2.3).
+  float ndu[MaxDegree + 1][MaxDegree + 1];
+  float left[MaxDegree + 1], right[MaxDegree + 1];
+  ndu[0][0] = 1;
+  for (uint32_t j = 1; j <= p; ++j) {
+    left[j] = t - knots[span + 1 - j];
+    right[j] = knots[span + j] - t;
+    float saved = 0;
+    for (uint32_t r = 0; r < j; ++r) {
+      ndu[j][r] = right[r + 1] + left[j - r];
+      const float temp = ndu[r][j - 1] / ndu[j][r];
+      ndu[r][j] = saved + right[r + 1] * temp;
+      saved = left[j - r] * temp;
+    }
+    ndu[j][j] = saved;
+  }
+  Basis basis;
+  basis.First = span - p;
+  for (uint32_t r = 0; r <= p; ++r) {
+    float derivative = 0;
+    if (r >= 1)
+      derivative += ndu[r - 1][p - 1] / ndu[p][r - 1];
+    if (r < p)
+      derivative -= ndu[r][p - 1] / ndu[p][r];
+    basis.Value[r] = ndu[r][p];
+    // Per unit of uv rather than per unit of knot.
+    basis.Derivative[r] = derivative * p * (knots[count] - knots[p]);
+  }
+  return basis;
+}
+
+void NURBSPatch::EvaluatePoint(const Basis &basisU, const Basis &basisV,
+                               Vector3 *position, Vector3 *normal) const {
+  ////////////////////////////////////////////////////////////////////////////////
+  // Homogeneous point and partial derivatives, all four components at once.
+  __m128 s = _mm_setzero_ps();
+  __m128 su = _mm_setzero_ps();
+  __m128 sv = _mm_setzero_ps();
+  for (uint32_t l = 0; l <= m_degreeV; ++l) {
+    const Vector4 *row =
+        &m_points[(basisV.First + l) * m_countU + basisU.First];
+    __m128 a = _mm_setzero_ps();
+    __m128 au = _mm_setzero_ps();
+    for (uint32_t k = 0; k <= m_degreeU; ++k) {
+      const __m128 point = _mm_loadu_ps(&row[k].X);
+      a = _mm_add_ps(a, _mm_mul_ps(_mm_set1_ps(basisU.Value[k]), point));
+      au = _mm_add_ps(au, _mm_mul_ps(_mm_set1_ps(basisU.Derivative[k]), point));
+    }
+    const __m128 value = _mm_set1_ps(basisV.Value[l]);
+    s = _mm_add_ps(s, _mm_mul_ps(value, a));
+    su = _mm_add_ps(su, _mm_mul_ps(value, au));
+    sv = _mm_add_ps(sv, _mm_mul_ps(_mm_set1_ps(basisV.Derivative[l]), a));
+  }
+  Vector4 h, hu, hv;
+  _mm_storeu_ps(&h.X, s);
+  _mm_storeu_ps(&hu.X, su);
+  _mm_storeu_ps(&hv.X, sv);
+  ////////////////////////////////////////////////////////////////////////////////
+  // Project back to 3D; the quotient rule gives the surface derivatives.
+  const float invW = 1 / h.W;
+  const Vector3 p = {h.X * invW, h.Y * invW, h.Z * invW};
+  if (position != nullptr)
+    *position = p;
+  if (normal == nullptr)
+    return;
+  const Vector3 du = (Vector3{hu.X, hu.Y, hu.Z} - p * hu.W) * invW;
+  const Vector3 dv = (Vector3{hv.X, hv.Y, hv.Z} - p * hv.W) * invW;
+  // Same winding as ParametricUVToMesh; a collapsed edge (zero derivative)
+  // leaves no normal, so fall back to +Y rather than NaN.
+  const Vector3 n = Cross(dv, du);
+  const float length = Length(n);
+  *normal = length > 0 ? n * (1 / length) : Vector3{0, 1, 0};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BezierPatch.
+
+static std::vector<float> BezierKnots(uint32_t count) {
+  std::vector<float> knots(2 * count, 0.0f);
+  std::fill(knots.begin() + count, knots.end(), 1.0f);
+  return knots;
+}
+
+BezierPatch::BezierPatch(uint32_t countU, uint32_t countV,
+                         const std::vector<Vector3> &points)
+    : NURBSPatch(countU - 1, countV - 1, countU, countV, points,
+                 std::vector<float>(points.size(), 1.0f), BezierKnots(countU),
+                 BezierKnots(countV)) {}
\ No newline at end of file
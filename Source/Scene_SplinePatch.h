@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Core_Object.h"
+#include "Scene_IParametricUV.h"
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Spline Patches
+//
+// Tensor product NURBS surfaces, and Bezier patches as the special case of a
+// single span with unit weights. The uv square maps onto the valid knot
+// range, so a patch drops straight into ParametricUVToMesh or the adaptive
+// tessellator.
+//
+// Control points are stored homogeneous (xw, yw, zw, w) so one SSE register
+// holds a whole point and every basis weight is a single multiply-add for
+// all four components. Evaluation finds the knot span and the basis values
+// and first derivatives per direction (de Boor); a grid computes those once
+// per column and once per row. Normals come from the analytic derivatives
+// of the rational surface.
+////////////////////////////////////////////////////////////////////////////////
+
+class NURBSPatch : public Object, public IParametricUV {
+public:
+  // Highest supported degree in either direction.
+  static const uint32_t MaxDegree = 7;
+  // countU * countV control points, u fastest, and one weight per point.
+  // Each knot vector has count + degree + 1 non-decreasing entries.
+  NURBSPatch(uint32_t degreeU, uint32_t degreeV, uint32_t countU,
+             uint32_t countV, const std::vector<Vector3> &points,
+             const std::vector<float> &weights,
+             const std::vector<float> &knotsU,
+             const std::vector<float> &knotsV);
+  Vector3 getVertexPosition(Vector2 uv) override;
+  Vector3 getVertexNormal(Vector2 uv) override;
+  void evaluate(const Vector2 *uv, uint32_t count, Vector3 *positions,
+                Vector3 *normals) override;
+  void evaluateGrid(const float *u, uint32_t countU, const float *v,
+                    uint32_t countV, Vector3 *positions,
+                    Vector3 *normals) override;
+
+private:
+  // The non-zero basis functions at one parameter.
+  struct Basis {
+    // Control point index of Value[0].
+    uint32_t First;
+    float Value[MaxDegree + 1];
+    float Derivative[MaxDegree + 1];
+  };
+  static Basis EvaluateBasis(uint32_t degree, uint32_t count,
+                             const std::vector<float> &knots, float t);
+  void EvaluatePoint(const Basis &basisU, const Basis &basisV,
+                     Vector3 *position, Vector3 *normal) const;
+  uint32_t m_degreeU;
+  uint32_t m_degreeV;
+  uint32_t m_countU;
+  uint32_t m_countV;
+  std::vector<float> m_knotsU;
+  std::vector<float> m_knotsV;
+  // Homogeneous control points, u fastest.
+  std::vector<Vector4> m_points;
+};
+
+// A Bezier patch of degree countU - 1 by countV - 1.
+class BezierPatch : public NURBSPatch {
+public:
+  BezierPatch(uint32_t countU, uint32_t countV,
+              const std::vector<Vector3> &points);
+};
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "Scene_StaticBatching.h"
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <utility>
+
+StaticBatches BuildStaticBatches(const std::vector<Instance> &scene,
+                                 const std::vector<bool> *dynamic,
+                                 const StaticBatchSettings &settings) {
+  if (dynamic != nullptr && dynamic->size() != scene.size())
+    throw std::exception("Dynamic flags must have one entry per instance.");
+  std::map<const IMesh *, uint32_t> meshUses;
+  for (const Instance &instance : scene)
+    ++meshUses[instance.Mesh.get()];
+  ////////////////////////////////////////////////////////////////////////////////
+  // Group by material in order of first use, closing a group before it grows
+  // past the batch limits. Dynamic instances, shared meshes and large meshes
+  // stand alone.
+  std::vector<std::vector<uint32_t>> groups;
+  std::vector<uint32_t> groupVertices, groupIndices;
+  std::map<const IMaterial *, uint32_t> groupIndex;
+  for (uint32_t i = 0; i < scene.size(); ++i) {
+    const uint32_t vertexCount = scene[i].Mesh->getVertexCount();
+    const uint32_t indexCount = scene[i].Mesh->getIndexCount();
+    if ((dynamic != nullptr && (*dynamic)[i]) ||
+        meshUses[scene[i].Mesh.get()] > 1 ||
+        vertexCount > settings.MaxMeshVertices) {
+      groups.push_back({i});
+      groupVertices.push_back(vertexCount);
+      groupIndices.push_back(indexCount);
+      continue;
+    }
+    auto findIt = groupIndex.find(scene[i].Material.get());
+    if (findIt == groupIndex.end() ||
+        groupVertices[findIt->second] + vertexCount >
+            settings.MaxBatchVertices ||
+        groupIndices[findIt->second] + indexCount > settings.MaxBatchIndices) {
+      groupIndex[scene[i].Material.get()] = (uint32_t)groups.size();
+      groups.push_back({i});
+      groupVertices.push_back(vertexCount);
+      groupIndices.push_back(indexCount);
+    } else {
+      groups[findIt->second].push_back(i);
+      groupVertices[findIt->second] += vertexCount;
+      groupIndices[findIt->second] += indexCount;
+    }
+  }
+  StaticBatches result;
+  result.DrawCallsBefore = (uint32_t)scene.size();
+  for (const std::vector<uint32_t> &group : groups) {
+    const Instance &first = scene[group[0]];
+    StaticBatch batch;
+    batch.WorldBounds = EmptyAABB();
+    // A lone instance needs no copy of its geometry.
+    if (group.size() == 1) {
+      StaticBatchRange range = {};
+      range.SourceIndex = group[0];
+      range.IndexCount = first.Mesh->getIndexCount();
+      range.WorldBounds = GetMeshBounds(*first.Mesh);
+      if (first.Mesh->getVertexCount() > 0) {
+        range.WorldBounds =
+            TransformAABB(*first.TransformObjectToWorld, range.WorldBounds);
+      }
+      batch.WorldBounds = range.WorldBounds;
+      batch.Ranges.push_back(range);
+      result.Scene.push_back(first);
+      result.Batches.push_back(std::move(batch));
+      continue;
+    }
+    bool sharedTransform = true;
+    for (uint32_t source : group) {
+      if (scene[source].TransformObjectToWorld != first.TransformObjectToWorld)
+        sharedTransform = false;
+    }
+    std::shared_ptr<MergedMesh> merged(new MergedMesh());
+    for (uint32_t source : group) {
+      const Instance &instance = scene[source];
+      const Matrix44 &objectToWorld = *instance.TransformObjectToWorld;
+      const Matrix44 normalToWorld = Transpose(Invert(objectToWorld));
+      // Baking a mirroring transform turns the triangles inside out.
+      const bool flipWinding =
+          !sharedTransform && Determinant(objectToWorld) < 0;
+      const uint32_t vertexCount = instance.Mesh->getVertexCount();
+      const uint32_t indexCount = instance.Mesh->getIndexCount();
+      const uint32_t baseVertex = (uint32_t)merged->Positions.size();
+      const uint32_t baseIndex = (uint32_t)merged->Indices.size();
+      merged->Positions.resize(baseVertex + vertexCount);
+      merged->Normals.resize(baseVertex + vertexCount);
+      merged->Texcoords.resize(baseVertex + vertexCount);
+      merged->Indices.resize(baseIndex + indexCount);
+      if (vertexCount > 0) {
+        instance.Mesh->copyVertices(&merged->Positions[baseVertex],
+                                    sizeof(Vector3));
+        instance.Mesh->copyNormals(&merged->Normals[baseVertex],
+                                   sizeof(Vector3));
+        instance.Mesh->copyTexcoords(&merged->Texcoords[baseVertex],
+                                     sizeof(Vector2));
+      }
+      if (indexCount > 0) {
+        instance.Mesh->copyIndices(&merged->Indices[baseIndex],
+                                   sizeof(uint32_t));
+      }
+      StaticBatchRange range = {};
+      range.SourceIndex = source;
+      range.FirstIndex = baseIndex;
+      range.IndexCount = indexCount;
+      range.WorldBounds = EmptyAABB();
+      for (uint32_t v = baseVertex; v < baseVertex + vertexCount; ++v) {
+        Vector3 world = TransformPoint(objectToWorld, merged->Positions[v]);
+        range.WorldBounds = Union(range.WorldBounds, world);
+        if (!sharedTransform) {
+          merged->Positions[v] = world;
+          Vector3 normal = TransformVector(normalToWorld, merged->Normals[v]);
+          float length = Length(normal);
+          merged->Normals[v] = length > 0 ? normal * (1 / length) : normal;
+        }
+      }
+      for (uint32_t i = baseIndex; i < baseIndex + indexCount; ++i)
+        merged->Indices[i] += baseVertex;
+      if (flipWinding) {
+        for (uint32_t i = baseIndex; i + 2 < baseIndex + indexCount; i += 3)
+          std::swap(merged->Indices[i + 1], merged->Indices[i + 2]);
+      }
+      batch.WorldBounds = Union(batch.WorldBounds, range.WorldBounds);
+      batch.Ranges.push_back(range);
+    }
+    Instance instance = {};
+    instance.TransformObjectToWorld =
+        sharedTransform
+            ? first.TransformObjectToWorld
+            : std::shared_ptr<Matrix44>(new Matrix44(Identity<float>));
+    instance.Mesh = merged;
+    instance.Material = first.Material;
+    result.Scene.push_back(instance);
+    result.Batches.push_back(std::move(batch));
+  }
+  result.DrawCallsAfter = (uint32_t)result.Scene.size();
+  return result;
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_BVH.h"
+#include "Scene_InstanceTable.h"
+#include "Scene_MergedMesh.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Static Batching
+//
+// LoadOBJ produces one instance per material switch, so a scene like Sponza
+// is made of many small meshes that each cost a full draw. This pass merges
+// static instances with the same material into one large mesh per material
+// so the existing renderers draw each material once.
+//
+// When every instance of a batch shares one transform (LoadOBJ shares a
+// single identity) the geometry stays in object space under that transform;
+// otherwise it is baked into world space under an identity transform. Baked
+// normals go through the inverse transpose, and the triangles of mirroring
+// transforms are rewound so they stay front facing.
+//
+// Only small meshes used by a single instance are merged. A mesh shared by
+// several instances stays a single copy and is left to instanced drawing
+// (BuildInstanceBatches); copying it per instance would multiply its memory.
+// Batches are closed before they pass a vertex or index limit so their
+// buffers stay a reasonable size.
+//
+// Each batch remembers which index range came from which source instance and
+// that instance's world bounds, so a culling pass can still draw sub-ranges
+// (DrawIndexed with a start index) instead of the whole batch.
+////////////////////////////////////////////////////////////////////////////////
+
+// The part of a batch which came from one source instance.
+struct StaticBatchRange {
+  uint32_t SourceIndex;
+  uint32_t FirstIndex;
+  uint32_t IndexCount;
+  AABB WorldBounds;
+};
+
+struct StaticBatch {
+  std::vector<StaticBatchRange> Ranges;
+  AABB WorldBounds;
+};
+
+struct StaticBatches {
+  // One instance per batch, ready for any renderer.
+  std::vector<Instance> Scene;
+  // Ranges of each entry of Scene.
+  std::vector<StaticBatch> Batches;
+  // Draws needed for the source scene and for the batched one.
+  uint32_t DrawCallsBefore;
+  uint32_t DrawCallsAfter;
+};
+
+struct StaticBatchSettings {
+  // Meshes with more vertices than this are worth a draw of their own.
+  uint32_t MaxMeshVertices = 4096;
+  // Limits of a single batch; 1M vertices of VertexVS is 32 MB.
+  uint32_t MaxBatchVertices = 1 << 20;
+  uint32_t MaxBatchIndices = 3 << 20;
+};
+
+// Merge the instances of a scene by material. Instances flagged in dynamic
+// (if given), shared meshes and large meshes are never merged and come
+// through as batches of their own.
+StaticBatches BuildStaticBatches(const std::vector<Instance> &scene,
+                                 const std::vector<bool> *dynamic = nullptr,
+                                 const StaticBatchSettings &settings = {});
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "Scene_StressScene.h"
+#include "Core_Sampling.h"
+#include "Scene_BVH.h"
+#include "Scene_IMaterial.h"
+#include "Scene_IMesh.h"
+#include "Scene_MeshOBJ.h"
+#include "Scene_ParametricUVToMesh.h"
+#include "Scene_Plane.h"
+#include "Scene_Sphere.h"
+#include <algorithm>
+#include <exception>
+#include <math.h>
+#include <memory>
+
+// A shared mesh and material plus the transform that centers the mesh on the
+// origin with a bounding radius of one.
+struct StressProp {
+  std::shared_ptr<IMesh> Mesh;
+  std::shared_ptr<IMaterial> Material;
+  Matrix44 Normalize;
+};
+
+static std::vector<StressProp>
+CreateStressProps(const StressSceneSettings &settings) {
+  std::shared_ptr<IMaterial> checkerboard(new Checkerboard());
+  std::shared_ptr<IMaterial> plastic(new RedPlastic());
+  std::shared_ptr<IParametricUV> sphere(new Sphere());
+  std::shared_ptr<IParametricUV> plane(new Plane());
+  std::vector<StressProp> props;
+  for (uint32_t steps : {8, 16, 32}) {
+    std::shared_ptr<IMesh> mesh(new ParametricUVToMesh(sphere, steps, steps));
+    props.push_back({mesh, plastic, Identity<float>});
+    props.push_back({mesh, checkerboard, Identity<float>});
+  }
+  props.push_back({std::shared_ptr<IMesh>(new ParametricUVToMesh(plane, 1, 1)),
+                   checkerboard, Identity<float>});
+  if (!settings.OBJFilename.empty()) {
+    for (const Instance &instance : LoadOBJ(settings.OBJFilename.c_str())) {
+      if (instance.Mesh->getVertexCount() == 0)
+        continue;
+      AABB bounds = GetMeshBounds(*instance.Mesh);
+      Vector3 center = (bounds.Min + bounds.Max) * 0.5f;
+      float radius = Length(bounds.Max - bounds.Min) * 0.5f;
+      float scale = radius > 0 ? 1 / radius : 1;
+      props.push_back(
+          {instance.Mesh, instance.Material,
+           CreateMatrixTranslate(center * -1.0f) *
+               CreateMatrixScale(Vector3{scale, scale, scale})});
+    }
+  }
+  return props;
+}
+
+std::vector<Instance> Scene_Stress(const StressSceneSettings &settings) {
+  if (settings.Extent <= 0 || settings.MinimumSize <= 0 ||
+      settings.MaximumSize < settings.MinimumSize)
+    throw std::exception("Stress scene sizes must be positive and ordered.");
+  const std::vector<StressProp> props = CreateStressProps(settings);
+  uint32_t random = HashPCG(settings.Seed);
+  ////////////////////////////////////////////////////////////////////////////////
+  // Cluster centers, or the shape of the city grid.
+  std::vector<Vector2> clusters;
+  if (settings.Distribution == StressClustered) {
+    for (uint32_t i = 0; i < std::max(settings.ClusterCount, 1u); ++i) {
+      clusters.push_back(
+          {(RandomUnit(random) - 0.5f) * settings.Extent,
+           (RandomUnit(random) - 0.5f) * settings.Extent});
+    }
+  }
+  const uint32_t blockLots = std::max(settings.BlockLots, 1u);
+  const float blockSize =
+      blockLots * settings.LotSize + settings.StreetWidth;
+  // The town grows past Extent rather than put two instances on one lot.
+  const uint32_t blocksPerSide = std::max(
+      std::max((uint32_t)(settings.Extent / blockSize), 1u),
+      (uint32_t)ceilf(sqrtf((float)settings.InstanceCount) / blockLots));
+  const uint32_t lotsPerSide = blocksPerSide * blockLots;
+  ////////////////////////////////////////////////////////////////////////////////
+  // Place every instance.
+  std::vector<Instance> scene;
+  scene.reserve(settings.InstanceCount);
+  for (uint32_t i = 0; i < settings.InstanceCount; ++i) {
+    const StressProp &prop =
+        props[std::min((uint32_t)(RandomUnit(random) * props.size()),
+                       (uint32_t)props.size() - 1)];
+    float size = settings.MinimumSize +
+                 (settings.MaximumSize - settings.MinimumSize) *
+                     RandomUnit(random);
+    Vector3 scale = {size, size, size};
+    float angle = 2 * Pi<float> * RandomUnit(random);
+    Vector2 position = {0, 0};
+    switch (settings.Distribution) {
+    case StressUniform:
+      position = {(RandomUnit(random) - 0.5f) * settings.Extent,
+                  (RandomUnit(random) - 0.5f) * settings.Extent};
+      break;
+    case StressClustered: {
+      const Vector2 &center = clusters[std::min(
+          (uint32_t)(RandomUnit(random) * clusters.size()),
+          (uint32_t)clusters.size() - 1)];
+      // The sum of three uniforms is a cheap bell curve.
+      float dx = RandomUnit(random) + RandomUnit(random) + RandomUnit(random);
+      float dy = RandomUnit(random) + RandomUnit(random) + RandomUnit(random);
+      position = {center.X + (dx - 1.5f) * settings.ClusterRadius,
+                  center.Y + (dy - 1.5f) * settings.ClusterRadius};
+      break;
+    }
+    case StressCityGrid: {
+      // Lots fill row by row from one corner of the town.
+      uint32_t lot = i;
+      uint32_t lotX = lot % lotsPerSide, lotY = lot / lotsPerSide;
+      float x = (lotX / blockLots) * blockSize +
+                (lotX % blockLots + 0.5f) * settings.LotSize;
+      float y = (lotY / blockLots) * blockSize +
+                (lotY % blockLots + 0.5f) * settings.LotSize;
+      float half = blocksPerSide * blockSize * 0.5f;
+      position = {x - half, y - half};
+      // Most lots hold a tall building, the rest a small prop.
+      if (RandomUnit(random) < 0.7f) {
+        float width = settings.LotSize * 0.45f;
+        scale = {width, width * (1 + 6 * RandomUnit(random)), width};
+      }
+      break;
+    }
+    }
+    const float c = cosf(angle), s = sinf(angle);
+    const Matrix44 rotation = {c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1};
+    Matrix44 transform =
+        prop.Normalize * CreateMatrixScale(scale) * rotation *
+        CreateMatrixTranslate(Vector3{position.X, scale.Y, position.Y});
+    Instance instance = {};
+    instance.TransformObjectToWorld.reset(new Matrix44(transform));
+    instance.Mesh = prop.Mesh;
+    instance.Material = prop.Material;
+    scene.push_back(instance);
+  }
+  return scene;
+}
\ No newline at end of file
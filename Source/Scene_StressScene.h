@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Scene_InstanceTable.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Procedural Stress Scenes
+//
+// A seeded generator of large scenes (thousands to millions of instances) for
+// benchmarking the CPU scene code: culling, sorting, batching, BVH builds and
+// transform updates. The same settings always produce the same scene on any
+// platform since all randomness comes from HashPCG.
+//
+// Instances draw from a small pool of shared meshes and materials, like a real
+// scene full of repeated props: spheres at three tessellation levels, planes,
+// and optionally every sub-mesh of an OBJ file with its own material.
+////////////////////////////////////////////////////////////////////////////////
+
+enum StressDistribution {
+  // Scattered evenly over the whole area.
+  StressUniform,
+  // Gathered in round clusters around random centers.
+  StressClustered,
+  // Buildings on city blocks separated by empty streets, with tall and short
+  // props mixed; the dense occluder case.
+  StressCityGrid,
+};
+
+struct StressSceneSettings {
+  uint32_t InstanceCount = 10000;
+  uint32_t Seed = 1;
+  StressDistribution Distribution = StressUniform;
+  // Instances are placed over a square of this side centered on the origin.
+  float Extent = 1000;
+  // Props are scaled between these sizes (bounding radius in world units).
+  float MinimumSize = 0.5f;
+  float MaximumSize = 4;
+  // StressClustered: number of clusters and their radius.
+  uint32_t ClusterCount = 32;
+  float ClusterRadius = 40;
+  // StressCityGrid: lots along each side of a block and the width of a lot
+  // and of a street. The grid grows past Extent if it has too few lots.
+  uint32_t BlockLots = 4;
+  float LotSize = 10;
+  float StreetWidth = 12;
+  // If set, the sub-meshes of this OBJ (one per material) join the pool.
+  std::string OBJFilename;
+};
+
+std::vector<Instance> Scene_Stress(const StressSceneSettings &settings = {});
\ No newline at end of file
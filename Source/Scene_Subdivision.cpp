@@ -0,0 +1,509 @@
+#include "Scene_Subdivision.h"
+#include "Core_Parallel.h"
+#include "Scene_BVH.h"
+#include "Scene_MergedMesh.h"
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+// Stencil rows or triangles handled per parallel task.
+static const uint32_t ROW_BATCH_SIZE = 4096;
+
+// A missing face or vertex.
+static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+// Faces of any size; face f covers Indices[Offsets[f], Offsets[f + 1]).
+struct Polygons {
+  std::vector<uint32_t> Offsets;
+  std::vector<uint32_t> Indices;
+};
+
+// Edge and vertex adjacency of one level.
+struct Topology {
+  // Two vertices and up to two faces per edge.
+  std::vector<uint32_t> EdgeVertices;
+  std::vector<uint32_t> EdgeFaces;
+  // Edges with one face, or with more than two.
+  std::vector<uint8_t> EdgeCrease;
+  // The edge from each face corner to the next, parallel to Indices.
+  std::vector<uint32_t> CornerEdges;
+  // Edges and faces around each vertex.
+  std::vector<uint32_t> VertexEdgeOffsets;
+  std::vector<uint32_t> VertexEdges;
+  std::vector<uint32_t> VertexFaceOffsets;
+  std::vector<uint32_t> VertexFaces;
+};
+
+static void AddWeight(SubdivisionStencils &rows, uint32_t source,
+                      float weight) {
+  rows.Sources.push_back(source);
+  rows.Weights.push_back(weight);
+}
+
+static void EndRow(SubdivisionStencils &rows) {
+  rows.Offsets.push_back((uint32_t)rows.Sources.size());
+}
+
+// Compressed rows from a list of (row, value) pairs.
+static void
+BuildAdjacency(uint32_t rowCount,
+               const std::vector<std::pair<uint32_t, uint32_t>> &pairs,
+               std::vector<uint32_t> &offsets, std::vector<uint32_t> &values) {
+  offsets.assign(rowCount + 1, 0);
+  for (const auto &pair : pairs)
+    ++offsets[pair.first + 1];
+  for (uint32_t row = 0; row < rowCount; ++row)
+    offsets[row + 1] += offsets[row];
+  values.resize(pairs.size());
+  std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+  for (const auto &pair : pairs)
+    values[cursor[pair.first]++] = pair.second;
+}
+
+static Topology BuildTopology(const Polygons &polygons, uint32_t vertexCount) {
+  Topology topology;
+  std::unordered_map<uint64_t, uint32_t> edgeLookup;
+  std::vector<uint32_t> edgeFaceCount;
+  std::vector<std::pair<uint32_t, uint32_t>> vertexEdges, vertexFaces;
+  const uint32_t faceCount = (uint32_t)polygons.Offsets.size() - 1;
+  topology.CornerEdges.resize(polygons.Indices.size());
+  for (uint32_t face = 0; face < faceCount; ++face) {
+    const uint32_t begin = polygons.Offsets[face];
+    const uint32_t size = polygons.Offsets[face + 1] - begin;
+    for (uint32_t corner = 0; corner < size; ++corner) {
+      const uint32_t a = polygons.Indices[begin + corner];
+      const uint32_t b = polygons.Indices[begin + (corner + 1) % size];
+      const uint64_t key =
+          (uint64_t)std::min(a, b) << 32 | (uint64_t)std::max(a, b);
+      auto inserted =
+          edgeLookup.emplace(key, (uint32_t)edgeFaceCount.size());
+      const uint32_t edge = inserted.first->second;
+      if (inserted.second) {
+        topology.EdgeVertices.push_back(a);
+        topology.EdgeVertices.push_back(b);
+        topology.EdgeFaces.push_back(face);
+        topology.EdgeFaces.push_back(INVALID_INDEX);
+        edgeFaceCount.push_back(1);
+        vertexEdges.push_back({a, edge});
+        vertexEdges.push_back({b, edge});
+      } else if (edgeFaceCount[edge]++ == 1) {
+        topology.EdgeFaces[2 * edge + 1] = face;
+      }
+      topology.CornerEdges[begin + corner] = edge;
+      vertexFaces.push_back({a, face});
+    }
+  }
+  topology.EdgeCrease.resize(edgeFaceCount.size());
+  for (size_t edge = 0; edge < edgeFaceCount.size(); ++edge)
+    topology.EdgeCrease[edge] = edgeFaceCount[edge] != 2;
+  BuildAdjacency(vertexCount, vertexEdges, topology.VertexEdgeOffsets,
+                 topology.VertexEdges);
+  BuildAdjacency(vertexCount, vertexFaces, topology.VertexFaceOffsets,
+                 topology.VertexFaces);
+  return topology;
+}
+
+// Pair triangles back into the quads they were split from. Both triangles of
+// a pair must have the shared edge as their longest one (the diagonal of a
+// reasonably shaped quad) and wind it in opposite directions. Anything left
+// over stays a triangle, which Catmull-Clark handles as a three sided face.
+static Polygons PairTriangles(const Polygons &triangles,
+                              const std::vector<Vector3> &positions) {
+  auto edgeKey = [](uint32_t a, uint32_t b) {
+    return (uint64_t)std::min(a, b) << 32 | (uint64_t)std::max(a, b);
+  };
+  const uint32_t triangleCount = (uint32_t)triangles.Offsets.size() - 1;
+  std::vector<uint32_t> longest(triangleCount);
+  std::unordered_map<uint64_t, std::vector<uint32_t>> edgeTriangles;
+  for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+    const uint32_t *corners = &triangles.Indices[3 * triangle];
+    float longestLength = -1;
+    for (uint32_t corner = 0; corner < 3; ++corner) {
+      const uint32_t a = corners[corner], b = corners[(corner + 1) % 3];
+      const float length = Length(positions[b] - positions[a]);
+      if (length > longestLength) {
+        longestLength = length;
+        longest[triangle] = corner;
+      }
+      edgeTriangles[edgeKey(a, b)].push_back(triangle);
+    }
+  }
+  std::vector<uint32_t> partner(triangleCount, INVALID_INDEX);
+  for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+    if (partner[triangle] != INVALID_INDEX)
+      continue;
+    const uint32_t *corners = &triangles.Indices[3 * triangle];
+    const uint32_t a = corners[longest[triangle]];
+    const uint32_t b = corners[(longest[triangle] + 1) % 3];
+    const std::vector<uint32_t> &shared = edgeTriangles[edgeKey(a, b)];
+    if (shared.size() != 2)
+      continue;
+    const uint32_t other = shared[0] ^ shared[1] ^ triangle;
+    const uint32_t *otherCorners = &triangles.Indices[3 * other];
+    if (partner[other] != INVALID_INDEX ||
+        otherCorners[longest[other]] != b ||
+        otherCorners[(longest[other] + 1) % 3] != a)
+      continue;
+    partner[triangle] = other;
+    partner[other] = triangle;
+  }
+  // Quads are emitted where their first triangle was, winding a, d, b, c for
+  // the triangles (a, b, c) and (b, a, d).
+  Polygons polygons;
+  polygons.Offsets.push_back(0);
+  for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+    const uint32_t *corners = &triangles.Indices[3 * triangle];
+    if (partner[triangle] == INVALID_INDEX) {
+      polygons.Indices.insert(polygons.Indices.end(), corners, corners + 3);
+    } else if (partner[triangle] > triangle) {
+      const uint32_t other = partner[triangle];
+      const uint32_t a = corners[longest[triangle]];
+      const uint32_t b = corners[(longest[triangle] + 1) % 3];
+      const uint32_t c = corners[(longest[triangle] + 2) % 3];
+      const uint32_t d =
+          triangles.Indices[3 * other + (longest[other] + 2) % 3];
+      polygons.Indices.insert(polygons.Indices.end(), {a, d, b, c});
+    } else {
+      continue;
+    }
+    polygons.Offsets.push_back((uint32_t)polygons.Indices.size());
+  }
+  return polygons;
+}
+
+// One level of subdivision: the rules as rows over the previous level's
+// vertices (vertex points, then edge points, then face points), the refined
+// faces and linearly interpolated texcoords.
+static void SubdivideLevel(const Polygons &in,
+                           const std::vector<Vector2> &texcoords,
+                           SubdivisionScheme scheme, Polygons &out,
+                           SubdivisionStencils &rows,
+                           std::vector<Vector2> &outTexcoords) {
+  const uint32_t vertexCount = (uint32_t)texcoords.size();
+  const Topology topology = BuildTopology(in, vertexCount);
+  const uint32_t edgeCount = (uint32_t)topology.EdgeCrease.size();
+  const uint32_t faceCount = (uint32_t)in.Offsets.size() - 1;
+  const bool loop = scheme == SubdivisionLoop;
+  rows = SubdivisionStencils();
+  rows.Offsets.push_back(0);
+  outTexcoords = texcoords;
+  // Face centroid weights, used by Catmull-Clark.
+  auto addCentroid = [&](uint32_t face, float weight) {
+    const uint32_t begin = in.Offsets[face];
+    const uint32_t size = in.Offsets[face + 1] - begin;
+    for (uint32_t corner = 0; corner < size; ++corner)
+      AddWeight(rows, in.Indices[begin + corner], weight / size);
+  };
+  ////////////////////////////////////////////////////////////////////////////////
+  // Vertex points.
+  for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+    const uint32_t edgeBegin = topology.VertexEdgeOffsets[vertex];
+    const uint32_t n = topology.VertexEdgeOffsets[vertex + 1] - edgeBegin;
+    uint32_t creaseNeighbors[2], creaseCount = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+      const uint32_t edge = topology.VertexEdges[edgeBegin + i];
+      if (!topology.EdgeCrease[edge])
+        continue;
+      if (creaseCount < 2) {
+        creaseNeighbors[creaseCount] =
+            topology.EdgeVertices[2 * edge] ^
+            topology.EdgeVertices[2 * edge + 1] ^ vertex;
+      }
+      ++creaseCount;
+    }
+    if (creaseCount == 2) {
+      AddWeight(rows, vertex, 0.75f);
+      AddWeight(rows, creaseNeighbors[0], 0.125f);
+      AddWeight(rows, creaseNeighbors[1], 0.125f);
+    } else if (creaseCount != 0 || n < 3) {
+      // Corners and non-manifold vertices stay put.
+      AddWeight(rows, vertex, 1);
+    } else if (loop) {
+      const float beta = n == 3 ? 3.0f / 16 : 3.0f / (8 * n);
+      AddWeight(rows, vertex, 1 - n * beta);
+      for (uint32_t i = 0; i < n; ++i) {
+        const uint32_t edge = topology.VertexEdges[edgeBegin + i];
+        AddWeight(rows,
+                  topology.EdgeVertices[2 * edge] ^
+                      topology.EdgeVertices[2 * edge + 1] ^ vertex,
+                  beta);
+      }
+    } else {
+      // (F + 2R + (n - 3)V) / n with R the mean of the edge midpoints and F
+      // the mean of the face centroids.
+      AddWeight(rows, vertex, (float)(n - 2) / n);
+      for (uint32_t i = 0; i < n; ++i) {
+        const uint32_t edge = topology.VertexEdges[edgeBegin + i];
+        AddWeight(rows,
+                  topology.EdgeVertices[2 * edge] ^
+                      topology.EdgeVertices[2 * edge + 1] ^ vertex,
+                  1.0f / (n * n));
+      }
+      const uint32_t faceBegin = topology.VertexFaceOffsets[vertex];
+      const uint32_t faceEnd = topology.VertexFaceOffsets[vertex + 1];
+      for (uint32_t i = faceBegin; i < faceEnd; ++i)
+        addCentroid(topology.VertexFaces[i], 1.0f / (n * n));
+    }
+    EndRow(rows);
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Edge points.
+  for (uint32_t edge = 0; edge < edgeCount; ++edge) {
+    const uint32_t a = topology.EdgeVertices[2 * edge];
+    const uint32_t b = topology.EdgeVertices[2 * edge + 1];
+    outTexcoords.push_back((texcoords[a] + texcoords[b]) * 0.5f);
+    if (topology.EdgeCrease[edge]) {
+      AddWeight(rows, a, 0.5f);
+      AddWeight(rows, b, 0.5f);
+    } else if (loop) {
+      AddWeight(rows, a, 0.375f);
+      AddWeight(rows, b, 0.375f);
+      for (uint32_t side = 0; side < 2; ++side) {
+        const uint32_t face = topology.EdgeFaces[2 * edge + side];
+        const uint32_t *corners = &in.Indices[in.Offsets[face]];
+        AddWeight(rows, corners[0] ^ corners[1] ^ corners[2] ^ a ^ b,
+                  0.125f);
+      }
+    } else {
+      AddWeight(rows, a, 0.25f);
+      AddWeight(rows, b, 0.25f);
+      addCentroid(topology.EdgeFaces[2 * edge], 0.25f);
+      addCentroid(topology.EdgeFaces[2 * edge + 1], 0.25f);
+    }
+    EndRow(rows);
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Face points and refined faces, keeping the winding of the source face.
+  out = Polygons();
+  out.Offsets.push_back(0);
+  const uint32_t edgePoint = vertexCount;
+  const uint32_t facePoint = vertexCount + edgeCount;
+  for (uint32_t face = 0; face < faceCount; ++face) {
+    const uint32_t begin = in.Offsets[face];
+    const uint32_t size = in.Offsets[face + 1] - begin;
+    const uint32_t *corners = &in.Indices[begin];
+    const uint32_t *edges = &topology.CornerEdges[begin];
+    if (loop) {
+      const uint32_t triangles[4][3] = {
+          {corners[0], edgePoint + edges[0], edgePoint + edges[2]},
+          {edgePoint + edges[0], corners[1], edgePoint + edges[1]},
+          {edgePoint + edges[2], edgePoint + edges[1], corners[2]},
+          {edgePoint + edges[0], edgePoint + edges[1], edgePoint + edges[2]}};
+      for (const auto &triangle : triangles) {
+        out.Indices.insert(out.Indices.end(), triangle, triangle + 3);
+        out.Offsets.push_back((uint32_t)out.Indices.size());
+      }
+      continue;
+    }
+    addCentroid(face, 1);
+    EndRow(rows);
+    Vector2 centroid = {0, 0};
+    for (uint32_t corner = 0; corner < size; ++corner)
+      centroid = centroid + texcoords[corners[corner]] * (1.0f / size);
+    outTexcoords.push_back(centroid);
+    for (uint32_t corner = 0; corner < size; ++corner) {
+      const uint32_t quad[4] = {corners[corner], edgePoint + edges[corner],
+                                facePoint + face,
+                                edgePoint + edges[(corner + size - 1) % size]};
+      out.Indices.insert(out.Indices.end(), quad, quad + 4);
+      out.Offsets.push_back((uint32_t)out.Indices.size());
+    }
+  }
+}
+
+SubdivisionSurface::SubdivisionSurface(const IMesh &cage,
+                                       SubdivisionScheme scheme,
+                                       uint32_t levels) {
+  ////////////////////////////////////////////////////////////////////////////////
+  // Weld the cage by position and drop triangles that collapse.
+  const uint32_t cageVertexCount = cage.getVertexCount();
+  const uint32_t cageIndexCount = cage.getIndexCount();
+  if (cageVertexCount == 0 || cageIndexCount == 0)
+    throw std::exception("Cannot subdivide an empty mesh.");
+  std::vector<Vector3> cagePositions(cageVertexCount);
+  std::vector<Vector2> cageTexcoords(cageVertexCount);
+  std::vector<uint32_t> cageIndices(cageIndexCount);
+  cage.copyVertices(&cagePositions[0], sizeof(Vector3));
+  cage.copyTexcoords(&cageTexcoords[0], sizeof(Vector2));
+  cage.copyIndices(&cageIndices[0], sizeof(uint32_t));
+  // Vertices closer than a tiny fraction of the mesh size share a cell or a
+  // neighboring one; closing seams rarely match to the last bit.
+  AABB bounds = EmptyAABB();
+  for (const Vector3 &p : cagePositions)
+    bounds = Union(bounds, p);
+  const Vector3 size = bounds.Max - bounds.Min;
+  const float tolerance =
+      std::max(1e-5f * std::max(std::max(size.X, size.Y), size.Z), 1e-20f);
+  std::map<std::tuple<int32_t, int32_t, int32_t>, std::vector<uint32_t>>
+      weldCells;
+  std::vector<uint32_t> weld(cageVertexCount);
+  std::vector<Vector2> texcoords;
+  for (uint32_t vertex = 0; vertex < cageVertexCount; ++vertex) {
+    const Vector3 &p = cagePositions[vertex];
+    const Vector3 cell = (p - bounds.Min) * (1 / tolerance);
+    const int32_t x = (int32_t)cell.X, y = (int32_t)cell.Y, z = (int32_t)cell.Z;
+    uint32_t match = INVALID_INDEX;
+    for (int32_t i = 0; i < 27 && match == INVALID_INDEX; ++i) {
+      auto found = weldCells.find(
+          std::make_tuple(x + i % 3 - 1, y + i / 3 % 3 - 1, z + i / 9 - 1));
+      if (found == weldCells.end())
+        continue;
+      for (uint32_t welded : found->second) {
+        if (Length(cagePositions[m_weldSource[welded]] - p) <= tolerance) {
+          match = welded;
+          break;
+        }
+      }
+    }
+    if (match == INVALID_INDEX) {
+      match = (uint32_t)m_weldSource.size();
+      m_weldSource.push_back(vertex);
+      texcoords.push_back(cageTexcoords[vertex]);
+      weldCells[std::make_tuple(x, y, z)].push_back(match);
+    }
+    weld[vertex] = match;
+  }
+  Polygons polygons;
+  polygons.Offsets.push_back(0);
+  for (uint32_t i = 0; i + 2 < cageIndexCount; i += 3) {
+    const uint32_t a = weld[cageIndices[i + 0]];
+    const uint32_t b = weld[cageIndices[i + 1]];
+    const uint32_t c = weld[cageIndices[i + 2]];
+    if (a == b || b == c || c == a)
+      continue;
+    polygons.Indices.insert(polygons.Indices.end(), {a, b, c});
+    polygons.Offsets.push_back((uint32_t)polygons.Indices.size());
+  }
+  // IMesh only carries triangles; Catmull-Clark wants the quads back.
+  if (scheme == SubdivisionCatmullClark) {
+    std::vector<Vector3> weldedPositions;
+    for (uint32_t source : m_weldSource)
+      weldedPositions.push_back(cagePositions[source]);
+    polygons = PairTriangles(polygons, weldedPositions);
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Subdivide level by level, folding each level's rules into the stencils
+  // so far.
+  const uint32_t controlCount = (uint32_t)m_weldSource.size();
+  m_stencils.Offsets.push_back(0);
+  for (uint32_t vertex = 0; vertex < controlCount; ++vertex) {
+    AddWeight(m_stencils, vertex, 1);
+    EndRow(m_stencils);
+  }
+  std::vector<float> accumulator(controlCount, 0);
+  std::vector<uint32_t> touched;
+  for (uint32_t level = 0; level < levels; ++level) {
+    Polygons refined;
+    SubdivisionStencils rows;
+    std::vector<Vector2> refinedTexcoords;
+    SubdivideLevel(polygons, texcoords, scheme, refined, rows,
+                   refinedTexcoords);
+    SubdivisionStencils composite;
+    composite.Offsets.push_back(0);
+    for (uint32_t row = 0; row + 1 < rows.Offsets.size(); ++row) {
+      for (uint32_t i = rows.Offsets[row]; i < rows.Offsets[row + 1]; ++i) {
+        const uint32_t source = rows.Sources[i];
+        for (uint32_t j = m_stencils.Offsets[source];
+             j < m_stencils.Offsets[source + 1]; ++j) {
+          const uint32_t control = m_stencils.Sources[j];
+          if (accumulator[control] == 0)
+            touched.push_back(control);
+          accumulator[control] += rows.Weights[i] * m_stencils.Weights[j];
+        }
+      }
+      std::sort(touched.begin(), touched.end());
+      for (uint32_t control : touched) {
+        if (accumulator[control] != 0)
+          AddWeight(composite, control, accumulator[control]);
+        accumulator[control] = 0;
+      }
+      touched.clear();
+      EndRow(composite);
+    }
+    std::swap(m_stencils, composite);
+    std::swap(polygons, refined);
+    texcoords.swap(refinedTexcoords);
+  }
+  ////////////////////////////////////////////////////////////////////////////////
+  // Triangulate the refined faces and index the triangles around each
+  // vertex for the normals.
+  m_mesh.reset(new MergedMesh());
+  const uint32_t refinedCount = (uint32_t)texcoords.size();
+  for (uint32_t face = 0; face + 1 < polygons.Offsets.size(); ++face) {
+    const uint32_t *corners = &polygons.Indices[polygons.Offsets[face]];
+    const uint32_t size = polygons.Offsets[face + 1] - polygons.Offsets[face];
+    for (uint32_t corner = 2; corner < size; ++corner) {
+      m_mesh->Indices.insert(m_mesh->Indices.end(),
+                             {corners[0], corners[corner - 1],
+                              corners[corner]});
+    }
+  }
+  std::vector<std::pair<uint32_t, uint32_t>> vertexTriangles;
+  for (uint32_t i = 0; i < m_mesh->Indices.size(); ++i)
+    vertexTriangles.push_back({m_mesh->Indices[i], i / 3});
+  BuildAdjacency(refinedCount, vertexTriangles, m_vertexTriangleOffsets,
+                 m_vertexTriangles);
+  m_faceNormals.resize(m_mesh->Indices.size() / 3);
+  m_mesh->Texcoords = texcoords;
+  m_mesh->Positions.resize(refinedCount);
+  m_mesh->Normals.resize(refinedCount);
+  m_welded.resize(controlCount);
+  Refine(&cagePositions[0]);
+}
+
+std::shared_ptr<IMesh> SubdivisionSurface::GetMesh() const { return m_mesh; }
+
+const SubdivisionStencils &SubdivisionSurface::GetStencils() const {
+  return m_stencils;
+}
+
+void SubdivisionSurface::Refine(const Vector3 *cagePositions) {
+  for (size_t vertex = 0; vertex < m_welded.size(); ++vertex)
+    m_welded[vertex] = cagePositions[m_weldSource[vertex]];
+  ////////////////////////////////////////////////////////////////////////////////
+  // Positions: one sparse matrix-vector product.
+  std::vector<Vector3> &positions = m_mesh->Positions;
+  const uint32_t vertexCount = (uint32_t)positions.size();
+  const uint32_t vertexBatches =
+      (vertexCount + ROW_BATCH_SIZE - 1) / ROW_BATCH_SIZE;
+  ParallelFor(vertexBatches, [&](uint32_t batch) {
+    const uint32_t end = std::min((batch + 1) * ROW_BATCH_SIZE, vertexCount);
+    for (uint32_t row = batch * ROW_BATCH_SIZE; row < end; ++row) {
+      Vector3 sum = {0, 0, 0};
+      for (uint32_t i = m_stencils.Offsets[row];
+           i < m_stencils.Offsets[row + 1]; ++i) {
+        sum = sum + m_welded[m_stencils.Sources[i]] * m_stencils.Weights[i];
+      }
+      positions[row] = sum;
+    }
+  });
+  ////////////////////////////////////////////////////////////////////////////////
+  // Area weighted face normals, then the normalized sum around each vertex.
+  const std::vector<uint32_t> &indices = m_mesh->Indices;
+  const uint32_t triangleCount = (uint32_t)m_faceNormals.size();
+  const uint32_t triangleBatches =
+      (triangleCount + ROW_BATCH_SIZE - 1) / ROW_BATCH_SIZE;
+  ParallelFor(triangleBatches, [&](uint32_t batch) {
+    const uint32_t end = std::min((batch + 1) * ROW_BATCH_SIZE, triangleCount);
+    for (uint32_t t = batch * ROW_BATCH_SIZE; t < end; ++t) {
+      const Vector3 &a = positions[indices[3 * t + 0]];
+      const Vector3 &b = positions[indices[3 * t + 1]];
+      const Vector3 &c = positions[indices[3 * t + 2]];
+      m_faceNormals[t] = Cross(b - a, c - a);
+    }
+  });
+  ParallelFor(vertexBatches, [&](uint32_t batch) {
+    const uint32_t end = std::min((batch + 1) * ROW_BATCH_SIZE, vertexCount);
+    for (uint32_t v = batch * ROW_BATCH_SIZE; v < end; ++v) {
+      Vector3 sum = {0, 0, 0};
+      for (uint32_t i = m_vertexTriangleOffsets[v];
+           i < m_vertexTriangleOffsets[v + 1]; ++i) {
+        sum = sum + m_faceNormals[m_vertexTriangles[i]];
+      }
+      const float length = Length(sum);
+      m_mesh->Normals[v] = length > 0 ? sum * (1 / length) : Vector3{0, 1, 0};
+    }
+  });
+}
\ No newline at end of file
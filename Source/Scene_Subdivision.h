@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_IMesh.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class MergedMesh;
+
+////////////////////////////////////////////////////////////////////////////////
+// Subdivision Surfaces
+//
+// Loop (triangles) and Catmull-Clark (quads) subdivision of an indexed IMesh.
+// Cage vertices at (nearly) the same position are welded first so seams in the
+// vertex data don't open up. IMesh only carries triangles, so for
+// Catmull-Clark the triangles of a triangulated quad cage are paired back
+// into quads across the diagonal (the longest edge of both); unpaired
+// triangles are refined as three sided faces. The edge and face adjacency of
+// every level is built once, and the rules of all levels are multiplied out
+// into one stencil table: each refined vertex is a fixed weighted sum of cage
+// vertices.
+//
+// Refining an animated cage is then one sparse matrix-vector product, done
+// in parallel row batches, followed by the vertex normals. Topology never
+// changes, so the index and texcoord streams are computed once. Texcoords
+// are interpolated linearly per level and take the coordinates of the first
+// cage vertex welded at each position, so UV seams aren't preserved.
+//
+// Boundary edges (one face) and non-manifold edges (three or more) are kept
+// as creases using the usual boundary curve rules.
+////////////////////////////////////////////////////////////////////////////////
+
+enum SubdivisionScheme {
+  SubdivisionLoop,
+  // Produces quads, which are drawn as two triangles each.
+  SubdivisionCatmullClark,
+};
+
+// Every refined vertex as a weighted sum of welded cage vertices, stored as
+// compressed rows: row i covers [Offsets[i], Offsets[i + 1]) of Sources and
+// Weights.
+struct SubdivisionStencils {
+  std::vector<uint32_t> Offsets;
+  std::vector<uint32_t> Sources;
+  std::vector<float> Weights;
+};
+
+class SubdivisionSurface : public Object {
+public:
+  SubdivisionSurface(const IMesh &cage, SubdivisionScheme scheme,
+                     uint32_t levels);
+  // The refined mesh. Refine updates it in place, so a renderer which caches
+  // uploads by mesh pointer must be told to upload it again.
+  std::shared_ptr<IMesh> GetMesh() const;
+  const SubdivisionStencils &GetStencils() const;
+  // Move the refined surface to new cage positions, one per cage vertex in
+  // the order of copyVertices.
+  void Refine(const Vector3 *cagePositions);
+
+private:
+  SubdivisionStencils m_stencils;
+  // The cage vertex which provides each welded vertex.
+  std::vector<uint32_t> m_weldSource;
+  std::vector<Vector3> m_welded;
+  // Triangles around each refined vertex for the normals.
+  std::vector<uint32_t> m_vertexTriangleOffsets;
+  std::vector<uint32_t> m_vertexTriangles;
+  std::vector<Vector3> m_faceNormals;
+  std::shared_ptr<MergedMesh> m_mesh;
+};
\ No newline at end of file
@@ -0,0 +1,245 @@
+#include "Scene_Tangents.h"
+#include "Core_Parallel.h"
+#include "Core_Sampling.h"
+#include "Scene_MeshRemap.h"
+#include <algorithm>
+#include <math.h>
+
+// Triangles handed to each parallel task.
+static const uint32_t TRIANGLE_BATCH_SIZE = 1024;
+
+// Orientation of a corner; degenerate corners have none and join whichever
+// group their vertex ends up with.
+enum CornerOrientation : uint8_t {
+  CornerNone,
+  CornerPositive,
+  CornerNegative,
+};
+
+// The streams tangent generation needs from a mesh.
+struct TangentInput {
+  std::vector<Vector3> Positions;
+  std::vector<Vector3> Normals;
+  std::vector<Vector2> Texcoords;
+  std::vector<uint32_t> Indices;
+};
+
+// Angle weighted tangent sums of one vertex per orientation; [0] positive
+// and [1] negative.
+struct TangentGroups {
+  Vector3 Tangent[2];
+  float Weight[2];
+  uint32_t Corners[2];
+};
+
+static TangentInput ReadTangentInput(const IMesh &mesh) {
+  TangentInput input;
+  const uint32_t vertexCount = mesh.getVertexCount();
+  const uint32_t indexCount = mesh.getIndexCount() / 3 * 3;
+  input.Positions.resize(vertexCount);
+  input.Normals.resize(vertexCount);
+  input.Texcoords.resize(vertexCount);
+  input.Indices.resize(mesh.getIndexCount());
+  if (vertexCount > 0) {
+    mesh.copyVertices(&input.Positions[0], sizeof(Vector3));
+    mesh.copyNormals(&input.Normals[0], sizeof(Vector3));
+    mesh.copyTexcoords(&input.Texcoords[0], sizeof(Vector2));
+  }
+  if (!input.Indices.empty())
+    mesh.copyIndices(&input.Indices[0], sizeof(uint32_t));
+  input.Indices.resize(indexCount);
+  return input;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Compute every corner's contribution in parallel over triangles, then sum
+// them per vertex and orientation.
+static std::vector<TangentGroups>
+AccumulateTangents(const TangentInput &input,
+                   std::vector<CornerOrientation> &orientations) {
+  const uint32_t triangleCount = (uint32_t)input.Indices.size() / 3;
+  std::vector<Vector3> contributions(input.Indices.size());
+  std::vector<float> weights(input.Indices.size());
+  orientations.resize(input.Indices.size());
+  const uint32_t batches =
+      (triangleCount + TRIANGLE_BATCH_SIZE - 1) / TRIANGLE_BATCH_SIZE;
+  ParallelFor(batches, [&](uint32_t batch) {
+    const uint32_t end =
+        std::min((batch + 1) * TRIANGLE_BATCH_SIZE, triangleCount);
+    for (uint32_t triangle = batch * TRIANGLE_BATCH_SIZE; triangle < end;
+         ++triangle) {
+      const uint32_t *corner = &input.Indices[3 * triangle];
+      const Vector3 &p0 = input.Positions[corner[0]];
+      const Vector2 &t0 = input.Texcoords[corner[0]];
+      const Vector3 d1 = input.Positions[corner[1]] - p0;
+      const Vector3 d2 = input.Positions[corner[2]] - p0;
+      const Vector2 s1 = input.Texcoords[corner[1]] - t0;
+      const Vector2 s2 = input.Texcoords[corner[2]] - t0;
+      // Only the sign of the texcoord area matters once normalized.
+      const float area = s1.X * s2.Y - s2.X * s1.Y;
+      const float flip = area < 0 ? -1.0f : 1.0f;
+      const Vector3 faceTangent = (d1 * s2.Y - d2 * s1.Y) * flip;
+      const Vector3 faceBitangent = (d2 * s1.X - d1 * s2.X) * flip;
+      const Vector3 faceNormal = Cross(d1, d2);
+      // Slivers (like rows collapsing into a pole) have no usable frame.
+      const bool sliver =
+          !(Length(faceNormal) > 1e-6f * Length(d1) * Length(d2));
+      for (uint32_t i = 0; i < 3; ++i) {
+        const uint32_t slot = 3 * triangle + i;
+        contributions[slot] = {0, 0, 0};
+        weights[slot] = 0;
+        orientations[slot] = CornerNone;
+        if (area == 0 || sliver)
+          continue;
+        Vector3 normal = input.Normals[corner[i]];
+        if (!(Length(normal) > 0))
+          normal = faceNormal;
+        normal = Normalize(normal);
+        auto project = [&](const Vector3 &v) {
+          return v - normal * Dot(normal, v);
+        };
+        const Vector3 tangent = project(faceTangent);
+        if (!(Length(tangent) > 0))
+          continue;
+        orientations[slot] =
+            Dot(Cross(normal, tangent), faceBitangent) < 0 ? CornerNegative
+                                                            : CornerPositive;
+        // Weight by the corner angle measured in the tangent plane.
+        const Vector3 &p = input.Positions[corner[i]];
+        const Vector3 e1 = project(input.Positions[corner[(i + 1) % 3]] - p);
+        const Vector3 e2 = project(input.Positions[corner[(i + 2) % 3]] - p);
+        if (!(Length(e1) > 0) || !(Length(e2) > 0))
+          continue;
+        const float cosine =
+            std::min(std::max(Dot(Normalize(e1), Normalize(e2)), -1.0f), 1.0f);
+        weights[slot] = acosf(cosine);
+        contributions[slot] = Normalize(tangent) * weights[slot];
+      }
+    }
+  });
+  std::vector<TangentGroups> groups(input.Positions.size());
+  for (TangentGroups &group : groups) {
+    group.Tangent[0] = group.Tangent[1] = {0, 0, 0};
+    group.Weight[0] = group.Weight[1] = 0;
+    group.Corners[0] = group.Corners[1] = 0;
+  }
+  for (size_t slot = 0; slot < input.Indices.size(); ++slot) {
+    if (orientations[slot] == CornerNone)
+      continue;
+    const int side = orientations[slot] == CornerNegative;
+    TangentGroups &group = groups[input.Indices[slot]];
+    group.Tangent[side] = group.Tangent[side] + contributions[slot];
+    group.Weight[side] += weights[slot];
+    ++group.Corners[side];
+  }
+  return groups;
+}
+
+// The final tangent of one orientation group; any tangent perpendicular to
+// the normal if the group is empty or degenerate.
+static Vector4 ResolveTangent(const TangentGroups &group, int side,
+                              const Vector3 &normal) {
+  const float sign = side == 0 ? 1.0f : -1.0f;
+  const float length = Length(group.Tangent[side]);
+  if (length > 0) {
+    const Vector3 t = group.Tangent[side] * (1 / length);
+    return {t.X, t.Y, t.Z, sign};
+  }
+  Vector3 tangent = {1, 0, 0}, bitangent;
+  if (Length(normal) > 0)
+    CreateBasis(Normalize(normal), tangent, bitangent);
+  return {tangent.X, tangent.Y, tangent.Z, sign};
+}
+
+std::vector<Vector4> GenerateTangents(const IMesh &mesh) {
+  const TangentInput input = ReadTangentInput(mesh);
+  std::vector<CornerOrientation> orientations;
+  const std::vector<TangentGroups> groups =
+      AccumulateTangents(input, orientations);
+  std::vector<Vector4> tangents(groups.size());
+  for (size_t vertex = 0; vertex < groups.size(); ++vertex) {
+    const TangentGroups &group = groups[vertex];
+    const int side = group.Weight[1] > group.Weight[0];
+    tangents[vertex] = ResolveTangent(group, side, input.Normals[vertex]);
+  }
+  return tangents;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MeshWithTangents.
+
+MeshWithTangents::MeshWithTangents(std::shared_ptr<IMesh> mesh)
+    : m_mesh(mesh) {
+  const TangentInput input = ReadTangentInput(*mesh);
+  std::vector<CornerOrientation> orientations;
+  const std::vector<TangentGroups> groups =
+      AccumulateTangents(input, orientations);
+  // Every vertex keeps its index for its positive corners (or its only
+  // orientation); vertices with corners of both get a copy for the negative
+  // ones.
+  const uint32_t vertexCount = (uint32_t)groups.size();
+  std::vector<uint32_t> mirrored(vertexCount, 0);
+  for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+    const TangentGroups &group = groups[vertex];
+    const int side = group.Corners[0] == 0 && group.Corners[1] > 0;
+    m_remap.push_back(vertex);
+    m_tangents.push_back(ResolveTangent(group, side, input.Normals[vertex]));
+  }
+  for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+    const TangentGroups &group = groups[vertex];
+    if (group.Corners[0] == 0 || group.Corners[1] == 0)
+      continue;
+    mirrored[vertex] = (uint32_t)m_remap.size();
+    m_remap.push_back(vertex);
+    m_tangents.push_back(ResolveTangent(group, 1, input.Normals[vertex]));
+  }
+  m_indices = input.Indices;
+  for (size_t slot = 0; slot < m_indices.size(); ++slot) {
+    const uint32_t vertex = m_indices[slot];
+    if (orientations[slot] == CornerNegative && mirrored[vertex] != 0)
+      m_indices[slot] = mirrored[vertex];
+  }
+}
+
+uint32_t MeshWithTangents::getVertexCount() const {
+  return (uint32_t)m_remap.size();
+}
+
+uint32_t MeshWithTangents::getIndexCount() const {
+  return (uint32_t)m_indices.size();
+}
+
+void MeshWithTangents::copyVertices(void *to, uint32_t stride) const {
+  CopyRemapped<Vector3>(m_remap, m_mesh->getVertexCount(), to, stride,
+                        [&](void *to, uint32_t stride) {
+                          m_mesh->copyVertices(to, stride);
+                        });
+}
+
+void MeshWithTangents::copyNormals(void *to, uint32_t stride) const {
+  CopyRemapped<Vector3>(m_remap, m_mesh->getVertexCount(), to, stride,
+                        [&](void *to, uint32_t stride) {
+                          m_mesh->copyNormals(to, stride);
+                        });
+}
+
+void MeshWithTangents::copyTexcoords(void *to, uint32_t stride) const {
+  CopyRemapped<Vector2>(m_remap, m_mesh->getVertexCount(), to, stride,
+                        [&](void *to, uint32_t stride) {
+                          m_mesh->copyTexcoords(to, stride);
+                        });
+}
+
+void MeshWithTangents::copyIndices(void *to, uint32_t stride) const {
+  for (size_t i = 0; i < m_indices.size(); ++i) {
+    *reinterpret_cast<uint32_t *>(to) = m_indices[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
+
+void MeshWithTangents::copyTangents(void *to, uint32_t stride) const {
+  for (size_t i = 0; i < m_tangents.size(); ++i) {
+    *reinterpret_cast<Vector4 *>(to) = m_tangents[i];
+    to = reinterpret_cast<uint8_t *>(to) + stride;
+  }
+}
\ No newline at end of file
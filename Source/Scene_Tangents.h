@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Core_Math.h"
+#include "Core_Object.h"
+#include "Scene_IMesh.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Tangent Frames
+//
+// Per-vertex tangents for normal and parallax mapping following the
+// MikkTSpace rules, so normal maps baked by the usual tools decode without
+// seams. Each triangle gets a tangent and bitangent from its position and
+// texcoord derivatives; every corner projects the tangent into the plane of
+// its vertex normal and weights it by the corner angle. Corners are grouped
+// by vertex and by orientation (mirrored texcoords flip it) and each group
+// is averaged.
+//
+// Tangents are stored as Vector4: xyz is the unit tangent and w is +1 or -1
+// with the bitangent B = w * cross(N, T). Shaders should build the frame
+// from the interpolated, unnormalized N, T and B as MikkTSpace expects.
+////////////////////////////////////////////////////////////////////////////////
+
+// Tangents of any mesh, computed in parallel over triangles. A vertex shared
+// by triangles of both orientations gets the one with more weight; use
+// MeshWithTangents to split those vertices instead.
+std::vector<Vector4> GenerateTangents(const IMesh &mesh);
+
+// A mesh with a precomputed tangent stream. Vertices on mirrored texcoord
+// seams are duplicated so each side keeps its own frame; the other streams
+// are copied from the original mesh through the remap.
+class MeshWithTangents : public Object, public IMesh {
+public:
+  MeshWithTangents(std::shared_ptr<IMesh> mesh);
+  uint32_t getVertexCount() const override;
+  uint32_t getIndexCount() const override;
+  void copyVertices(void *to, uint32_t stride) const override;
+  void copyNormals(void *to, uint32_t stride) const override;
+  void copyTexcoords(void *to, uint32_t stride) const override;
+  void copyIndices(void *to, uint32_t stride) const override;
+  // Tangent (xyz) and bitangent sign (w) per vertex as Vector4.
+  void copyTangents(void *to, uint32_t stride) const;
+
+private:
+  std::shared_ptr<IMesh> m_mesh;
+  // Original vertex of every output vertex.
+  std::vector<uint32_t> m_remap;
+  std::vector<uint32_t> m_indices;
+  std::vector<Vector4> m_tangents;
+};
\ No newline at end of file
@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////
+// Test - Automatic Instancing
+////////////////////////////////////////////////////////////////////////////////
+// Checks that BuildInstanceBatches orders packets by first use, gives every
+// packet a contiguous range in scene order, leaves out invisible instances,
+// and that UpdateInstanceTransforms follows moved instances.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "Scene_IMaterial.h"
+#include "Scene_IMesh.h"
+#include "Scene_InstanceBatching.h"
+#include <stdio.h>
+#include <string.h>
+
+// Batching only looks at mesh identity.
+class EmptyMesh : public IMesh {
+public:
+  uint32_t getVertexCount() const override { return 0; }
+  uint32_t getIndexCount() const override { return 0; }
+  void copyVertices(void *to, uint32_t stride) const override {}
+  void copyNormals(void *to, uint32_t stride) const override {}
+  void copyTexcoords(void *to, uint32_t stride) const override {}
+  void copyIndices(void *to, uint32_t stride) const override {}
+};
+
+static uint32_t g_failures = 0;
+
+static void Check(bool condition, const char *what) {
+  if (condition)
+    return;
+  printf("FAILED: %s\n", what);
+  ++g_failures;
+}
+
+static Instance MakeInstance(std::shared_ptr<IMesh> mesh,
+                             std::shared_ptr<IMaterial> material, float x) {
+  Instance instance = {};
+  instance.TransformObjectToWorld.reset(
+      new Matrix44(CreateMatrixTranslate(Vector3{x, 0, 0})));
+  instance.Mesh = mesh;
+  instance.Material = material;
+  return instance;
+}
+
+// The packet's instances are exactly the given scene indices, in order.
+static bool PacketHolds(const InstanceBatches &batches, uint32_t packet,
+                        const std::vector<uint32_t> &expected) {
+  const InstanceDrawPacket &p = batches.Packets[packet];
+  if (p.InstanceCount != expected.size())
+    return false;
+  for (uint32_t i = 0; i < p.InstanceCount; ++i) {
+    if (batches.SourceIndex[p.FirstInstance + i] != expected[i])
+      return false;
+  }
+  return true;
+}
+
+// Every packed transform is the transform of its source instance.
+static bool TransformsMatch(const InstanceBatches &batches,
+                            const std::vector<Instance> &scene) {
+  for (size_t slot = 0; slot < batches.Transforms.size(); ++slot) {
+    const Matrix44 &source =
+        *scene[batches.SourceIndex[slot]].TransformObjectToWorld;
+    if (memcmp(&batches.Transforms[slot], &source, sizeof(Matrix44)) != 0)
+      return false;
+  }
+  return true;
+}
+
+int main() {
+  std::shared_ptr<IMesh> sphere(new EmptyMesh());
+  std::shared_ptr<IMesh> plane(new EmptyMesh());
+  std::shared_ptr<IMaterial> red(new RedPlastic());
+  std::shared_ptr<IMaterial> checker(new Checkerboard());
+  // Packets by first use: (plane, checker), (sphere, red), (sphere, checker).
+  std::vector<Instance> scene = {
+      MakeInstance(plane, checker, 0), MakeInstance(sphere, red, 1),
+      MakeInstance(sphere, red, 2),    MakeInstance(sphere, checker, 3),
+      MakeInstance(plane, checker, 4), MakeInstance(sphere, red, 5)};
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Grouping and packet ranges.
+  InstanceBatches batches = BuildInstanceBatches(scene);
+  Check(batches.Packets.size() == 3, "three packets");
+  Check(batches.Transforms.size() == scene.size() &&
+            batches.SourceIndex.size() == scene.size(),
+        "every instance packed once");
+  if (batches.Packets.size() == 3) {
+    Check(batches.Packets[0].Mesh == plane &&
+              batches.Packets[0].Material == checker,
+          "first packet is the first instance's");
+    Check(batches.Packets[1].Mesh == sphere &&
+              batches.Packets[1].Material == red,
+          "second packet is the second used");
+    Check(batches.Packets[2].Mesh == sphere &&
+              batches.Packets[2].Material == checker,
+          "same mesh with another material is its own packet");
+    uint32_t next = 0;
+    for (const InstanceDrawPacket &packet : batches.Packets) {
+      Check(packet.FirstInstance == next, "packets are back to back");
+      next = packet.FirstInstance + packet.InstanceCount;
+    }
+    Check(PacketHolds(batches, 0, {0, 4}), "packet 0 in scene order");
+    Check(PacketHolds(batches, 1, {1, 2, 5}), "packet 1 in scene order");
+    Check(PacketHolds(batches, 2, {3}), "packet 2 in scene order");
+  }
+  Check(TransformsMatch(batches, scene), "packed transforms");
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Visibility filtering; hiding the first instance changes first use.
+  std::vector<bool> visible = {false, true, false, true, true, true};
+  InstanceBatches culled = BuildInstanceBatches(scene, &visible);
+  Check(culled.Transforms.size() == 4, "hidden instances are left out");
+  if (culled.Packets.size() == 3) {
+    Check(culled.Packets[0].Mesh == sphere &&
+              culled.Packets[0].Material == red,
+          "first use counts visible instances only");
+    Check(PacketHolds(culled, 0, {1, 5}), "culled packet 0");
+    Check(PacketHolds(culled, 1, {3}), "culled packet 1");
+    Check(PacketHolds(culled, 2, {4}), "culled packet 2");
+  } else {
+    Check(false, "three visible packets");
+  }
+  Check(TransformsMatch(culled, scene), "culled transforms");
+  std::vector<bool> none(scene.size(), false);
+  InstanceBatches empty = BuildInstanceBatches(scene, &none);
+  Check(empty.Packets.empty() && empty.Transforms.empty(),
+        "nothing visible, nothing drawn");
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Moved transforms are picked up without grouping again.
+  *scene[2].TransformObjectToWorld = CreateMatrixTranslate(Vector3{0, 7, 0});
+  *scene[4].TransformObjectToWorld = CreateMatrixScale(Vector3{2, 2, 2});
+  Check(!TransformsMatch(batches, scene), "stale before update");
+  UpdateInstanceTransforms(batches, scene);
+  Check(TransformsMatch(batches, scene), "current after update");
+  UpdateInstanceTransforms(culled, scene);
+  Check(TransformsMatch(culled, scene), "culled current after update");
+
+  if (g_failures == 0)
+    printf("All instance batching checks passed.\n");
+  return g_failures == 0 ? 0 : 1;
+}
\ No newline at end of file